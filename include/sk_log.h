@@ -1,10 +1,15 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
+#include <ck_pr.h>
+
 #include <sk_cc.h>
 #include <sk_error.h>
+#include <sk_flag.h>
+#include <sk_mem.h>
 
 /* The level determines the importance of the message, see syslog(3). */
 enum sk_log_level {
@@ -42,6 +47,16 @@ sk_log_level_str(enum sk_log_level level);
 /* Default log level of newly created logger */
 #define SK_LOG_DEFAULT_LEVEL SK_LOG_NOTICE
 
+/*
+ * Maximum level compiled in the convenience macros, e.g. `sk_log_debug`.
+ *
+ * Calls of a higher level are folded away at build time and their arguments
+ * are never evaluated. Override with `-DSK_LOG_COMPILE_LEVEL=SK_LOG_INFO`.
+ */
+#ifndef SK_LOG_COMPILE_LEVEL
+#define SK_LOG_COMPILE_LEVEL SK_LOG_DEBUG
+#endif
+
 /*
  * A logger is a FIFO where messages are enqueued with various information such
  * as the log level, the time the message occurred, etc.
@@ -60,9 +75,130 @@ struct sk_logger_drv;
 typedef struct sk_logger_drv sk_logger_drv_t;
 
 enum {
-	/* Maximum size of a logger's ring buffer */
-	SK_LOGGER_RING_MAX = 16,
+	/* Maximum size of a logger's ring buffer of SK_LOGGER_RING_FIXED */
+	SK_LOGGER_RING_MAX = 24,
+};
+
+/* Logger flags */
+enum {
+	/* The logger accepts messages, unset when destroyed */
+	SK_LOGGER_ENABLED = 1 << 0,
+	/*
+	 * Messages are formatted by `sk_logger_drain` instead of `sk_log`. The
+	 * arguments are packed in the message and strings are copied, but the
+	 * format string itself is referenced and must outlive the message, e.g. a
+	 * string literal.
+	 */
+	SK_LOGGER_DEFERRED = 1 << 1,
+};
+
+/* Storage of a logger's messages */
+enum sk_logger_ring {
+	/* Ring of `sk_log_msg_t` slots; 2^log_size messages */
+	SK_LOGGER_RING_FIXED = 0,
+	/*
+	 * Ring of variable length records, see `sk_ring_t`; 2^log_size bytes. A
+	 * message only takes its header and the length of its payload.
+	 */
+	SK_LOGGER_RING_VARIABLE,
+	/*
+	 * A variable length ring per producer thread, allocated on the first
+	 * message of the thread; 2^log_size bytes each. Producers never contend,
+	 * but messages of different threads are not ordered. The ring of an
+	 * exited thread is freed once drained.
+	 */
+	SK_LOGGER_RING_PER_THREAD,
+	/*
+	 * Flight recorder of 2^log_size messages in a file backed mapping at
+	 * `path`, see `sk_log_flight.h`. Messages overwrite the oldest ones and
+	 * are never drained; they survive the process and are read from the
+	 * file. SK_LOGGER_DEFERRED is ignored.
+	 */
+	SK_LOGGER_RING_FLIGHT,
+};
+
+/*
+ * Behavior of `sk_log` when the ring is full. Every dropped message is counted
+ * per level, see `sk_logger_dropped`, and the drain reports them to the driver
+ * with a synthetic SK_LOG_WARNING message at the end of a pass, at most every
+ * `drop_report_ms`.
+ */
+enum sk_logger_full_policy {
+	/* Drop the new message; favors latency */
+	SK_LOGGER_FULL_DROP_NEWEST = 0,
+	/* Drop the oldest message of the ring to make room for the new one */
+	SK_LOGGER_FULL_DROP_OLDEST,
+	/*
+	 * Yield the cpu until the drain makes room, for at most
+	 * `block_timeout_us`, then drop the new message; favors completeness.
+	 */
+	SK_LOGGER_FULL_BLOCK,
+	/*
+	 * Enqueue in an overflow ring of 2^spill_log_size bytes, drop the new
+	 * message if it is also full. Following messages go to the overflow ring
+	 * until it is drained, such that order is preserved.
+	 */
+	SK_LOGGER_FULL_SPILL,
+};
+
+/* Source of the timestamps of messages, all in nanoseconds */
+enum sk_log_clock {
+	/* clock_gettime(2) CLOCK_REALTIME */
+	SK_LOG_CLOCK_REALTIME = 0,
+	/* CLOCK_REALTIME_COARSE, cheaper but of the resolution of a tick */
+	SK_LOG_CLOCK_REALTIME_COARSE,
+	/* CLOCK_MONOTONIC, time since boot */
+	SK_LOG_CLOCK_MONOTONIC,
+	/*
+	 * The cpu cycle counter, a few cycles per message. Readings are converted
+	 * to realtime nanoseconds by the drain, with a calibration made when the
+	 * first such logger is created. Falls back to SK_LOG_CLOCK_REALTIME if
+	 * the counter isn't invariant, or on other architectures than x86.
+	 */
+	SK_LOG_CLOCK_TSC,
+};
+
+enum {
+	/* Defaults of `struct sk_logger_opts` */
+	SK_LOGGER_BLOCK_TIMEOUT_US = 1000,
+	SK_LOGGER_SPILL_LOG_SIZE = 16,
+	SK_LOGGER_DROP_REPORT_MS = 1000,
+};
+
+/* Options of a logger, zero initialized fields are defaults */
+struct sk_logger_opts {
+	/* Capacity of the ring, see `enum sk_logger_ring` */
+	uint8_t log_size;
+	/* Storage of messages */
+	enum sk_logger_ring ring;
+	/* Backing file of SK_LOGGER_RING_FLIGHT */
+	const char *path;
+	/*
+	 * Allocation of rings, e.g. huge pages, prefaulted, locked or bound to a
+	 * NUMA node, see `sk_mem.h`. Ignored by SK_LOGGER_RING_FLIGHT.
+	 */
+	sk_mem_opts_t mem;
+	/* Source of timestamps */
+	enum sk_log_clock clock;
+
+	/* Behavior when the ring is full */
+	enum sk_logger_full_policy full_policy;
+	/* See SK_LOGGER_FULL_BLOCK */
+	uint32_t block_timeout_us;
+	/* See SK_LOGGER_FULL_SPILL */
+	uint8_t spill_log_size;
+	/* Minimum interval between two reports of dropped messages */
+	uint32_t drop_report_ms;
+
+	/*
+	 * Collapse consecutive identical messages, same callsite, level and
+	 * payload, logged within this window of the first one. The driver gets
+	 * the first one suffixed with ` (repeated N times)`. Runs are collapsed
+	 * within a drain run. 0 disables.
+	 */
+	uint32_t coalesce_ms;
 };
+typedef struct sk_logger_opts sk_logger_opts_t;
 
 /*
  * Initialize a logger.
@@ -91,6 +227,27 @@ sk_logger_t *
 sk_logger_create(const char *name, uint8_t log_size, sk_logger_drv_t *driver,
 	sk_error_t *error) sk_nonnull(1, 4);
 
+/*
+ * Initialize a logger with options.
+ *
+ * See `sk_logger_create`, which is a shortcut for a fixed ring.
+ *
+ * @param name, name of the logger
+ * @param opts, options of the logger
+ * @param driver, backend storage for the logger
+ * @param error, error to store failure information
+ *
+ * @return newly allocated logger on success, or NULL on failure and set error
+ *
+ * @errors SK_ERROR_ENOMEM, if memory allocations failed
+ *         SK_ERROR_EINVAL, if log_size is out of range for the ring, or the
+ *                          full policy or the clock is unknown
+ *         The driver open function may also return a custom error_code
+ */
+sk_logger_t *
+sk_logger_create_opts(const char *name, const sk_logger_opts_t *opts,
+	sk_logger_drv_t *driver, sk_error_t *error) sk_nonnull(1, 2, 4);
+
 /*
  * Free a logger.
  *
@@ -110,10 +267,12 @@ enum sk_log_level
 sk_logger_get_level(sk_logger_t *logger) sk_nonnull(1);
 
 /*
- * Set the effective log level of a logger.
+ * Set the log level of a logger.
  *
  * All future message of priority lower then the provided level will be
- * discarded.
+ * discarded. Loggers are named hierarchically with dots, e.g. `app.db.pool`,
+ * and a logger without a level of its own inherits the one of its closest
+ * ancestor, thus the level also applies to such descendants.
  *
  * @param logger, logger to get the level from
  * @param level, level to set to
@@ -123,6 +282,160 @@ sk_logger_get_level(sk_logger_t *logger) sk_nonnull(1);
 bool
 sk_logger_set_level(sk_logger_t *logger, enum sk_log_level level) sk_nonnull(1);
 
+/*
+ * Set the level of loggers whose name matches a glob(7) pattern, e.g.
+ * `app.db*` for `app.db` and its descendants.
+ *
+ * The pattern is kept such that it also applies to loggers created later, and
+ * to the descendants of matching names. The latest level given to a name wins,
+ * either by pattern or by `sk_logger_set_level`. Levels are changed under a
+ * lock of their own, logging never looks names up.
+ *
+ * @param pattern, glob matched against whole names
+ * @param level, level to set to
+ * @param error, error to store failure information
+ *
+ * @return true on success, false otherwise and set error
+ *
+ * @errors SK_ERROR_EINVAL, if the level is invalid
+ *         SK_ERROR_ENOMEM, if memory allocations failed
+ */
+bool
+sk_logger_set_level_match(const char *pattern, enum sk_log_level level,
+	sk_error_t *error) sk_nonnull(1, 3);
+
+/*
+ * Set the level of loggers whose whole name matches an extended regular
+ * expression, see `sk_logger_set_level_match` and regex(7).
+ *
+ * @param regex, regular expression matched against whole names
+ * @param level, level to set to
+ * @param error, error to store failure information
+ *
+ * @return true on success, false otherwise and set error
+ *
+ * @errors SK_ERROR_EINVAL, if the regex or the level is invalid
+ *         SK_ERROR_ENOMEM, if memory allocations failed
+ */
+bool
+sk_logger_set_level_regex(const char *regex, enum sk_log_level level,
+	sk_error_t *error) sk_nonnull(1, 3);
+
+/*
+ * Forget the patterns of `sk_logger_set_level_match` and
+ * `sk_logger_set_level_regex`, e.g. once an incident is over. Loggers are back
+ * to their own or inherited levels.
+ */
+void
+sk_logger_reset_level_match(void);
+
+/*
+ * Find a live logger by name.
+ *
+ * @param name, name of the logger
+ *
+ * @return the most recently created logger of that name, NULL if none. It
+ *         must not be destroyed while used.
+ */
+sk_logger_t *
+sk_logger_find(const char *name) sk_nonnull(1);
+
+/*
+ * Get the number of messages of a level dropped by a logger since its
+ * creation, see `enum sk_logger_full_policy`.
+ *
+ * @param logger, logger to get the counter from
+ * @param level, level of the dropped messages
+ *
+ * @return the number of dropped messages
+ */
+uint64_t
+sk_logger_dropped(sk_logger_t *logger, enum sk_log_level level)
+	sk_nonnull(1);
+
+enum {
+	/* Buckets of the latency histogram of `sk_logger_stats` */
+	SK_LOGGER_LATENCY_BUCKETS = 32,
+};
+
+/*
+ * Self instrumentation of a logger, see `sk_logger_get_stats`.
+ */
+struct sk_logger_stats {
+	/* Messages accepted by the ring, and dropped, see `sk_logger_dropped` */
+	uint64_t enqueued;
+	uint64_t dropped;
+	/* Messages drained from the ring, and driver calls that failed */
+	uint64_t drained;
+	uint64_t driver_errors;
+
+	/*
+	 * Messages waiting in the ring, and the most the drain ever found
+	 * waiting. The capacity is the number of messages the ring holds; for
+	 * variable length rings, messages of a full payload, per thread for
+	 * SK_LOGGER_RING_PER_THREAD. Flight recorders have no waiting messages.
+	 */
+	uint64_t pending;
+	uint64_t pending_high;
+	uint64_t capacity;
+
+	/*
+	 * Time from the timestamp of messages to their handing to the driver.
+	 * Bucket i counts latencies of [2^i, 2^(i+1)) nanoseconds, the first one
+	 * also counts shorter ones and the last one longer ones.
+	 */
+	uint64_t latency[SK_LOGGER_LATENCY_BUCKETS];
+};
+typedef struct sk_logger_stats sk_logger_stats_t;
+
+/*
+ * Get a snapshot of the instrumentation of a logger.
+ *
+ * Counters are read one by one while the logger is in use; they are only
+ * consistent with each other once it is idle.
+ *
+ * @param logger, logger to get the instrumentation of
+ * @param stats, snapshot to store into
+ */
+void
+sk_logger_get_stats(sk_logger_t *logger, sk_logger_stats_t *stats)
+	sk_nonnull(1, 2);
+
+/*
+ * Set flags of a logger.
+ *
+ * @param logger, logger to modify
+ * @param flags, flags to set
+ */
+void
+sk_logger_set_flags(sk_logger_t *logger, sk_flag_t flags) sk_nonnull(1);
+
+/*
+ * Unset flags of a logger.
+ *
+ * @param logger, logger to modify
+ * @param flags, flags to unset
+ */
+void
+sk_logger_unset_flags(sk_logger_t *logger, sk_flag_t flags) sk_nonnull(1);
+
+/*
+ * Check if a logger accepts messages of a given level.
+ *
+ * This is the inlined gate of the convenience macros, it costs a single relaxed
+ * load. It relies on the level being the first member of `struct sk_logger`.
+ *
+ * @param logger, logger to check
+ * @param level, level of the message
+ *
+ * @return true if a message of this level would be logged
+ */
+static inline bool
+sk_logger_is_enabled(const sk_logger_t *logger, enum sk_log_level level)
+{
+	return level <= (enum sk_log_level)ck_pr_load_int((const int *)logger);
+}
+
 /*
  * Log a message.
  *
@@ -138,28 +451,382 @@ bool
 sk_log(sk_logger_t *logger, enum sk_log_level level, sk_debug_t debug,
 	const char *fmt, ...) sk_log_attr;
 
+/* Type of the value of a structured field */
+enum sk_kv_type {
+	SK_KV_TYPE_INT = 0,
+	SK_KV_TYPE_UINT,
+	SK_KV_TYPE_DOUBLE,
+	SK_KV_TYPE_BOOL,
+	SK_KV_TYPE_STR,
+};
+
+/* A typed key-value field of a structured message, see `sk_log_kv` */
+struct sk_kv {
+	const char *key;
+	enum sk_kv_type type;
+	union {
+		int64_t i;
+		uint64_t u;
+		double d;
+		bool b;
+		const char *s;
+	};
+};
+typedef struct sk_kv sk_kv_t;
+
+#define SK_KV_INT(k, v)                                                        \
+	((sk_kv_t){.key = (k), .type = SK_KV_TYPE_INT, .i = (v)})
+#define SK_KV_UINT(k, v)                                                       \
+	((sk_kv_t){.key = (k), .type = SK_KV_TYPE_UINT, .u = (v)})
+#define SK_KV_DOUBLE(k, v)                                                     \
+	((sk_kv_t){.key = (k), .type = SK_KV_TYPE_DOUBLE, .d = (v)})
+#define SK_KV_BOOL(k, v)                                                       \
+	((sk_kv_t){.key = (k), .type = SK_KV_TYPE_BOOL, .b = (v)})
+#define SK_KV_STR(k, v)                                                        \
+	((sk_kv_t){.key = (k), .type = SK_KV_TYPE_STR, .s = (v)})
+
+enum {
+	/* Maximum number of fields of a structured message */
+	SK_LOG_KV_MAX = 32,
+};
+
+/*
+ * Log a structured message, see `sk_log_kv`.
+ *
+ * Fields are encoded in their binary representation after the message, keys
+ * and strings are copied. Fields which don't fit in the message, or past
+ * SK_LOG_KV_MAX, are dropped; the last string value may be truncated.
+ *
+ * @param logger, logger to log the message to
+ * @param level, level of the message
+ * @param debug, captured information of the caller, see sk_debug_t
+ * @param text, message, not a format
+ * @param kvs, fields of the message
+ * @param n, number of fields
+ *
+ * @return true on success, false on failure
+ */
+bool
+sk_log_kv_array(sk_logger_t *logger, enum sk_log_level level,
+	sk_debug_t debug, const char *text, const sk_kv_t *kvs, size_t n)
+	sk_nonnull(1, 4);
+
+/*
+ * Log a message with typed fields, e.g.
+ *
+ *   sk_log_kv(logger, SK_LOG_INFO, sk_debug, "login",
+ *       SK_KV_UINT("user", id), SK_KV_STR("from", addr));
+ *
+ * Values are never formatted by the caller, drivers receive the fields with
+ * `sk_log_msg_kv`.
+ */
+#define sk_log_kv(logger, level, debug, msg, ...)                              \
+	sk_log_kv_array((logger), (level), (debug), (msg),                         \
+		(const sk_kv_t[]){__VA_ARGS__},                                        \
+		sizeof((const sk_kv_t[]){__VA_ARGS__}) / sizeof(sk_kv_t))
+
+/*
+ * Log a message if the level passes both the compile time threshold and the
+ * logger's level. Otherwise, arguments are not evaluated and it yields true.
+ */
+#define sk_log_gate(logger, level, fmt, ...)                                   \
+	(((level) <= SK_LOG_COMPILE_LEVEL &&                                       \
+		 sk_logger_is_enabled((logger), (level)))                              \
+			? sk_log((logger), (level), sk_debug, (fmt), ##__VA_ARGS__)        \
+			: true)
+
 /* Convenience macros that captures sk_debug_t and currify the level */
 
 #define sk_log_debug(logger, fmt, ...)                                         \
-	sk_log((logger), SK_LOG_DEBUG, sk_debug, (fmt), ##__VA_ARGS__)
+	sk_log_gate((logger), SK_LOG_DEBUG, (fmt), ##__VA_ARGS__)
 
 #define sk_log_info(logger, fmt, ...)                                          \
-	sk_log((logger), SK_LOG_INFO, sk_debug, (fmt), ##__VA_ARGS__)
+	sk_log_gate((logger), SK_LOG_INFO, (fmt), ##__VA_ARGS__)
 
 #define sk_log_notice(logger, fmt, ...)                                        \
-	sk_log((logger), SK_LOG_NOTICE, sk_debug, (fmt), ##__VA_ARGS__)
+	sk_log_gate((logger), SK_LOG_NOTICE, (fmt), ##__VA_ARGS__)
 
 #define sk_log_warning(logger, fmt, ...)                                       \
-	sk_log((logger), SK_LOG_WARNING, sk_debug, (fmt), ##__VA_ARGS__)
+	sk_log_gate((logger), SK_LOG_WARNING, (fmt), ##__VA_ARGS__)
 
 #define sk_log_error(logger, fmt, ...)                                         \
-	sk_log((logger), SK_LOG_ERROR, sk_debug, (fmt), ##__VA_ARGS__)
+	sk_log_gate((logger), SK_LOG_ERROR, (fmt), ##__VA_ARGS__)
 
 #define sk_log_critical(logger, fmt, ...)                                      \
-	sk_log((logger), SK_LOG_CRITICAL, sk_debug, (fmt), ##__VA_ARGS__)
+	sk_log_gate((logger), SK_LOG_CRITICAL, (fmt), ##__VA_ARGS__)
 
 #define sk_log_alert(logger, fmt, ...)                                         \
-	sk_log((logger), SK_LOG_ALERT, sk_debug, (fmt), ##__VA_ARGS__)
+	sk_log_gate((logger), SK_LOG_ALERT, (fmt), ##__VA_ARGS__)
 
 #define sk_log_emergency(logger, fmt, ...)                                     \
-	sk_log((logger), SK_LOG_EMERGENCY, sk_debug, (fmt), ##__VA_ARGS__)
+	sk_log_gate((logger), SK_LOG_EMERGENCY, (fmt), ##__VA_ARGS__)
+
+/*
+ * Limits of a callsite against log storms, checked before formatting. The
+ * state lives in the static storage of the callsite and is updated lock-free.
+ *
+ * Rate limiting is a token bucket of `burst` messages refilled every
+ * `interval_nsec`; sampling lets one message in `every` through. Suppressed
+ * messages are counted and reported by the next message that gets through,
+ * e.g. "message (12 suppressed)".
+ */
+struct sk_log_limit {
+	/* Token bucket, unused if interval_nsec is 0 */
+	uint64_t interval_nsec;
+	uint64_t burst;
+	/* Sampling, unused if every is 0 */
+	uint64_t every;
+
+	/* State; time the bucket is full again, and messages seen */
+	uint64_t tat;
+	uint64_t seen;
+	uint64_t suppressed;
+};
+typedef struct sk_log_limit sk_log_limit_t;
+
+/*
+ * Initializers of `sk_log_limit_t`, rate is in messages per second and
+ * unlimited if 0.
+ */
+#define SK_LOG_LIMIT_RATE(rate, n)                                             \
+	{                                                                          \
+		.interval_nsec =                                                       \
+			((rate) != 0) ? 1000000000ULL / (((rate) != 0) ? (rate) : 1) : 0,  \
+		.burst = (n)                                                           \
+	}
+#define SK_LOG_LIMIT_SAMPLE(n)                                                 \
+	{                                                                          \
+		.every = (n)                                                           \
+	}
+
+/*
+ * Log a message subject to the limits of its callsite.
+ *
+ * @param logger, logger to log the message to
+ * @param level, level of the message
+ * @param debug, captured information of the caller, see sk_debug_t
+ * @param limit, limits of the callsite
+ * @param fmt, printf format definition to construct the message
+ * @param ..., arguments of provided for the formatting
+ *
+ * @return true on success or if suppressed, false on failure
+ */
+bool
+sk_log_limited(sk_logger_t *logger, enum sk_log_level level, sk_debug_t debug,
+	sk_log_limit_t *limit, const char *fmt, ...)
+	__attribute__((format(printf, 5, 6), nonnull(1, 4, 5)));
+
+/*
+ * Log a message through the limits of a callsite, see `sk_log_gate`. The
+ * limit initializer must be a constant expression.
+ */
+#define sk_log_gate_limited(logger, level, init, fmt, ...)                     \
+	({                                                                         \
+		static sk_log_limit_t sk_log_limit_ = init;                            \
+		((level) <= SK_LOG_COMPILE_LEVEL &&                                    \
+			sk_logger_is_enabled((logger), (level)))                           \
+			? sk_log_limited((logger), (level), sk_debug, &sk_log_limit_,      \
+				  (fmt), ##__VA_ARGS__)                                        \
+			: true;                                                            \
+	})
+
+/* At most `rate` messages per second, after a burst of `burst` messages */
+#define sk_log_ratelimited(logger, level, rate, burst, fmt, ...)               \
+	sk_log_gate_limited((logger), (level), SK_LOG_LIMIT_RATE(rate, burst),    \
+		(fmt), ##__VA_ARGS__)
+
+/* One message in `n` */
+#define sk_log_sampled(logger, level, n, fmt, ...)                             \
+	sk_log_gate_limited(                                                       \
+		(logger), (level), SK_LOG_LIMIT_SAMPLE(n), (fmt), ##__VA_ARGS__)
+
+#define sk_log_debug_ratelimited(logger, rate, burst, fmt, ...)                \
+	sk_log_ratelimited(                                                        \
+		(logger), SK_LOG_DEBUG, rate, burst, (fmt), ##__VA_ARGS__)
+
+#define sk_log_info_ratelimited(logger, rate, burst, fmt, ...)                 \
+	sk_log_ratelimited((logger), SK_LOG_INFO, rate, burst, (fmt), ##__VA_ARGS__)
+
+#define sk_log_notice_ratelimited(logger, rate, burst, fmt, ...)               \
+	sk_log_ratelimited(                                                        \
+		(logger), SK_LOG_NOTICE, rate, burst, (fmt), ##__VA_ARGS__)
+
+#define sk_log_warning_ratelimited(logger, rate, burst, fmt, ...)              \
+	sk_log_ratelimited(                                                        \
+		(logger), SK_LOG_WARNING, rate, burst, (fmt), ##__VA_ARGS__)
+
+#define sk_log_error_ratelimited(logger, rate, burst, fmt, ...)                \
+	sk_log_ratelimited(                                                        \
+		(logger), SK_LOG_ERROR, rate, burst, (fmt), ##__VA_ARGS__)
+
+#define sk_log_critical_ratelimited(logger, rate, burst, fmt, ...)             \
+	sk_log_ratelimited(                                                        \
+		(logger), SK_LOG_CRITICAL, rate, burst, (fmt), ##__VA_ARGS__)
+
+#define sk_log_alert_ratelimited(logger, rate, burst, fmt, ...)                \
+	sk_log_ratelimited(                                                        \
+		(logger), SK_LOG_ALERT, rate, burst, (fmt), ##__VA_ARGS__)
+
+#define sk_log_emergency_ratelimited(logger, rate, burst, fmt, ...)            \
+	sk_log_ratelimited(                                                        \
+		(logger), SK_LOG_EMERGENCY, rate, burst, (fmt), ##__VA_ARGS__)
+
+#define sk_log_debug_sampled(logger, n, fmt, ...)                              \
+	sk_log_sampled((logger), SK_LOG_DEBUG, n, (fmt), ##__VA_ARGS__)
+
+#define sk_log_info_sampled(logger, n, fmt, ...)                               \
+	sk_log_sampled((logger), SK_LOG_INFO, n, (fmt), ##__VA_ARGS__)
+
+#define sk_log_notice_sampled(logger, n, fmt, ...)                             \
+	sk_log_sampled((logger), SK_LOG_NOTICE, n, (fmt), ##__VA_ARGS__)
+
+#define sk_log_warning_sampled(logger, n, fmt, ...)                            \
+	sk_log_sampled((logger), SK_LOG_WARNING, n, (fmt), ##__VA_ARGS__)
+
+#define sk_log_error_sampled(logger, n, fmt, ...)                              \
+	sk_log_sampled((logger), SK_LOG_ERROR, n, (fmt), ##__VA_ARGS__)
+
+#define sk_log_critical_sampled(logger, n, fmt, ...)                           \
+	sk_log_sampled((logger), SK_LOG_CRITICAL, n, (fmt), ##__VA_ARGS__)
+
+#define sk_log_alert_sampled(logger, n, fmt, ...)                              \
+	sk_log_sampled((logger), SK_LOG_ALERT, n, (fmt), ##__VA_ARGS__)
+
+#define sk_log_emergency_sampled(logger, n, fmt, ...)                          \
+	sk_log_sampled((logger), SK_LOG_EMERGENCY, n, (fmt), ##__VA_ARGS__)
+
+/*
+ * Callsite of `sk_log_dynamic`, enabled at runtime independently of the level
+ * of its logger, as the kernel's dynamic debug.
+ *
+ * Callsites live in the static storage of the caller, in the
+ * SK_LOG_CALLSITES_SECTION section of its module, such that they're
+ * enumerated without registration. A disabled callsite costs a load and a
+ * predictable branch.
+ */
+struct sk_log_callsite {
+	/* Set while enabled, see `sk_log_callsites_enable` */
+	int enabled;
+	enum sk_log_level level;
+	sk_debug_t debug;
+	const char *fmt;
+};
+typedef struct sk_log_callsite sk_log_callsite_t;
+
+#define SK_LOG_CALLSITES_SECTION "sk_log_callsites"
+
+/*
+ * Log a message with the level and caller of a callsite, whatever the level
+ * of the logger, see `sk_log_dynamic`.
+ *
+ * @param logger, logger to log the message to
+ * @param callsite, callsite of the message
+ * @param fmt, printf format definition to construct the message
+ * @param ..., arguments of provided for the formatting
+ *
+ * @return true on success, false on failure
+ */
+bool
+sk_log_callsite(sk_logger_t *logger, const sk_log_callsite_t *callsite,
+	const char *fmt, ...)
+	__attribute__((format(printf, 3, 4), nonnull(1, 2, 3)));
+
+/*
+ * Log a message only while its callsite is enabled, see
+ * `sk_log_callsites_enable`. Callsites start disabled. The level and the
+ * format must be constant expressions; levels above SK_LOG_COMPILE_LEVEL are
+ * still removed at build time.
+ */
+#define sk_log_dynamic(logger, level, fmt, ...)                                \
+	({                                                                         \
+		static sk_log_callsite_t sk_log_callsite_ sk_align(8)                  \
+			__attribute__((section(SK_LOG_CALLSITES_SECTION), used)) = {       \
+				0, (level), {__FILE__, __func__, __LINE__}, (fmt)};            \
+		((level) <= SK_LOG_COMPILE_LEVEL &&                                    \
+			sk_unlikely(ck_pr_load_int(&sk_log_callsite_.enabled)))            \
+			? sk_log_callsite(                                                 \
+				  (logger), &sk_log_callsite_, (fmt), ##__VA_ARGS__)           \
+			: true;                                                            \
+	})
+
+#define sk_log_debug_dynamic(logger, fmt, ...)                                 \
+	sk_log_dynamic((logger), SK_LOG_DEBUG, (fmt), ##__VA_ARGS__)
+
+#define sk_log_info_dynamic(logger, fmt, ...)                                  \
+	sk_log_dynamic((logger), SK_LOG_INFO, (fmt), ##__VA_ARGS__)
+
+#define sk_log_notice_dynamic(logger, fmt, ...)                                \
+	sk_log_dynamic((logger), SK_LOG_NOTICE, (fmt), ##__VA_ARGS__)
+
+/* Callsites of a module, i.e. the executable or a shared object */
+struct sk_log_callsites_module {
+	sk_log_callsite_t *start, *stop;
+	struct sk_log_callsites_module *next;
+};
+typedef struct sk_log_callsites_module sk_log_callsites_module_t;
+
+/*
+ * Register the callsites of a module, see `SK_LOG_CALLSITES_MODULE`. A module
+ * registered twice is ignored.
+ *
+ * @param module, callsites of the module, in static storage
+ */
+void
+sk_log_callsites_register(sk_log_callsites_module_t *module) sk_nonnull(1);
+
+/*
+ * Unregister the callsites of a module before it's unloaded, e.g. by
+ * dlclose(3). A module that isn't registered is ignored.
+ *
+ * @param module, callsites of the module, as registered
+ */
+void
+sk_log_callsites_unregister(sk_log_callsites_module_t *module) sk_nonnull(1);
+
+/*
+ * Register the callsites section of the module built from the source that
+ * expands it at load time, and unregister it at unload time. The library
+ * registers the module it is linked into; executables and shared objects
+ * linking the shared library expand it in one of their sources.
+ */
+#define SK_LOG_CALLSITES_MODULE()                                              \
+	extern sk_log_callsite_t __start_sk_log_callsites[]                        \
+		__attribute__((weak, visibility("hidden")));                           \
+	extern sk_log_callsite_t __stop_sk_log_callsites[]                         \
+		__attribute__((weak, visibility("hidden")));                           \
+	static sk_log_callsites_module_t sk_log_callsites_module_ = {              \
+		__start_sk_log_callsites, __stop_sk_log_callsites, NULL};              \
+	sk_constructor static void sk_log_callsites_module_load_(void)             \
+	{                                                                          \
+		sk_log_callsites_register(&sk_log_callsites_module_);                  \
+	}                                                                          \
+	sk_destructor static void sk_log_callsites_module_unload_(void)            \
+	{                                                                          \
+		sk_log_callsites_unregister(&sk_log_callsites_module_);                \
+	}
+
+/*
+ * Enable or disable the callsites matching a glob(7) pattern. The pattern is
+ * matched against `file:function:line` of each registered callsite, e.g.
+ * `*db.c:*`, `*:db_commit:*` or `src/db.c:*:120`. Callsites of modules
+ * registered later are not affected.
+ *
+ * @param pattern, glob matched against `file:function:line`
+ * @param enabled, state to set matching callsites to
+ *
+ * @return the number of matching callsites
+ */
+size_t
+sk_log_callsites_enable(const char *pattern, bool enabled) sk_nonnull(1);
+
+/*
+ * Apply a function to every registered callsite.
+ *
+ * @param fn, function to apply
+ * @param ctx, context passed to fn
+ *
+ * @return the sum of the values returned by fn
+ */
+size_t
+sk_log_callsites_foreach(size_t (*fn)(sk_log_callsite_t *, void *), void *ctx)
+	sk_nonnull(1);
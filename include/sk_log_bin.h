@@ -0,0 +1,179 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sk_cc.h>
+#include <sk_error.h>
+#include <sk_logger_drv.h>
+
+/*
+ * Binary log files, written by the binary driver and read with
+ * `sk_log_bin_open` or the `sk-logcat` tool.
+ *
+ * A file starts with a header, followed by blocks of length prefixed records
+ * in native byte order. Each block starts with the range of its timestamps
+ * and a bitmap of its levels. A sparse index, `<path>.idx`, holds an entry per
+ * block such that readers seek by time and skip blocks without the wanted
+ * levels without touching them. The index is written after its block; readers
+ * recover entries missing after a crash by walking the block headers.
+ */
+
+#define SK_LOG_BIN_MAGIC "SKLOGBIN"
+#define SK_LOG_BIN_INDEX_SUFFIX ".idx"
+
+enum {
+	SK_LOG_BIN_VERSION = 1,
+	/* Magic of a block, `SKBK` */
+	SK_LOG_BIN_BLOCK_MAGIC = 0x4b424b53,
+	/* Default size of a block */
+	SK_LOG_BIN_BLOCK_SIZE = 64 * 1024,
+	/* Default age after which a block that isn't full is written */
+	SK_LOG_BIN_FLUSH_MS = 1000,
+	/* Size of the logger name in the header */
+	SK_LOG_BIN_NAME_MAX = 64,
+};
+
+struct sk_log_bin_hdr {
+	char magic[8];
+	uint32_t version;
+	/* Offset of the first block in the file */
+	uint32_t hdr_size;
+	/* Process and logger that created the file */
+	int32_t pid;
+	char name[SK_LOG_BIN_NAME_MAX];
+};
+typedef struct sk_log_bin_hdr sk_log_bin_hdr_t;
+
+struct sk_log_bin_block {
+	uint32_t magic;
+	/* Bytes of records following the header */
+	uint32_t size;
+	uint32_t count;
+	/* Bit `1 << level` is set if a record has this level */
+	uint32_t levels;
+	/* Range of the timestamps of the records */
+	uint64_t ts_min;
+	uint64_t ts_max;
+};
+typedef struct sk_log_bin_block sk_log_bin_block_t;
+
+/* Entry of the index */
+struct sk_log_bin_index {
+	/* Offset of the block in the file */
+	uint64_t offset;
+	sk_log_bin_block_t block;
+};
+typedef struct sk_log_bin_index sk_log_bin_index_t;
+
+/*
+ * A record is this header followed by the caller's file, function, thread
+ * name and payload. Strings but the payload are not NUL terminated; the
+ * payload holds the message and its encoded fields, see `sk_log_msg_kv`.
+ */
+struct sk_log_bin_record {
+	/* Size of the record, header included */
+	uint16_t size;
+	uint8_t level;
+	uint8_t kv_count;
+	int32_t line;
+	uint64_t ts_nsec;
+	int32_t pid, tid;
+	uint8_t file_len;
+	uint8_t function_len;
+	uint8_t thread_len;
+	uint8_t reserved;
+	uint16_t payload_len;
+	uint16_t reserved2;
+};
+typedef struct sk_log_bin_record sk_log_bin_record_t;
+
+/* Messages to read, see `sk_log_bin_seek` */
+struct sk_log_bin_query {
+	/* Range of timestamps, inclusive; 0 leaves a bound open */
+	uint64_t from_nsec;
+	uint64_t to_nsec;
+	/* Bitmap of levels, `1 << level`; 0 reads all levels */
+	uint32_t levels;
+};
+typedef struct sk_log_bin_query sk_log_bin_query_t;
+
+/* A message decoded from a file */
+struct sk_log_bin_entry {
+	/* File and function of `msg.debug` and its thread point here */
+	sk_log_msg_t msg;
+	char file[256];
+	char function[256];
+	char thread[SK_LOG_THREAD_NAME_MAX];
+};
+typedef struct sk_log_bin_entry sk_log_bin_entry_t;
+
+/* Reader of a binary log file */
+struct sk_log_bin_reader {
+	const sk_log_bin_hdr_t *hdr;
+	const char *map;
+	size_t map_size;
+
+	/*
+	 * Blocks of the file, and the highest timestamp of the blocks up to each
+	 * one such that seeking is a binary search.
+	 */
+	sk_log_bin_index_t *blocks;
+	uint64_t *ts_high;
+	size_t n_blocks;
+
+	/* Current query, block and offset of the next record in the file */
+	sk_log_bin_query_t query;
+	size_t block;
+	uint64_t offset, end;
+};
+typedef struct sk_log_bin_reader sk_log_bin_reader_t;
+
+/*
+ * Open a binary log file and its index. The index is optional.
+ *
+ * @param reader, reader to initialize, positioned on the first message
+ * @param path, path of the file
+ * @param error, error to store failure information
+ *
+ * @return true on success, false otherwise and set error
+ *
+ * @errors SK_ERROR_EINVAL, if the file is not a valid binary log file
+ *         SK_ERROR_ENOMEM, if the blocks can't be allocated
+ *         errno(3) of open(2), fstat(2) or mmap(2) otherwise
+ */
+bool
+sk_log_bin_open(sk_log_bin_reader_t *reader, const char *path,
+	sk_error_t *error) sk_nonnull(1, 2, 3);
+
+/*
+ * Restrict the following reads to a query, starting at the first block that
+ * may hold a matching message.
+ *
+ * @param reader, reader to position
+ * @param query, messages to read, NULL reads all
+ */
+void
+sk_log_bin_seek(sk_log_bin_reader_t *reader, const sk_log_bin_query_t *query)
+	sk_nonnull(1);
+
+/*
+ * Read the next message matching the query, in the order of the file.
+ *
+ * @param reader, reader to read from
+ * @param entry, entry to decode the message into
+ *
+ * @return true if a message was read, false once the query is exhausted
+ */
+bool
+sk_log_bin_next(sk_log_bin_reader_t *reader, sk_log_bin_entry_t *entry)
+	sk_nonnull(1, 2);
+
+/*
+ * Close a reader.
+ *
+ * @param reader, reader to close
+ */
+void
+sk_log_bin_close(sk_log_bin_reader_t *reader) sk_nonnull(1);
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sk_cc.h>
+#include <sk_error.h>
+
+/*
+ * The drain runtime is a pool of worker threads that drain every logger, such
+ * that users don't need to call `sk_logger_drain` themselves.
+ *
+ * Loggers are partitioned among workers by their identifier. A worker with
+ * nothing to drain arms its loggers and sleeps on a futex; the first message
+ * enqueued in an armed logger wakes it. Producers thus only pay for a wakeup
+ * on the empty to non-empty transition.
+ *
+ * The number of messages drained from a logger in a pass adapts to the load:
+ * it doubles when the logger had more pending messages, and halves when the
+ * logger was mostly idle.
+ */
+
+enum {
+	/* Maximum number of workers */
+	SK_LOG_DRAIN_WORKERS_MAX = 64,
+	/* Default bounds of the batch size */
+	SK_LOG_DRAIN_BATCH_MIN = 16,
+	SK_LOG_DRAIN_BATCH_MAX = 4096,
+	/* Default upper bound of an idle worker sleep, in milliseconds */
+	SK_LOG_DRAIN_IDLE_MS = 100,
+};
+
+/* Options of the drain runtime, zero initialized fields are defaults */
+struct sk_log_drain_opts {
+	/* Number of workers, defaults to 1 */
+	uint8_t workers;
+	/* Bounds of the number of messages drained from a logger per pass */
+	size_t batch_min;
+	size_t batch_max;
+	/* Upper bound of an idle worker sleep, a safety net for lost wakeups */
+	uint32_t idle_ms;
+	/*
+	 * Pin worker `i` to cpu `cpus[i % n_cpus]`, no affinity if NULL. The
+	 * cpus are read by sk_log_drain_start, they needn't outlive it.
+	 */
+	const int *cpus;
+	size_t n_cpus;
+};
+typedef struct sk_log_drain_opts sk_log_drain_opts_t;
+
+/*
+ * Start the drain runtime.
+ *
+ * @param opts, options of the runtime, NULL for defaults
+ * @param error, error to store failure information
+ *
+ * @return true on success, false otherwise and set error
+ *
+ * @errors SK_ERROR_EINVAL, if the runtime is already started or options are
+ *                          invalid
+ *         SK_ERROR_EAGAIN, if a worker thread can't be created
+ */
+bool
+sk_log_drain_start(const sk_log_drain_opts_t *opts, sk_error_t *error)
+	sk_nonnull(2);
+
+/*
+ * Stop the drain runtime.
+ *
+ * Workers drain pending messages before exiting. Does nothing if the runtime
+ * is not started.
+ */
+void
+sk_log_drain_stop(void);
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <sk_cc.h>
+#include <sk_error.h>
+#include <sk_log.h>
+
+/*
+ * A flight recorder is a ring of messages living in a file backed shared
+ * mapping, see SK_LOGGER_RING_FLIGHT. Producers overwrite the oldest slot and
+ * nothing is drained; since the pages belong to the file, the last messages
+ * survive the process, e.g. SIGKILL, OOM kill or segfault, and are decoded
+ * after the fact with `sk_log_flight_open` or the `sk-flight` tool. A
+ * recorder created over an existing file first renames it with the
+ * SK_LOG_FLIGHT_PREV_SUFFIX suffix, such that a restart keeps the messages
+ * of the run that crashed.
+ *
+ * The file starts with a self-describing header giving the geometry of the
+ * ring and the offset of each field in a slot, such that readers don't depend
+ * on the layout they were compiled with.
+ */
+
+#define SK_LOG_FLIGHT_MAGIC "SKFLIGHT"
+/* Suffix of the recorder of the previous run, kept aside on creation */
+#define SK_LOG_FLIGHT_PREV_SUFFIX ".prev"
+
+enum {
+	SK_LOG_FLIGHT_VERSION = 1,
+	/* Maximum number of slots, 2^SK_LOG_FLIGHT_LOG_SIZE_MAX */
+	SK_LOG_FLIGHT_LOG_SIZE_MAX = 24,
+	/* Size of the copies of sk_debug_t strings */
+	SK_LOG_FLIGHT_FILE_MAX = 64,
+	SK_LOG_FLIGHT_FUNCTION_MAX = 48,
+	/* Size of the logger name in the header */
+	SK_LOG_FLIGHT_NAME_MAX = 64,
+};
+
+/* Location of a field in a slot */
+struct sk_log_flight_field {
+	uint32_t offset;
+	uint32_t size;
+};
+
+struct sk_log_flight_hdr {
+	char magic[8];
+	uint32_t version;
+	/* Offset of the first slot in the file */
+	uint32_t hdr_size;
+	uint32_t slot_size;
+	uint32_t slot_count;
+
+	struct {
+		struct sk_log_flight_field seq;
+		struct sk_log_flight_field ts_nsec;
+		struct sk_log_flight_field level;
+		struct sk_log_flight_field pid;
+		struct sk_log_flight_field tid;
+		struct sk_log_flight_field line;
+		struct sk_log_flight_field thread;
+		struct sk_log_flight_field file;
+		struct sk_log_flight_field function;
+		struct sk_log_flight_field payload;
+	} fields;
+
+	/* Process and logger owning the recorder */
+	int32_t pid;
+	char name[SK_LOG_FLIGHT_NAME_MAX];
+
+	/* Number of slots ever reserved, the next position to write */
+	uint64_t head sk_cache_aligned;
+};
+typedef struct sk_log_flight_hdr sk_log_flight_hdr_t;
+
+/* Recorder of a logger, see SK_LOGGER_RING_FLIGHT */
+struct sk_log_flight {
+	sk_log_flight_hdr_t *hdr;
+	char *slots;
+	uint64_t mask;
+	size_t map_size;
+};
+typedef struct sk_log_flight sk_log_flight_t;
+
+/* A message decoded from a recorder */
+struct sk_log_flight_record {
+	/* Position of the message in the recorder */
+	uint64_t position;
+
+	uint64_t ts_nsec;
+	enum sk_log_level level;
+	pid_t pid, tid;
+	int line;
+
+	char thread[16];
+	char file[256];
+	char function[256];
+	char payload[256];
+};
+typedef struct sk_log_flight_record sk_log_flight_record_t;
+
+/* Reader of a recorder file */
+struct sk_log_flight_reader {
+	const sk_log_flight_hdr_t *hdr;
+	const char *map;
+	size_t map_size;
+
+	/* Next position to read and end of the recorder */
+	uint64_t position;
+	uint64_t head;
+};
+typedef struct sk_log_flight_reader sk_log_flight_reader_t;
+
+/*
+ * Open a recorder file, written by a live or dead process.
+ *
+ * @param reader, reader to initialize
+ * @param path, path of the recorder
+ * @param error, error to store failure information
+ *
+ * @return true on success, false otherwise and set error
+ *
+ * @errors SK_ERROR_EINVAL, if the file is not a valid recorder
+ *         errno(3) of open(2), fstat(2) or mmap(2) otherwise
+ */
+bool
+sk_log_flight_open(sk_log_flight_reader_t *reader, const char *path,
+	sk_error_t *error) sk_nonnull(1, 2, 3);
+
+/*
+ * Read the next message of a recorder, from the oldest to the newest.
+ *
+ * Slots that were being written, or overwritten since the reader was opened,
+ * are skipped.
+ *
+ * @param reader, reader to read from
+ * @param record, record to decode the message into
+ *
+ * @return true if a message was read, false once the recorder is exhausted
+ */
+bool
+sk_log_flight_next(sk_log_flight_reader_t *reader,
+	sk_log_flight_record_t *record) sk_nonnull(1, 2);
+
+/*
+ * Close a reader.
+ *
+ * @param reader, reader to close
+ */
+void
+sk_log_flight_close(sk_log_flight_reader_t *reader) sk_nonnull(1);
@@ -1,21 +1,32 @@
 #pragma once
 
+#include <pthread.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 
+#include <ck_queue.h>
 #include <ck_ring.h>
 
 #include <sk_error.h>
 #include <sk_flag.h>
 #include <sk_log.h>
+#include <sk_log_flight.h>
+#include <sk_ring.h>
 
 enum {
 	/* Message maximum size */
 	SK_LOG_MSG_MAX = 256,
+	/* Maximum number of messages passed to a driver's log_batch callback */
+	SK_LOG_BATCH_MAX = 64,
 };
 
 struct sk_log_msg {
-	/* Timestamp in nanoseconds */
+	/*
+	 * Timestamp in nanoseconds, see `enum sk_log_clock`. Holds cycles in the
+	 * ring of a SK_LOG_CLOCK_TSC logger, drivers always get nanoseconds.
+	 */
 	uint64_t ts_nsec;
 	/* Log level of the message */
 	enum sk_log_level level;
@@ -24,15 +35,64 @@ struct sk_log_msg {
 
 	/* Process and thread identifiers captured while logging the message  */
 	pid_t pid, tid;
+	/*
+	 * Name of the thread that logged the message, only known with
+	 * SK_LOGGER_RING_PER_THREAD, NULL otherwise.
+	 */
+	const char *thread;
+
+	/*
+	 * Format of the message while its payload holds packed arguments, see
+	 * SK_LOGGER_DEFERRED. Drivers always receive formatted messages where this
+	 * is NULL.
+	 */
+	const char *fmt;
+
+	/*
+	 * Number of typed fields encoded after the NUL terminated message in the
+	 * payload, see `sk_log_kv` and `sk_log_msg_kv`.
+	 */
+	uint8_t kv_count;
 
 	/* Message */
 	char payload[SK_LOG_MSG_MAX];
 };
 typedef struct sk_log_msg sk_log_msg_t;
 
+/*
+ * Decode the typed fields of a message logged with `sk_log_kv`.
+ *
+ * Keys and string values point into the payload of the message, they are
+ * valid as long as the message is.
+ *
+ * @param msg, message to decode
+ * @param kvs, array to decode into
+ * @param n, size of the array, SK_LOG_KV_MAX holds any message
+ *
+ * @return the number of decoded fields, 0 for a plain message
+ */
+size_t
+sk_log_msg_kv(const sk_log_msg_t *msg, sk_kv_t *kvs, size_t n)
+	sk_nonnull(1, 2);
+
+/*
+ * Size of the used part of a payload, the message and its encoded fields.
+ * Bytes of the payload past it are not part of the message, drivers must not
+ * read them, see `struct sk_logger_drv`.
+ *
+ * @param msg, formatted message
+ *
+ * @return the number of bytes to copy to preserve the message and its fields
+ */
+size_t
+sk_log_msg_payload_size(const sk_log_msg_t *msg) sk_nonnull(1);
+
 typedef bool (*sk_logger_open_fn_t)(sk_logger_drv_t *, sk_error_t *);
 typedef bool (*sk_logger_log_fn_t)(
 	sk_logger_drv_t *, sk_log_msg_t *, sk_error_t *);
+typedef bool (*sk_logger_log_batch_fn_t)(
+	sk_logger_drv_t *, sk_log_msg_t **, size_t, sk_error_t *);
+typedef bool (*sk_logger_flush_fn_t)(sk_logger_drv_t *, sk_error_t *);
 typedef void (*sk_logger_close_fn_t)(sk_logger_drv_t *);
 
 /*
@@ -41,6 +101,9 @@ typedef void (*sk_logger_close_fn_t)(sk_logger_drv_t *);
  * The driver decides how messages are handled; drivers will usually forward the
  * messages to a specific backed, e.g. syslog, console, files, ...
  *
+ * Members are only ever appended. Drivers must be zeroed before being filled,
+ * e.g. with a designated initializer, such that optional callbacks unknown to
+ * the code building them stay NULL. Builders are handed a zeroed driver.
  */
 struct sk_logger_drv {
 	/*
@@ -58,38 +121,176 @@ struct sk_logger_drv {
 	/*
 	 * Callback that process a message. It should return true on success or
 	 * false on failure and set the error message.
+	 *
+	 * Messages may point into the ring of the logger, they are only valid
+	 * during the call and their payload up to `sk_log_msg_payload_size`.
 	 */
 	sk_logger_log_fn_t log;
 	/* Callback that close the driver. */
 	sk_logger_close_fn_t close;
+	/*
+	 * Optional callback that process up to SK_LOG_BATCH_MAX messages in
+	 * order, preferred to `log` by the drain when set. It should return true
+	 * on success or false on failure and set the error message. Messages are
+	 * valid as with `log`.
+	 */
+	sk_logger_log_batch_fn_t log_batch;
+	/*
+	 * Optional callback invoked when the drain emptied the ring, such that
+	 * drivers buffering messages don't hold them while the logger is idle.
+	 */
+	sk_logger_flush_fn_t flush;
+	/* Name of the logger owning the driver, set by the logger before `open` */
+	const char *name;
+};
+
+enum {
+	/* Size of a thread name, see prctl(2) PR_GET_NAME */
+	SK_LOG_THREAD_NAME_MAX = 16,
 };
 
+/* A thread logging to a logger, its ring for SK_LOGGER_RING_PER_THREAD */
+struct sk_logger_producer {
+	/* Messages logged by the thread */
+	sk_ring_t ring;
+
+	/* Last record handed to the driver in place, only used by the drain */
+	void *peeked;
+
+	/* Identity of the thread owning the ring */
+	pid_t tid;
+	char thread[SK_LOG_THREAD_NAME_MAX];
+
+	/*
+	 * References of the thread and of the logger, the last one frees the
+	 * producer. The thread exited once only the logger's is left, the drain
+	 * then frees the producer when its ring is empty.
+	 */
+	int refs;
+	/* Next producer of the thread, see `log_thread_exit` */
+	struct sk_logger_producer *owned_next;
+	/* Identifier of the logger, matched by `logger_producer` */
+	uint64_t logger_id;
+
+	/* Message reserved by the thread when it can't be in the ring */
+	sk_log_msg_t staging;
+
+	/* Messages enqueued by the thread, only written by it */
+	uint64_t enqueued sk_cache_aligned;
+
+	CK_SLIST_ENTRY(sk_logger_producer) next;
+};
+typedef struct sk_logger_producer sk_logger_producer_t;
+
 /*
  * A logger is a ring buffer of messages to be processed by the driver.
  */
 struct sk_logger {
+	/*
+	 * Current minimum log level threshold. Must stay the first member, see
+	 * `sk_logger_is_enabled`.
+	 */
+	enum sk_log_level level;
+
 	/* Name of the logger */
 	char *name;
 
+	/*
+	 * Level set on the logger itself and the sequence of the change, see
+	 * `sk_logger_set_level`; the sequence is 0 while the level is inherited.
+	 * Protected by the levels lock.
+	 */
+	enum sk_log_level own_level;
+	uint64_t own_level_seq;
+
 	/* Various flags */
 	sk_flag_t flags;
 
-	/* Current minimum log level threshold */
-	enum sk_log_level level;
+	/* Source of timestamps */
+	enum sk_log_clock clock;
 
-	/* Ring buffer storing messages */
+	/* Ring buffer storing messages, see `enum sk_logger_ring` */
+	enum sk_logger_ring ring_type;
 	ck_ring_t ring;
 	size_t buf_size;
 	sk_log_msg_t *buf;
+	sk_ring_t records;
+	/* Allocation options of rings */
+	sk_mem_opts_t mem;
+	sk_log_flight_t flight;
+	/*
+	 * Last records of the variable length and spill rings handed to the
+	 * driver in place, released after the batch; only used by the drain.
+	 */
+	void *records_peeked, *spill_peeked;
+
+	/*
+	 * Threads logging to the logger, with their ring for
+	 * SK_LOGGER_RING_PER_THREAD. The list is only appended to under lock, the
+	 * drain walks it without lock.
+	 */
+	uint64_t id;
+	uint8_t producer_log_size;
+	pthread_mutex_t producers_lock;
+	CK_SLIST_HEAD(, sk_logger_producer) producers;
+	/* Next producer to drain from, only used by the drain */
+	sk_logger_producer_t *cursor;
 
 	/* Driver */
 	sk_logger_drv_t driver;
+
+	/* Set while a thread drains the logger, rings have a single consumer */
+	int draining;
+
+	/*
+	 * Backpressure, see `enum sk_logger_full_policy`. Dropped counters are
+	 * incremented by producers; the reported counters and the time of the
+	 * last report are owned by the drain.
+	 */
+	enum sk_logger_full_policy full_policy;
+	uint64_t block_timeout_nsec;
+	sk_ring_t spill;
+	uint64_t dropped[SK_LOG_COUNT];
+	uint64_t dropped_reported[SK_LOG_COUNT];
+	uint64_t drop_report_nsec;
+	uint64_t drop_reported_at;
+
+	/* Window of duplicates collapsed by the drain, see `coalesce_ms` */
+	uint64_t coalesce_nsec;
+
+	/*
+	 * Instrumentation, see `sk_logger_get_stats`. Producers count enqueued
+	 * messages on their own line, here only without a producer, and evicted
+	 * ones; the drain owns the others.
+	 */
+	uint64_t enqueued sk_cache_aligned;
+	uint64_t evicted sk_cache_aligned;
+	uint64_t drained;
+	uint64_t driver_errors;
+	uint64_t pending_high;
+	uint64_t latency[SK_LOGGER_LATENCY_BUCKETS];
+
+	/*
+	 * Drain runtime, see `sk_log_drain.h`. An idle worker arms the logger and
+	 * sleeps on the wakeup word, the next producer disarms it and wakes the
+	 * worker. The batch is the number of messages drained per pass.
+	 */
+	int armed sk_cache_aligned;
+	uint32_t *wakeup;
+	size_t batch;
+
+	/* Next logger of the registry */
+	CK_SLIST_ENTRY(sk_logger) next;
 };
 
 /*
  * Logger's ring buffer drain method.
  *
- * Each message will be processed by the driver log callback.
+ * Each message will be processed by the driver log callback. Only one thread
+ * drains a logger at a time, concurrent calls return immediately without
+ * draining. Messages dropped since the last report are reported with a
+ * synthetic message at the end of every pass, whether the ring is empty or
+ * not, at most every `drop_report_ms`; it's not counted in `drained`.
  *
  * @param logger, logger to drain message from
  * @param drained, counter to store the number of drained messages
@@ -102,6 +303,59 @@ bool
 sk_logger_drain(sk_logger_t *logger, size_t *drained, size_t maximum_drain, sk_error_t *error)
     sk_nonnull(1, 2, 4);
 
+/*
+ * Reserve a message to fill in place, e.g.
+ *
+ *   sk_log_msg_t *msg = sk_log_reserve(logger, SK_LOG_INFO, sk_debug);
+ *   if (msg != NULL) {
+ *       render(msg->payload, SK_LOG_MSG_MAX);
+ *       sk_log_commit(logger, msg);
+ *   }
+ *
+ * With SK_LOGGER_RING_VARIABLE and SK_LOGGER_RING_PER_THREAD, the message is
+ * a record of the ring and isn't copied until the driver; otherwise it's a
+ * message of the calling thread for this logger that the commit enqueues.
+ * The header of the message is set, the payload is left to the caller.
+ *
+ * The message must be committed or aborted before the thread reserves
+ * another one of the logger, and until then the drain doesn't get past it;
+ * the thread may log to the logger and to others meanwhile. Logging
+ * isn't async-signal-safe: a signal handler must not log while the thread it
+ * interrupted may be logging.
+ *
+ * @param logger, logger to log the message to
+ * @param level, level of the message
+ * @param debug, captured information of the caller, see sk_debug_t
+ *
+ * @return the message to fill, NULL if the level is disabled or there is no
+ *         memory for the message
+ */
+sk_log_msg_t *
+sk_log_reserve(sk_logger_t *logger, enum sk_log_level level, sk_debug_t debug)
+	sk_nonnull(1);
+
+/*
+ * Commit a message reserved with `sk_log_reserve`, its payload holding NUL
+ * terminated text. If the ring is full, the full policy of the logger
+ * applies.
+ *
+ * @param logger, logger the message was reserved from
+ * @param msg, reserved message
+ *
+ * @return true on success, false if the message was dropped
+ */
+bool
+sk_log_commit(sk_logger_t *logger, sk_log_msg_t *msg) sk_nonnull(1, 2);
+
+/*
+ * Give up a message reserved with `sk_log_reserve`, nothing is enqueued.
+ *
+ * @param logger, logger the message was reserved from
+ * @param msg, reserved message
+ */
+void
+sk_log_abort(sk_logger_t *logger, sk_log_msg_t *msg) sk_nonnull(1, 2);
+
 /*
  * A driver builder is a function and a context that instantiate drivers.
  *
@@ -172,7 +426,8 @@ sk_logger_drv_builder_tally(
 /*
  * Console driver
  *
- * Log message to stdout/stderr.
+ * Log message to stdout/stderr. Batches are written with a single writev(2)
+ * per run of messages going to the same stream.
  */
 struct sk_logger_drv_console_ctx {
 	/*
@@ -203,3 +458,274 @@ typedef struct sk_logger_drv_syslog_ctx sk_logger_drv_syslog_ctx_t;
 bool
 sk_logger_drv_builder_syslog(
 	sk_logger_drv_t *driver, void *ctx, sk_error_t *error) sk_nonnull(1, 2, 3);
+
+/*
+ * Syslog socket driver
+ *
+ * Send messages to the local syslog socket without syslog(3). Messages are
+ * formatted by the driver in RFC 3164 or RFC 5424, a batch is sent with a
+ * single sendmmsg(2). The socket is reconnected when syslogd restarts; while
+ * it is unreachable, batches fail and are lost. The context may be NULL.
+ */
+#define SK_LOGGER_DRV_SYSLOG_PATH "/dev/log"
+
+enum sk_logger_drv_syslog_format {
+	/* `<pri>Mmm dd hh:mm:ss ident[pid]: ...`, as syslog(3) */
+	SK_LOGGER_DRV_SYSLOG_RFC3164 = 0,
+	/* `<pri>1 timestamp host ident pid - - ...` */
+	SK_LOGGER_DRV_SYSLOG_RFC5424,
+};
+
+struct sk_logger_drv_syslog_socket_ctx {
+	/* Path of the socket, defaults to SK_LOGGER_DRV_SYSLOG_PATH */
+	const char *path;
+	/* Identity of messages, defaults to the program name */
+	const char *ident;
+	/* Facility of messages, see syslog(3), defaults to LOG_USER */
+	int facility;
+	enum sk_logger_drv_syslog_format format;
+};
+typedef struct sk_logger_drv_syslog_socket_ctx sk_logger_drv_syslog_socket_ctx_t;
+
+bool
+sk_logger_drv_builder_syslog_socket(
+	sk_logger_drv_t *driver, void *ctx, sk_error_t *error) sk_nonnull(1, 3);
+
+/*
+ * Remote driver
+ *
+ * Ship messages to a collector over TCP or UDP, a line per message:
+ * `<ts> <logger> <function> [<level>]: <payload> <fields>`.
+ *
+ * TCP frames are buffered up to `spill_size` bytes, covering outages of the
+ * collector; frames are dropped when full and a notice follows once there is
+ * room again. Batches are sent without blocking, the flush at the end of a
+ * drain run waits for the collector at most `budget_nsec`. Connections are
+ * non-blocking and retried with an exponential backoff.
+ *
+ * UDP frames are packed in datagrams of up to `mtu` bytes, and lost if the
+ * collector can't receive them.
+ */
+enum sk_logger_drv_remote_proto {
+	SK_LOGGER_DRV_REMOTE_TCP = 0,
+	SK_LOGGER_DRV_REMOTE_UDP,
+};
+
+enum sk_logger_drv_remote_framing {
+	/* Frames end with a newline, newlines of messages are replaced */
+	SK_LOGGER_DRV_REMOTE_NEWLINE = 0,
+	/* Frames start with their length on 4 bytes in network order */
+	SK_LOGGER_DRV_REMOTE_LENGTH,
+};
+
+enum {
+	SK_LOGGER_DRV_REMOTE_MTU = 1400,
+	SK_LOGGER_DRV_REMOTE_SPILL_SIZE = 1 << 20,
+};
+
+#define SK_LOGGER_DRV_REMOTE_BUDGET_NSEC (10 * 1000 * 1000ULL)
+#define SK_LOGGER_DRV_REMOTE_RECONNECT_MIN_NSEC (100 * 1000 * 1000ULL)
+#define SK_LOGGER_DRV_REMOTE_RECONNECT_MAX_NSEC (30 * 1000 * 1000 * 1000ULL)
+
+struct sk_logger_drv_remote_ctx {
+	/* Address of the collector, resolved when the driver opens */
+	const char *host;
+	const char *port;
+	enum sk_logger_drv_remote_proto proto;
+	enum sk_logger_drv_remote_framing framing;
+
+	/* Bound of a datagram, defaults to SK_LOGGER_DRV_REMOTE_MTU */
+	size_t mtu;
+	/* Bytes buffered for TCP, defaults to SK_LOGGER_DRV_REMOTE_SPILL_SIZE */
+	size_t spill_size;
+	/* Time a drain run may wait, SK_LOGGER_DRV_REMOTE_BUDGET_NSEC default */
+	uint64_t budget_nsec;
+	/* Delays between connection attempts, see the defaults above */
+	uint64_t reconnect_min_nsec;
+	uint64_t reconnect_max_nsec;
+};
+typedef struct sk_logger_drv_remote_ctx sk_logger_drv_remote_ctx_t;
+
+bool
+sk_logger_drv_builder_remote(
+	sk_logger_drv_t *driver, void *ctx, sk_error_t *error) sk_nonnull(1, 2, 3);
+
+/*
+ * JSON and logfmt drivers
+ *
+ * Write a line per message holding its timestamp, level, logger name, caller,
+ * process and thread identifiers, payload and typed fields, e.g.
+ *
+ *   {"ts":...,"level":"info","logger":"db",...,"msg":"login","user":42}
+ *   ts=... level=info logger=db ... msg=login user=42
+ *
+ * Lines of a batch are formatted in a reusable buffer and written at once.
+ * Both drivers take this context, which may be NULL.
+ */
+struct sk_logger_drv_json_ctx {
+	/* Stream to write to, stdout if NULL */
+	FILE *stream;
+};
+typedef struct sk_logger_drv_json_ctx sk_logger_drv_json_ctx_t;
+
+bool
+sk_logger_drv_builder_json(
+	sk_logger_drv_t *driver, void *ctx, sk_error_t *error) sk_nonnull(1, 3);
+
+bool
+sk_logger_drv_builder_logfmt(
+	sk_logger_drv_t *driver, void *ctx, sk_error_t *error) sk_nonnull(1, 3);
+
+/*
+ * Binary driver
+ *
+ * Append messages to a binary log file in blocks of length prefixed records,
+ * with a sparse time index in `<path>.idx`, see `sk_log_bin.h`. A block is
+ * written when full, and once the drain emptied the ring if its first record
+ * is older than `flush_ms`, such that an idle logger doesn't write a block
+ * per message. Files are read with `sk_log_bin_open` or the `sk-logcat` tool.
+ */
+struct sk_logger_drv_bin_ctx {
+	/* Path of the file, created if missing, appended to otherwise */
+	const char *path;
+	/* Permissions of created files, defaults to 0644 */
+	mode_t mode;
+	/* Size of a block, defaults to SK_LOG_BIN_BLOCK_SIZE */
+	uint32_t block_size;
+	/* Age of a block written before it's full, defaults to SK_LOG_BIN_FLUSH_MS */
+	uint32_t flush_ms;
+};
+typedef struct sk_logger_drv_bin_ctx sk_logger_drv_bin_ctx_t;
+
+bool
+sk_logger_drv_builder_bin(
+	sk_logger_drv_t *driver, void *ctx, sk_error_t *error) sk_nonnull(1, 2, 3);
+
+/*
+ * io_uring driver
+ *
+ * Write lines, as the file driver, to a file or a descriptor through
+ * io_uring. Lines are formatted in one of `depth` registered buffers while
+ * previous buffers are written asynchronously, in order; the drain only waits
+ * once every buffer waits to be written. A buffer is written when full, and
+ * when the drain emptied the ring. Falls back to write(2) when io_uring is
+ * unavailable, e.g. old kernels or seccomp.
+ */
+enum {
+	/* Default number of buffers */
+	SK_LOGGER_DRV_URING_DEPTH = 4,
+	/* Default size of a buffer */
+	SK_LOGGER_DRV_URING_BUF_SIZE = 256 * 1024,
+};
+
+struct sk_logger_drv_uring_ctx {
+	/* Path of a file to append to, created if missing */
+	const char *path;
+	/* Permissions of a created file, defaults to 0644 */
+	mode_t mode;
+	/* Descriptor written to if `path` is NULL, e.g. a socket, not closed */
+	int fd;
+
+	/* Number of buffers, defaults to SK_LOGGER_DRV_URING_DEPTH */
+	uint32_t depth;
+	/* Size of a buffer, defaults to SK_LOGGER_DRV_URING_BUF_SIZE */
+	size_t buf_size;
+
+	/* Always write with write(2) */
+	bool no_uring;
+};
+typedef struct sk_logger_drv_uring_ctx sk_logger_drv_uring_ctx_t;
+
+bool
+sk_logger_drv_builder_uring(
+	sk_logger_drv_t *driver, void *ctx, sk_error_t *error) sk_nonnull(1, 2, 3);
+
+/*
+ * Tee driver
+ *
+ * Fan messages out to several sinks, each a driver receiving the messages of
+ * its level or more severe. A sink may have a queue drained by a thread of
+ * its own: the drain never waits on it, and a slow or blocked sink only drops
+ * its own messages, which are reported to it once it caught up. Sinks without
+ * a queue are called by the drain in order.
+ */
+struct sk_logger_drv_tee_sink {
+	/* Builder and context of the driver of the sink */
+	sk_logger_drv_builder_fn_t builder;
+	void *ctx;
+	/* Least severe level forwarded to the sink */
+	enum sk_log_level level;
+	/* Size of the queue, 2^queue_log_size bytes, 0 for no queue */
+	uint8_t queue_log_size;
+};
+typedef struct sk_logger_drv_tee_sink sk_logger_drv_tee_sink_t;
+
+struct sk_logger_drv_tee_ctx {
+	/* Sinks, built by the tee builder */
+	const sk_logger_drv_tee_sink_t *sinks;
+	size_t n_sinks;
+};
+typedef struct sk_logger_drv_tee_ctx sk_logger_drv_tee_ctx_t;
+
+bool
+sk_logger_drv_builder_tee(
+	sk_logger_drv_t *driver, void *ctx, sk_error_t *error) sk_nonnull(1, 2, 3);
+
+/*
+ * File driver
+ *
+ * Append messages to a file through a large buffer. The buffer is written
+ * when full, and when the drain emptied the ring. Rotation and reopening
+ * happen in the drain, producers never wait on the file.
+ */
+enum sk_logger_drv_file_sync {
+	/* Never sync, leave it to the kernel */
+	SK_LOGGER_DRV_FILE_SYNC_NEVER = 0,
+	/* fdatasync(2) every `sync_bytes` written */
+	SK_LOGGER_DRV_FILE_SYNC_BYTES,
+	/* fdatasync(2) after a batch holding a message of SK_LOG_ERROR or above */
+	SK_LOGGER_DRV_FILE_SYNC_ERROR,
+};
+
+enum {
+	/* Default size of the buffer */
+	SK_LOGGER_DRV_FILE_BUF_SIZE = 1 << 20,
+};
+
+struct sk_logger_drv_file_ctx {
+	/* Path of the file, created if missing */
+	const char *path;
+	/* Permissions of a created file, defaults to 0644 */
+	mode_t mode;
+	/* Size of the buffer, defaults to SK_LOGGER_DRV_FILE_BUF_SIZE */
+	size_t buf_size;
+
+	/*
+	 * Rotate when the file reaches `rotate_size` bytes, or `rotate_sec`
+	 * seconds after it was opened; 0 disables either. The file is renamed
+	 * `path.1` after shifting previous ones, up to `path.<rotate_keep>`
+	 * which defaults to 1.
+	 */
+	size_t rotate_size;
+	uint32_t rotate_sec;
+	uint8_t rotate_keep;
+
+	/* Durability of written messages */
+	enum sk_logger_drv_file_sync sync;
+	size_t sync_bytes;
+
+	/* Install a SIGHUP handler calling `sk_logger_drv_file_reopen` */
+	bool reopen_on_sighup;
+};
+typedef struct sk_logger_drv_file_ctx sk_logger_drv_file_ctx_t;
+
+bool
+sk_logger_drv_builder_file(
+	sk_logger_drv_t *driver, void *ctx, sk_error_t *error) sk_nonnull(1, 2, 3);
+
+/*
+ * Reopen the files of every file driver, e.g. after an external rotation.
+ * Files are reopened by their next write. Async signal safe.
+ */
+void
+sk_logger_drv_file_reopen(void);
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sk_cc.h>
+#include <sk_error.h>
+
+/*
+ * Allocation of large, long lived buffers such as rings, with control over
+ * their pages: huge pages avoid TLB misses, prefaulting and locking avoid
+ * page faults on the first writes, and binding keeps them on a NUMA node.
+ */
+enum sk_mem_flags {
+	/*
+	 * Back with huge pages of the reserved pool, see MAP_HUGETLB. Falls back
+	 * to SK_MEM_THP when the pool is empty.
+	 */
+	SK_MEM_HUGETLB = 1 << 0,
+	/* Advise transparent huge pages, see MADV_HUGEPAGE */
+	SK_MEM_THP = 1 << 1,
+	/* Fault every page in at allocation */
+	SK_MEM_POPULATE = 1 << 2,
+	/* Lock pages in memory, see mlock(2); implies SK_MEM_POPULATE */
+	SK_MEM_MLOCK = 1 << 3,
+	/* Bind pages to `numa_node`, see mbind(2) */
+	SK_MEM_NUMA = 1 << 4,
+};
+
+enum {
+	/* Size of huge pages, allocations with huge pages are rounded to it */
+	SK_MEM_HUGE_PAGE_SIZE = 2 * 1024 * 1024,
+	/* Bound of NUMA nodes */
+	SK_MEM_NUMA_NODES_MAX = 1024,
+};
+
+struct sk_mem_opts {
+	/* See `enum sk_mem_flags`, 0 for plain calloc(3) */
+	uint32_t flags;
+	/* Node of SK_MEM_NUMA */
+	uint16_t numa_node;
+};
+typedef struct sk_mem_opts sk_mem_opts_t;
+
+/*
+ * Allocate zeroed memory.
+ *
+ * @param size, size of the allocation
+ * @param opts, options of the allocation, NULL for plain calloc(3)
+ * @param error, error to store failure information
+ *
+ * @return the memory, to free with `sk_mem_free` and the same options, NULL
+ *         on failure and set error
+ *
+ * @errors SK_ERROR_ENOMEM, if memory allocation failed or can't be locked
+ *         SK_ERROR_EINVAL, if the NUMA node is invalid
+ */
+void *
+sk_mem_alloc(size_t size, const sk_mem_opts_t *opts, sk_error_t *error)
+	sk_nonnull(3);
+
+/*
+ * Free memory allocated by `sk_mem_alloc`.
+ *
+ * @param mem, memory to free, may be NULL
+ * @param size, size of the allocation
+ * @param opts, options of the allocation
+ */
+void
+sk_mem_free(void *mem, size_t size, const sk_mem_opts_t *opts);
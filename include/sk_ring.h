@@ -0,0 +1,239 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sk_cc.h>
+#include <sk_error.h>
+#include <sk_mem.h>
+
+/*
+ * A ring of variable length records.
+ *
+ * Multiple producers reserve space for a record, fill it in place and commit
+ * it. A single consumer peeks at the oldest record and releases it once
+ * processed, or walks several records in place before releasing them. A
+ * record takes an 8 bytes header plus its length rounded to 8 bytes; records
+ * never straddle the end of the buffer, the tail end is padded instead.
+ *
+ * Records are returned in reservation order. A consumer stops at the first
+ * reserved but not yet committed record, even if later records are committed.
+ */
+struct sk_ring {
+	/* Consumer position in bytes, only moved by the consumer */
+	uint64_t head sk_cache_aligned;
+	/* Producers reservation position in bytes */
+	uint64_t tail sk_cache_aligned;
+
+	/* Capacity in bytes, a power of 2 */
+	size_t size sk_cache_aligned;
+	size_t mask;
+	char *buf;
+	/* Allocation options of the buffer */
+	sk_mem_opts_t mem;
+};
+typedef struct sk_ring sk_ring_t;
+
+enum {
+	/* Minimum size of a ring */
+	SK_RING_SIZE_MIN = 6,
+	/* Maximum size of a ring */
+	SK_RING_SIZE_MAX = 32,
+};
+
+/*
+ * Initialize a ring.
+ *
+ * @param ring, ring to initialize
+ * @param log_size, capacity of 2^log_size bytes
+ * @param error, error to store failure information
+ *
+ * @return true on success, false otherwise and set error
+ *
+ * @errors SK_ERROR_EINVAL, if log_size is not in [SK_RING_SIZE_MIN,
+ *                          SK_RING_SIZE_MAX]
+ *         SK_ERROR_ENOMEM, if memory allocation failed
+ */
+bool
+sk_ring_init(sk_ring_t *ring, uint8_t log_size, sk_error_t *error)
+	sk_nonnull(1, 3);
+
+/*
+ * Initialize a ring whose buffer is allocated with `sk_mem_alloc`.
+ *
+ * @param ring, ring to initialize
+ * @param log_size, capacity of 2^log_size bytes
+ * @param mem, allocation options of the buffer, NULL for calloc(3)
+ * @param error, error to store failure information
+ *
+ * @return true on success, false otherwise and set error
+ *
+ * @errors see `sk_ring_init` and `sk_mem_alloc`
+ */
+bool
+sk_ring_init_mem(sk_ring_t *ring, uint8_t log_size, const sk_mem_opts_t *mem,
+	sk_error_t *error) sk_nonnull(1, 4);
+
+/*
+ * Free a ring.
+ *
+ * @param ring, ring to free
+ */
+void
+sk_ring_destroy(sk_ring_t *ring) sk_nonnull(1);
+
+/*
+ * Maximum length of a record that a ring accepts.
+ *
+ * @param ring, ring to query
+ *
+ * @return the maximum record length in bytes
+ */
+size_t
+sk_ring_record_max(const sk_ring_t *ring) sk_nonnull(1);
+
+/*
+ * Reserve a record. Safe to call from multiple producers.
+ *
+ * The record must be committed with `sk_ring_commit`; until then the consumer
+ * can't make progress past it.
+ *
+ * @param ring, ring to reserve into
+ * @param len, length of the record
+ *
+ * @return pointer to 8 bytes aligned storage of len bytes, or NULL if the ring
+ *         is full or len is greater than `sk_ring_record_max`
+ */
+void *
+sk_ring_reserve(sk_ring_t *ring, size_t len) sk_nonnull(1);
+
+/*
+ * Reserve a record. Only safe from a single producer.
+ *
+ * Same as `sk_ring_reserve` without the atomic read-modify-write.
+ *
+ * @param ring, ring to reserve into
+ * @param len, length of the record
+ *
+ * @return pointer to 8 bytes aligned storage of len bytes, or NULL if the ring
+ *         is full or len is greater than `sk_ring_record_max`
+ */
+void *
+sk_ring_reserve_sp(sk_ring_t *ring, size_t len) sk_nonnull(1);
+
+/*
+ * Commit a reserved record, making it visible to the consumer.
+ *
+ * @param ring, ring the record was reserved into
+ * @param record, record returned by `sk_ring_reserve`
+ */
+void
+sk_ring_commit(sk_ring_t *ring, void *record) sk_nonnull(1, 2);
+
+/*
+ * Commit a reserved record shortened to `len`, e.g. reserved for the longest
+ * record and filled with less. The rest of the reservation is handed back to
+ * producers, or skipped by the consumer if a later record was reserved.
+ *
+ * @param ring, ring the record was reserved into
+ * @param record, record returned by `sk_ring_reserve`
+ * @param len, length of the record, at most the reserved length
+ */
+void
+sk_ring_commit_len(sk_ring_t *ring, void *record, size_t len)
+	sk_nonnull(1, 2);
+
+/*
+ * Abort a reserved record, the consumer never sees it.
+ *
+ * @param ring, ring the record was reserved into
+ * @param record, record returned by `sk_ring_reserve`
+ */
+void
+sk_ring_abort(sk_ring_t *ring, void *record) sk_nonnull(1, 2);
+
+/*
+ * Copy a record into the ring.
+ *
+ * @param ring, ring to enqueue into
+ * @param record, record to copy
+ * @param len, length of the record
+ *
+ * @return true on success, false if the ring is full
+ */
+bool
+sk_ring_enqueue(sk_ring_t *ring, const void *record, size_t len)
+	sk_nonnull(1, 2);
+
+/*
+ * Copy a record into the ring. Only safe from a single producer.
+ *
+ * @param ring, ring to enqueue into
+ * @param record, record to copy
+ * @param len, length of the record
+ *
+ * @return true on success, false if the ring is full
+ */
+bool
+sk_ring_enqueue_sp(sk_ring_t *ring, const void *record, size_t len)
+	sk_nonnull(1, 2);
+
+/*
+ * Peek at the oldest committed record. Only safe from a single consumer.
+ *
+ * @param ring, ring to peek into
+ * @param len, length of the record
+ *
+ * @return pointer to the record, or NULL if there's no committed record
+ */
+void *
+sk_ring_peek(sk_ring_t *ring, size_t *len) sk_nonnull(1, 2);
+
+/*
+ * Peek at the committed record following a peeked one, without releasing
+ * either. Only safe from a single consumer.
+ *
+ * @param ring, ring to peek into
+ * @param record, record returned by `sk_ring_peek` or `sk_ring_peek_next`
+ * @param len, length of the record
+ *
+ * @return pointer to the record, or NULL if there's no committed record
+ */
+void *
+sk_ring_peek_next(sk_ring_t *ring, void *record, size_t *len)
+	sk_nonnull(1, 2, 3);
+
+/*
+ * Release a peeked record and the ones before it, freeing their space.
+ *
+ * @param ring, ring to release from
+ * @param record, record returned by `sk_ring_peek` or `sk_ring_peek_next`
+ */
+void
+sk_ring_release(sk_ring_t *ring, void *record) sk_nonnull(1, 2);
+
+/*
+ * Copy out and release the oldest committed record.
+ *
+ * @param ring, ring to dequeue from
+ * @param record, buffer to copy the record into
+ * @param len, capacity of record on input, length of the record on output
+ *
+ * @return true on success, false if there's no committed record or the record
+ *         doesn't fit, in which case it's left in place and len is set to its
+ *         length
+ */
+bool
+sk_ring_dequeue(sk_ring_t *ring, void *record, size_t *len)
+	sk_nonnull(1, 2, 3);
+
+/*
+ * Number of bytes used by records, including headers and padding.
+ *
+ * @param ring, ring to query
+ *
+ * @return bytes in use
+ */
+size_t
+sk_ring_used(const sk_ring_t *ring) sk_nonnull(1);
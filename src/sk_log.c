@@ -1,18 +1,29 @@
+#include <assert.h>
+#include <fnmatch.h>
+#include <inttypes.h>
+#include <regex.h>
+#include <sched.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/prctl.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
 #include <time.h>
 #include <unistd.h>
 
 #include <ck_pr.h>
+#include <ck_queue.h>
+#include <ck_rwlock.h>
 
 #include <sk_flag.h>
 #include <sk_log.h>
 #include <sk_logger_drv.h>
 
+#include "sk_log_priv.h"
+
 // clang-format off
 static const char *level_labels[] = {
 	[SK_LOG_EMERGENCY] = "emergency",
@@ -26,70 +37,1268 @@ static const char *level_labels[] = {
 };
 // clang-format on
 
-const char *
-sk_log_level_str(enum sk_log_level level)
+const char *
+sk_log_level_str(enum sk_log_level level)
+{
+	return (level < SK_LOG_COUNT) ? level_labels[level] : NULL;
+}
+
+CK_RING_PROTOTYPE(msg, sk_log_msg)
+
+/* Size of a message in the ring given its payload size */
+#define SK_LOG_MSG_SIZE(payload_size)                                          \
+	(offsetof(sk_log_msg_t, payload) + (payload_size))
+
+enum {
+	/* Producer rings cached per thread, see `logger_producer` */
+	LOG_THREAD_CACHE_SIZE = 8,
+	/* Attempts to make room with SK_LOGGER_FULL_DROP_OLDEST */
+	LOG_EVICT_RETRIES = 16,
+};
+
+static inline uint64_t
+log_clock_ns(clockid_t clock)
+{
+	struct timespec time;
+	clock_gettime(clock, &time);
+
+	return (uint64_t)time.tv_sec * 1000000000 + (uint64_t)time.tv_nsec;
+}
+
+/* Monotonic time in nanoseconds, for timeouts and intervals */
+static inline uint64_t
+log_monotonic(void)
+{
+	return log_clock_ns(CLOCK_MONOTONIC);
+}
+
+/* Timestamp of a message, in cycles for SK_LOG_CLOCK_TSC */
+static inline uint64_t
+logger_timestamp(const sk_logger_t *logger)
+{
+	switch (logger->clock) {
+	case SK_LOG_CLOCK_REALTIME:
+		return log_clock_ns(CLOCK_REALTIME);
+	case SK_LOG_CLOCK_REALTIME_COARSE:
+		return log_clock_ns(CLOCK_REALTIME_COARSE);
+	case SK_LOG_CLOCK_MONOTONIC:
+		return log_clock_ns(CLOCK_MONOTONIC);
+	case SK_LOG_CLOCK_TSC:
+		return sk_log_tsc_read();
+	}
+
+	return 0;
+}
+
+/* Convert a timestamp of `logger_timestamp` to nanoseconds */
+static inline uint64_t
+logger_timestamp_ns(const sk_logger_t *logger, uint64_t ts)
+{
+	return (logger->clock == SK_LOG_CLOCK_TSC) ? sk_log_tsc_to_ns(ts) : ts;
+}
+
+/* Identity of the calling thread and its recently used producer rings */
+struct log_thread {
+	pid_t pid, tid;
+	char name[SK_LOG_THREAD_NAME_MAX];
+
+	struct {
+		uint64_t logger_id;
+		sk_logger_producer_t *producer;
+	} producers[LOG_THREAD_CACHE_SIZE];
+	/* Every producer of the thread, released when it exits */
+	sk_logger_producer_t *owned;
+};
+
+static __thread struct log_thread log_self;
+
+/* Unique logger identifiers, such that stale thread caches never match */
+static uint64_t logger_ids;
+
+/* Registry of live loggers */
+static ck_rwlock_t loggers_lock = CK_RWLOCK_INITIALIZER;
+static CK_SLIST_HEAD(, sk_logger) loggers = CK_SLIST_HEAD_INITIALIZER(loggers);
+
+size_t
+sk_loggers_foreach(size_t (*fn)(sk_logger_t *, void *), void *ctx)
+{
+	sk_logger_t *logger;
+	size_t sum = 0;
+
+	ck_rwlock_read_lock(&loggers_lock);
+	CK_SLIST_FOREACH(logger, &loggers, next)
+	{
+		sum += fn(logger, ctx);
+	}
+	ck_rwlock_read_unlock(&loggers_lock);
+
+	return sum;
+}
+
+/*
+ * Levels given to loggers by name patterns, see `sk_logger_set_level_match`.
+ * Protected by the levels lock, newest first.
+ */
+struct level_rule {
+	char *pattern;
+	bool is_regex;
+	regex_t regex;
+
+	enum sk_log_level level;
+	uint64_t seq;
+
+	CK_SLIST_ENTRY(level_rule) next;
+};
+
+static CK_SLIST_HEAD(, level_rule)
+	level_rules = CK_SLIST_HEAD_INITIALIZER(level_rules);
+
+/* Orders level changes, the latest applying to a name wins */
+static uint64_t level_seq;
+
+/*
+ * Serializes level changes. Taken before the read side of the registry lock,
+ * such that changing levels doesn't wait for drain workers to leave drivers.
+ */
+static pthread_mutex_t levels_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static bool
+level_rule_match(const struct level_rule *rule, const char *name)
+{
+	if (rule->is_regex)
+		return regexec(&rule->regex, name, 0, NULL, 0) == 0;
+
+	return fnmatch(rule->pattern, name, 0) == 0;
+}
+
+static void
+level_rule_free(struct level_rule *rule)
+{
+	if (rule->is_regex)
+		regfree(&rule->regex);
+	free(rule->pattern);
+	free(rule);
+}
+
+/*
+ * Find the latest level set on a name, either on `self` or on any logger of
+ * that name if NULL, or by a pattern matching the name.
+ */
+static bool
+level_lookup(const char *name, const sk_logger_t *self, enum sk_log_level *level)
+{
+	const struct level_rule *rule;
+	const sk_logger_t *logger;
+	uint64_t seq = 0;
+
+	if (self != NULL && self->own_level_seq != 0) {
+		seq = self->own_level_seq;
+		*level = self->own_level;
+	}
+
+	if (self == NULL) {
+		CK_SLIST_FOREACH(logger, &loggers, next)
+		{
+			if (logger->own_level_seq > seq &&
+				strcmp(logger->name, name) == 0) {
+				seq = logger->own_level_seq;
+				*level = logger->own_level;
+			}
+		}
+	}
+
+	CK_SLIST_FOREACH(rule, &level_rules, next)
+	{
+		/* Rules are sorted by decreasing sequence */
+		if (rule->seq <= seq)
+			break;
+		if (level_rule_match(rule, name)) {
+			seq = rule->seq;
+			*level = rule->level;
+			break;
+		}
+	}
+
+	return seq != 0;
+}
+
+/*
+ * Effective level of a logger: the latest level set on its name, else the one
+ * of its closest ancestor, e.g. `a.b` then `a` for `a.b.c`.
+ */
+static enum sk_log_level
+logger_level_resolve(const sk_logger_t *logger)
+{
+	enum sk_log_level level = SK_LOG_DEFAULT_LEVEL;
+
+	char *name = strdup(logger->name);
+	if (name == NULL)
+		return ck_pr_load_int((const int *)&logger->level);
+
+	const sk_logger_t *self = logger;
+	char *end = name + strlen(name);
+	do {
+		*end = '\0';
+		if (level_lookup(name, self, &level))
+			break;
+		self = NULL;
+	} while ((end = strrchr(name, '.')) != NULL);
+
+	free(name);
+
+	return level;
+}
+
+/* Apply levels to every logger, the levels lock must be held */
+static void
+loggers_levels_update(void)
+{
+	sk_logger_t *logger;
+
+	ck_rwlock_read_lock(&loggers_lock);
+	CK_SLIST_FOREACH(logger, &loggers, next)
+	{
+		ck_pr_store_int((int *)&logger->level, logger_level_resolve(logger));
+	}
+	ck_rwlock_read_unlock(&loggers_lock);
+}
+
+/* Apply levels after a logger joined or left the registry */
+static void
+loggers_levels_refresh(void)
+{
+	pthread_mutex_lock(&levels_lock);
+	loggers_levels_update();
+	pthread_mutex_unlock(&levels_lock);
+}
+
+sk_logger_t *
+sk_logger_find(const char *name)
+{
+	sk_logger_t *logger;
+
+	ck_rwlock_read_lock(&loggers_lock);
+	CK_SLIST_FOREACH(logger, &loggers, next)
+	{
+		if (strcmp(logger->name, name) == 0)
+			break;
+	}
+	ck_rwlock_read_unlock(&loggers_lock);
+
+	return logger;
+}
+
+static bool
+level_rule_add(const char *pattern, bool is_regex, enum sk_log_level level,
+	sk_error_t *error)
+{
+	struct level_rule *rule, *old;
+
+	if (level >= SK_LOG_COUNT)
+		return sk_error_msg_code(error, "invalid level", SK_ERROR_EINVAL);
+
+	if ((rule = calloc(1, sizeof(*rule))) == NULL)
+		return sk_error_msg_code(
+			error, "level rule calloc failed", SK_ERROR_ENOMEM);
+
+	if ((rule->pattern = strdup(pattern)) == NULL) {
+		sk_error_msg_code(error, "pattern strdup failed", SK_ERROR_ENOMEM);
+		goto failed_pattern;
+	}
+
+	if (is_regex) {
+		/* Patterns match whole names */
+		const size_t size = strlen(pattern) + sizeof("^()$");
+		char *anchored = malloc(size);
+		if (anchored == NULL) {
+			sk_error_msg_code(
+				error, "pattern malloc failed", SK_ERROR_ENOMEM);
+			goto failed_regex;
+		}
+		snprintf(anchored, size, "^(%s)$", pattern);
+		const int ret =
+			regcomp(&rule->regex, anchored, REG_EXTENDED | REG_NOSUB);
+		free(anchored);
+		if (ret != 0) {
+			sk_error_msg_code(error, "invalid regex", SK_ERROR_EINVAL);
+			goto failed_regex;
+		}
+	}
+
+	rule->is_regex = is_regex;
+	rule->level = level;
+
+	pthread_mutex_lock(&levels_lock);
+	/* A pattern given again replaces the previous rule */
+	CK_SLIST_FOREACH(old, &level_rules, next)
+	{
+		if (old->is_regex == is_regex && strcmp(old->pattern, pattern) == 0)
+			break;
+	}
+	if (old != NULL)
+		CK_SLIST_REMOVE(&level_rules, old, level_rule, next);
+
+	rule->seq = ++level_seq;
+	CK_SLIST_INSERT_HEAD(&level_rules, rule, next);
+	loggers_levels_update();
+	pthread_mutex_unlock(&levels_lock);
+
+	if (old != NULL)
+		level_rule_free(old);
+
+	return true;
+
+failed_regex:
+	free(rule->pattern);
+failed_pattern:
+	free(rule);
+	return false;
+}
+
+bool
+sk_logger_set_level_match(
+	const char *pattern, enum sk_log_level level, sk_error_t *error)
+{
+	return level_rule_add(pattern, false, level, error);
+}
+
+bool
+sk_logger_set_level_regex(
+	const char *regex, enum sk_log_level level, sk_error_t *error)
+{
+	return level_rule_add(regex, true, level, error);
+}
+
+void
+sk_logger_reset_level_match(void)
+{
+	pthread_mutex_lock(&levels_lock);
+	while (!CK_SLIST_EMPTY(&level_rules)) {
+		struct level_rule *rule = CK_SLIST_FIRST(&level_rules);
+		CK_SLIST_REMOVE_HEAD(&level_rules, next);
+		level_rule_free(rule);
+	}
+	loggers_levels_update();
+	pthread_mutex_unlock(&levels_lock);
+}
+
+/* Drop a reference to a producer, the last one frees it */
+static void
+logger_producer_put(sk_logger_producer_t *producer)
+{
+	if (ck_pr_faa_int(&producer->refs, -1) != 1)
+		return;
+
+	sk_ring_destroy(&producer->ring);
+	free(producer);
+}
+
+static inline bool
+logger_producer_exited(const sk_logger_producer_t *producer)
+{
+	return ck_pr_load_int((int *)&producer->refs) == 1;
+}
+
+/* Key whose destructor releases the producers of exiting threads */
+static pthread_key_t log_thread_key;
+
+static void
+log_thread_exit(void *opaque)
+{
+	struct log_thread *self = opaque;
+	sk_logger_producer_t *producer = self->owned, *next;
+
+	for (; producer != NULL; producer = next) {
+		next = producer->owned_next;
+		logger_producer_put(producer);
+	}
+
+	memset(self->producers, 0, sizeof(self->producers));
+	self->owned = NULL;
+}
+
+static void
+log_thread_atfork_child(void)
+{
+	/* The child inherits the cache of the forking thread, but not its ids */
+	log_self.pid = 0;
+	log_self.tid = 0;
+}
+
+sk_constructor static void
+log_init(void)
+{
+	pthread_atfork(NULL, NULL, log_thread_atfork_child);
+	pthread_key_create(&log_thread_key, log_thread_exit);
+}
+
+static inline struct log_thread *
+log_thread(void)
+{
+	struct log_thread *self = &log_self;
+
+	if (sk_unlikely(self->tid == 0)) {
+		self->pid = getpid();
+		self->tid = syscall(SYS_gettid);
+		if (prctl(PR_GET_NAME, self->name) == -1)
+			self->name[0] = '\0';
+	}
+
+	return self;
+}
+
+/* Check that a variable length ring of 2^log_size holds any message */
+static bool
+records_log_size_valid(uint8_t log_size, sk_error_t *error)
+{
+	if (log_size < SK_RING_SIZE_MIN || log_size > SK_RING_SIZE_MAX)
+		return sk_error_msg_code(
+			error, "ring log_size out of range", SK_ERROR_EINVAL);
+
+	const sk_ring_t ring = {.size = (size_t)1 << log_size};
+	if (sk_ring_record_max(&ring) < sizeof(sk_log_msg_t))
+		return sk_error_msg_code(
+			error, "log_size too small for a message", SK_ERROR_EINVAL);
+
+	return true;
+}
+
+/*
+ * Find or allocate the producer of the calling thread, slow path of sk_log.
+ * Only producers of SK_LOGGER_RING_PER_THREAD have a ring.
+ */
+static sk_logger_producer_t *
+logger_producer_find(sk_logger_t *logger, struct log_thread *self)
+{
+	sk_logger_producer_t *producer;
+	sk_error_t error;
+
+	pthread_mutex_lock(&logger->producers_lock);
+
+	/* A thread id is only reused once its previous owner exited */
+	CK_SLIST_FOREACH(producer, &logger->producers, next)
+	{
+		if (producer->tid == self->tid && !logger_producer_exited(producer)) {
+			/* The name may have changed since */
+			memcpy(producer->thread, self->name, sizeof(producer->thread));
+			goto unlock;
+		}
+	}
+
+	if ((producer = calloc(1, sizeof(*producer))) == NULL)
+		goto unlock;
+
+	if (logger->ring_type == SK_LOGGER_RING_PER_THREAD &&
+		!sk_ring_init_mem(&producer->ring, logger->producer_log_size,
+			&logger->mem, &error)) {
+		free(producer);
+		producer = NULL;
+		goto unlock;
+	}
+
+	producer->tid = self->tid;
+	memcpy(producer->thread, self->name, sizeof(producer->thread));
+	producer->refs = 2;
+	producer->logger_id = logger->id;
+	CK_SLIST_INSERT_HEAD(&logger->producers, producer, next);
+
+	if (self->owned == NULL)
+		pthread_setspecific(log_thread_key, self);
+	producer->owned_next = self->owned;
+	self->owned = producer;
+
+unlock:
+	pthread_mutex_unlock(&logger->producers_lock);
+
+	return producer;
+}
+
+/*
+ * Producer of the calling thread. Loggers colliding in the cache walk the
+ * producers owned by the thread, only the first log of a thread to a logger
+ * takes `producers_lock`.
+ */
+static inline sk_logger_producer_t *
+logger_producer(sk_logger_t *logger)
+{
+	struct log_thread *self = log_thread();
+	const size_t slot = logger->id % LOG_THREAD_CACHE_SIZE;
+	sk_logger_producer_t *producer;
+
+	if (sk_likely(self->producers[slot].logger_id == logger->id))
+		return self->producers[slot].producer;
+
+	for (producer = self->owned; producer != NULL;
+		 producer = producer->owned_next)
+		if (producer->logger_id == logger->id)
+			break;
+
+	if (producer == NULL)
+		producer = logger_producer_find(logger, self);
+	if (producer != NULL) {
+		self->producers[slot].logger_id = logger->id;
+		self->producers[slot].producer = producer;
+	}
+
+	return producer;
+}
+
+static bool
+logger_ring_init(
+	sk_logger_t *logger, const sk_logger_opts_t *opts, sk_error_t *error)
+{
+	const uint8_t log_size = opts->log_size;
+	const size_t ring_size = (size_t)1 << log_size;
+
+	/* Applies to every ring of the logger */
+	logger->mem = opts->mem;
+
+	pthread_mutex_init(&logger->producers_lock, NULL);
+	CK_SLIST_INIT(&logger->producers);
+
+	switch (opts->ring) {
+	case SK_LOGGER_RING_FIXED:
+		if (log_size > SK_LOGGER_RING_MAX)
+			return sk_error_msg_code(
+				error, "log_size > SK_LOGGER_RING_MAX", SK_ERROR_EINVAL);
+
+		if ((logger->buf = sk_mem_alloc(sizeof(sk_log_msg_t) * ring_size,
+				 &logger->mem, error)) == NULL)
+			return false;
+
+		logger->buf_size = ring_size;
+		ck_ring_init(&logger->ring, ring_size);
+		break;
+	case SK_LOGGER_RING_VARIABLE:
+		if (!records_log_size_valid(log_size, error) ||
+			!sk_ring_init_mem(&logger->records, log_size, &logger->mem, error))
+			return false;
+		break;
+	case SK_LOGGER_RING_PER_THREAD:
+		if (!records_log_size_valid(log_size, error))
+			return false;
+
+		logger->producer_log_size = log_size;
+		break;
+	case SK_LOGGER_RING_FLIGHT:
+		if (opts->path == NULL)
+			return sk_error_msg_code(
+				error, "flight ring requires a path", SK_ERROR_EINVAL);
+
+		if (!sk_log_flight_init(
+				&logger->flight, opts->path, logger->name, log_size, error))
+			return false;
+		break;
+	default:
+		return sk_error_msg_code(error, "unknown ring type", SK_ERROR_EINVAL);
+	}
+
+	logger->ring_type = opts->ring;
+
+	return true;
+}
+
+static void
+logger_ring_destroy(sk_logger_t *logger)
+{
+	switch (logger->ring_type) {
+	case SK_LOGGER_RING_FIXED:
+		sk_mem_free(
+			logger->buf, sizeof(sk_log_msg_t) * logger->buf_size, &logger->mem);
+		break;
+	case SK_LOGGER_RING_VARIABLE:
+		sk_ring_destroy(&logger->records);
+		break;
+	case SK_LOGGER_RING_PER_THREAD:
+		break;
+	case SK_LOGGER_RING_FLIGHT:
+		sk_log_flight_destroy(&logger->flight);
+		break;
+	}
+
+	/* Live threads keep their producers, without ring, until they exit */
+	while (!CK_SLIST_EMPTY(&logger->producers)) {
+		sk_logger_producer_t *producer = CK_SLIST_FIRST(&logger->producers);
+		CK_SLIST_REMOVE_HEAD(&logger->producers, next);
+		sk_ring_destroy(&producer->ring);
+		logger_producer_put(producer);
+	}
+	pthread_mutex_destroy(&logger->producers_lock);
+
+	if (logger->spill.buf != NULL)
+		sk_ring_destroy(&logger->spill);
+}
+
+static bool
+logger_clock_init(
+	sk_logger_t *logger, const sk_logger_opts_t *opts, sk_error_t *error)
+{
+	switch (opts->clock) {
+	case SK_LOG_CLOCK_REALTIME:
+	case SK_LOG_CLOCK_REALTIME_COARSE:
+	case SK_LOG_CLOCK_MONOTONIC:
+		logger->clock = opts->clock;
+		break;
+	case SK_LOG_CLOCK_TSC:
+		logger->clock =
+			sk_log_tsc_init() ? SK_LOG_CLOCK_TSC : SK_LOG_CLOCK_REALTIME;
+		break;
+	default:
+		return sk_error_msg_code(error, "unknown clock", SK_ERROR_EINVAL);
+	}
+
+	return true;
+}
+
+static bool
+logger_full_policy_init(
+	sk_logger_t *logger, const sk_logger_opts_t *opts, sk_error_t *error)
+{
+	const uint32_t timeout_us = (opts->block_timeout_us != 0)
+		? opts->block_timeout_us
+		: SK_LOGGER_BLOCK_TIMEOUT_US;
+	const uint32_t report_ms = (opts->drop_report_ms != 0)
+		? opts->drop_report_ms
+		: SK_LOGGER_DROP_REPORT_MS;
+	const uint8_t spill_log_size = (opts->spill_log_size != 0)
+		? opts->spill_log_size
+		: SK_LOGGER_SPILL_LOG_SIZE;
+
+	switch (opts->full_policy) {
+	case SK_LOGGER_FULL_DROP_NEWEST:
+	case SK_LOGGER_FULL_DROP_OLDEST:
+		break;
+	case SK_LOGGER_FULL_BLOCK:
+		logger->block_timeout_nsec = (uint64_t)timeout_us * 1000;
+		break;
+	case SK_LOGGER_FULL_SPILL:
+		if (!records_log_size_valid(spill_log_size, error) ||
+			!sk_ring_init_mem(
+				&logger->spill, spill_log_size, &logger->mem, error))
+			return false;
+		break;
+	default:
+		return sk_error_msg_code(
+			error, "unknown full policy", SK_ERROR_EINVAL);
+	}
+
+	logger->full_policy = opts->full_policy;
+	logger->drop_report_nsec = (uint64_t)report_ms * 1000000;
+	logger->coalesce_nsec = (uint64_t)opts->coalesce_ms * 1000000;
+
+	return true;
+}
+
+/* Enqueue a message whose payload takes `payload_size` bytes */
+static bool
+logger_enqueue(sk_logger_t *logger, sk_log_msg_t *msg, size_t payload_size)
+{
+	/* Follow spilled messages until they are drained, or drop */
+	if (logger->spill.buf != NULL && sk_ring_used(&logger->spill) != 0)
+		return sk_ring_enqueue(
+			&logger->spill, msg, SK_LOG_MSG_SIZE(payload_size));
+
+	switch (logger->ring_type) {
+	case SK_LOGGER_RING_FIXED:
+		return ck_ring_enqueue_mpmc_msg(&logger->ring, logger->buf, msg);
+	case SK_LOGGER_RING_VARIABLE:
+		return sk_ring_enqueue(
+			&logger->records, msg, SK_LOG_MSG_SIZE(payload_size));
+	case SK_LOGGER_RING_PER_THREAD: {
+		sk_logger_producer_t *producer = logger_producer(logger);
+		return producer != NULL &&
+			sk_ring_enqueue_sp(
+				&producer->ring, msg, SK_LOG_MSG_SIZE(payload_size));
+	}
+	case SK_LOGGER_RING_FLIGHT:
+		/* Nothing drains a recorder to convert cycles */
+		msg->ts_nsec = logger_timestamp_ns(logger, msg->ts_nsec);
+		sk_log_flight_write(
+			&logger->flight, msg, payload_size, log_thread()->name);
+		return true;
+	}
+
+	return false;
+}
+
+/*
+ * Peek at the record following the last one handed to the driver in place,
+ * the records stay in the ring until `logger_release`.
+ */
+static sk_log_msg_t *
+logger_peek(sk_ring_t *ring, void **peeked, size_t *payload_size)
+{
+	size_t size;
+	sk_log_msg_t *msg = (*peeked == NULL)
+		? sk_ring_peek(ring, &size)
+		: sk_ring_peek_next(ring, *peeked, &size);
+
+	if (msg != NULL) {
+		*peeked = msg;
+		*payload_size = size - offsetof(sk_log_msg_t, payload);
+	}
+
+	return msg;
+}
+
+/* Round robin over producer rings, one message at a time */
+static sk_log_msg_t *
+logger_dequeue_producers(sk_logger_t *logger, size_t *payload_size)
+{
+	sk_logger_producer_t *first = CK_SLIST_FIRST(&logger->producers);
+	if (first == NULL)
+		return NULL;
+
+	sk_logger_producer_t *start = logger->cursor ? logger->cursor : first;
+	sk_logger_producer_t *producer = start;
+
+	do {
+		sk_logger_producer_t *next = CK_SLIST_NEXT(producer, next);
+		if (next == NULL)
+			next = first;
+
+		sk_log_msg_t *msg =
+			logger_peek(&producer->ring, &producer->peeked, payload_size);
+		if (msg != NULL) {
+			msg->thread = producer->thread;
+			logger->cursor = next;
+			return msg;
+		}
+
+		producer = next;
+	} while (producer != start);
+
+	return NULL;
+}
+
+/* Release the records handed to the driver in place */
+static void
+logger_release(sk_logger_t *logger)
+{
+	sk_logger_producer_t *producer;
+
+	if (logger->records_peeked != NULL)
+		sk_ring_release(&logger->records, logger->records_peeked);
+	if (logger->spill_peeked != NULL)
+		sk_ring_release(&logger->spill, logger->spill_peeked);
+	logger->records_peeked = logger->spill_peeked = NULL;
+
+	if (logger->ring_type != SK_LOGGER_RING_PER_THREAD)
+		return;
+
+	CK_SLIST_FOREACH(producer, &logger->producers, next)
+	{
+		if (producer->peeked != NULL)
+			sk_ring_release(&producer->ring, producer->peeked);
+		producer->peeked = NULL;
+	}
+}
+
+/* Free the producers of exited threads once drained, only by the drain */
+static void
+logger_producers_reap(sk_logger_t *logger)
+{
+	sk_logger_producer_t *producer, *tmp;
+
+	pthread_mutex_lock(&logger->producers_lock);
+	CK_SLIST_FOREACH_SAFE(producer, &logger->producers, next, tmp)
+	{
+		if (!logger_producer_exited(producer) ||
+			(producer->ring.buf != NULL && sk_ring_used(&producer->ring) != 0))
+			continue;
+
+		CK_SLIST_REMOVE(&logger->producers, producer, sk_logger_producer, next);
+		if (logger->cursor == producer)
+			logger->cursor = NULL;
+		ck_pr_add_64(&logger->enqueued, producer->enqueued);
+		logger_producer_put(producer);
+	}
+	pthread_mutex_unlock(&logger->producers_lock);
+}
+
+static inline void
+logger_dropped(sk_logger_t *logger, enum sk_log_level level)
+{
+	ck_pr_inc_64(&logger->dropped[level]);
+}
+
+/* Sum the messages enqueued by every producer */
+static uint64_t
+logger_enqueued_sum(sk_logger_t *logger)
+{
+	const sk_logger_producer_t *producer;
+	uint64_t enqueued = ck_pr_load_64(&logger->enqueued);
+
+	pthread_mutex_lock(&logger->producers_lock);
+	CK_SLIST_FOREACH(producer, &logger->producers, next)
+	{
+		enqueued += ck_pr_load_64((uint64_t *)&producer->enqueued);
+	}
+	pthread_mutex_unlock(&logger->producers_lock);
+
+	return enqueued;
+}
+
+/* Messages enqueued and not drained yet, producers count them afterwards */
+static uint64_t
+logger_pending(sk_logger_t *logger)
+{
+	if (logger->ring_type == SK_LOGGER_RING_FLIGHT)
+		return 0;
+
+	const uint64_t gone =
+		ck_pr_load_64(&logger->drained) + ck_pr_load_64(&logger->evicted);
+	const uint64_t enqueued = logger_enqueued_sum(logger);
+
+	return (enqueued > gone) ? enqueued - gone : 0;
+}
+
+/* Drop the oldest message of the ring the calling thread enqueues into */
+static void
+logger_evict(sk_logger_t *logger)
+{
+	sk_log_msg_t *oldest;
+	sk_ring_t *ring;
+	size_t size;
+
+	switch (logger->ring_type) {
+	case SK_LOGGER_RING_FIXED: {
+		sk_log_msg_t msg;
+		if (ck_ring_trydequeue_mpmc_msg(&logger->ring, logger->buf, &msg)) {
+			logger_dropped(logger, msg.level);
+			ck_pr_inc_64(&logger->evicted);
+		}
+		return;
+	}
+	case SK_LOGGER_RING_VARIABLE:
+		ring = &logger->records;
+		break;
+	case SK_LOGGER_RING_PER_THREAD: {
+		sk_logger_producer_t *producer = logger_producer(logger);
+		if (producer == NULL)
+			return;
+		ring = &producer->ring;
+		break;
+	}
+	default:
+		return;
+	}
+
+	/* Variable length rings have a single consumer; if busy, it makes room */
+	if (!ck_pr_cas_int(&logger->draining, 0, 1))
+		return;
+
+	if ((oldest = sk_ring_peek(ring, &size)) != NULL) {
+		logger_dropped(logger, oldest->level);
+		ck_pr_inc_64(&logger->evicted);
+		sk_ring_release(ring, oldest);
+	}
+
+	ck_pr_store_int(&logger->draining, 0);
+}
+
+/* Wake the drain worker if it sleeps, see `sk_log_drain.h` */
+static inline void
+logger_wakeup(sk_logger_t *logger)
+{
+	uint32_t *wakeup = ck_pr_load_ptr(&logger->wakeup);
+	if (wakeup == NULL)
+		return;
+
+	/* Orders the enqueue before reading armed, see the worker idle path */
+	ck_pr_fence_memory();
+	if (ck_pr_load_int(&logger->armed) && ck_pr_fas_int(&logger->armed, 0))
+		sk_log_drain_wakeup(wakeup);
+}
+
+/* Apply the full policy once a message could not be enqueued */
+static bool
+logger_enqueue_full(
+	sk_logger_t *logger, sk_log_msg_t *msg, size_t payload_size)
+{
+	switch (logger->full_policy) {
+	case SK_LOGGER_FULL_DROP_NEWEST:
+		break;
+	case SK_LOGGER_FULL_DROP_OLDEST:
+		for (int i = 0; i < LOG_EVICT_RETRIES; i++) {
+			logger_evict(logger);
+			if (logger_enqueue(logger, msg, payload_size))
+				return true;
+		}
+		break;
+	case SK_LOGGER_FULL_BLOCK: {
+		const uint64_t deadline = log_monotonic() + logger->block_timeout_nsec;
+
+		logger_wakeup(logger);
+		do {
+			sched_yield();
+			if (logger_enqueue(logger, msg, payload_size))
+				return true;
+		} while (log_monotonic() < deadline);
+		break;
+	}
+	case SK_LOGGER_FULL_SPILL:
+		if (sk_ring_enqueue(
+				&logger->spill, msg, SK_LOG_MSG_SIZE(payload_size)))
+			return true;
+		break;
+	}
+
+	logger_dropped(logger, msg->level);
+
+	return false;
+}
+
+/* Dequeue a message of the ring, in place unless copied to `slot` */
+static sk_log_msg_t *
+logger_dequeue_ring(
+	sk_logger_t *logger, sk_log_msg_t *slot, size_t *payload_size)
 {
-	return (level < SK_LOG_COUNT) ? level_labels[level] : NULL;
+	switch (logger->ring_type) {
+	case SK_LOGGER_RING_FIXED:
+		*payload_size = SK_LOG_MSG_MAX;
+		return ck_ring_trydequeue_mpmc_msg(&logger->ring, logger->buf, slot)
+			? slot
+			: NULL;
+	case SK_LOGGER_RING_VARIABLE:
+		return logger_peek(
+			&logger->records, &logger->records_peeked, payload_size);
+	case SK_LOGGER_RING_PER_THREAD:
+		return logger_dequeue_producers(logger, payload_size);
+	case SK_LOGGER_RING_FLIGHT:
+		/* Messages are read from the file */
+		return NULL;
+	}
+
+	return NULL;
 }
 
-enum {
-	SK_LOGGER_ENABLED = 1,
+/* Unpack the arguments of a message into the payload of `slot` */
+static void
+logger_msg_format(sk_log_msg_t *msg, size_t payload_size, sk_log_msg_t *slot)
+{
+	char payload[SK_LOG_MSG_MAX];
+	char *out = (msg == slot) ? payload : slot->payload;
+
+	if (!sk_log_fmt_unpack(
+			out, SK_LOG_MSG_MAX, msg->fmt, msg->payload, payload_size))
+		snprintf(out, SK_LOG_MSG_MAX, "%s", msg->fmt);
+
+	if (msg == slot)
+		memcpy(slot->payload, payload, SK_LOG_MSG_MAX);
+	else
+		memcpy(slot, msg, offsetof(sk_log_msg_t, payload));
+	slot->fmt = NULL;
+}
+
+/*
+ * Dequeue a formatted message. Messages of variable length rings are handed
+ * in place unless they must be copied to `slot`: to format them, or when
+ * `copy` is set.
+ */
+static sk_log_msg_t *
+logger_dequeue(sk_logger_t *logger, sk_log_msg_t *slot, bool copy)
+{
+	size_t payload_size;
+	sk_log_msg_t *msg = logger_dequeue_ring(logger, slot, &payload_size);
+
+	/* Spilled messages are newer than the ones of the ring */
+	if (msg == NULL) {
+		if (logger->spill.buf == NULL ||
+			(msg = logger_peek(&logger->spill, &logger->spill_peeked,
+				 &payload_size)) == NULL)
+			return NULL;
+		msg->thread = NULL;
+	}
+
+	msg->ts_nsec = logger_timestamp_ns(logger, msg->ts_nsec);
+
+	if (msg->fmt != NULL) {
+		logger_msg_format(msg, payload_size, slot);
+		return slot;
+	}
+
+	if (copy && msg != slot) {
+		memcpy(slot, msg, SK_LOG_MSG_SIZE(payload_size));
+		return slot;
+	}
+
+	return msg;
+}
+
+static inline bool
+logger_drv_logs(const sk_logger_drv_t *driver)
+{
+	return driver->log != NULL || driver->log_batch != NULL;
+}
+
+static inline bool
+logger_drv_checked(sk_logger_t *logger, bool ok)
+{
+	if (!ok)
+		ck_pr_inc_64(&logger->driver_errors);
+
+	return ok;
+}
+
+/* Forward messages to the driver, in a single call if it supports batches */
+static bool
+logger_drv_log(
+	sk_logger_t *logger, sk_log_msg_t **msgs, size_t n, sk_error_t *error)
+{
+	sk_logger_drv_t *driver = &logger->driver;
+
+	if (driver->log_batch != NULL)
+		return logger_drv_checked(
+			logger, driver->log_batch(driver, msgs, n, error));
+
+	bool ok = true;
+	for (size_t i = 0; i < n; i++)
+		ok &= logger_drv_checked(logger, driver->log(driver, msgs[i], error));
+
+	return ok;
+}
+
+/*
+ * Runs of identical messages collapsed by the drain. The run heading the end
+ * of a batch may go on in the next one, its message is held meanwhile.
+ */
+struct log_coalesce {
+	sk_log_msg_t held;
+	/* Messages to forward, then the number of repeats of each */
+	sk_log_msg_t *out[SK_LOG_BATCH_MAX + 1];
+	uint64_t repeats[SK_LOG_BATCH_MAX + 1];
+	size_t n;
 };
 
-CK_RING_PROTOTYPE(msg, sk_log_msg)
+static bool
+log_coalesce_same(const sk_log_msg_t *head, const sk_log_msg_t *msg,
+	uint64_t window_nsec)
+{
+	if (msg->ts_nsec - head->ts_nsec > window_nsec ||
+		msg->level != head->level || msg->debug.line != head->debug.line ||
+		msg->debug.file != head->debug.file ||
+		msg->debug.function != head->debug.function ||
+		msg->kv_count != head->kv_count)
+		return false;
+
+	const size_t size = sk_log_msg_payload_size(head);
+
+	return size == sk_log_msg_payload_size(msg) &&
+		memcmp(head->payload, msg->payload, size) == 0;
+}
+
+/* Append ` (repeated N times)` to the message, before its fields */
+static void
+log_coalesce_annotate(sk_log_msg_t *msg, uint64_t repeats)
+{
+	char suffix[48];
+	const int len =
+		snprintf(suffix, sizeof(suffix), " (repeated %" PRIu64 " times)", repeats);
+	if (len <= 0)
+		return;
+
+	size_t text = strnlen(msg->payload, SK_LOG_MSG_MAX - 1);
+	size_t fields = sk_log_msg_payload_size(msg) - text - 1;
+
+	/* Fields are dropped, then the message truncated, to make room */
+	if (text + 1 + len + fields > SK_LOG_MSG_MAX) {
+		msg->kv_count = 0;
+		fields = 0;
+	}
+	if (text + 1 + len > SK_LOG_MSG_MAX)
+		text = SK_LOG_MSG_MAX - 1 - len;
+
+	memmove(msg->payload + text + len + 1, msg->payload + text + 1, fields);
+	memcpy(msg->payload + text, suffix, len + 1);
+}
+
+/* Collapse the messages of a batch into the runs to forward */
+static void
+logger_coalesce(sk_logger_t *logger, struct log_coalesce *coalesce,
+	sk_log_msg_t **msgs, size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		const size_t last = coalesce->n - 1;
+
+		if (coalesce->n != 0 &&
+			log_coalesce_same(
+				coalesce->out[last], msgs[i], logger->coalesce_nsec)) {
+			coalesce->repeats[last]++;
+			continue;
+		}
+
+		coalesce->out[coalesce->n] = msgs[i];
+		coalesce->repeats[coalesce->n] = 0;
+		coalesce->n++;
+	}
+}
+
+/*
+ * Forward the runs that ended, the last one is held unless `final`. Messages
+ * of the batch can be reused afterwards.
+ */
+static bool
+logger_coalesce_forward(sk_logger_t *logger, struct log_coalesce *coalesce,
+	bool final, sk_error_t *error)
+{
+	bool ok = true;
+
+	if (coalesce->n == 0)
+		return true;
+
+	const size_t last = coalesce->n - 1;
+	for (size_t i = 0; i < last; i++) {
+		if (coalesce->repeats[i] != 0)
+			log_coalesce_annotate(coalesce->out[i], coalesce->repeats[i]);
+	}
+	if (last != 0)
+		ok &= logger_drv_log(logger, coalesce->out, last, error);
+
+	if (coalesce->out[last] != &coalesce->held)
+		coalesce->held = *coalesce->out[last];
+	coalesce->out[0] = &coalesce->held;
+	coalesce->repeats[0] = coalesce->repeats[last];
+	coalesce->n = 1;
+
+	if (final) {
+		if (coalesce->repeats[0] != 0)
+			log_coalesce_annotate(&coalesce->held, coalesce->repeats[0]);
+		ok &= logger_drv_log(logger, coalesce->out, 1, error);
+		coalesce->n = 0;
+	}
+
+	return ok;
+}
+
+/* Report messages dropped since the previous report to the driver */
+static bool
+logger_report_drops(sk_logger_t *logger, sk_error_t *error)
+{
+	sk_logger_drv_t *driver = &logger->driver;
+	const uint64_t now = log_monotonic();
+	uint64_t dropped[SK_LOG_COUNT], total = 0;
+
+	if (logger->drop_reported_at != 0 &&
+		now - logger->drop_reported_at < logger->drop_report_nsec)
+		return true;
+
+	for (int level = 0; level < SK_LOG_COUNT; level++) {
+		dropped[level] = ck_pr_load_64(&logger->dropped[level]) -
+			logger->dropped_reported[level];
+		logger->dropped_reported[level] += dropped[level];
+		total += dropped[level];
+	}
+
+	if (total == 0)
+		return true;
+
+	logger->drop_reported_at = now;
+
+	if (!logger_drv_logs(driver))
+		return true;
+
+	const struct log_thread *self = log_thread();
+	sk_log_msg_t msg = {
+		.ts_nsec = logger_timestamp_ns(logger, logger_timestamp(logger)),
+		.level = SK_LOG_WARNING,
+		.debug = sk_debug,
+		.pid = self->pid,
+		.tid = self->tid,
+	};
+
+	/* e.g. "3 messages dropped (error: 1, info: 2)" */
+	char *payload = msg.payload;
+	size_t left = SK_LOG_MSG_MAX;
+	int len = snprintf(payload, left, "%" PRIu64 " messages dropped (", total);
+	for (int level = 0; level < SK_LOG_COUNT && len > 0 && (size_t)len < left;
+		 level++) {
+		if (dropped[level] == 0)
+			continue;
+
+		payload += len;
+		left -= len;
+		len = snprintf(payload, left, "%s: %" PRIu64 ", ", level_labels[level],
+			dropped[level]);
+	}
+	/* Replace the trailing separator, the payload is at worst truncated */
+	if (len > 0 && (size_t)len < left)
+		strcpy(payload + len - 2, ")");
+
+	sk_log_msg_t *msgs[] = {&msg};
+	return logger_drv_log(logger, msgs, 1, error);
+}
 
 sk_logger_t *
 sk_logger_create(const char *name, uint8_t log_size, sk_logger_drv_t *driver,
 	sk_error_t *error)
 {
-	size_t ring_size = 1 << log_size;
+	const sk_logger_opts_t opts = {.log_size = log_size};
 
-	if (log_size > SK_LOGGER_RING_MAX) {
-		sk_error_msg_code(
-			error, "log_size > SK_LOGGER_RING_MAX", SK_ERROR_EINVAL);
-		goto failed;
-	}
+	return sk_logger_create_opts(name, &opts, driver, error);
+}
 
+sk_logger_t *
+sk_logger_create_opts(const char *name, const sk_logger_opts_t *opts,
+	sk_logger_drv_t *driver, sk_error_t *error)
+{
 	sk_logger_t *logger = calloc(1, sizeof(*logger));
 	if (logger == NULL) {
 		sk_error_msg_code(error, "logger calloc failed", SK_ERROR_ENOMEM);
 		goto failed;
 	}
 
+	logger->id = ck_pr_faa_64(&logger_ids, 1) + 1;
+
 	if ((logger->name = strdup(name)) == NULL) {
 		sk_error_msg_code(error, "name strdup failed", SK_ERROR_ENOMEM);
 		goto failed_name_alloc;
 	}
 
-	if ((logger->buf = calloc(sizeof(sk_log_msg_t), ring_size)) == NULL) {
-		sk_error_msg_code(error, "buffer calloc failed", SK_ERROR_ENOMEM);
+	if (!logger_clock_init(logger, opts, error) ||
+		!logger_ring_init(logger, opts, error))
 		goto failed_buf_alloc;
-	}
 
-	logger->buf_size = ring_size;
-	ck_ring_init(&logger->ring, ring_size);
-	sk_logger_set_level(logger, SK_LOG_DEFAULT_LEVEL);
+	if (!logger_full_policy_init(logger, opts, error))
+		goto failed_full_policy;
+
 	sk_flag_set(&logger->flags, SK_LOGGER_ENABLED);
 
-	/* Find driver */
+	/*
+	 * Find driver. Only known members are taken, the others stay zeroed as
+	 * for builders.
+	 */
 	if (driver != NULL) {
-		logger->driver = *driver;
+		logger->driver.ctx = driver->ctx;
+		logger->driver.open = driver->open;
+		logger->driver.log = driver->log;
+		logger->driver.close = driver->close;
+		logger->driver.log_batch = driver->log_batch;
+		logger->driver.flush = driver->flush;
 	} else if (!sk_logger_default_drv(&logger->driver, error)) {
 		goto failed_default_driver;
 	}
 
 	/* Initialize driver */
+	logger->driver.name = logger->name;
 	if (logger->driver.open != NULL &&
 		!logger->driver.open(&logger->driver, error))
 		goto failed_open_driver;
 
+	/* Inherits its level, and may be inherited from */
+	ck_rwlock_write_lock(&loggers_lock);
+	CK_SLIST_INSERT_HEAD(&loggers, logger, next);
+	ck_rwlock_write_unlock(&loggers_lock);
+	loggers_levels_refresh();
+
 	return logger;
 
 failed_open_driver:
 	if (logger->driver.close != NULL)
 		logger->driver.close(&logger->driver);
 failed_default_driver:
-	free(logger->buf);
+failed_full_policy:
+	logger_ring_destroy(logger);
 failed_buf_alloc:
 	free(logger->name);
 failed_name_alloc:
@@ -103,16 +1312,87 @@ sk_logger_destroy(sk_logger_t *logger)
 {
 	sk_flag_unset(&logger->flags, SK_LOGGER_ENABLED);
 
+	/* Waits for drain workers to leave the logger */
+	ck_rwlock_write_lock(&loggers_lock);
+	CK_SLIST_REMOVE(&loggers, logger, sk_logger, next);
+	ck_rwlock_write_unlock(&loggers_lock);
+	loggers_levels_refresh();
+
 	/* TODO: wait until drained */
 
 	if (logger->driver.close != NULL)
 		logger->driver.close(&logger->driver);
 
-	free(logger->buf);
+	logger_ring_destroy(logger);
 	free(logger->name);
 	free(logger);
 }
 
+static_assert(offsetof(sk_logger_t, level) == 0,
+	"level must be the first member, see sk_logger_is_enabled");
+static_assert(sizeof(enum sk_log_level) == sizeof(int),
+	"required due to the usage of ck_pr_load_int");
+
+void
+sk_logger_set_flags(sk_logger_t *logger, sk_flag_t flags)
+{
+	sk_flag_set(&logger->flags, flags);
+}
+
+void
+sk_logger_unset_flags(sk_logger_t *logger, sk_flag_t flags)
+{
+	sk_flag_unset(&logger->flags, flags);
+}
+
+uint64_t
+sk_logger_dropped(sk_logger_t *logger, enum sk_log_level level)
+{
+	return (level < SK_LOG_COUNT) ? ck_pr_load_64(&logger->dropped[level]) : 0;
+}
+
+/* Messages the ring holds, see `sk_logger_stats` */
+static uint64_t
+logger_capacity(const sk_logger_t *logger)
+{
+	/* Records have an 8 bytes header and are 8 bytes aligned */
+	const size_t record = 8 + ((SK_LOG_MSG_SIZE(SK_LOG_MSG_MAX) + 7) & ~7ul);
+
+	switch (logger->ring_type) {
+	case SK_LOGGER_RING_FIXED:
+		return logger->buf_size - 1;
+	case SK_LOGGER_RING_VARIABLE:
+		return logger->records.size / record;
+	case SK_LOGGER_RING_PER_THREAD:
+		return ((size_t)1 << logger->producer_log_size) / record;
+	case SK_LOGGER_RING_FLIGHT:
+		return logger->flight.mask + 1;
+	}
+
+	return 0;
+}
+
+void
+sk_logger_get_stats(sk_logger_t *logger, sk_logger_stats_t *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+
+	stats->enqueued = logger_enqueued_sum(logger);
+	for (int level = 0; level < SK_LOG_COUNT; level++)
+		stats->dropped += ck_pr_load_64(&logger->dropped[level]);
+	stats->drained = ck_pr_load_64(&logger->drained);
+	stats->driver_errors = ck_pr_load_64(&logger->driver_errors);
+
+	stats->pending = logger_pending(logger);
+	stats->pending_high = ck_pr_load_64(&logger->pending_high);
+	if (stats->pending > stats->pending_high)
+		stats->pending_high = stats->pending;
+	stats->capacity = logger_capacity(logger);
+
+	for (size_t i = 0; i < SK_LOGGER_LATENCY_BUCKETS; i++)
+		stats->latency[i] = ck_pr_load_64(&logger->latency[i]);
+}
+
 enum sk_log_level
 sk_logger_get_level(sk_logger_t *logger)
 {
@@ -122,56 +1402,424 @@ sk_logger_get_level(sk_logger_t *logger)
 bool
 sk_logger_set_level(sk_logger_t *logger, enum sk_log_level level)
 {
-	ck_pr_store_int((int *)&logger->level, level);
+	if (level >= SK_LOG_COUNT)
+		return false;
+
+	pthread_mutex_lock(&levels_lock);
+	logger->own_level = level;
+	logger->own_level_seq = ++level_seq;
+	/* Also applies to descendants inheriting the level */
+	loggers_levels_update();
+	pthread_mutex_unlock(&levels_lock);
+
+	return true;
+}
+
+/* Capture the header of a message */
+static inline void
+logger_msg_init(const sk_logger_t *logger, sk_log_msg_t *msg,
+	enum sk_log_level level, sk_debug_t debug)
+{
+	msg->ts_nsec = logger_timestamp(logger);
+	msg->level = level;
+	msg->debug = debug;
+
+	const struct log_thread *self = log_thread();
+	msg->pid = self->pid;
+	msg->tid = self->tid;
+	msg->thread = NULL;
+	msg->fmt = NULL;
+	msg->kv_count = 0;
+}
+
+static inline void
+logger_enqueued(sk_logger_t *logger)
+{
+	/* Only the thread of a producer writes its counter */
+	sk_logger_producer_t *producer = logger_producer(logger);
+	if (sk_likely(producer != NULL))
+		ck_pr_store_64(&producer->enqueued, producer->enqueued + 1);
+	else
+		ck_pr_inc_64(&logger->enqueued);
+
+	logger_wakeup(logger);
+}
+
+/* Enqueue a message, applying the full policy, and wake the drain */
+static inline bool
+logger_log(sk_logger_t *logger, sk_log_msg_t *msg, size_t payload_size)
+{
+	if (sk_unlikely(!logger_enqueue(logger, msg, payload_size)) &&
+		!logger_enqueue_full(logger, msg, payload_size))
+		return false;
+
+	logger_enqueued(logger);
+
+	return true;
+}
+
+/*
+ * Reserve a message to fill in place, a record of the largest message in a
+ * variable length ring. Messages of the fixed and flight rings, or which
+ * follow spilled ones, or don't fit, are filled in `staging` and copied on
+ * commit; NULL if there is no staging message then.
+ */
+static sk_log_msg_t *
+logger_reserve(sk_logger_t *logger, enum sk_log_level level, sk_debug_t debug,
+	sk_log_msg_t *staging)
+{
+	const size_t size = SK_LOG_MSG_SIZE(SK_LOG_MSG_MAX);
+	sk_log_msg_t *msg = NULL;
+	sk_ring_t *ring = NULL;
+
+	if (logger->spill.buf == NULL || sk_ring_used(&logger->spill) == 0) {
+		switch (logger->ring_type) {
+		case SK_LOGGER_RING_VARIABLE:
+			ring = &logger->records;
+			msg = sk_ring_reserve(ring, size);
+			break;
+		case SK_LOGGER_RING_PER_THREAD: {
+			sk_logger_producer_t *producer = logger_producer(logger);
+			if (producer != NULL) {
+				ring = &producer->ring;
+				msg = sk_ring_reserve_sp(ring, size);
+			}
+			break;
+		}
+		default:
+			break;
+		}
+	}
+
+	if (msg == NULL && (msg = staging) == NULL)
+		return NULL;
+
+	logger_msg_init(logger, msg, level, debug);
+
+	return msg;
+}
+
+/*
+ * Ring a message that isn't staged was reserved in, found from the logger
+ * such that reservations of other loggers don't interfere.
+ */
+static sk_ring_t *
+logger_reserved_ring(sk_logger_t *logger)
+{
+	if (logger->ring_type == SK_LOGGER_RING_PER_THREAD)
+		return &logger_producer(logger)->ring;
+
+	return &logger->records;
+}
+
+/* Enqueue a reserved message whose payload takes `payload_size` bytes */
+static bool
+logger_commit(sk_logger_t *logger, sk_log_msg_t *msg, size_t payload_size,
+	const sk_log_msg_t *staging)
+{
+	if (msg == staging)
+		return logger_log(logger, msg, payload_size);
+
+	sk_ring_commit_len(
+		logger_reserved_ring(logger), msg, SK_LOG_MSG_SIZE(payload_size));
+	logger_enqueued(logger);
 
 	return true;
 }
 
+/* Give a reserved message up */
+static void
+logger_abort(
+	sk_logger_t *logger, sk_log_msg_t *msg, const sk_log_msg_t *staging)
+{
+	if (msg != staging)
+		sk_ring_abort(logger_reserved_ring(logger), msg);
+}
+
+/*
+ * Staging message of the thread for a logger, such that reservations of
+ * different loggers don't share it.
+ */
+static inline sk_log_msg_t *
+logger_staging(sk_logger_t *logger)
+{
+	sk_logger_producer_t *producer = logger_producer(logger);
+
+	return (producer != NULL) ? &producer->staging : NULL;
+}
+
+sk_log_msg_t *
+sk_log_reserve(sk_logger_t *logger, enum sk_log_level level, sk_debug_t debug)
+{
+	if (!sk_logger_is_enabled(logger, level))
+		return NULL;
+
+	return logger_reserve(logger, level, debug, logger_staging(logger));
+}
+
+bool
+sk_log_commit(sk_logger_t *logger, sk_log_msg_t *msg)
+{
+	return logger_commit(logger, msg, sk_log_msg_payload_size(msg),
+		logger_staging(logger));
+}
+
+void
+sk_log_abort(sk_logger_t *logger, sk_log_msg_t *msg)
+{
+	logger_abort(logger, msg, logger_staging(logger));
+}
+
+/*
+ * Format and enqueue a message, noting messages suppressed at its callsite
+ * since the previous one, see `sk_log_limited`.
+ */
+static bool
+logger_logv(sk_logger_t *logger, enum sk_log_level level, sk_debug_t debug,
+	uint64_t suppressed, const char *fmt, va_list args)
+{
+	sk_log_msg_t staging;
+	sk_log_msg_t *msg = logger_reserve(logger, level, debug, &staging);
+
+	size_t payload_size = 0;
+	/* A recorder's reader can't resolve the format string */
+	if (sk_flag_get(&logger->flags, SK_LOGGER_DEFERRED) &&
+		logger->ring_type != SK_LOGGER_RING_FLIGHT && suppressed == 0) {
+		va_list packed;
+		va_copy(packed, args);
+		payload_size =
+			sk_log_fmt_pack(msg->payload, SK_LOG_MSG_MAX, fmt, packed);
+		if (payload_size != 0)
+			msg->fmt = fmt;
+		va_end(packed);
+	}
+	if (msg->fmt == NULL) {
+		int len = vsnprintf(msg->payload, SK_LOG_MSG_MAX, fmt, args);
+		if (len >= 0 && len < SK_LOG_MSG_MAX && suppressed != 0) {
+			const int more = snprintf(msg->payload + len, SK_LOG_MSG_MAX - len,
+				" (%" PRIu64 " suppressed)", suppressed);
+			len = (more >= 0) ? len + more : len;
+		}
+		if (len >= 0)
+			payload_size = (len < SK_LOG_MSG_MAX) ? (size_t)len + 1
+			                                      : SK_LOG_MSG_MAX;
+	}
+
+	if (payload_size == 0) {
+		logger_abort(logger, msg, &staging);
+		return false;
+	}
+
+	return logger_commit(logger, msg, payload_size, &staging);
+}
+
 bool
 sk_log(sk_logger_t *logger, enum sk_log_level level, sk_debug_t debug,
 	const char *fmt, ...)
 {
-	struct timespec time;
-	clock_gettime(CLOCK_REALTIME, &time);
-
-	if (sk_logger_get_level(logger) < level)
+	if (!sk_logger_is_enabled(logger, level))
 		return true;
 
-	sk_log_msg_t msg;
-	msg.ts_nsec = (time.tv_sec * 1000000) + time.tv_nsec;
-	msg.level = level;
-	msg.debug = debug;
-	/* TODO: make pid & tid a __thread variable */
-	msg.pid = getpid();
-	msg.tid = syscall(SYS_gettid);
+	va_list args;
+	va_start(args, fmt);
+	const bool ret = logger_logv(logger, level, debug, 0, fmt, args);
+	va_end(args);
+
+	return ret;
+}
 
+bool
+sk_log_callsite(sk_logger_t *logger, const sk_log_callsite_t *callsite,
+	const char *fmt, ...)
+{
 	va_list args;
 	va_start(args, fmt);
-	if (vsnprintf(msg.payload, SK_LOG_MSG_MAX, fmt, args) == -1)
+	const bool ret = logger_logv(
+		logger, callsite->level, callsite->debug, 0, fmt, args);
+	va_end(args);
+
+	return ret;
+}
+
+/* Check a callsite's limits, lock-free */
+static bool
+log_limit_allow(sk_log_limit_t *limit)
+{
+	if (limit->every > 1 && ck_pr_faa_64(&limit->seen, 1) % limit->every != 0)
 		return false;
+
+	if (limit->interval_nsec == 0)
+		return true;
+
+	/*
+	 * Generic cell rate algorithm: `tat` is the time the bucket is full
+	 * again, a message passes if it's at most `burst - 1` intervals ahead.
+	 */
+	const uint64_t now = log_monotonic();
+	const uint64_t tolerance =
+		limit->interval_nsec * ((limit->burst > 1) ? limit->burst - 1 : 0);
+	uint64_t tat = ck_pr_load_64(&limit->tat);
+
+	for (;;) {
+		const uint64_t base = (tat > now) ? tat : now;
+		if (base - now > tolerance)
+			return false;
+		if (ck_pr_cas_64_value(
+				&limit->tat, tat, base + limit->interval_nsec, &tat))
+			return true;
+	}
+}
+
+bool
+sk_log_limited(sk_logger_t *logger, enum sk_log_level level,
+	sk_debug_t debug, sk_log_limit_t *limit, const char *fmt, ...)
+{
+	if (!sk_logger_is_enabled(logger, level))
+		return true;
+
+	if (!log_limit_allow(limit)) {
+		ck_pr_inc_64(&limit->suppressed);
+		return true;
+	}
+
+	const uint64_t suppressed = (ck_pr_load_64(&limit->suppressed) != 0)
+		? ck_pr_fas_64(&limit->suppressed, 0)
+		: 0;
+
+	va_list args;
+	va_start(args, fmt);
+	const bool ret = logger_logv(logger, level, debug, suppressed, fmt, args);
 	va_end(args);
 
-	/* TODO(fsaintjacques): blocks on queue full. */
-	return ck_ring_enqueue_mpmc_msg(&logger->ring, logger->buf, &msg);
+	return ret;
+}
+
+bool
+sk_log_kv_array(sk_logger_t *logger, enum sk_log_level level,
+	sk_debug_t debug, const char *text, const sk_kv_t *kvs, size_t n)
+{
+	if (!sk_logger_is_enabled(logger, level))
+		return true;
+
+	sk_log_msg_t staging;
+	sk_log_msg_t *msg = logger_reserve(logger, level, debug, &staging);
+
+	/* Fields start after the message, even a truncated one */
+	size_t payload_size = strnlen(text, SK_LOG_MSG_MAX - 1);
+	memcpy(msg->payload, text, payload_size);
+	msg->payload[payload_size++] = '\0';
+
+	if (n != 0)
+		payload_size += sk_log_kv_pack(msg->payload + payload_size,
+			SK_LOG_MSG_MAX - payload_size, kvs, n, &msg->kv_count);
+
+	/* A recorder's reader only knows text, render the fields eagerly */
+	if (logger->ring_type == SK_LOGGER_RING_FLIGHT && msg->kv_count != 0) {
+		char fields[SK_LOG_KV_TEXT_MAX];
+		const size_t len = sk_log_kv_format(fields, sizeof(fields), msg);
+		const size_t text_len = strlen(msg->payload);
+		const size_t copied = (len < SK_LOG_MSG_MAX - 1 - text_len)
+			? len
+			: SK_LOG_MSG_MAX - 1 - text_len;
+
+		memcpy(msg->payload + text_len, fields, copied);
+		msg->payload[text_len + copied] = '\0';
+		payload_size = text_len + copied + 1;
+		msg->kv_count = 0;
+	}
+
+	return logger_commit(logger, msg, payload_size, &staging);
+}
+
+/* Account the time messages waited before being handed to the driver */
+static void
+logger_latency(sk_logger_t *logger, uint64_t *latency, sk_log_msg_t **msgs,
+	size_t n)
+{
+	const uint64_t now = logger_timestamp_ns(logger, logger_timestamp(logger));
+
+	for (size_t i = 0; i < n; i++) {
+		const uint64_t ts = msgs[i]->ts_nsec;
+		size_t bucket = 0;
+
+		if (now > ts)
+			bucket = 63 - __builtin_clzll(now - ts);
+		if (bucket >= SK_LOGGER_LATENCY_BUCKETS)
+			bucket = SK_LOGGER_LATENCY_BUCKETS - 1;
+		latency[bucket]++;
+	}
 }
 
 bool
 sk_logger_drain(sk_logger_t *logger, size_t *drained, size_t maximum_drain,
     sk_error_t *error)
 {
-	sk_log_msg_t msg;
+	sk_log_msg_t slots[SK_LOG_BATCH_MAX], *msgs[SK_LOG_BATCH_MAX];
 	sk_logger_drv_t *driver = &logger->driver;
+	const uint64_t coalesce_nsec = logger->coalesce_nsec;
+	struct log_coalesce coalesce = {.n = 0};
+	uint64_t latency[SK_LOGGER_LATENCY_BUCKETS] = {0};
 	bool ok = true;
 	size_t count = 0;
+	bool empty = false;
+
+	*drained = 0;
+	if (!ck_pr_cas_int(&logger->draining, 0, 1))
+		return true;
+
+	/* The backlog peaks when the drain starts */
+	const uint64_t pending = logger_pending(logger);
+	if (pending > logger->pending_high)
+		ck_pr_store_64(&logger->pending_high, pending);
 
-	while ((!maximum_drain || count != maximum_drain) &&
-	       ck_ring_trydequeue_mpmc_msg(&logger->ring, logger->buf, &msg)) {
-		if (driver->log != NULL) {
-			ok &= driver->log(driver, &msg, error);
-			++count;
+	while (!empty && (!maximum_drain || count != maximum_drain)) {
+		size_t n = SK_LOG_BATCH_MAX, dequeued;
+		if (maximum_drain && maximum_drain - count < n)
+			n = maximum_drain - count;
+
+		/* Coalescing rewrites and holds messages past the batch */
+		for (dequeued = 0; dequeued < n; dequeued++) {
+			msgs[dequeued] =
+				logger_dequeue(logger, &slots[dequeued], coalesce_nsec != 0);
+			if (msgs[dequeued] == NULL) {
+				empty = true;
+				break;
+			}
+		}
+
+		if (dequeued != 0 && logger_drv_logs(driver)) {
+			logger_latency(logger, latency, msgs, dequeued);
+			if (coalesce_nsec != 0) {
+				logger_coalesce(logger, &coalesce, msgs, dequeued);
+				ok &= logger_coalesce_forward(logger, &coalesce, false, error);
+			} else {
+				ok &= logger_drv_log(logger, msgs, dequeued, error);
+			}
 		}
+		count += dequeued;
+		logger_release(logger);
+	}
+
+	if (coalesce_nsec != 0)
+		ok &= logger_coalesce_forward(logger, &coalesce, true, error);
+	logger_producers_reap(logger);
+
+	/*
+	 * Reported after the messages of the pass, on the interval even when the
+	 * ring doesn't empty.
+	 */
+	ok &= logger_report_drops(logger, error);
+	if (empty && driver->flush != NULL)
+		ok &= logger_drv_checked(logger, driver->flush(driver, error));
+
+	ck_pr_add_64(&logger->drained, count);
+	for (size_t i = 0; i < SK_LOGGER_LATENCY_BUCKETS; i++) {
+		if (latency[i] != 0)
+			ck_pr_add_64(&logger->latency[i], latency[i]);
 	}
 
+	ck_pr_store_int(&logger->draining, 0);
+
 	*drained = count;
 	return ok;
 }
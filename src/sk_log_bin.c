@@ -0,0 +1,326 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <sk_log_bin.h>
+
+#include "sk_log_priv.h"
+
+static bool
+bin_hdr_valid(const sk_log_bin_hdr_t *hdr, size_t map_size)
+{
+	return memcmp(hdr->magic, SK_LOG_BIN_MAGIC, sizeof(hdr->magic)) == 0 &&
+		hdr->version == SK_LOG_BIN_VERSION &&
+		hdr->hdr_size >= sizeof(*hdr) && hdr->hdr_size <= map_size &&
+		memchr(hdr->name, '\0', sizeof(hdr->name)) != NULL;
+}
+
+/* A block of `size` bytes of records at `offset` fits in the file */
+static bool
+bin_block_fits(const sk_log_bin_reader_t *reader, uint64_t offset,
+	const sk_log_bin_block_t *block)
+{
+	return block->magic == SK_LOG_BIN_BLOCK_MAGIC &&
+		offset + sizeof(*block) <= reader->map_size &&
+		block->size <= reader->map_size - offset - sizeof(*block);
+}
+
+static bool
+bin_blocks_push(sk_log_bin_reader_t *reader, size_t *capacity,
+	const sk_log_bin_index_t *entry)
+{
+	if (reader->n_blocks == *capacity) {
+		const size_t grown = (*capacity != 0) ? *capacity * 2 : 64;
+		sk_log_bin_index_t *blocks =
+			realloc(reader->blocks, grown * sizeof(*blocks));
+		if (blocks == NULL)
+			return false;
+		reader->blocks = blocks;
+		*capacity = grown;
+	}
+
+	reader->blocks[reader->n_blocks++] = *entry;
+
+	return true;
+}
+
+/* The block at `offset` is the one of an index entry */
+static bool
+bin_entry_valid(
+	const sk_log_bin_reader_t *reader, const sk_log_bin_index_t *entry)
+{
+	return entry->offset + sizeof(entry->block) <= reader->map_size &&
+		memcmp(reader->map + entry->offset, &entry->block,
+			sizeof(entry->block)) == 0 &&
+		bin_block_fits(reader, entry->offset, &entry->block);
+}
+
+/* Walk the headers of consecutive blocks from `*offset` up to `end` */
+static bool
+bin_blocks_walk(sk_log_bin_reader_t *reader, size_t *capacity,
+	uint64_t *offset, uint64_t end)
+{
+	sk_log_bin_index_t entry;
+
+	while (*offset + sizeof(entry.block) <= end) {
+		entry.offset = *offset;
+		memcpy(&entry.block, reader->map + *offset, sizeof(entry.block));
+		if (!bin_block_fits(reader, *offset, &entry.block) ||
+			entry.block.size > end - *offset - sizeof(entry.block))
+			break;
+		if (!bin_blocks_push(reader, capacity, &entry))
+			return false;
+		*offset += sizeof(entry.block) + entry.block.size;
+	}
+
+	return true;
+}
+
+/*
+ * Load the entries of the index whose blocks are in the file, and walk the
+ * headers of blocks missing from the index, e.g. after a crash.
+ */
+static bool
+bin_blocks_load(sk_log_bin_reader_t *reader, const char *path)
+{
+	char index_path[PATH_MAX];
+	uint64_t offset = reader->hdr->hdr_size;
+	size_t capacity = 0;
+	sk_log_bin_index_t entry;
+
+	snprintf(index_path, sizeof(index_path), "%s" SK_LOG_BIN_INDEX_SUFFIX, path);
+	FILE *index = fopen(index_path, "re");
+	if (index != NULL) {
+		while (fread(&entry, sizeof(entry), 1, index) == 1) {
+			if (entry.offset < offset || !bin_entry_valid(reader, &entry))
+				continue;
+			if (!bin_blocks_walk(reader, &capacity, &offset, entry.offset) ||
+				!bin_blocks_push(reader, &capacity, &entry)) {
+				fclose(index);
+				return false;
+			}
+			offset = entry.offset + sizeof(entry.block) + entry.block.size;
+		}
+		fclose(index);
+	}
+
+	if (!bin_blocks_walk(reader, &capacity, &offset, reader->map_size))
+		return false;
+
+	if ((reader->ts_high = malloc((reader->n_blocks + 1) * sizeof(uint64_t))) ==
+		NULL)
+		return false;
+
+	uint64_t high = 0;
+	for (size_t i = 0; i < reader->n_blocks; i++) {
+		if (reader->blocks[i].block.ts_max > high)
+			high = reader->blocks[i].block.ts_max;
+		reader->ts_high[i] = high;
+	}
+
+	return true;
+}
+
+bool
+sk_log_bin_open(
+	sk_log_bin_reader_t *reader, const char *path, sk_error_t *error)
+{
+	struct stat st;
+
+	memset(reader, 0, sizeof(*reader));
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return sk_error_msg_code(
+			error, "failed to open binary log file", errno);
+
+	if (fstat(fd, &st) == -1) {
+		sk_error_msg_code(error, "failed to stat binary log file", errno);
+		goto failed;
+	}
+
+	if ((size_t)st.st_size < sizeof(sk_log_bin_hdr_t)) {
+		sk_error_msg_code(
+			error, "binary log file too small", SK_ERROR_EINVAL);
+		goto failed;
+	}
+
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		sk_error_msg_code(error, "failed to map binary log file", errno);
+		goto failed;
+	}
+	close(fd);
+
+	reader->hdr = map;
+	reader->map = map;
+	reader->map_size = st.st_size;
+
+	if (!bin_hdr_valid(reader->hdr, reader->map_size)) {
+		sk_log_bin_close(reader);
+		return sk_error_msg_code(
+			error, "invalid binary log file header", SK_ERROR_EINVAL);
+	}
+
+	if (!bin_blocks_load(reader, path)) {
+		sk_log_bin_close(reader);
+		return sk_error_msg_code(
+			error, "binary log blocks malloc failed", SK_ERROR_ENOMEM);
+	}
+
+	sk_log_bin_seek(reader, NULL);
+
+	return true;
+
+failed:
+	close(fd);
+	return false;
+}
+
+/* A block may hold messages of the query */
+static bool
+bin_block_matches(
+	const sk_log_bin_query_t *query, const sk_log_bin_block_t *block)
+{
+	return (query->levels == 0 || (query->levels & block->levels) != 0) &&
+		(query->from_nsec == 0 || block->ts_max >= query->from_nsec) &&
+		(query->to_nsec == 0 || block->ts_min <= query->to_nsec);
+}
+
+static bool
+bin_record_matches(
+	const sk_log_bin_query_t *query, const sk_log_bin_record_t *record)
+{
+	return record->level < SK_LOG_COUNT &&
+		(query->levels == 0 || (query->levels & (1u << record->level))) &&
+		(query->from_nsec == 0 || record->ts_nsec >= query->from_nsec) &&
+		(query->to_nsec == 0 || record->ts_nsec <= query->to_nsec);
+}
+
+/* Position the reader on the records of a block */
+static void
+bin_block_enter(sk_log_bin_reader_t *reader, size_t block)
+{
+	reader->block = block;
+	if (block < reader->n_blocks) {
+		const sk_log_bin_index_t *entry = &reader->blocks[block];
+		reader->offset = entry->offset + sizeof(entry->block);
+		reader->end = reader->offset + entry->block.size;
+	} else {
+		reader->offset = reader->end = 0;
+	}
+}
+
+void
+sk_log_bin_seek(sk_log_bin_reader_t *reader, const sk_log_bin_query_t *query)
+{
+	reader->query = (query != NULL) ? *query : (sk_log_bin_query_t){0};
+
+	/* First block whose messages, or earlier ones, reach `from_nsec` */
+	size_t low = 0, high = reader->n_blocks;
+	while (low < high) {
+		const size_t mid = low + (high - low) / 2;
+		if (reader->ts_high[mid] < reader->query.from_nsec)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	bin_block_enter(reader, low);
+}
+
+static bool
+bin_record_decode(const char *p, const sk_log_bin_record_t *record,
+	sk_log_bin_entry_t *entry)
+{
+	const size_t size = sizeof(*record) + record->file_len +
+		record->function_len + record->thread_len + record->payload_len;
+
+	if (size != record->size || record->payload_len > SK_LOG_MSG_MAX ||
+		record->thread_len >= sizeof(entry->thread))
+		return false;
+
+	p += sizeof(*record);
+	memcpy(entry->file, p, record->file_len);
+	entry->file[record->file_len] = '\0';
+	p += record->file_len;
+	memcpy(entry->function, p, record->function_len);
+	entry->function[record->function_len] = '\0';
+	p += record->function_len;
+	memcpy(entry->thread, p, record->thread_len);
+	entry->thread[record->thread_len] = '\0';
+	p += record->thread_len;
+
+	sk_log_msg_t *msg = &entry->msg;
+	memset(msg->payload, 0, sizeof(msg->payload));
+	memcpy(msg->payload, p, record->payload_len);
+	/* The message of a corrupted payload still ends */
+	if (memchr(msg->payload, '\0', sizeof(msg->payload)) == NULL)
+		msg->payload[SK_LOG_MSG_MAX - 1] = '\0';
+
+	msg->ts_nsec = record->ts_nsec;
+	msg->level = record->level;
+	msg->debug.file = entry->file;
+	msg->debug.function = entry->function;
+	msg->debug.line = record->line;
+	msg->pid = record->pid;
+	msg->tid = record->tid;
+	msg->thread = (record->thread_len != 0) ? entry->thread : NULL;
+	msg->fmt = NULL;
+	msg->kv_count = record->kv_count;
+
+	return true;
+}
+
+bool
+sk_log_bin_next(sk_log_bin_reader_t *reader, sk_log_bin_entry_t *entry)
+{
+	sk_log_bin_record_t record;
+
+	while (reader->block < reader->n_blocks) {
+		const sk_log_bin_index_t *block = &reader->blocks[reader->block];
+
+		if (reader->offset == block->offset + sizeof(block->block) &&
+			!bin_block_matches(&reader->query, &block->block)) {
+			bin_block_enter(reader, reader->block + 1);
+			continue;
+		}
+
+		if (reader->end - reader->offset < sizeof(record)) {
+			bin_block_enter(reader, reader->block + 1);
+			continue;
+		}
+
+		const char *p = reader->map + reader->offset;
+		memcpy(&record, p, sizeof(record));
+		if (record.size < sizeof(record) ||
+			record.size > reader->end - reader->offset) {
+			/* Skip the rest of a corrupted block */
+			bin_block_enter(reader, reader->block + 1);
+			continue;
+		}
+		reader->offset += record.size;
+
+		if (bin_record_matches(&reader->query, &record) &&
+			bin_record_decode(p, &record, entry))
+			return true;
+	}
+
+	return false;
+}
+
+void
+sk_log_bin_close(sk_log_bin_reader_t *reader)
+{
+	if (reader->map != NULL)
+		munmap((void *)reader->map, reader->map_size);
+	free(reader->blocks);
+	free(reader->ts_high);
+	memset(reader, 0, sizeof(*reader));
+}
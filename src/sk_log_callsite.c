@@ -0,0 +1,98 @@
+#include <fnmatch.h>
+#include <pthread.h>
+#include <stdio.h>
+
+#include <ck_pr.h>
+
+#include <sk_log.h>
+
+/* Registered modules, newest first, until their module is unloaded */
+static pthread_mutex_t callsites_lock = PTHREAD_MUTEX_INITIALIZER;
+static sk_log_callsites_module_t *modules;
+
+/* The module the library is linked into */
+SK_LOG_CALLSITES_MODULE()
+
+void
+sk_log_callsites_register(sk_log_callsites_module_t *module)
+{
+	sk_log_callsites_module_t *it;
+
+	/* No callsite in the module */
+	if (module->start == NULL || module->start == module->stop)
+		return;
+
+	pthread_mutex_lock(&callsites_lock);
+	for (it = modules; it != NULL; it = it->next) {
+		if (it->start == module->start)
+			goto unlock;
+	}
+
+	module->next = modules;
+	modules = module;
+
+unlock:
+	pthread_mutex_unlock(&callsites_lock);
+}
+
+void
+sk_log_callsites_unregister(sk_log_callsites_module_t *module)
+{
+	sk_log_callsites_module_t **it;
+
+	pthread_mutex_lock(&callsites_lock);
+	for (it = &modules; *it != NULL; it = &(*it)->next) {
+		if (*it == module) {
+			*it = module->next;
+			module->next = NULL;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&callsites_lock);
+}
+
+size_t
+sk_log_callsites_foreach(size_t (*fn)(sk_log_callsite_t *, void *), void *ctx)
+{
+	size_t sum = 0;
+
+	pthread_mutex_lock(&callsites_lock);
+	for (sk_log_callsites_module_t *module = modules; module != NULL;
+		 module = module->next) {
+		for (sk_log_callsite_t *site = module->start; site < module->stop;
+			 site++)
+			sum += fn(site, ctx);
+	}
+	pthread_mutex_unlock(&callsites_lock);
+
+	return sum;
+}
+
+struct callsite_match {
+	const char *pattern;
+	bool enabled;
+};
+
+static size_t
+callsite_match(sk_log_callsite_t *site, void *ctx)
+{
+	const struct callsite_match *match = ctx;
+	char name[4096];
+
+	snprintf(name, sizeof(name), "%s:%s:%d", site->debug.file,
+		site->debug.function, site->debug.line);
+	if (fnmatch(match->pattern, name, 0) != 0)
+		return 0;
+
+	ck_pr_store_int(&site->enabled, match->enabled);
+
+	return 1;
+}
+
+size_t
+sk_log_callsites_enable(const char *pattern, bool enabled)
+{
+	struct callsite_match match = {.pattern = pattern, .enabled = enabled};
+
+	return sk_log_callsites_foreach(callsite_match, &match);
+}
@@ -0,0 +1,109 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#include "sk_log_priv.h"
+
+/*
+ * SK_LOG_CLOCK_TSC timestamps are raw cycles, converted to nanoseconds by the
+ * drain. The conversion is calibrated once against CLOCK_MONOTONIC_RAW, then
+ * anchored to CLOCK_REALTIME; it isn't disciplined by NTP afterwards.
+ */
+
+enum {
+	/* Duration of the calibration, longer is more accurate */
+	TSC_CALIBRATION_NSEC = 10 * 1000 * 1000,
+	/* Fixed point precision of nanoseconds per cycle */
+	TSC_SHIFT = 32,
+};
+
+static struct {
+	bool usable;
+	/* Cycle counter and realtime at the same instant */
+	uint64_t base_tsc;
+	uint64_t base_ns;
+	/* Nanoseconds per cycle << TSC_SHIFT */
+	uint64_t mult;
+} tsc_clock;
+
+static pthread_once_t tsc_once = PTHREAD_ONCE_INIT;
+
+static uint64_t
+clock_ns(clockid_t clock)
+{
+	struct timespec time;
+	clock_gettime(clock, &time);
+
+	return (uint64_t)time.tv_sec * 1000000000 + (uint64_t)time.tv_nsec;
+}
+
+/* A counter ticking at a constant rate, in every P-state and C-state */
+static bool
+tsc_invariant(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007)
+		return false;
+	if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+		return false;
+
+	return (edx & (1 << 8)) != 0;
+#else
+	return false;
+#endif
+}
+
+static void
+tsc_calibrate(void)
+{
+	if (!tsc_invariant())
+		return;
+
+	const uint64_t start_ns = clock_ns(CLOCK_MONOTONIC_RAW);
+	const uint64_t start_tsc = sk_log_tsc_read();
+	uint64_t end_ns, end_tsc;
+
+	do {
+		end_ns = clock_ns(CLOCK_MONOTONIC_RAW);
+		end_tsc = sk_log_tsc_read();
+	} while (end_ns - start_ns < TSC_CALIBRATION_NSEC);
+
+	if (end_tsc <= start_tsc)
+		return;
+
+	tsc_clock.mult = ((end_ns - start_ns) << TSC_SHIFT) / (end_tsc - start_tsc);
+	tsc_clock.base_tsc = sk_log_tsc_read();
+	tsc_clock.base_ns = clock_ns(CLOCK_REALTIME);
+	tsc_clock.usable = true;
+}
+
+bool
+sk_log_tsc_init(void)
+{
+	pthread_once(&tsc_once, tsc_calibrate);
+
+	return tsc_clock.usable;
+}
+
+uint64_t
+sk_log_tsc_to_ns(uint64_t tsc)
+{
+	/* Counters of other cpus may lag slightly behind the base */
+	if (tsc < tsc_clock.base_tsc)
+		return tsc_clock.base_ns -
+			(uint64_t)(((unsigned __int128)(tsc_clock.base_tsc - tsc) *
+						   tsc_clock.mult) >>
+				TSC_SHIFT);
+
+	return tsc_clock.base_ns +
+		(uint64_t)(((unsigned __int128)(tsc - tsc_clock.base_tsc) *
+					   tsc_clock.mult) >>
+			TSC_SHIFT);
+}
@@ -0,0 +1,243 @@
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <ck_pr.h>
+
+#include <sk_log_drain.h>
+#include <sk_logger_drv.h>
+
+#include "sk_log_priv.h"
+
+struct drain_worker {
+	/* Futex word bumped by producers waking the worker */
+	uint32_t wakeup sk_cache_aligned;
+
+	pthread_t thread;
+	size_t index;
+	/* Cpu the worker is pinned to, -1 if none */
+	int cpu;
+};
+
+/*
+ * Workers are statically allocated: producers may still hold a pointer to a
+ * wakeup word after the runtime stopped.
+ */
+static struct drain_worker workers[SK_LOG_DRAIN_WORKERS_MAX];
+
+static struct {
+	pthread_mutex_t lock;
+	bool started;
+	int running;
+	size_t n_workers;
+	sk_log_drain_opts_t opts;
+} runtime = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+void
+sk_log_drain_wakeup(uint32_t *wakeup)
+{
+	ck_pr_inc_32(wakeup);
+	syscall(SYS_futex, wakeup, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+static void
+worker_sleep(struct drain_worker *worker, uint32_t seen)
+{
+	const uint32_t ms = runtime.opts.idle_ms;
+	const struct timespec timeout = {ms / 1000, (ms % 1000) * 1000000L};
+
+	syscall(SYS_futex, &worker->wakeup, FUTEX_WAIT_PRIVATE, seen, &timeout,
+		NULL, 0);
+}
+
+static inline bool
+worker_owns(const struct drain_worker *worker, const sk_logger_t *logger)
+{
+	return logger->id % runtime.n_workers == worker->index;
+}
+
+/* Drain a batch of a logger, adapting the batch to its load */
+static size_t
+worker_drain(sk_logger_t *logger, void *ctx)
+{
+	struct drain_worker *worker = ctx;
+	const size_t batch_min = runtime.opts.batch_min;
+	const size_t batch_max = runtime.opts.batch_max;
+	size_t drained = 0;
+	sk_error_t error;
+
+	if (!worker_owns(worker, logger))
+		return 0;
+
+	if (ck_pr_load_ptr(&logger->wakeup) != &worker->wakeup)
+		ck_pr_store_ptr(&logger->wakeup, &worker->wakeup);
+
+	size_t batch = logger->batch;
+	if (batch < batch_min || batch > batch_max)
+		batch = batch_min;
+
+	/* Drivers failures are not actionable here */
+	(void)sk_logger_drain(logger, &drained, batch, &error);
+
+	if (drained == batch && batch < batch_max)
+		batch *= 2;
+	else if (drained < batch / 4 && batch > batch_min)
+		batch /= 2;
+	logger->batch = (batch > batch_max) ? batch_max : batch;
+
+	return drained;
+}
+
+/* Arm a logger such that its next message wakes the worker */
+static size_t
+worker_arm(sk_logger_t *logger, void *ctx)
+{
+	struct drain_worker *worker = ctx;
+
+	if (worker_owns(worker, logger))
+		ck_pr_store_int(&logger->armed, 1);
+
+	return 0;
+}
+
+static size_t
+worker_disarm(sk_logger_t *logger, void *ctx)
+{
+	(void)ctx;
+
+	ck_pr_store_ptr(&logger->wakeup, NULL);
+	ck_pr_store_int(&logger->armed, 0);
+
+	return 0;
+}
+
+static void
+worker_affinity(struct drain_worker *worker)
+{
+	if (worker->cpu < 0 || worker->cpu >= CPU_SETSIZE)
+		return;
+
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(worker->cpu, &set);
+
+	/* Best effort, the cpu might be offline or outside of our cpuset */
+	(void)pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static void *
+worker_main(void *opaque)
+{
+	struct drain_worker *worker = opaque;
+
+	worker_affinity(worker);
+
+	while (ck_pr_load_int(&runtime.running)) {
+		if (sk_loggers_foreach(worker_drain, worker) != 0)
+			continue;
+
+		/*
+		 * Read the wakeup word before arming: a producer that sees an armed
+		 * logger bumps it, and the futex wait returns immediately.
+		 */
+		const uint32_t seen = ck_pr_load_32(&worker->wakeup);
+		sk_loggers_foreach(worker_arm, worker);
+		ck_pr_fence_memory();
+
+		/* Messages enqueued before arming */
+		if (sk_loggers_foreach(worker_drain, worker) != 0)
+			continue;
+
+		worker_sleep(worker, seen);
+	}
+
+	/* Flush pending messages before exiting */
+	while (sk_loggers_foreach(worker_drain, worker) != 0)
+		;
+
+	return NULL;
+}
+
+bool
+sk_log_drain_start(const sk_log_drain_opts_t *opts, sk_error_t *error)
+{
+	const sk_log_drain_opts_t defaults = {0};
+	if (opts == NULL)
+		opts = &defaults;
+
+	if (opts->workers > SK_LOG_DRAIN_WORKERS_MAX)
+		return sk_error_msg_code(
+			error, "workers > SK_LOG_DRAIN_WORKERS_MAX", SK_ERROR_EINVAL);
+
+	pthread_mutex_lock(&runtime.lock);
+
+	if (runtime.started) {
+		pthread_mutex_unlock(&runtime.lock);
+		return sk_error_msg_code(
+			error, "drain runtime already started", SK_ERROR_EINVAL);
+	}
+
+	runtime.opts = *opts;
+	if (runtime.opts.batch_min == 0)
+		runtime.opts.batch_min = SK_LOG_DRAIN_BATCH_MIN;
+	if (runtime.opts.batch_max == 0)
+		runtime.opts.batch_max = SK_LOG_DRAIN_BATCH_MAX;
+	if (runtime.opts.batch_max < runtime.opts.batch_min)
+		runtime.opts.batch_max = runtime.opts.batch_min;
+	if (runtime.opts.idle_ms == 0)
+		runtime.opts.idle_ms = SK_LOG_DRAIN_IDLE_MS;
+
+	/* The cpus of the caller may not outlive the call */
+	runtime.opts.cpus = NULL;
+	runtime.opts.n_cpus = 0;
+
+	runtime.n_workers = (opts->workers != 0) ? opts->workers : 1;
+	ck_pr_store_int(&runtime.running, 1);
+
+	for (size_t i = 0; i < runtime.n_workers; i++) {
+		workers[i].index = i;
+		workers[i].cpu = (opts->cpus != NULL && opts->n_cpus != 0)
+			? opts->cpus[i % opts->n_cpus]
+			: -1;
+		if (pthread_create(&workers[i].thread, NULL, worker_main,
+				&workers[i]) != 0) {
+			ck_pr_store_int(&runtime.running, 0);
+			for (size_t j = 0; j < i; j++) {
+				sk_log_drain_wakeup(&workers[j].wakeup);
+				pthread_join(workers[j].thread, NULL);
+			}
+			sk_loggers_foreach(worker_disarm, NULL);
+			pthread_mutex_unlock(&runtime.lock);
+			return sk_error_msg_code(
+				error, "failed to create drain worker", SK_ERROR_EAGAIN);
+		}
+	}
+
+	runtime.started = true;
+	pthread_mutex_unlock(&runtime.lock);
+
+	return true;
+}
+
+void
+sk_log_drain_stop(void)
+{
+	pthread_mutex_lock(&runtime.lock);
+
+	if (runtime.started) {
+		ck_pr_store_int(&runtime.running, 0);
+
+		for (size_t i = 0; i < runtime.n_workers; i++) {
+			sk_log_drain_wakeup(&workers[i].wakeup);
+			pthread_join(workers[i].thread, NULL);
+		}
+
+		sk_loggers_foreach(worker_disarm, NULL);
+		runtime.started = false;
+	}
+
+	pthread_mutex_unlock(&runtime.lock);
+}
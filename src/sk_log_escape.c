@@ -0,0 +1,169 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "sk_log_priv.h"
+
+/*
+ * Escaping is dominated by the search of the next byte to escape, strings
+ * usually have none. The search is vectorized with SSE2, or AVX2 when the cpu
+ * supports it, such that runs of plain bytes cost about a memcpy.
+ */
+
+/* Bytes of interest: control bytes up to `ctl_max`, quotes and backslashes */
+struct escape_class {
+	uint8_t ctl_max;
+	/* Another byte of interest, e.g. `=` for logfmt */
+	char extra;
+};
+
+/* Bytes escaped in a JSON string, also in a quoted logfmt value */
+static const struct escape_class escape_json = {0x1f, '"'};
+/* Bytes requiring a logfmt value to be quoted, including the space */
+static const struct escape_class escape_logfmt = {0x20, '='};
+
+static inline bool
+escape_byte_matches(uint8_t c, const struct escape_class *cls)
+{
+	return c <= cls->ctl_max || c == '"' || c == '\\' || c == cls->extra;
+}
+
+/* Length of the prefix without bytes of interest */
+static size_t
+escape_scan_scalar(const char *s, size_t len, const struct escape_class *cls)
+{
+	size_t i = 0;
+
+	while (i < len && !escape_byte_matches(s[i], cls))
+		i++;
+
+	return i;
+}
+
+#if defined(__SSE2__)
+static size_t
+escape_scan_sse2(const char *s, size_t len, const struct escape_class *cls)
+{
+	const __m128i ctl = _mm_set1_epi8(cls->ctl_max);
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	const __m128i extra = _mm_set1_epi8(cls->extra);
+	size_t i = 0;
+
+	for (; i + sizeof(__m128i) <= len; i += sizeof(__m128i)) {
+		const __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+		/* Unsigned v <= ctl_max, bytes above 0x7f are never of interest */
+		const __m128i low = _mm_cmpeq_epi8(_mm_min_epu8(v, ctl), v);
+		const __m128i m = _mm_or_si128(
+			_mm_or_si128(low, _mm_cmpeq_epi8(v, extra)),
+			_mm_or_si128(_mm_cmpeq_epi8(v, quote),
+				_mm_cmpeq_epi8(v, backslash)));
+
+		const int mask = _mm_movemask_epi8(m);
+		if (mask != 0)
+			return i + __builtin_ctz(mask);
+	}
+
+	return i + escape_scan_scalar(s + i, len - i, cls);
+}
+#endif
+
+#if defined(__x86_64__) && defined(__GNUC__)
+__attribute__((target("avx2"))) static size_t
+escape_scan_avx2(const char *s, size_t len, const struct escape_class *cls)
+{
+	const __m256i ctl = _mm256_set1_epi8(cls->ctl_max);
+	const __m256i quote = _mm256_set1_epi8('"');
+	const __m256i backslash = _mm256_set1_epi8('\\');
+	const __m256i extra = _mm256_set1_epi8(cls->extra);
+	size_t i = 0;
+
+	for (; i + sizeof(__m256i) <= len; i += sizeof(__m256i)) {
+		const __m256i v = _mm256_loadu_si256((const __m256i *)(s + i));
+		const __m256i low = _mm256_cmpeq_epi8(_mm256_min_epu8(v, ctl), v);
+		const __m256i m = _mm256_or_si256(
+			_mm256_or_si256(low, _mm256_cmpeq_epi8(v, extra)),
+			_mm256_or_si256(_mm256_cmpeq_epi8(v, quote),
+				_mm256_cmpeq_epi8(v, backslash)));
+
+		const uint32_t mask = _mm256_movemask_epi8(m);
+		if (mask != 0)
+			return i + __builtin_ctz(mask);
+	}
+
+	return i + escape_scan_sse2(s + i, len - i, cls);
+}
+#endif
+
+typedef size_t (*escape_scan_fn_t)(
+	const char *, size_t, const struct escape_class *);
+
+#if defined(__SSE2__)
+static escape_scan_fn_t escape_scan = escape_scan_sse2;
+#else
+static escape_scan_fn_t escape_scan = escape_scan_scalar;
+#endif
+
+sk_constructor static void
+escape_init(void)
+{
+#if defined(__x86_64__) && defined(__GNUC__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		escape_scan = escape_scan_avx2;
+#endif
+}
+
+size_t
+sk_log_escape_json(char *out, const char *in, size_t len)
+{
+	static const char hex[] = "0123456789abcdef";
+	char *p = out;
+	size_t i = 0;
+
+	while (i < len) {
+		const size_t run = escape_scan(in + i, len - i, &escape_json);
+		memcpy(p, in + i, run);
+		p += run;
+		i += run;
+		if (i == len)
+			break;
+
+		const uint8_t c = in[i++];
+		*p++ = '\\';
+		switch (c) {
+		case '"':
+		case '\\':
+			*p++ = c;
+			break;
+		case '\n':
+			*p++ = 'n';
+			break;
+		case '\r':
+			*p++ = 'r';
+			break;
+		case '\t':
+			*p++ = 't';
+			break;
+		default:
+			memcpy(p, "u00", 3);
+			p[3] = hex[c >> 4];
+			p[4] = hex[c & 0xf];
+			p += 5;
+			break;
+		}
+	}
+
+	return p - out;
+}
+
+bool
+sk_log_logfmt_needs_quotes(const char *in, size_t len)
+{
+	return len == 0 || escape_scan(in, len, &escape_logfmt) != len;
+}
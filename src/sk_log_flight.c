@@ -0,0 +1,349 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <ck_pr.h>
+
+#include <sk_log_flight.h>
+#include <sk_logger_drv.h>
+
+#include "sk_log_priv.h"
+
+enum {
+	/* Slots start on the page following the header */
+	FLIGHT_HDR_SIZE = 4096,
+};
+
+struct flight_slot {
+	/* 2 * position + 1 while written, 2 * position + 2 once complete */
+	uint64_t seq;
+	/* Pointers of the message are only meaningful to the writer */
+	sk_log_msg_t msg;
+	char thread[SK_LOG_THREAD_NAME_MAX];
+	char file[SK_LOG_FLIGHT_FILE_MAX];
+	char function[SK_LOG_FLIGHT_FUNCTION_MAX];
+};
+
+static_assert(sizeof(sk_log_flight_hdr_t) <= FLIGHT_HDR_SIZE,
+	"flight header must fit in FLIGHT_HDR_SIZE");
+static_assert(sizeof(struct flight_slot) % 8 == 0,
+	"flight slots must keep seq aligned");
+
+#define FLIGHT_FIELD(member)                                                   \
+	(struct sk_log_flight_field)                                               \
+	{                                                                          \
+		offsetof(struct flight_slot, member),                                  \
+			sizeof(((struct flight_slot *)0)->member)                          \
+	}
+
+static void
+flight_hdr_init(sk_log_flight_hdr_t *hdr, const char *name, uint32_t count)
+{
+	hdr->version = SK_LOG_FLIGHT_VERSION;
+	hdr->hdr_size = FLIGHT_HDR_SIZE;
+	hdr->slot_size = sizeof(struct flight_slot);
+	hdr->slot_count = count;
+
+	hdr->fields.seq = FLIGHT_FIELD(seq);
+	hdr->fields.ts_nsec = FLIGHT_FIELD(msg.ts_nsec);
+	hdr->fields.level = FLIGHT_FIELD(msg.level);
+	hdr->fields.pid = FLIGHT_FIELD(msg.pid);
+	hdr->fields.tid = FLIGHT_FIELD(msg.tid);
+	hdr->fields.line = FLIGHT_FIELD(msg.debug.line);
+	hdr->fields.thread = FLIGHT_FIELD(thread);
+	hdr->fields.file = FLIGHT_FIELD(file);
+	hdr->fields.function = FLIGHT_FIELD(function);
+	hdr->fields.payload = FLIGHT_FIELD(msg.payload);
+
+	hdr->pid = getpid();
+	snprintf(hdr->name, sizeof(hdr->name), "%s", name);
+
+	/* Readers only trust a header once the magic is set */
+	ck_pr_fence_store();
+	memcpy(hdr->magic, SK_LOG_FLIGHT_MAGIC, sizeof(hdr->magic));
+}
+
+/* Move the recorder of a previous run aside, e.g. of a crashed process */
+static bool
+flight_keep_previous(const char *path, sk_error_t *error)
+{
+	char prev[PATH_MAX];
+	struct stat st;
+
+	/* Nothing to keep, failures to open are reported by the caller */
+	if (stat(path, &st) == -1 || st.st_size == 0)
+		return true;
+
+	if (snprintf(prev, sizeof(prev), "%s" SK_LOG_FLIGHT_PREV_SUFFIX, path) >=
+		(int)sizeof(prev))
+		return sk_error_msg_code(
+			error, "flight path too long", SK_ERROR_EINVAL);
+
+	if (rename(path, prev) == -1)
+		return sk_error_msg_code(
+			error, "failed to keep previous flight file", errno);
+
+	return true;
+}
+
+bool
+sk_log_flight_init(sk_log_flight_t *flight, const char *path,
+	const char *name, uint8_t log_size, sk_error_t *error)
+{
+	if (log_size == 0 || log_size > SK_LOG_FLIGHT_LOG_SIZE_MAX)
+		return sk_error_msg_code(
+			error, "flight log_size out of range", SK_ERROR_EINVAL);
+
+	const uint32_t count = (uint32_t)1 << log_size;
+	const size_t size = FLIGHT_HDR_SIZE + count * sizeof(struct flight_slot);
+
+	if (!flight_keep_previous(path, error))
+		return false;
+
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd == -1)
+		return sk_error_msg_code(error, "failed to open flight file", errno);
+
+	if (ftruncate(fd, size) == -1) {
+		sk_error_msg_code(error, "failed to size flight file", errno);
+		goto failed;
+	}
+
+	void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		sk_error_msg_code(error, "failed to map flight file", errno);
+		goto failed;
+	}
+
+	/* The mapping outlives the descriptor */
+	close(fd);
+
+	flight->hdr = map;
+	flight->slots = (char *)map + FLIGHT_HDR_SIZE;
+	flight->mask = count - 1;
+	flight->map_size = size;
+
+	flight_hdr_init(flight->hdr, name, count);
+
+	return true;
+
+failed:
+	close(fd);
+	return false;
+}
+
+void
+sk_log_flight_destroy(sk_log_flight_t *flight)
+{
+	munmap(flight->hdr, flight->map_size);
+	flight->hdr = NULL;
+}
+
+/* Copy a string, keeping its tail if it doesn't fit, e.g. long paths */
+static void
+flight_copy_str(char *dst, size_t size, const char *src)
+{
+	if (src == NULL) {
+		dst[0] = '\0';
+		return;
+	}
+
+	size_t len = strlen(src);
+	if (len > size - 1) {
+		src += len - (size - 1);
+		len = size - 1;
+	}
+
+	memcpy(dst, src, len);
+	dst[len] = '\0';
+}
+
+void
+sk_log_flight_write(sk_log_flight_t *flight, const sk_log_msg_t *msg,
+	size_t payload_size, const char *thread)
+{
+	const uint64_t position = ck_pr_faa_64(&flight->hdr->head, 1);
+	struct flight_slot *slot = (struct flight_slot *)(flight->slots +
+		(position & flight->mask) * sizeof(struct flight_slot));
+
+	ck_pr_store_64(&slot->seq, 2 * position + 1);
+	ck_pr_fence_store();
+
+	memcpy(&slot->msg, msg, offsetof(sk_log_msg_t, payload) + payload_size);
+	flight_copy_str(slot->thread, sizeof(slot->thread), thread);
+	flight_copy_str(slot->file, sizeof(slot->file), msg->debug.file);
+	flight_copy_str(
+		slot->function, sizeof(slot->function), msg->debug.function);
+
+	ck_pr_fence_store();
+	ck_pr_store_64(&slot->seq, 2 * position + 2);
+}
+
+static bool
+flight_field_valid(const sk_log_flight_hdr_t *hdr,
+	const struct sk_log_flight_field *field, bool integer)
+{
+	if (field->size == 0 || field->offset + field->size > hdr->slot_size)
+		return false;
+
+	return !integer || field->size == 4 || field->size == 8;
+}
+
+static bool
+flight_hdr_valid(const sk_log_flight_hdr_t *hdr, size_t map_size)
+{
+	if (memcmp(hdr->magic, SK_LOG_FLIGHT_MAGIC, sizeof(hdr->magic)) != 0 ||
+		hdr->version != SK_LOG_FLIGHT_VERSION)
+		return false;
+
+	if (hdr->hdr_size < sizeof(*hdr) || hdr->hdr_size % 8 != 0 ||
+		hdr->slot_size == 0 || hdr->slot_size % 8 != 0 ||
+		hdr->slot_count == 0 ||
+		hdr->hdr_size + (uint64_t)hdr->slot_size * hdr->slot_count > map_size)
+		return false;
+
+	/* The sequence is read atomically */
+	if (hdr->fields.seq.size != 8 || hdr->fields.seq.offset % 8 != 0)
+		return false;
+
+	return flight_field_valid(hdr, &hdr->fields.seq, true) &&
+		flight_field_valid(hdr, &hdr->fields.ts_nsec, true) &&
+		flight_field_valid(hdr, &hdr->fields.level, true) &&
+		flight_field_valid(hdr, &hdr->fields.pid, true) &&
+		flight_field_valid(hdr, &hdr->fields.tid, true) &&
+		flight_field_valid(hdr, &hdr->fields.line, true) &&
+		flight_field_valid(hdr, &hdr->fields.thread, false) &&
+		flight_field_valid(hdr, &hdr->fields.file, false) &&
+		flight_field_valid(hdr, &hdr->fields.function, false) &&
+		flight_field_valid(hdr, &hdr->fields.payload, false);
+}
+
+bool
+sk_log_flight_open(
+	sk_log_flight_reader_t *reader, const char *path, sk_error_t *error)
+{
+	struct stat st;
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return sk_error_msg_code(error, "failed to open flight file", errno);
+
+	if (fstat(fd, &st) == -1) {
+		sk_error_msg_code(error, "failed to stat flight file", errno);
+		goto failed;
+	}
+
+	if ((size_t)st.st_size < sizeof(sk_log_flight_hdr_t)) {
+		sk_error_msg_code(error, "flight file too small", SK_ERROR_EINVAL);
+		goto failed;
+	}
+
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		sk_error_msg_code(error, "failed to map flight file", errno);
+		goto failed;
+	}
+	close(fd);
+
+	reader->hdr = map;
+	reader->map = map;
+	reader->map_size = st.st_size;
+
+	if (!flight_hdr_valid(reader->hdr, reader->map_size)) {
+		sk_log_flight_close(reader);
+		return sk_error_msg_code(
+			error, "invalid flight file header", SK_ERROR_EINVAL);
+	}
+
+	const uint64_t count = reader->hdr->slot_count;
+	reader->head = ck_pr_load_64((uint64_t *)&reader->hdr->head);
+	reader->position = (reader->head > count) ? reader->head - count : 0;
+
+	return true;
+
+failed:
+	close(fd);
+	return false;
+}
+
+static uint64_t
+flight_read_uint(const char *slot, const struct sk_log_flight_field *field)
+{
+	if (field->size == 4) {
+		uint32_t value;
+		memcpy(&value, slot + field->offset, sizeof(value));
+		return value;
+	}
+
+	uint64_t value;
+	memcpy(&value, slot + field->offset, sizeof(value));
+	return value;
+}
+
+static void
+flight_read_str(char *dst, size_t size, const char *slot,
+	const struct sk_log_flight_field *field)
+{
+	const size_t max = (field->size < size - 1) ? field->size : size - 1;
+	const size_t len = strnlen(slot + field->offset, max);
+
+	memcpy(dst, slot + field->offset, len);
+	dst[len] = '\0';
+}
+
+bool
+sk_log_flight_next(
+	sk_log_flight_reader_t *reader, sk_log_flight_record_t *record)
+{
+	const sk_log_flight_hdr_t *hdr = reader->hdr;
+
+	while (reader->position < reader->head) {
+		const uint64_t position = reader->position++;
+		const char *slot = reader->map + hdr->hdr_size +
+			(position % hdr->slot_count) * hdr->slot_size;
+		uint64_t *seq = (uint64_t *)(slot + hdr->fields.seq.offset);
+
+		const uint64_t before = ck_pr_load_64(seq);
+		if (before != 2 * position + 2)
+			continue;
+		ck_pr_fence_load();
+
+		record->position = position;
+		record->ts_nsec = flight_read_uint(slot, &hdr->fields.ts_nsec);
+		record->level = flight_read_uint(slot, &hdr->fields.level);
+		record->pid = flight_read_uint(slot, &hdr->fields.pid);
+		record->tid = flight_read_uint(slot, &hdr->fields.tid);
+		record->line = flight_read_uint(slot, &hdr->fields.line);
+		flight_read_str(record->thread, sizeof(record->thread), slot,
+			&hdr->fields.thread);
+		flight_read_str(
+			record->file, sizeof(record->file), slot, &hdr->fields.file);
+		flight_read_str(record->function, sizeof(record->function), slot,
+			&hdr->fields.function);
+		flight_read_str(record->payload, sizeof(record->payload), slot,
+			&hdr->fields.payload);
+
+		/* A live writer lapped the reader meanwhile */
+		ck_pr_fence_load();
+		if (ck_pr_load_64(seq) != before)
+			continue;
+
+		return true;
+	}
+
+	return false;
+}
+
+void
+sk_log_flight_close(sk_log_flight_reader_t *reader)
+{
+	munmap((void *)reader->map, reader->map_size);
+	reader->map = NULL;
+	reader->hdr = NULL;
+}
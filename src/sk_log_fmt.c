@@ -0,0 +1,365 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "sk_log_priv.h"
+
+/*
+ * Deferred formatting walks the printf format twice: once in the caller to
+ * pack the arguments, once in the drain to format them. Both sides must agree
+ * on the type of each argument, which is what `fmt_next` computes.
+ */
+
+enum arg_type {
+	ARG_NONE = 0,
+	ARG_INT,
+	ARG_LONG,
+	ARG_LLONG,
+	ARG_INTMAX,
+	ARG_SIZE,
+	ARG_PTRDIFF,
+	ARG_DOUBLE,
+	ARG_LDOUBLE,
+	ARG_STR,
+	ARG_PTR,
+	/* Conversion that can't be deferred */
+	ARG_INVALID,
+};
+
+struct fmt_spec {
+	/* Conversion specification, e.g. "%-*.3lld" */
+	const char *start;
+	size_t len;
+	/* Number of `*` width and precision arguments preceding the value */
+	int stars;
+	/* Precision when given as a literal, -1 otherwise */
+	int precision;
+	bool star_precision;
+	enum arg_type type;
+};
+
+/* Parse the next conversion of a format, returns the text following it. */
+static const char *
+fmt_next(const char *fmt, struct fmt_spec *spec)
+{
+	const char *p = strchr(fmt, '%');
+
+	memset(spec, 0, sizeof(*spec));
+	spec->precision = -1;
+
+	while (p != NULL && p[1] == '%')
+		p = strchr(p + 2, '%');
+
+	if (p == NULL)
+		return NULL;
+
+	spec->start = p++;
+
+	while (strchr("-+ #0'I", *p) != NULL && *p != '\0')
+		p++;
+
+	if (*p == '*') {
+		spec->stars++;
+		p++;
+	} else {
+		while (*p >= '0' && *p <= '9')
+			p++;
+	}
+
+	if (*p == '.') {
+		p++;
+		if (*p == '*') {
+			spec->stars++;
+			spec->star_precision = true;
+			p++;
+		} else {
+			spec->precision = 0;
+			while (*p >= '0' && *p <= '9')
+				spec->precision = spec->precision * 10 + (*p++ - '0');
+		}
+	}
+
+	enum arg_type integer = ARG_INT;
+	bool long_double = false;
+	switch (*p) {
+	case 'h':
+		p += (p[1] == 'h') ? 2 : 1;
+		break;
+	case 'l':
+		integer = (p[1] == 'l') ? ARG_LLONG : ARG_LONG;
+		p += (p[1] == 'l') ? 2 : 1;
+		break;
+	case 'q':
+		integer = ARG_LLONG;
+		p++;
+		break;
+	case 'j':
+		integer = ARG_INTMAX;
+		p++;
+		break;
+	case 'z':
+		integer = ARG_SIZE;
+		p++;
+		break;
+	case 't':
+		integer = ARG_PTRDIFF;
+		p++;
+		break;
+	case 'L':
+		integer = ARG_LLONG;
+		long_double = true;
+		p++;
+		break;
+	}
+
+	switch (*p) {
+	case 'd':
+	case 'i':
+	case 'u':
+	case 'o':
+	case 'x':
+	case 'X':
+		spec->type = integer;
+		break;
+	case 'c':
+		spec->type = (integer == ARG_INT) ? ARG_INT : ARG_INVALID;
+		break;
+	case 'e':
+	case 'E':
+	case 'f':
+	case 'F':
+	case 'g':
+	case 'G':
+	case 'a':
+	case 'A':
+		spec->type = long_double ? ARG_LDOUBLE : ARG_DOUBLE;
+		break;
+	case 's':
+		spec->type = (integer == ARG_INT) ? ARG_STR : ARG_INVALID;
+		break;
+	case 'p':
+		spec->type = ARG_PTR;
+		break;
+	default:
+		/* %n, %m, wide characters and unknown conversions */
+		spec->type = ARG_INVALID;
+		return p;
+	}
+
+	spec->len = (size_t)(p + 1 - spec->start);
+
+	return p + 1;
+}
+
+#define PACK(type, promoted)                                                   \
+	do {                                                                       \
+		type value = (type)va_arg(args, promoted);                             \
+		if (size - used < sizeof(value))                                       \
+			return 0;                                                          \
+		memcpy(buf + used, &value, sizeof(value));                             \
+		used += sizeof(value);                                                 \
+	} while (0)
+
+size_t
+sk_log_fmt_pack(char *buf, size_t size, const char *fmt, va_list args)
+{
+	struct fmt_spec spec;
+	size_t used = 0;
+
+	while ((fmt = fmt_next(fmt, &spec)) != NULL) {
+		int precision = spec.precision;
+
+		for (int i = 0; i < spec.stars; i++) {
+			int star = va_arg(args, int);
+			if (size - used < sizeof(star))
+				return 0;
+			memcpy(buf + used, &star, sizeof(star));
+			used += sizeof(star);
+
+			if (spec.star_precision && i == spec.stars - 1)
+				precision = star;
+		}
+
+		switch (spec.type) {
+		case ARG_INT:
+			PACK(int, int);
+			break;
+		case ARG_LONG:
+			PACK(long, long);
+			break;
+		case ARG_LLONG:
+			PACK(long long, long long);
+			break;
+		case ARG_INTMAX:
+			PACK(intmax_t, intmax_t);
+			break;
+		case ARG_SIZE:
+			PACK(size_t, size_t);
+			break;
+		case ARG_PTRDIFF:
+			PACK(ptrdiff_t, ptrdiff_t);
+			break;
+		case ARG_DOUBLE:
+			PACK(double, double);
+			break;
+		case ARG_LDOUBLE:
+			PACK(long double, long double);
+			break;
+		case ARG_PTR:
+			PACK(void *, void *);
+			break;
+		case ARG_STR: {
+			const char *str = va_arg(args, const char *);
+			if (str == NULL)
+				str = "(null)";
+
+			/* Strings with a precision need not be NUL terminated */
+			size_t len = (precision >= 0) ? strnlen(str, (size_t)precision)
+			                              : strlen(str);
+			if (size - used == 0)
+				return 0;
+			/* Truncate, the formatted payload would be truncated anyway */
+			if (len > size - used - 1)
+				len = size - used - 1;
+			memcpy(buf + used, str, len);
+			buf[used + len] = '\0';
+			used += len + 1;
+			break;
+		}
+		case ARG_NONE:
+		case ARG_INVALID:
+			return 0;
+		}
+	}
+
+	/* An empty argument list still needs a non-zero size */
+	return (used != 0) ? used : 1;
+}
+
+#undef PACK
+
+/* Formats are validated by the pack side, see `fmt_next` */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+
+#define UNPACK(type)                                                           \
+	do {                                                                       \
+		type value;                                                            \
+		if (end - buf < (ptrdiff_t)sizeof(value))                              \
+			return false;                                                      \
+		memcpy(&value, buf, sizeof(value));                                    \
+		buf += sizeof(value);                                                  \
+		if (spec.stars == 0)                                                   \
+			n = snprintf(out, size, conv, value);                              \
+		else if (spec.stars == 1)                                              \
+			n = snprintf(out, size, conv, stars[0], value);                    \
+		else                                                                   \
+			n = snprintf(out, size, conv, stars[0], stars[1], value);          \
+	} while (0)
+
+bool
+sk_log_fmt_unpack(char *out, size_t size, const char *fmt, const char *buf,
+	size_t buf_size)
+{
+	const char *end = buf + buf_size;
+	struct fmt_spec spec;
+	const char *next;
+	char conv[32];
+
+	while ((next = fmt_next(fmt, &spec)) != NULL && size > 1) {
+		int stars[2] = {0, 0};
+		int n = 0;
+
+		if (spec.type == ARG_INVALID || spec.len >= sizeof(conv))
+			return false;
+
+		/* Literal text preceding the conversion, %% are collapsed */
+		for (const char *p = fmt; p < spec.start && size > 1; p++) {
+			*out++ = *p;
+			size--;
+			if (p[0] == '%' && p[1] == '%')
+				p++;
+		}
+
+		for (int i = 0; i < spec.stars; i++) {
+			if (end - buf < (ptrdiff_t)sizeof(int))
+				return false;
+			memcpy(&stars[i], buf, sizeof(int));
+			buf += sizeof(int);
+		}
+
+		memcpy(conv, spec.start, spec.len);
+		conv[spec.len] = '\0';
+
+		switch (spec.type) {
+		case ARG_INT:
+			UNPACK(int);
+			break;
+		case ARG_LONG:
+			UNPACK(long);
+			break;
+		case ARG_LLONG:
+			UNPACK(long long);
+			break;
+		case ARG_INTMAX:
+			UNPACK(intmax_t);
+			break;
+		case ARG_SIZE:
+			UNPACK(size_t);
+			break;
+		case ARG_PTRDIFF:
+			UNPACK(ptrdiff_t);
+			break;
+		case ARG_DOUBLE:
+			UNPACK(double);
+			break;
+		case ARG_LDOUBLE:
+			UNPACK(long double);
+			break;
+		case ARG_PTR:
+			UNPACK(void *);
+			break;
+		case ARG_STR: {
+			const char *str = buf;
+			size_t len = strnlen(buf, (size_t)(end - buf));
+			if (len == (size_t)(end - buf))
+				return false;
+			buf += len + 1;
+			if (spec.stars == 0)
+				n = snprintf(out, size, conv, str);
+			else if (spec.stars == 1)
+				n = snprintf(out, size, conv, stars[0], str);
+			else
+				n = snprintf(out, size, conv, stars[0], stars[1], str);
+			break;
+		}
+		case ARG_NONE:
+		case ARG_INVALID:
+			return false;
+		}
+
+		if (n < 0)
+			return false;
+		if ((size_t)n >= size)
+			n = (int)size - 1;
+
+		out += n;
+		size -= (size_t)n;
+		fmt = next;
+	}
+
+	/* Trailing literal text */
+	for (; *fmt != '\0' && size > 1; fmt++) {
+		*out++ = *fmt;
+		size--;
+		if (fmt[0] == '%' && fmt[1] == '%')
+			fmt++;
+	}
+	*out = '\0';
+
+	return true;
+}
+
+#undef UNPACK
+
+#pragma GCC diagnostic pop
@@ -0,0 +1,159 @@
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "sk_log_priv.h"
+
+/*
+ * Text header of a message without printf: integers are rendered two digits
+ * at a time from a table, and the date and time of the current second are
+ * rendered once per second in a thread local cache, such that a header
+ * costs about a few copies.
+ */
+
+enum {
+	/* `2026-10-17T13:37:00.` */
+	HEADER_SECOND_LEN = 20,
+	/* `123456Z` */
+	HEADER_FRACTION_LEN = 7,
+};
+
+static const char digit_pairs[] = "00010203040506070809"
+								  "10111213141516171819"
+								  "20212223242526272829"
+								  "30313233343536373839"
+								  "40414243444546474849"
+								  "50515253545556575859"
+								  "60616263646566676869"
+								  "70717273747576777879"
+								  "80818283848586878889"
+								  "90919293949596979899";
+
+/* Rendering of the last second seen by the thread */
+static __thread struct {
+	uint64_t sec;
+	char text[HEADER_SECOND_LEN];
+} header_second = {UINT64_MAX, ""};
+
+/* Render `v` on exactly 2 digits */
+static inline char *
+header_u2(char *p, uint32_t v)
+{
+	memcpy(p, &digit_pairs[2 * (v % 100)], 2);
+	return p + 2;
+}
+
+/* Render `v`, returns the end of the digits */
+static char *
+header_u32(char *p, uint32_t v)
+{
+	char digits[10], *d = digits + sizeof(digits);
+
+	while (v >= 100) {
+		d -= 2;
+		memcpy(d, &digit_pairs[2 * (v % 100)], 2);
+		v /= 100;
+	}
+	if (v >= 10) {
+		d -= 2;
+		memcpy(d, &digit_pairs[2 * v], 2);
+	} else {
+		*--d = '0' + v;
+	}
+
+	const size_t len = digits + sizeof(digits) - d;
+	memcpy(p, d, len);
+
+	return p + len;
+}
+
+static const char *
+header_second_text(uint64_t sec)
+{
+	if (header_second.sec == sec)
+		return header_second.text;
+
+	const time_t t = sec;
+	struct tm tm;
+	gmtime_r(&t, &tm);
+
+	const uint32_t year = tm.tm_year + 1900;
+	char *p = header_second.text;
+	p = header_u2(p, year / 100);
+	p = header_u2(p, year);
+	*p++ = '-';
+	p = header_u2(p, tm.tm_mon + 1);
+	*p++ = '-';
+	p = header_u2(p, tm.tm_mday);
+	*p++ = 'T';
+	p = header_u2(p, tm.tm_hour);
+	*p++ = ':';
+	p = header_u2(p, tm.tm_min);
+	*p++ = ':';
+	p = header_u2(p, tm.tm_sec);
+	*p++ = '.';
+	header_second.sec = sec;
+
+	return header_second.text;
+}
+
+/* Cursor of the header being rendered, writes are bounded by `end` */
+struct header {
+	char *p, *end;
+};
+
+static inline void
+header_raw(struct header *h, const char *s, size_t len)
+{
+	if (len > (size_t)(h->end - h->p))
+		len = h->end - h->p;
+
+	memcpy(h->p, s, len);
+	h->p += len;
+}
+
+#define header_lit(h, s) header_raw(h, s, sizeof(s) - 1)
+
+static inline void
+header_str(struct header *h, const char *s)
+{
+	if (s == NULL)
+		s = "(null)";
+	header_raw(h, s, strnlen(s, h->end - h->p));
+}
+
+size_t
+sk_log_header_format(char *out, size_t size, const sk_log_msg_t *msg)
+{
+	struct header h = {out, out + size};
+	char ts[HEADER_SECOND_LEN + HEADER_FRACTION_LEN], num[16];
+
+	/* `2026-10-17T13:37:00.123456Z` */
+	const uint32_t usec = msg->ts_nsec % 1000000000 / 1000;
+	memcpy(ts, header_second_text(msg->ts_nsec / 1000000000), HEADER_SECOND_LEN);
+	char *p = ts + HEADER_SECOND_LEN;
+	p = header_u2(p, usec / 10000);
+	p = header_u2(p, usec / 100);
+	p = header_u2(p, usec);
+	*p = 'Z';
+	header_raw(&h, ts, sizeof(ts));
+
+	header_lit(&h, " logger {file: ");
+	header_str(&h, msg->debug.file);
+	header_lit(&h, ", func: ");
+	header_str(&h, msg->debug.function);
+	header_lit(&h, ", line: ");
+	p = num;
+	uint32_t line = msg->debug.line;
+	if (msg->debug.line < 0) {
+		*p++ = '-';
+		line = -line;
+	}
+	p = header_u32(p, line);
+	header_raw(&h, num, p - num);
+	header_lit(&h, "} [");
+	header_str(&h, sk_log_level_str(msg->level));
+	header_lit(&h, "]: ");
+
+	return h.p - out;
+}
@@ -0,0 +1,274 @@
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "sk_log_priv.h"
+
+/*
+ * Fields of a structured message follow the NUL terminated message in the
+ * payload. A field is encoded as its type and key length on a byte each, the
+ * NUL terminated key, then its value: numbers take 8 bytes and booleans a byte
+ * in their native representation, strings their length on 2 bytes followed by
+ * the NUL terminated string. Keys and strings are thus readable in place.
+ */
+
+enum {
+	/* Type and key length */
+	KV_HEAD_SIZE = 2,
+	/* Length of a string value */
+	KV_STR_HEAD_SIZE = sizeof(uint16_t),
+	KV_NUMBER_SIZE = sizeof(uint64_t),
+	KV_KEY_MAX = UINT8_MAX,
+};
+
+size_t
+sk_log_kv_pack(
+	char *buf, size_t size, const sk_kv_t *kvs, size_t n, uint8_t *count)
+{
+	size_t used = 0;
+
+	*count = 0;
+	for (size_t i = 0; i < n && *count < SK_LOG_KV_MAX; i++) {
+		const sk_kv_t *kv = &kvs[i];
+		const char *key = (kv->key != NULL) ? kv->key : "";
+		const size_t key_len = strnlen(key, KV_KEY_MAX);
+		const size_t head = KV_HEAD_SIZE + key_len + 1;
+		const char *str = NULL;
+		size_t str_len = 0, value_size;
+		bool truncated = false;
+
+		switch (kv->type) {
+		case SK_KV_TYPE_INT:
+		case SK_KV_TYPE_UINT:
+		case SK_KV_TYPE_DOUBLE:
+			value_size = KV_NUMBER_SIZE;
+			break;
+		case SK_KV_TYPE_BOOL:
+			value_size = 1;
+			break;
+		case SK_KV_TYPE_STR:
+			str = (kv->s != NULL) ? kv->s : "(null)";
+			str_len = strnlen(str, size);
+			value_size = KV_STR_HEAD_SIZE + str_len + 1;
+			break;
+		default:
+			continue;
+		}
+
+		if (used + head + value_size > size) {
+			/* Only a string shrinks to fit, it is then the last field */
+			if (str == NULL || used + head + KV_STR_HEAD_SIZE + 1 > size)
+				break;
+			str_len = size - used - head - KV_STR_HEAD_SIZE - 1;
+			value_size = KV_STR_HEAD_SIZE + str_len + 1;
+			truncated = true;
+		}
+
+		char *p = buf + used;
+		*p++ = (char)kv->type;
+		*p++ = (char)key_len;
+		memcpy(p, key, key_len);
+		p[key_len] = '\0';
+		p += key_len + 1;
+
+		if (str != NULL) {
+			const uint16_t len = str_len;
+			memcpy(p, &len, sizeof(len));
+			memcpy(p + KV_STR_HEAD_SIZE, str, str_len);
+			p[KV_STR_HEAD_SIZE + str_len] = '\0';
+		} else if (kv->type == SK_KV_TYPE_BOOL) {
+			*p = kv->b;
+		} else {
+			memcpy(p, &kv->u, KV_NUMBER_SIZE);
+		}
+
+		used += head + value_size;
+		(*count)++;
+
+		if (truncated)
+			break;
+	}
+
+	return used;
+}
+
+/* Decode a field at `*p`, bounded by `end` */
+static bool
+kv_decode(const char **p, const char *end, sk_kv_t *kv)
+{
+	const char *cur = *p;
+
+	if (end - cur < KV_HEAD_SIZE)
+		return false;
+
+	const uint8_t type = cur[0], key_len = cur[1];
+	cur += KV_HEAD_SIZE;
+	if (end - cur < key_len + 1)
+		return false;
+
+	kv->key = cur;
+	kv->type = type;
+	cur += key_len + 1;
+
+	switch (kv->type) {
+	case SK_KV_TYPE_INT:
+	case SK_KV_TYPE_UINT:
+	case SK_KV_TYPE_DOUBLE:
+		if (end - cur < KV_NUMBER_SIZE)
+			return false;
+		memcpy(&kv->u, cur, KV_NUMBER_SIZE);
+		cur += KV_NUMBER_SIZE;
+		break;
+	case SK_KV_TYPE_BOOL:
+		if (end - cur < 1)
+			return false;
+		kv->b = *cur++;
+		break;
+	case SK_KV_TYPE_STR: {
+		uint16_t len;
+		if (end - cur < KV_STR_HEAD_SIZE)
+			return false;
+		memcpy(&len, cur, sizeof(len));
+		cur += KV_STR_HEAD_SIZE;
+		if (end - cur < len + 1)
+			return false;
+		kv->s = cur;
+		cur += len + 1;
+		break;
+	}
+	default:
+		return false;
+	}
+
+	*p = cur;
+	return true;
+}
+
+size_t
+sk_log_msg_kv(const sk_log_msg_t *msg, sk_kv_t *kvs, size_t n)
+{
+	const char *end = msg->payload + SK_LOG_MSG_MAX;
+	const char *p = msg->payload + strnlen(msg->payload, SK_LOG_MSG_MAX) + 1;
+	size_t i;
+
+	for (i = 0; i < n && i < msg->kv_count; i++) {
+		if (!kv_decode(&p, end, &kvs[i]))
+			break;
+	}
+
+	return i;
+}
+
+size_t
+sk_log_msg_payload_size(const sk_log_msg_t *msg)
+{
+	const char *end = msg->payload + SK_LOG_MSG_MAX;
+	const char *p = msg->payload + strnlen(msg->payload, SK_LOG_MSG_MAX - 1) + 1;
+	sk_kv_t kv;
+
+	for (size_t i = 0; i < msg->kv_count; i++) {
+		if (!kv_decode(&p, end, &kv))
+			break;
+	}
+
+	return p - msg->payload;
+}
+
+/* Quote strings that would be ambiguous unquoted */
+static bool
+kv_needs_quotes(const char *s)
+{
+	if (*s == '\0')
+		return true;
+
+	for (; *s != '\0'; s++) {
+		if (*s == ' ' || *s == '=' || *s == '"' || (unsigned char)*s < 0x20)
+			return true;
+	}
+
+	return false;
+}
+
+/* Append a quoted and escaped string, returns the length of the text */
+static size_t
+kv_format_quoted(char *out, size_t size, size_t len, const char *s)
+{
+	if (len + 1 < size)
+		out[len++] = '"';
+
+	for (; *s != '\0' && len + 1 < size; s++) {
+		const char escaped = (*s == '"' || *s == '\\') ? *s
+			: (*s == '\n')                             ? 'n'
+			: (*s == '\t')                             ? 't'
+			                                           : '\0';
+		if (escaped == '\0') {
+			out[len++] = *s;
+		} else if (len + 2 < size) {
+			out[len++] = '\\';
+			out[len++] = escaped;
+		} else {
+			break;
+		}
+	}
+
+	if (len + 1 < size)
+		out[len++] = '"';
+	out[len] = '\0';
+
+	return len;
+}
+
+size_t
+sk_log_kv_format(char *out, size_t size, const sk_log_msg_t *msg)
+{
+	sk_kv_t kvs[SK_LOG_KV_MAX];
+	const size_t n = sk_log_msg_kv(msg, kvs, SK_LOG_KV_MAX);
+	size_t len = 0;
+
+	out[0] = '\0';
+	for (size_t i = 0; i < n && len + 1 < size; i++) {
+		const sk_kv_t *kv = &kvs[i];
+		int written = -1;
+
+		switch (kv->type) {
+		case SK_KV_TYPE_INT:
+			written = snprintf(
+				out + len, size - len, " %s=%" PRId64, kv->key, kv->i);
+			break;
+		case SK_KV_TYPE_UINT:
+			written = snprintf(
+				out + len, size - len, " %s=%" PRIu64, kv->key, kv->u);
+			break;
+		case SK_KV_TYPE_DOUBLE:
+			written = snprintf(out + len, size - len, " %s=%g", kv->key, kv->d);
+			break;
+		case SK_KV_TYPE_BOOL:
+			written = snprintf(out + len, size - len, " %s=%s", kv->key,
+				kv->b ? "true" : "false");
+			break;
+		case SK_KV_TYPE_STR:
+			if (!kv_needs_quotes(kv->s)) {
+				written = snprintf(
+					out + len, size - len, " %s=%s", kv->key, kv->s);
+				break;
+			}
+			written = snprintf(out + len, size - len, " %s=", kv->key);
+			if (written >= 0 && (size_t)written < size - len) {
+				len = kv_format_quoted(out, size, len + written, kv->s);
+				continue;
+			}
+			break;
+		}
+
+		if (written < 0)
+			break;
+		if ((size_t)written >= size - len) {
+			len = size - 1;
+			break;
+		}
+		len += written;
+	}
+
+	return len;
+}
@@ -0,0 +1,222 @@
+#pragma once
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <sk_logger_drv.h>
+
+/*
+ * Timestamp of a message in seconds with microseconds, rendered from its
+ * integer nanoseconds such that the locale doesn't change the radix, e.g.
+ *
+ *   printf("ts=" SK_LOG_MSG_TS_FMT, SK_LOG_MSG_TS_ARGS(msg));
+ */
+#define SK_LOG_MSG_TS_FMT "%" PRIu64 ".%06" PRIu64
+#define SK_LOG_MSG_TS_ARGS(msg)                                                \
+	(msg)->ts_nsec / 1000000000, (msg)->ts_nsec % 1000000000 / 1000
+
+/*
+ * Render the text header of a message shared by drivers, e.g.
+ * `2026-10-17T13:37:00.123456Z logger {file: a.c, func: f, line: 42} [info]: `.
+ * Timestamps are UTC, dates are cached per thread for the current second.
+ *
+ * @param out, buffer to render into, not NUL terminated
+ * @param size, size of the buffer, the header is truncated to fit
+ * @param msg, message to render the header of
+ *
+ * @return the length of the header
+ */
+size_t
+sk_log_header_format(char *out, size_t size, const sk_log_msg_t *msg)
+	sk_nonnull(1, 3);
+
+/*
+ * Call a function on every live logger. The registry is read locked
+ * meanwhile, such that loggers can't be destroyed.
+ *
+ * @param fn, function to call on each logger
+ * @param ctx, context passed to fn
+ *
+ * @return the sum of the values returned by fn
+ */
+size_t
+sk_loggers_foreach(size_t (*fn)(sk_logger_t *, void *), void *ctx)
+	sk_nonnull(1);
+
+/*
+ * Wake the drain worker sleeping on a wakeup word, see `sk_log_drain.h`.
+ *
+ * @param wakeup, wakeup word of the worker
+ */
+void
+sk_log_drain_wakeup(uint32_t *wakeup) sk_nonnull(1);
+
+/*
+ * Pack the arguments of a printf format into a buffer.
+ *
+ * Values are copied in their native representation, strings are copied
+ * inline. The format string is not copied and must outlive the buffer.
+ *
+ * @param buf, buffer to pack into
+ * @param size, size of the buffer
+ * @param fmt, printf format
+ * @param args, arguments of the format
+ *
+ * @return the number of bytes used, or 0 if the format can't be deferred and
+ *         must be formatted eagerly, e.g. `%m`, `%n` or out of space.
+ */
+size_t
+sk_log_fmt_pack(char *buf, size_t size, const char *fmt, va_list args)
+	sk_nonnull(1, 3);
+
+/*
+ * Format arguments packed by `sk_log_fmt_pack`.
+ *
+ * @param out, buffer to format into, always NUL terminated
+ * @param size, size of the output buffer
+ * @param fmt, printf format used to pack
+ * @param buf, packed arguments
+ * @param buf_size, size of packed arguments
+ *
+ * @return true on success, false if the packed buffer is corrupted
+ */
+bool
+sk_log_fmt_unpack(char *out, size_t size, const char *fmt, const char *buf,
+	size_t buf_size) sk_nonnull(1, 3, 4);
+
+/*
+ * Encode typed fields, see `sk_log_kv`.
+ *
+ * @param buf, buffer to encode into
+ * @param size, size of the buffer
+ * @param kvs, fields to encode
+ * @param n, number of fields
+ * @param count, number of encoded fields, the ones that fit
+ *
+ * @return the number of bytes used
+ */
+size_t
+sk_log_kv_pack(char *buf, size_t size, const sk_kv_t *kvs, size_t n,
+	uint8_t *count) sk_nonnull(1, 5);
+
+enum {
+	/* Size of a text rendering of the fields of a message */
+	SK_LOG_KV_TEXT_MAX = 1024,
+};
+
+/*
+ * Render the fields of a message as text for drivers that don't handle them,
+ * e.g. ` user=42 from="a b"`. Strings are quoted if needed.
+ *
+ * @param out, buffer to render into, always NUL terminated
+ * @param size, size of the buffer
+ * @param msg, message holding the fields
+ *
+ * @return the length of the text, possibly truncated
+ */
+size_t
+sk_log_kv_format(char *out, size_t size, const sk_log_msg_t *msg)
+	sk_nonnull(1, 3);
+
+enum {
+	/* Worst case length of an escaped byte, e.g. `\u001f` */
+	SK_LOG_ESCAPE_MAX = 6,
+};
+
+/*
+ * Escape a string for a JSON string literal, quotes excluded. Also used for
+ * quoted logfmt values.
+ *
+ * @param out, buffer to escape into, of at least SK_LOG_ESCAPE_MAX * len
+ * @param in, string to escape
+ * @param len, length of the string
+ *
+ * @return the length of the escaped string, which is not NUL terminated
+ */
+size_t
+sk_log_escape_json(char *out, const char *in, size_t len) sk_nonnull(1, 2);
+
+/*
+ * Check if a logfmt value must be quoted, i.e. it is empty or holds spaces,
+ * `=`, quotes, backslashes or control bytes.
+ *
+ * @param in, value to check
+ * @param len, length of the value
+ *
+ * @return true if the value must be quoted and escaped
+ */
+bool
+sk_log_logfmt_needs_quotes(const char *in, size_t len) sk_nonnull(1);
+
+/* Read the cycle counter, see SK_LOG_CLOCK_TSC */
+static inline uint64_t
+sk_log_tsc_read(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+/*
+ * Calibrate the cycle counter once.
+ *
+ * @return true if the counter is invariant and calibrated, false otherwise
+ */
+bool
+sk_log_tsc_init(void);
+
+/*
+ * Convert a cycle counter reading to nanoseconds since the epoch.
+ *
+ * @param tsc, reading of `sk_log_tsc_read`
+ *
+ * @return the time of the reading in nanoseconds
+ */
+uint64_t
+sk_log_tsc_to_ns(uint64_t tsc);
+
+/*
+ * Create the recorder of a SK_LOGGER_RING_FLIGHT logger, see `sk_log_flight.h`.
+ * A non empty file at `path` is renamed with SK_LOG_FLIGHT_PREV_SUFFIX.
+ *
+ * @param flight, recorder to initialize
+ * @param path, path of the backing file
+ * @param name, name of the logger
+ * @param log_size, the recorder holds 2^log_size messages
+ * @param error, error to store failure information
+ *
+ * @return true on success, false otherwise and set error
+ */
+bool
+sk_log_flight_init(sk_log_flight_t *flight, const char *path,
+	const char *name, uint8_t log_size, sk_error_t *error)
+	sk_nonnull(1, 2, 3, 5);
+
+/*
+ * Unmap a recorder, its file is left in place.
+ *
+ * @param flight, recorder to destroy
+ */
+void
+sk_log_flight_destroy(sk_log_flight_t *flight) sk_nonnull(1);
+
+/*
+ * Write a message in a recorder, overwriting the oldest one.
+ *
+ * @param flight, recorder to write into
+ * @param msg, message to write, its payload must be formatted
+ * @param payload_size, number of valid payload bytes
+ * @param thread, name of the calling thread
+ */
+void
+sk_log_flight_write(sk_log_flight_t *flight, const sk_log_msg_t *msg,
+	size_t payload_size, const char *thread) sk_nonnull(1, 2, 4);
@@ -1,9 +1,14 @@
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
 #include <syslog.h>
 
 #include <sk_logger_drv.h>
 
+#include "sk_log_priv.h"
+
 static sk_logger_drv_console_ctx_t __default_console_ctx = {SK_LOG_WARNING};
 
 /* protect with lock */
@@ -64,6 +69,8 @@ sk_logger_drv_builder_null(
 
 	driver->open = sk_logger_drv_open_null;
 	driver->log = sk_logger_drv_log_null;
+	driver->log_batch = NULL;
+	driver->flush = NULL;
 	driver->close = sk_logger_drv_close_null;
 
 	driver->ctx = ctx;
@@ -111,6 +118,8 @@ sk_logger_drv_builder_tally(
 
 	driver->open = sk_logger_drv_open_tally;
 	driver->log = sk_logger_drv_log_tally;
+	driver->log_batch = NULL;
+	driver->flush = NULL;
 	driver->close = sk_logger_drv_close_tally;
 
 	driver->ctx = NULL;
@@ -121,25 +130,108 @@ sk_logger_drv_builder_tally(
 /*
  * console driver
  */
-bool
-sk_logger_drv_log_console(
-	sk_logger_drv_t *driver, sk_log_msg_t *msg, sk_error_t *error)
+enum {
+	/* Headers of a batch are formatted in a buffer of this size */
+	CONSOLE_BUF_SIZE = 64 * 1024,
+	/*
+	 * A message is written as a header, its payload, its fields rendered
+	 * after the header in the buffer, and a newline.
+	 */
+	CONSOLE_IOV_PER_MSG = 4,
+	/* Room in the buffer for the header and fields of a message */
+	CONSOLE_MSG_MAX = 4096,
+};
+
+struct console_ctx {
+	sk_logger_drv_console_ctx_t opts;
+
+	char buf[CONSOLE_BUF_SIZE];
+	struct iovec iov[CONSOLE_IOV_PER_MSG * SK_LOG_BATCH_MAX];
+};
+
+static inline FILE *
+console_stream(const struct console_ctx *ctx, const sk_log_msg_t *msg)
+{
+	return (msg->level <= ctx->opts.threshold) ? stderr : stdout;
+}
+
+/* Write vectors entirely, resuming after partial writes */
+static bool
+console_writev(int fd, struct iovec *iov, int iovcnt)
 {
-	const enum sk_log_level threshold =
-		((sk_logger_drv_console_ctx_t *)driver->ctx)->threshold;
+	while (iovcnt > 0) {
+		ssize_t written = writev(fd, iov, iovcnt);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+
+		for (; iovcnt > 0 && (size_t)written >= iov->iov_len; iov++, iovcnt--)
+			written -= iov->iov_len;
+
+		if (iovcnt > 0) {
+			iov->iov_base = (char *)iov->iov_base + written;
+			iov->iov_len -= written;
+		}
+	}
 
-	FILE *fd = (msg->level <= threshold) ? stderr : stdout;
+	return true;
+}
 
-	if (fprintf(fd, "%f %s {file: %s, func: %s, line: %d} [%s]: %s\n",
-			msg->ts_nsec / 1000000.0, "logger", msg->debug.file,
-			msg->debug.function, msg->debug.line, sk_log_level_str(msg->level),
-			msg->payload) < 0) {
-		return sk_error_msg(error, "failed to print to console");
+bool
+sk_logger_drv_log_batch_console(sk_logger_drv_t *driver, sk_log_msg_t **msgs,
+	size_t n, sk_error_t *error)
+{
+	struct console_ctx *ctx = driver->ctx;
+	static char newline[] = "\n";
+	size_t i = 0;
+
+	while (i < n) {
+		FILE *stream = console_stream(ctx, msgs[i]);
+		struct iovec *iov = ctx->iov;
+		size_t used = 0;
+
+		/* Gather the run of messages going to the same stream */
+		for (; i < n && console_stream(ctx, msgs[i]) == stream; i++) {
+			const sk_log_msg_t *msg = msgs[i];
+
+			/* Flush the headers gathered so far first */
+			if (sizeof(ctx->buf) - used < CONSOLE_MSG_MAX && iov != ctx->iov)
+				break;
+
+			const size_t len = sk_log_header_format(
+				ctx->buf + used, sizeof(ctx->buf) - used, msg);
+			*iov++ = (struct iovec){ctx->buf + used, len};
+			*iov++ = (struct iovec){(void *)msg->payload,
+				strnlen(msg->payload, SK_LOG_MSG_MAX)};
+			used += len;
+
+			size_t fields = 0;
+			if (msg->kv_count != 0 && used + 1 < sizeof(ctx->buf))
+				fields = sk_log_kv_format(
+					ctx->buf + used, sizeof(ctx->buf) - used, msg);
+			*iov++ = (struct iovec){ctx->buf + used, fields};
+			*iov++ = (struct iovec){newline, 1};
+			used += fields;
+		}
+
+		/* Preserve ordering with messages buffered by stdio */
+		fflush(stream);
+		if (!console_writev(fileno(stream), ctx->iov, iov - ctx->iov))
+			return sk_error_msg(error, "failed to write to console");
 	}
 
 	return true;
 }
 
+bool
+sk_logger_drv_log_console(
+	sk_logger_drv_t *driver, sk_log_msg_t *msg, sk_error_t *error)
+{
+	return sk_logger_drv_log_batch_console(driver, &msg, 1, error);
+}
+
 void
 sk_logger_drv_close_console(sk_logger_drv_t *driver)
 {
@@ -152,15 +244,17 @@ sk_logger_drv_builder_console(
 {
 	(void)error;
 
-	sk_logger_drv_console_ctx_t *console_ctx = calloc(1, sizeof(*console_ctx));
+	struct console_ctx *console_ctx = calloc(1, sizeof(*console_ctx));
 	if (console_ctx == NULL)
 		return sk_error_msg_code(
 			error, "console_ctx calloc failed", SK_ERROR_ENOMEM);
-	memcpy(console_ctx, ctx, sizeof(*console_ctx));
+	memcpy(&console_ctx->opts, ctx, sizeof(console_ctx->opts));
 
 	/* No need a custom opener since we initialize the context in the builder */
 	driver->open = sk_logger_drv_open_null;
 	driver->log = sk_logger_drv_log_console;
+	driver->log_batch = sk_logger_drv_log_batch_console;
+	driver->flush = NULL;
 	driver->close = sk_logger_drv_close_console;
 
 	driver->ctx = console_ctx;
@@ -188,9 +282,14 @@ sk_logger_drv_log_syslog(
 {
 	(void)driver;
 	(void)error;
+	char fields[SK_LOG_KV_TEXT_MAX] = "";
+
+	if (msg->kv_count != 0)
+		sk_log_kv_format(fields, sizeof(fields), msg);
 
-	syslog(msg->level, "%s {file: %s, func: %s, line: %d} %s\n", "logger",
-		msg->debug.file, msg->debug.function, msg->debug.line, msg->payload);
+	syslog(msg->level, "%s {file: %s, func: %s, line: %d} %s%s\n", "logger",
+		msg->debug.file, msg->debug.function, msg->debug.line, msg->payload,
+		fields);
 
 	return true;
 }
@@ -217,6 +316,8 @@ sk_logger_drv_builder_syslog(
 
 	driver->open = sk_logger_drv_open_syslog;
 	driver->log = sk_logger_drv_log_syslog;
+	driver->log_batch = NULL;
+	driver->flush = NULL;
 	driver->close = sk_logger_drv_close_syslog;
 
 	driver->ctx = syslog_ctx;
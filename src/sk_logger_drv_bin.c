@@ -0,0 +1,379 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sk_log_bin.h>
+#include <sk_logger_drv.h>
+
+#include "sk_log_priv.h"
+
+enum {
+	BIN_DEFAULT_MODE = 0644,
+	/* Bound of a record, truncated strings included */
+	BIN_RECORD_MAX = sizeof(sk_log_bin_record_t) + 2 * UINT8_MAX +
+		SK_LOG_THREAD_NAME_MAX + SK_LOG_MSG_MAX,
+	BIN_BLOCK_MIN = sizeof(sk_log_bin_block_t) + BIN_RECORD_MAX,
+};
+
+static_assert(sizeof(sk_log_bin_record_t) == 32,
+	"binary records must have a stable layout");
+static_assert(sizeof(sk_log_bin_block_t) == 32,
+	"binary blocks must have a stable layout");
+
+struct bin_ctx {
+	sk_logger_drv_bin_ctx_t opts;
+	char *path;
+
+	int fd, index_fd;
+	/* Offset of the next block, the size of the file */
+	uint64_t size;
+
+	/* Block being filled, starting with its header, since `opened_nsec` */
+	char *buf;
+	size_t used;
+	sk_log_bin_block_t block;
+	uint64_t opened_nsec;
+};
+
+static uint64_t
+bin_monotonic(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/* Write a buffer, resuming after partial writes */
+static bool
+bin_write(int fd, const void *buf, size_t size, sk_error_t *error)
+{
+	size_t written = 0;
+
+	while (written < size) {
+		const ssize_t len =
+			write(fd, (const char *)buf + written, size - written);
+		if (len == -1) {
+			if (errno == EINTR)
+				continue;
+			return sk_error_msg_code(
+				error, "failed to write binary log file", errno);
+		}
+		written += len;
+	}
+
+	return true;
+}
+
+static void
+bin_block_reset(struct bin_ctx *ctx)
+{
+	ctx->used = sizeof(sk_log_bin_block_t);
+	ctx->block = (sk_log_bin_block_t){
+		.magic = SK_LOG_BIN_BLOCK_MAGIC,
+		.ts_min = UINT64_MAX,
+	};
+}
+
+/* Drop what a failed write left after the last block */
+static void
+bin_rewind(struct bin_ctx *ctx)
+{
+	struct stat st;
+
+	/* Readers skip what remains, blocks are written after it */
+	if (ftruncate(ctx->fd, ctx->size) == -1 && fstat(ctx->fd, &st) == 0)
+		ctx->size = st.st_size;
+}
+
+/* Write the block, then its index entry */
+static bool
+bin_block_write(struct bin_ctx *ctx, sk_error_t *error)
+{
+	if (ctx->block.count == 0)
+		return true;
+
+	ctx->block.size = ctx->used - sizeof(sk_log_bin_block_t);
+	memcpy(ctx->buf, &ctx->block, sizeof(ctx->block));
+
+	const sk_log_bin_index_t entry = {.offset = ctx->size, .block = ctx->block};
+	const size_t used = ctx->used;
+
+	/* The block is discarded on failure, the next one may succeed */
+	bin_block_reset(ctx);
+
+	if (!bin_write(ctx->fd, ctx->buf, used, error)) {
+		bin_rewind(ctx);
+		return false;
+	}
+	ctx->size += used;
+
+	return bin_write(ctx->index_fd, &entry, sizeof(entry), error);
+}
+
+static void
+bin_block_append(struct bin_ctx *ctx, const sk_log_msg_t *msg)
+{
+	const char *file = (msg->debug.file != NULL) ? msg->debug.file : "";
+	const char *function =
+		(msg->debug.function != NULL) ? msg->debug.function : "";
+	const char *thread = (msg->thread != NULL) ? msg->thread : "";
+
+	if (ctx->block.count == 0)
+		ctx->opened_nsec = bin_monotonic();
+
+	sk_log_bin_record_t record = {
+		.level = msg->level,
+		.kv_count = msg->kv_count,
+		.line = msg->debug.line,
+		.ts_nsec = msg->ts_nsec,
+		.pid = msg->pid,
+		.tid = msg->tid,
+		.file_len = strnlen(file, UINT8_MAX),
+		.function_len = strnlen(function, UINT8_MAX),
+		.thread_len = strnlen(thread, SK_LOG_THREAD_NAME_MAX),
+		.payload_len = sk_log_msg_payload_size(msg),
+	};
+	record.size = sizeof(record) + record.file_len + record.function_len +
+		record.thread_len + record.payload_len;
+
+	char *p = ctx->buf + ctx->used;
+	memcpy(p, &record, sizeof(record));
+	p += sizeof(record);
+	memcpy(p, file, record.file_len);
+	p += record.file_len;
+	memcpy(p, function, record.function_len);
+	p += record.function_len;
+	memcpy(p, thread, record.thread_len);
+	p += record.thread_len;
+	memcpy(p, msg->payload, record.payload_len);
+
+	ctx->used += record.size;
+	ctx->block.count++;
+	ctx->block.levels |= 1u << msg->level;
+	if (msg->ts_nsec < ctx->block.ts_min)
+		ctx->block.ts_min = msg->ts_nsec;
+	if (msg->ts_nsec > ctx->block.ts_max)
+		ctx->block.ts_max = msg->ts_nsec;
+}
+
+/*
+ * Truncate the file after its last valid block, and the index after its
+ * last whole entry, such that blocks are appended after those of a crash.
+ */
+static bool
+bin_blocks_recover(struct bin_ctx *ctx, uint64_t offset, sk_error_t *error)
+{
+	sk_log_bin_block_t block;
+	struct stat st;
+
+	while (pread(ctx->fd, &block, sizeof(block), offset) == sizeof(block) &&
+		block.magic == SK_LOG_BIN_BLOCK_MAGIC &&
+		block.size <= ctx->size - offset - sizeof(block))
+		offset += sizeof(block) + block.size;
+
+	if (offset < ctx->size) {
+		if (ftruncate(ctx->fd, offset) == -1)
+			return sk_error_msg_code(
+				error, "failed to truncate binary log file", errno);
+		ctx->size = offset;
+	}
+
+	if (fstat(ctx->index_fd, &st) == -1)
+		return sk_error_msg_code(
+			error, "failed to stat binary log index", errno);
+	if (st.st_size % sizeof(sk_log_bin_index_t) != 0 &&
+		ftruncate(ctx->index_fd,
+			st.st_size - st.st_size % sizeof(sk_log_bin_index_t)) == -1)
+		return sk_error_msg_code(
+			error, "failed to truncate binary log index", errno);
+
+	return true;
+}
+
+/* Write the header of a new file, or check the one of an existing file */
+static bool
+bin_hdr_prepare(struct bin_ctx *ctx, const char *name, sk_error_t *error)
+{
+	sk_log_bin_hdr_t hdr = {
+		.version = SK_LOG_BIN_VERSION,
+		.hdr_size = sizeof(hdr),
+		.pid = getpid(),
+	};
+
+	if (ctx->size == 0) {
+		memcpy(hdr.magic, SK_LOG_BIN_MAGIC, sizeof(hdr.magic));
+		snprintf(hdr.name, sizeof(hdr.name), "%s", (name != NULL) ? name : "");
+		if (!bin_write(ctx->fd, &hdr, sizeof(hdr), error))
+			return false;
+		ctx->size = sizeof(hdr);
+		return true;
+	}
+
+	if (pread(ctx->fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+		memcmp(hdr.magic, SK_LOG_BIN_MAGIC, sizeof(hdr.magic)) != 0 ||
+		hdr.version != SK_LOG_BIN_VERSION || hdr.hdr_size < sizeof(hdr) ||
+		hdr.hdr_size > ctx->size)
+		return sk_error_msg_code(
+			error, "invalid binary log file header", SK_ERROR_EINVAL);
+
+	return bin_blocks_recover(ctx, hdr.hdr_size, error);
+}
+
+bool
+sk_logger_drv_open_bin(sk_logger_drv_t *driver, sk_error_t *error)
+{
+	struct bin_ctx *ctx = driver->ctx;
+	char index_path[PATH_MAX];
+	struct stat st;
+
+	if ((ctx->buf = malloc(ctx->opts.block_size)) == NULL)
+		return sk_error_msg_code(
+			error, "binary block malloc failed", SK_ERROR_ENOMEM);
+	bin_block_reset(ctx);
+
+	ctx->fd = open(ctx->path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC,
+		ctx->opts.mode);
+	if (ctx->fd == -1) {
+		sk_error_msg_code(error, "failed to open binary log file", errno);
+		goto failed_open;
+	}
+
+	if (fstat(ctx->fd, &st) == -1) {
+		sk_error_msg_code(error, "failed to stat binary log file", errno);
+		goto failed_index;
+	}
+	ctx->size = st.st_size;
+
+	snprintf(index_path, sizeof(index_path), "%s" SK_LOG_BIN_INDEX_SUFFIX,
+		ctx->path);
+	ctx->index_fd = open(index_path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC,
+		ctx->opts.mode);
+	if (ctx->index_fd == -1) {
+		sk_error_msg_code(error, "failed to open binary log index", errno);
+		goto failed_index;
+	}
+
+	if (!bin_hdr_prepare(ctx, driver->name, error))
+		goto failed_prepare;
+
+	return true;
+
+failed_prepare:
+	close(ctx->index_fd);
+	ctx->index_fd = -1;
+failed_index:
+	close(ctx->fd);
+	ctx->fd = -1;
+failed_open:
+	free(ctx->buf);
+	ctx->buf = NULL;
+	return false;
+}
+
+bool
+sk_logger_drv_log_batch_bin(sk_logger_drv_t *driver, sk_log_msg_t **msgs,
+	size_t n, sk_error_t *error)
+{
+	struct bin_ctx *ctx = driver->ctx;
+
+	for (size_t i = 0; i < n; i++) {
+		if (ctx->opts.block_size - ctx->used < BIN_RECORD_MAX &&
+			!bin_block_write(ctx, error))
+			return false;
+
+		bin_block_append(ctx, msgs[i]);
+	}
+
+	return true;
+}
+
+bool
+sk_logger_drv_flush_bin(sk_logger_drv_t *driver, sk_error_t *error)
+{
+	struct bin_ctx *ctx = driver->ctx;
+
+	/* Younger blocks wait to fill */
+	if (ctx->block.count == 0 ||
+		bin_monotonic() - ctx->opened_nsec <
+			(uint64_t)ctx->opts.flush_ms * 1000000)
+		return true;
+
+	return bin_block_write(ctx, error);
+}
+
+bool
+sk_logger_drv_log_bin(
+	sk_logger_drv_t *driver, sk_log_msg_t *msg, sk_error_t *error)
+{
+	return sk_logger_drv_log_batch_bin(driver, &msg, 1, error) &&
+		sk_logger_drv_flush_bin(driver, error);
+}
+
+void
+sk_logger_drv_close_bin(sk_logger_drv_t *driver)
+{
+	struct bin_ctx *ctx = driver->ctx;
+	sk_error_t error;
+
+	if (ctx->buf != NULL) {
+		(void)bin_block_write(ctx, &error);
+		close(ctx->index_fd);
+		close(ctx->fd);
+	}
+
+	free(ctx->buf);
+	free(ctx->path);
+	free(ctx);
+}
+
+bool
+sk_logger_drv_builder_bin(sk_logger_drv_t *driver, void *ctx, sk_error_t *error)
+{
+	const sk_logger_drv_bin_ctx_t *opts = ctx;
+
+	if (opts->path == NULL)
+		return sk_error_msg_code(
+			error, "binary log path is NULL", SK_ERROR_EINVAL);
+
+	struct bin_ctx *bin_ctx = calloc(1, sizeof(*bin_ctx));
+	if (bin_ctx == NULL)
+		return sk_error_msg_code(
+			error, "bin_ctx calloc failed", SK_ERROR_ENOMEM);
+
+	bin_ctx->opts = *opts;
+	bin_ctx->fd = bin_ctx->index_fd = -1;
+
+	if ((bin_ctx->path = strdup(opts->path)) == NULL) {
+		free(bin_ctx);
+		return sk_error_msg_code(
+			error, "binary log path strdup failed", SK_ERROR_ENOMEM);
+	}
+	bin_ctx->opts.path = bin_ctx->path;
+
+	if (bin_ctx->opts.mode == 0)
+		bin_ctx->opts.mode = BIN_DEFAULT_MODE;
+	if (bin_ctx->opts.block_size == 0)
+		bin_ctx->opts.block_size = SK_LOG_BIN_BLOCK_SIZE;
+	if (bin_ctx->opts.block_size < BIN_BLOCK_MIN)
+		bin_ctx->opts.block_size = BIN_BLOCK_MIN;
+	if (bin_ctx->opts.flush_ms == 0)
+		bin_ctx->opts.flush_ms = SK_LOG_BIN_FLUSH_MS;
+
+	driver->open = sk_logger_drv_open_bin;
+	driver->log = sk_logger_drv_log_bin;
+	driver->log_batch = sk_logger_drv_log_batch_bin;
+	driver->flush = sk_logger_drv_flush_bin;
+	driver->close = sk_logger_drv_close_bin;
+
+	driver->ctx = bin_ctx;
+
+	return true;
+}
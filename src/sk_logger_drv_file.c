@@ -0,0 +1,331 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <ck_pr.h>
+
+#include <sk_logger_drv.h>
+
+#include "sk_log_priv.h"
+
+enum {
+	/* Room kept in the buffer for a formatted message */
+	FILE_LINE_MAX = 4096,
+	FILE_DEFAULT_MODE = 0644,
+};
+
+struct file_ctx {
+	sk_logger_drv_file_ctx_t opts;
+	char *path;
+
+	int fd;
+	/* Size of the file, buffered bytes excluded */
+	uint64_t size;
+	/* Bytes written since the last fdatasync */
+	uint64_t unsynced;
+	/* Monotonic time the file was opened at, in seconds */
+	uint64_t opened_at;
+	/* Value of `file_generation` when the file was opened */
+	uint32_t generation;
+
+	char *buf;
+	size_t used;
+};
+
+/* Bumped by `sk_logger_drv_file_reopen` */
+static uint32_t file_generation;
+static int file_sighup_installed;
+
+void
+sk_logger_drv_file_reopen(void)
+{
+	ck_pr_inc_32(&file_generation);
+}
+
+static void
+file_sighup(int signum)
+{
+	(void)signum;
+	sk_logger_drv_file_reopen();
+}
+
+static uint64_t
+file_now(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec;
+}
+
+static bool
+file_open(struct file_ctx *ctx, sk_error_t *error)
+{
+	struct stat st;
+
+	ctx->generation = ck_pr_load_32(&file_generation);
+
+	ctx->fd = open(ctx->path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC,
+		ctx->opts.mode);
+	if (ctx->fd == -1)
+		return sk_error_msg_code(error, "failed to open log file", errno);
+
+	ctx->size = (fstat(ctx->fd, &st) == 0) ? (uint64_t)st.st_size : 0;
+	ctx->opened_at = file_now();
+
+	return true;
+}
+
+static void
+file_close(struct file_ctx *ctx)
+{
+	if (ctx->fd != -1)
+		close(ctx->fd);
+	ctx->fd = -1;
+}
+
+static bool
+file_sync(struct file_ctx *ctx, sk_error_t *error)
+{
+	ctx->unsynced = 0;
+	if (fdatasync(ctx->fd) == -1)
+		return sk_error_msg_code(error, "failed to sync log file", errno);
+
+	return true;
+}
+
+/* Write the buffer, resuming after partial writes */
+static bool
+file_flush(struct file_ctx *ctx, sk_error_t *error)
+{
+	size_t written = 0;
+
+	while (written < ctx->used) {
+		const ssize_t len =
+			write(ctx->fd, ctx->buf + written, ctx->used - written);
+		if (len == -1) {
+			if (errno == EINTR)
+				continue;
+			/* The buffer is discarded, the next batch may succeed */
+			ctx->used = 0;
+			return sk_error_msg_code(
+				error, "failed to write log file", errno);
+		}
+		written += len;
+	}
+
+	ctx->size += written;
+	ctx->unsynced += written;
+	ctx->used = 0;
+
+	if (ctx->opts.sync == SK_LOGGER_DRV_FILE_SYNC_BYTES &&
+		ctx->unsynced >= ctx->opts.sync_bytes)
+		return file_sync(ctx, error);
+
+	return true;
+}
+
+/* Shift `path.<i>` to `path.<i + 1>`, then `path` to `path.1` */
+static bool
+file_rotate(struct file_ctx *ctx, sk_error_t *error)
+{
+	char from[PATH_MAX], to[PATH_MAX];
+
+	if (!file_flush(ctx, error))
+		return false;
+	file_close(ctx);
+
+	for (int i = ctx->opts.rotate_keep; i > 1; i--) {
+		snprintf(from, sizeof(from), "%s.%d", ctx->path, i - 1);
+		snprintf(to, sizeof(to), "%s.%d", ctx->path, i);
+		/* Missing files are expected until `rotate_keep` rotations */
+		(void)rename(from, to);
+	}
+
+	snprintf(to, sizeof(to), "%s.1", ctx->path);
+	if (rename(ctx->path, to) == -1 && errno != ENOENT) {
+		sk_error_msg_code(error, "failed to rotate log file", errno);
+		/* Keep appending to the current file */
+		(void)file_open(ctx, error);
+		return false;
+	}
+
+	return file_open(ctx, error);
+}
+
+/* Reopen or rotate before writing a batch */
+static bool
+file_prepare(struct file_ctx *ctx, sk_error_t *error)
+{
+	if (ctx->fd != -1 && ctx->generation != ck_pr_load_32(&file_generation)) {
+		if (!file_flush(ctx, error))
+			return false;
+		file_close(ctx);
+	}
+
+	/* Also retries a file that failed to reopen */
+	if (ctx->fd == -1)
+		return file_open(ctx, error);
+
+	if (ctx->opts.rotate_sec != 0 &&
+		file_now() - ctx->opened_at >= ctx->opts.rotate_sec)
+		return file_rotate(ctx, error);
+
+	return true;
+}
+
+bool
+sk_logger_drv_open_file(sk_logger_drv_t *driver, sk_error_t *error)
+{
+	struct file_ctx *ctx = driver->ctx;
+
+	if ((ctx->buf = malloc(ctx->opts.buf_size)) == NULL)
+		return sk_error_msg_code(
+			error, "file buffer malloc failed", SK_ERROR_ENOMEM);
+
+	if (!file_open(ctx, error))
+		goto failed_open;
+
+	if (ctx->opts.reopen_on_sighup &&
+		ck_pr_cas_int(&file_sighup_installed, 0, 1)) {
+		struct sigaction action = {.sa_handler = file_sighup};
+		sigemptyset(&action.sa_mask);
+		action.sa_flags = SA_RESTART;
+		sigaction(SIGHUP, &action, NULL);
+	}
+
+	return true;
+
+failed_open:
+	free(ctx->buf);
+	ctx->buf = NULL;
+	return false;
+}
+
+bool
+sk_logger_drv_log_batch_file(sk_logger_drv_t *driver, sk_log_msg_t **msgs,
+	size_t n, sk_error_t *error)
+{
+	struct file_ctx *ctx = driver->ctx;
+	bool sync = false;
+
+	if (!file_prepare(ctx, error))
+		return false;
+
+	for (size_t i = 0; i < n; i++) {
+		const sk_log_msg_t *msg = msgs[i];
+
+		if (ctx->opts.buf_size - ctx->used < FILE_LINE_MAX &&
+			!file_flush(ctx, error))
+			return false;
+
+		char *line = ctx->buf + ctx->used;
+		const size_t left = ctx->opts.buf_size - ctx->used;
+		size_t len = sk_log_header_format(line, left - 1, msg);
+		size_t payload = strnlen(msg->payload, SK_LOG_MSG_MAX);
+		if (payload > left - 1 - len)
+			payload = left - 1 - len;
+		memcpy(line + len, msg->payload, payload);
+		len += payload;
+		if (msg->kv_count != 0 && len + 1 < left - 1)
+			len += sk_log_kv_format(line + len, left - 1 - len, msg);
+		line[len++] = '\n';
+		ctx->used += len;
+
+		if (ctx->opts.sync == SK_LOGGER_DRV_FILE_SYNC_ERROR &&
+			msg->level <= SK_LOG_ERROR)
+			sync = true;
+
+		if (ctx->opts.rotate_size != 0 &&
+			ctx->size + ctx->used >= ctx->opts.rotate_size &&
+			!file_rotate(ctx, error))
+			return false;
+	}
+
+	if (sync && (!file_flush(ctx, error) || !file_sync(ctx, error)))
+		return false;
+
+	return true;
+}
+
+bool
+sk_logger_drv_flush_file(sk_logger_drv_t *driver, sk_error_t *error)
+{
+	struct file_ctx *ctx = driver->ctx;
+
+	return ctx->used == 0 || file_flush(ctx, error);
+}
+
+bool
+sk_logger_drv_log_file(
+	sk_logger_drv_t *driver, sk_log_msg_t *msg, sk_error_t *error)
+{
+	return sk_logger_drv_log_batch_file(driver, &msg, 1, error) &&
+		sk_logger_drv_flush_file(driver, error);
+}
+
+void
+sk_logger_drv_close_file(sk_logger_drv_t *driver)
+{
+	struct file_ctx *ctx = driver->ctx;
+	sk_error_t error;
+
+	if (ctx->buf != NULL && ctx->fd != -1)
+		(void)file_flush(ctx, &error);
+
+	file_close(ctx);
+	free(ctx->buf);
+	free(ctx->path);
+	free(ctx);
+}
+
+bool
+sk_logger_drv_builder_file(
+	sk_logger_drv_t *driver, void *ctx, sk_error_t *error)
+{
+	const sk_logger_drv_file_ctx_t *opts = ctx;
+
+	if (opts->path == NULL)
+		return sk_error_msg_code(error, "file path is NULL", SK_ERROR_EINVAL);
+
+	struct file_ctx *file_ctx = calloc(1, sizeof(*file_ctx));
+	if (file_ctx == NULL)
+		return sk_error_msg_code(
+			error, "file_ctx calloc failed", SK_ERROR_ENOMEM);
+
+	file_ctx->opts = *opts;
+	file_ctx->fd = -1;
+
+	if ((file_ctx->path = strdup(opts->path)) == NULL) {
+		free(file_ctx);
+		return sk_error_msg_code(
+			error, "file path strdup failed", SK_ERROR_ENOMEM);
+	}
+	file_ctx->opts.path = file_ctx->path;
+
+	if (file_ctx->opts.mode == 0)
+		file_ctx->opts.mode = FILE_DEFAULT_MODE;
+	if (file_ctx->opts.buf_size == 0)
+		file_ctx->opts.buf_size = SK_LOGGER_DRV_FILE_BUF_SIZE;
+	if (file_ctx->opts.buf_size < FILE_LINE_MAX)
+		file_ctx->opts.buf_size = FILE_LINE_MAX;
+	if (file_ctx->opts.rotate_keep == 0)
+		file_ctx->opts.rotate_keep = 1;
+
+	driver->open = sk_logger_drv_open_file;
+	driver->log = sk_logger_drv_log_file;
+	driver->log_batch = sk_logger_drv_log_batch_file;
+	driver->flush = sk_logger_drv_flush_file;
+	driver->close = sk_logger_drv_close_file;
+
+	driver->ctx = file_ctx;
+
+	return true;
+}
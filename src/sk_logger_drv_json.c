@@ -0,0 +1,349 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <locale.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sk_logger_drv.h>
+
+#include "sk_log_priv.h"
+
+enum {
+	/* Lines of a batch are formatted in a buffer of this size */
+	JSON_BUF_SIZE = 64 * 1024,
+	/* Bound of a formatted line, given the bounds below */
+	JSON_LINE_MAX = 16 * 1024,
+	/* Caller's file and function names are truncated to this length */
+	JSON_NAME_MAX = 512,
+};
+
+enum json_format {
+	JSON_FORMAT_JSON = 0,
+	JSON_FORMAT_LOGFMT,
+};
+
+struct json_ctx {
+	FILE *stream;
+	enum json_format format;
+	/* Doubles are formatted in the C locale, whatever the one of the thread */
+	locale_t c_locale;
+
+	char buf[JSON_BUF_SIZE];
+	size_t used;
+};
+
+/* Cursor of the line being formatted, writes are bounded by `end` */
+struct json_line {
+	char *p, *end;
+};
+
+static void
+line_raw(struct json_line *line, const char *s, size_t len)
+{
+	if (len > (size_t)(line->end - line->p))
+		len = line->end - line->p;
+
+	memcpy(line->p, s, len);
+	line->p += len;
+}
+
+static sk_printf(2, 3) void line_fmt(
+	struct json_line *line, const char *fmt, ...)
+{
+	const size_t left = line->end - line->p;
+	va_list args;
+
+	va_start(args, fmt);
+	const int len = vsnprintf(line->p, left, fmt, args);
+	va_end(args);
+
+	if (len > 0)
+		line->p += ((size_t)len < left) ? (size_t)len : left;
+}
+
+/* Append an escaped string, quotes excluded */
+static void
+line_escaped(struct json_line *line, const char *s, size_t len)
+{
+	const size_t left = line->end - line->p;
+
+	if (len * SK_LOG_ESCAPE_MAX > left)
+		len = left / SK_LOG_ESCAPE_MAX;
+
+	line->p += sk_log_escape_json(line->p, s, len);
+}
+
+static void
+line_json_str(struct json_line *line, const char *s, size_t max)
+{
+	if (s == NULL) {
+		line_raw(line, "null", 4);
+		return;
+	}
+
+	line_raw(line, "\"", 1);
+	line_escaped(line, s, strnlen(s, max));
+	line_raw(line, "\"", 1);
+}
+
+static void
+line_logfmt_str(struct json_line *line, const char *s, size_t max)
+{
+	const size_t len = (s != NULL) ? strnlen(s, max) : 0;
+
+	if (len != 0 && !sk_log_logfmt_needs_quotes(s, len)) {
+		line_raw(line, s, len);
+		return;
+	}
+
+	line_raw(line, "\"", 1);
+	if (len != 0)
+		line_escaped(line, s, len);
+	line_raw(line, "\"", 1);
+}
+
+static void
+line_json_kv(struct json_line *line, const sk_kv_t *kv)
+{
+	line_raw(line, ",", 1);
+	line_json_str(line, kv->key, SK_LOG_MSG_MAX);
+	line_raw(line, ":", 1);
+
+	switch (kv->type) {
+	case SK_KV_TYPE_INT:
+		line_fmt(line, "%" PRId64, kv->i);
+		break;
+	case SK_KV_TYPE_UINT:
+		line_fmt(line, "%" PRIu64, kv->u);
+		break;
+	case SK_KV_TYPE_DOUBLE:
+		/* JSON has no representation of infinities and NaN */
+		if (isfinite(kv->d))
+			line_fmt(line, "%.17g", kv->d);
+		else
+			line_raw(line, "null", 4);
+		break;
+	case SK_KV_TYPE_BOOL:
+		if (kv->b)
+			line_raw(line, "true", 4);
+		else
+			line_raw(line, "false", 5);
+		break;
+	case SK_KV_TYPE_STR:
+		line_json_str(line, kv->s, SK_LOG_MSG_MAX);
+		break;
+	}
+}
+
+static void
+line_logfmt_kv(struct json_line *line, const sk_kv_t *kv)
+{
+	line_raw(line, " ", 1);
+	line_logfmt_str(line, kv->key, SK_LOG_MSG_MAX);
+	line_raw(line, "=", 1);
+
+	switch (kv->type) {
+	case SK_KV_TYPE_INT:
+		line_fmt(line, "%" PRId64, kv->i);
+		break;
+	case SK_KV_TYPE_UINT:
+		line_fmt(line, "%" PRIu64, kv->u);
+		break;
+	case SK_KV_TYPE_DOUBLE:
+		line_fmt(line, "%.17g", kv->d);
+		break;
+	case SK_KV_TYPE_BOOL:
+		if (kv->b)
+			line_raw(line, "true", 4);
+		else
+			line_raw(line, "false", 5);
+		break;
+	case SK_KV_TYPE_STR:
+		line_logfmt_str(line, kv->s, SK_LOG_MSG_MAX);
+		break;
+	}
+}
+
+static void
+json_format_json(struct json_line *line, const char *name,
+	const sk_log_msg_t *msg, const sk_kv_t *kvs, size_t n)
+{
+	line_fmt(line,
+		"{\"ts\":" SK_LOG_MSG_TS_FMT ",\"level\":\"%s\",\"logger\":",
+		SK_LOG_MSG_TS_ARGS(msg), sk_log_level_str(msg->level));
+	line_json_str(line, name, JSON_NAME_MAX);
+	line_raw(line, ",\"file\":", 8);
+	line_json_str(line, msg->debug.file, JSON_NAME_MAX);
+	line_raw(line, ",\"func\":", 8);
+	line_json_str(line, msg->debug.function, JSON_NAME_MAX);
+	line_fmt(line, ",\"line\":%d,\"pid\":%d,\"tid\":%d", msg->debug.line,
+		msg->pid, msg->tid);
+	if (msg->thread != NULL) {
+		line_raw(line, ",\"thread\":", 10);
+		line_json_str(line, msg->thread, SK_LOG_THREAD_NAME_MAX);
+	}
+	line_raw(line, ",\"msg\":", 7);
+	line_json_str(line, msg->payload, SK_LOG_MSG_MAX);
+
+	for (size_t i = 0; i < n; i++)
+		line_json_kv(line, &kvs[i]);
+
+	line_raw(line, "}\n", 2);
+}
+
+static void
+json_format_logfmt(struct json_line *line, const char *name,
+	const sk_log_msg_t *msg, const sk_kv_t *kvs, size_t n)
+{
+	line_fmt(line, "ts=" SK_LOG_MSG_TS_FMT " level=%s logger=",
+		SK_LOG_MSG_TS_ARGS(msg), sk_log_level_str(msg->level));
+	line_logfmt_str(line, name, JSON_NAME_MAX);
+	line_raw(line, " file=", 6);
+	line_logfmt_str(line, msg->debug.file, JSON_NAME_MAX);
+	line_raw(line, " func=", 6);
+	line_logfmt_str(line, msg->debug.function, JSON_NAME_MAX);
+	line_fmt(line, " line=%d pid=%d tid=%d", msg->debug.line, msg->pid,
+		msg->tid);
+	if (msg->thread != NULL) {
+		line_raw(line, " thread=", 8);
+		line_logfmt_str(line, msg->thread, SK_LOG_THREAD_NAME_MAX);
+	}
+	line_raw(line, " msg=", 5);
+	line_logfmt_str(line, msg->payload, SK_LOG_MSG_MAX);
+
+	for (size_t i = 0; i < n; i++)
+		line_logfmt_kv(line, &kvs[i]);
+
+	line_raw(line, "\n", 1);
+}
+
+/* Write the buffer, resuming after partial writes */
+static bool
+json_flush(struct json_ctx *ctx, sk_error_t *error)
+{
+	const int fd = fileno(ctx->stream);
+	size_t written = 0;
+
+	/* Preserve ordering with messages buffered by stdio */
+	fflush(ctx->stream);
+
+	while (written < ctx->used) {
+		const ssize_t len =
+			write(fd, ctx->buf + written, ctx->used - written);
+		if (len == -1) {
+			if (errno == EINTR)
+				continue;
+			ctx->used = 0;
+			return sk_error_msg_code(error, "failed to write lines", errno);
+		}
+		written += len;
+	}
+
+	ctx->used = 0;
+
+	return true;
+}
+
+bool
+sk_logger_drv_log_batch_json(sk_logger_drv_t *driver, sk_log_msg_t **msgs,
+	size_t n, sk_error_t *error)
+{
+	struct json_ctx *ctx = driver->ctx;
+	sk_kv_t kvs[SK_LOG_KV_MAX];
+
+	for (size_t i = 0; i < n; i++) {
+		const sk_log_msg_t *msg = msgs[i];
+
+		if (JSON_BUF_SIZE - ctx->used < JSON_LINE_MAX &&
+			!json_flush(ctx, error))
+			return false;
+
+		struct json_line line = {
+			ctx->buf + ctx->used,
+			ctx->buf + ctx->used + JSON_LINE_MAX,
+		};
+		const size_t n_kvs = sk_log_msg_kv(msg, kvs, SK_LOG_KV_MAX);
+		const locale_t locale = uselocale(ctx->c_locale);
+
+		switch (ctx->format) {
+		case JSON_FORMAT_JSON:
+			json_format_json(&line, driver->name, msg, kvs, n_kvs);
+			break;
+		case JSON_FORMAT_LOGFMT:
+			json_format_logfmt(&line, driver->name, msg, kvs, n_kvs);
+			break;
+		}
+
+		uselocale(locale);
+
+		ctx->used = line.p - ctx->buf;
+	}
+
+	return json_flush(ctx, error);
+}
+
+bool
+sk_logger_drv_log_json(
+	sk_logger_drv_t *driver, sk_log_msg_t *msg, sk_error_t *error)
+{
+	return sk_logger_drv_log_batch_json(driver, &msg, 1, error);
+}
+
+void
+sk_logger_drv_close_json(sk_logger_drv_t *driver)
+{
+	struct json_ctx *ctx = driver->ctx;
+
+	freelocale(ctx->c_locale);
+	free(ctx);
+}
+
+static bool
+json_builder(sk_logger_drv_t *driver, const sk_logger_drv_json_ctx_t *opts,
+	enum json_format format, sk_error_t *error)
+{
+	struct json_ctx *ctx = malloc(sizeof(*ctx));
+	if (ctx == NULL)
+		return sk_error_msg_code(
+			error, "json_ctx malloc failed", SK_ERROR_ENOMEM);
+
+	if ((ctx->c_locale = newlocale(LC_ALL_MASK, "C", (locale_t)0)) ==
+		(locale_t)0) {
+		free(ctx);
+		return sk_error_msg_code(
+			error, "json_ctx newlocale failed", SK_ERROR_ENOMEM);
+	}
+
+	ctx->stream =
+		(opts != NULL && opts->stream != NULL) ? opts->stream : stdout;
+	ctx->format = format;
+	ctx->used = 0;
+
+	driver->open = NULL;
+	driver->log = sk_logger_drv_log_json;
+	driver->log_batch = sk_logger_drv_log_batch_json;
+	driver->flush = NULL;
+	driver->close = sk_logger_drv_close_json;
+
+	driver->ctx = ctx;
+
+	return true;
+}
+
+bool
+sk_logger_drv_builder_json(
+	sk_logger_drv_t *driver, void *ctx, sk_error_t *error)
+{
+	return json_builder(driver, ctx, JSON_FORMAT_JSON, error);
+}
+
+bool
+sk_logger_drv_builder_logfmt(
+	sk_logger_drv_t *driver, void *ctx, sk_error_t *error)
+{
+	return json_builder(driver, ctx, JSON_FORMAT_LOGFMT, error);
+}
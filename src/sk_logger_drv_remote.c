@@ -0,0 +1,492 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sk_logger_drv.h>
+
+#include "sk_log_priv.h"
+
+/*
+ * Frames of a TCP stream are appended to a bounded buffer, then sent without
+ * blocking; only the end of a drain run, see `flush`, waits for the collector
+ * and no longer than the budget. Pending frames cover outages, new ones are
+ * dropped when the buffer is full. Frames of UDP are packed in datagrams of
+ * up to `mtu` bytes and sent right away, or lost.
+ */
+
+enum {
+	/* Bound of a frame, room for the header, payload and fields */
+	REMOTE_FRAME_MAX = 2048,
+	REMOTE_LENGTH_SIZE = sizeof(uint32_t),
+};
+
+enum remote_state {
+	REMOTE_DISCONNECTED = 0,
+	REMOTE_CONNECTING,
+	REMOTE_CONNECTED,
+};
+
+struct remote_ctx {
+	sk_logger_drv_remote_ctx_t opts;
+	char *host, *port;
+
+	struct sockaddr_storage addr;
+	socklen_t addr_len;
+
+	int fd;
+	enum remote_state state;
+	/* Monotonic time of the next connection attempt, and the current delay */
+	uint64_t reconnect_at;
+	uint64_t backoff;
+
+	/*
+	 * Pending bytes of the stream, or the datagram being packed. The frame
+	 * holding `head` starts at `frame`, it is resent whole after a
+	 * reconnection.
+	 */
+	char *buf;
+	size_t frame, head, tail;
+
+	/* Frames dropped since the last notice */
+	uint64_t dropped;
+};
+
+static uint64_t
+remote_now(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+static void
+remote_close(struct remote_ctx *ctx)
+{
+	if (ctx->fd != -1)
+		close(ctx->fd);
+	ctx->fd = -1;
+	ctx->state = REMOTE_DISCONNECTED;
+}
+
+/* Schedule the next attempt, doubling the delay up to its maximum */
+static void
+remote_backoff(struct remote_ctx *ctx)
+{
+	remote_close(ctx);
+
+	ctx->reconnect_at = remote_now() + ctx->backoff;
+	ctx->backoff *= 2;
+	if (ctx->backoff > ctx->opts.reconnect_max_nsec)
+		ctx->backoff = ctx->opts.reconnect_max_nsec;
+}
+
+/* Start a non-blocking connection */
+static void
+remote_connect(struct remote_ctx *ctx)
+{
+	const int type = (ctx->opts.proto == SK_LOGGER_DRV_REMOTE_UDP)
+		? SOCK_DGRAM
+		: SOCK_STREAM;
+
+	ctx->fd =
+		socket(ctx->addr.ss_family, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (ctx->fd == -1) {
+		remote_backoff(ctx);
+		return;
+	}
+
+	if (type == SOCK_STREAM) {
+		const int one = 1;
+		(void)setsockopt(
+			ctx->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	}
+
+	if (connect(ctx->fd, (struct sockaddr *)&ctx->addr, ctx->addr_len) == 0) {
+		ctx->state = REMOTE_CONNECTED;
+		ctx->backoff = ctx->opts.reconnect_min_nsec;
+	} else if (errno == EINPROGRESS) {
+		ctx->state = REMOTE_CONNECTING;
+	} else {
+		remote_backoff(ctx);
+	}
+}
+
+/* Wait until the socket is writable, returns false at the deadline */
+static bool
+remote_wait(struct remote_ctx *ctx, uint64_t deadline)
+{
+	struct pollfd pfd = {.fd = ctx->fd, .events = POLLOUT};
+
+	for (;;) {
+		const uint64_t now = remote_now();
+		const uint64_t left = (deadline > now) ? deadline - now : 0;
+		const struct timespec timeout = {
+			.tv_sec = left / 1000000000,
+			.tv_nsec = left % 1000000000,
+		};
+
+		const int ready = ppoll(&pfd, 1, &timeout, NULL);
+		if (ready == -1 && errno == EINTR)
+			continue;
+
+		return ready > 0;
+	}
+}
+
+/* Complete a pending connection */
+static bool
+remote_connected(struct remote_ctx *ctx, uint64_t deadline)
+{
+	int err = 0;
+	socklen_t len = sizeof(err);
+
+	if (!remote_wait(ctx, deadline))
+		return false;
+
+	if (getsockopt(ctx->fd, SOL_SOCKET, SO_ERROR, &err, &len) == -1 ||
+		err != 0) {
+		remote_backoff(ctx);
+		return false;
+	}
+
+	ctx->state = REMOTE_CONNECTED;
+	ctx->backoff = ctx->opts.reconnect_min_nsec;
+
+	return true;
+}
+
+/* Ensure a connection, without waiting past the deadline */
+static bool
+remote_ready(struct remote_ctx *ctx, uint64_t deadline)
+{
+	if (ctx->state == REMOTE_DISCONNECTED) {
+		if (remote_now() < ctx->reconnect_at)
+			return false;
+		remote_connect(ctx);
+	}
+
+	if (ctx->state == REMOTE_CONNECTING)
+		return remote_connected(ctx, deadline);
+
+	return ctx->state == REMOTE_CONNECTED;
+}
+
+/* Length of the pending frame at `off` */
+static size_t
+remote_frame_len(const struct remote_ctx *ctx, size_t off)
+{
+	const char *p = ctx->buf + off;
+
+	if (ctx->opts.framing == SK_LOGGER_DRV_REMOTE_LENGTH) {
+		uint32_t be;
+		memcpy(&be, p, sizeof(be));
+		return REMOTE_LENGTH_SIZE + ntohl(be);
+	}
+
+	return (const char *)memchr(p, '\n', ctx->tail - off) - p + 1;
+}
+
+/* Send pending bytes of the stream until the deadline */
+static void
+remote_pump(struct remote_ctx *ctx, uint64_t deadline)
+{
+	while (ctx->head < ctx->tail && remote_ready(ctx, deadline)) {
+		const ssize_t len = send(ctx->fd, ctx->buf + ctx->head,
+			ctx->tail - ctx->head, MSG_NOSIGNAL);
+		if (len > 0) {
+			ctx->head += len;
+			while (ctx->frame < ctx->head &&
+				ctx->frame + remote_frame_len(ctx, ctx->frame) <= ctx->head)
+				ctx->frame += remote_frame_len(ctx, ctx->frame);
+			continue;
+		}
+
+		if (len == -1 && errno == EINTR)
+			continue;
+		if (len == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			if (!remote_wait(ctx, deadline))
+				break;
+			continue;
+		}
+
+		/* The collector went away, the new stream starts at a frame */
+		ctx->head = ctx->frame;
+		remote_backoff(ctx);
+		ctx->reconnect_at = remote_now();
+	}
+
+	if (ctx->head == ctx->tail)
+		ctx->frame = ctx->head = ctx->tail = 0;
+}
+
+/* Format a frame, returns its length */
+static size_t
+remote_frame(const struct remote_ctx *ctx, char *out, const char *name,
+	const sk_log_msg_t *msg)
+{
+	const bool length = ctx->opts.framing == SK_LOGGER_DRV_REMOTE_LENGTH;
+	char *line = out + (length ? REMOTE_LENGTH_SIZE : 0);
+	/* Room for the newline */
+	const size_t left = REMOTE_FRAME_MAX - (line - out) - 1;
+
+	int len = snprintf(line, left, SK_LOG_MSG_TS_FMT " %s %s [%s]: %s",
+		SK_LOG_MSG_TS_ARGS(msg), name, msg->debug.function,
+		sk_log_level_str(msg->level), msg->payload);
+	if (len < 0)
+		return 0;
+	if ((size_t)len >= left)
+		len = left - 1;
+	if (msg->kv_count != 0)
+		len += sk_log_kv_format(line + len, left - len, msg);
+
+	if (length) {
+		const uint32_t be = htonl(len);
+		memcpy(out, &be, sizeof(be));
+		return REMOTE_LENGTH_SIZE + len;
+	}
+
+	/* Newlines of the payload would split the frame */
+	for (char *p = line; (p = memchr(p, '\n', line + len - p)) != NULL;)
+		*p = ' ';
+
+	line[len++] = '\n';
+	return len;
+}
+
+/* Room for a frame at the tail, moving pending bytes to the front */
+static bool
+remote_reserve(struct remote_ctx *ctx)
+{
+	if (ctx->opts.spill_size - ctx->tail >= REMOTE_FRAME_MAX)
+		return true;
+
+	/* A partially sent frame stays at the front */
+	memmove(ctx->buf, ctx->buf + ctx->frame, ctx->tail - ctx->frame);
+	ctx->tail -= ctx->frame;
+	ctx->head -= ctx->frame;
+	ctx->frame = 0;
+
+	return ctx->opts.spill_size - ctx->tail >= REMOTE_FRAME_MAX;
+}
+
+static void
+remote_append(struct remote_ctx *ctx, const char *name, const sk_log_msg_t *msg)
+{
+	if (!remote_reserve(ctx)) {
+		ctx->dropped++;
+		return;
+	}
+
+	if (ctx->dropped != 0) {
+		sk_log_msg_t notice = {
+			.level = SK_LOG_WARNING,
+			.ts_nsec = msg->ts_nsec,
+			.debug = sk_debug,
+		};
+		snprintf(notice.payload, sizeof(notice.payload),
+			"%" PRIu64 " messages dropped while the collector was away",
+			ctx->dropped);
+		ctx->tail += remote_frame(ctx, ctx->buf + ctx->tail, name, &notice);
+		ctx->dropped = 0;
+
+		if (!remote_reserve(ctx)) {
+			ctx->dropped++;
+			return;
+		}
+	}
+
+	ctx->tail += remote_frame(ctx, ctx->buf + ctx->tail, name, msg);
+}
+
+static void
+remote_datagram_send(struct remote_ctx *ctx)
+{
+	if (ctx->tail != 0 && remote_ready(ctx, 0) &&
+		send(ctx->fd, ctx->buf, ctx->tail, MSG_NOSIGNAL) == -1 &&
+		errno != EAGAIN && errno != EWOULDBLOCK)
+		remote_backoff(ctx);
+
+	ctx->tail = 0;
+}
+
+/* Pack frames in datagrams of up to `mtu` bytes */
+static void
+remote_datagrams(struct remote_ctx *ctx, const char *name, sk_log_msg_t **msgs,
+	size_t n)
+{
+	char frame[REMOTE_FRAME_MAX];
+
+	for (size_t i = 0; i < n; i++) {
+		const size_t len = remote_frame(ctx, frame, name, msgs[i]);
+
+		if (ctx->tail + len > ctx->opts.mtu)
+			remote_datagram_send(ctx);
+
+		memcpy(ctx->buf + ctx->tail, frame, len);
+		ctx->tail += len;
+	}
+
+	remote_datagram_send(ctx);
+}
+
+bool
+sk_logger_drv_open_remote(sk_logger_drv_t *driver, sk_error_t *error)
+{
+	struct remote_ctx *ctx = driver->ctx;
+	const struct addrinfo hints = {
+		.ai_family = AF_UNSPEC,
+		.ai_socktype = (ctx->opts.proto == SK_LOGGER_DRV_REMOTE_UDP)
+			? SOCK_DGRAM
+			: SOCK_STREAM,
+	};
+	struct addrinfo *res;
+
+	const int err = getaddrinfo(ctx->host, ctx->port, &hints, &res);
+	if (err != 0)
+		return sk_error_msg_code(
+			error, "failed to resolve collector", SK_ERROR_EINVAL);
+
+	memcpy(&ctx->addr, res->ai_addr, res->ai_addrlen);
+	ctx->addr_len = res->ai_addrlen;
+	freeaddrinfo(res);
+
+	/* Datagrams hold at least a frame */
+	const size_t size = (ctx->opts.proto == SK_LOGGER_DRV_REMOTE_UDP)
+		? ctx->opts.mtu + REMOTE_FRAME_MAX
+		: ctx->opts.spill_size;
+	if ((ctx->buf = malloc(size)) == NULL)
+		return sk_error_msg_code(
+			error, "remote buffer malloc failed", SK_ERROR_ENOMEM);
+
+	remote_connect(ctx);
+
+	return true;
+}
+
+bool
+sk_logger_drv_log_batch_remote(sk_logger_drv_t *driver, sk_log_msg_t **msgs,
+	size_t n, sk_error_t *error)
+{
+	(void)error;
+	struct remote_ctx *ctx = driver->ctx;
+
+	if (ctx->opts.proto == SK_LOGGER_DRV_REMOTE_UDP) {
+		remote_datagrams(ctx, driver->name, msgs, n);
+		return true;
+	}
+
+	for (size_t i = 0; i < n; i++)
+		remote_append(ctx, driver->name, msgs[i]);
+
+	/* Only the flush waits for the collector */
+	remote_pump(ctx, 0);
+
+	return true;
+}
+
+bool
+sk_logger_drv_flush_remote(sk_logger_drv_t *driver, sk_error_t *error)
+{
+	(void)error;
+	struct remote_ctx *ctx = driver->ctx;
+
+	if (ctx->opts.proto == SK_LOGGER_DRV_REMOTE_TCP)
+		remote_pump(ctx, remote_now() + ctx->opts.budget_nsec);
+
+	return true;
+}
+
+bool
+sk_logger_drv_log_remote(
+	sk_logger_drv_t *driver, sk_log_msg_t *msg, sk_error_t *error)
+{
+	return sk_logger_drv_log_batch_remote(driver, &msg, 1, error) &&
+		sk_logger_drv_flush_remote(driver, error);
+}
+
+void
+sk_logger_drv_close_remote(sk_logger_drv_t *driver)
+{
+	struct remote_ctx *ctx = driver->ctx;
+	sk_error_t error;
+
+	if (ctx->buf != NULL)
+		(void)sk_logger_drv_flush_remote(driver, &error);
+
+	remote_close(ctx);
+	free(ctx->buf);
+	free(ctx->host);
+	free(ctx->port);
+	free(ctx);
+}
+
+bool
+sk_logger_drv_builder_remote(
+	sk_logger_drv_t *driver, void *ctx, sk_error_t *error)
+{
+	const sk_logger_drv_remote_ctx_t *opts = ctx;
+
+	if (opts->host == NULL || opts->port == NULL)
+		return sk_error_msg_code(
+			error, "remote host or port is NULL", SK_ERROR_EINVAL);
+
+	struct remote_ctx *remote_ctx = calloc(1, sizeof(*remote_ctx));
+	if (remote_ctx == NULL)
+		return sk_error_msg_code(
+			error, "remote_ctx calloc failed", SK_ERROR_ENOMEM);
+
+	remote_ctx->opts = *opts;
+	remote_ctx->fd = -1;
+
+	remote_ctx->host = strdup(opts->host);
+	remote_ctx->port = strdup(opts->port);
+	if (remote_ctx->host == NULL || remote_ctx->port == NULL) {
+		free(remote_ctx->host);
+		free(remote_ctx->port);
+		free(remote_ctx);
+		return sk_error_msg_code(
+			error, "remote address strdup failed", SK_ERROR_ENOMEM);
+	}
+	remote_ctx->opts.host = remote_ctx->host;
+	remote_ctx->opts.port = remote_ctx->port;
+
+	if (remote_ctx->opts.mtu == 0)
+		remote_ctx->opts.mtu = SK_LOGGER_DRV_REMOTE_MTU;
+	if (remote_ctx->opts.spill_size == 0)
+		remote_ctx->opts.spill_size = SK_LOGGER_DRV_REMOTE_SPILL_SIZE;
+	if (remote_ctx->opts.spill_size < 2 * REMOTE_FRAME_MAX)
+		remote_ctx->opts.spill_size = 2 * REMOTE_FRAME_MAX;
+	if (remote_ctx->opts.budget_nsec == 0)
+		remote_ctx->opts.budget_nsec = SK_LOGGER_DRV_REMOTE_BUDGET_NSEC;
+	if (remote_ctx->opts.reconnect_min_nsec == 0)
+		remote_ctx->opts.reconnect_min_nsec =
+			SK_LOGGER_DRV_REMOTE_RECONNECT_MIN_NSEC;
+	if (remote_ctx->opts.reconnect_max_nsec == 0)
+		remote_ctx->opts.reconnect_max_nsec =
+			SK_LOGGER_DRV_REMOTE_RECONNECT_MAX_NSEC;
+	if (remote_ctx->opts.reconnect_max_nsec <
+		remote_ctx->opts.reconnect_min_nsec)
+		remote_ctx->opts.reconnect_max_nsec =
+			remote_ctx->opts.reconnect_min_nsec;
+	remote_ctx->backoff = remote_ctx->opts.reconnect_min_nsec;
+
+	driver->open = sk_logger_drv_open_remote;
+	driver->log = sk_logger_drv_log_remote;
+	driver->log_batch = sk_logger_drv_log_batch_remote;
+	driver->flush = sk_logger_drv_flush_remote;
+	driver->close = sk_logger_drv_close_remote;
+
+	driver->ctx = remote_ctx;
+
+	return true;
+}
@@ -0,0 +1,273 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sk_logger_drv.h>
+
+#include "sk_log_priv.h"
+
+/*
+ * Syslog over the local datagram socket, without syslog(3): messages are
+ * formatted once by the driver and a batch is sent with a single sendmmsg(2).
+ */
+
+enum {
+	/* Bound of a datagram, room for the header, payload and fields */
+	SYSLOG_LINE_MAX = 2048,
+	SYSLOG_HOST_MAX = 256,
+};
+
+struct syslog_ctx {
+	sk_logger_drv_syslog_socket_ctx_t opts;
+	struct sockaddr_un addr;
+	char *ident;
+	char host[SYSLOG_HOST_MAX];
+	pid_t pid;
+
+	int fd;
+
+	char lines[SK_LOG_BATCH_MAX][SYSLOG_LINE_MAX];
+	struct iovec iov[SK_LOG_BATCH_MAX];
+	struct mmsghdr hdrs[SK_LOG_BATCH_MAX];
+};
+
+static void
+syslog_close(struct syslog_ctx *ctx)
+{
+	if (ctx->fd != -1)
+		close(ctx->fd);
+	ctx->fd = -1;
+}
+
+static bool
+syslog_connect(struct syslog_ctx *ctx, sk_error_t *error)
+{
+	ctx->fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if (ctx->fd == -1)
+		return sk_error_msg_code(error, "failed to create socket", errno);
+
+	if (connect(ctx->fd, (struct sockaddr *)&ctx->addr, sizeof(ctx->addr)) ==
+		-1) {
+		const int err = errno;
+		syslog_close(ctx);
+		return sk_error_msg_code(error, "failed to connect to syslog", err);
+	}
+
+	return true;
+}
+
+/* Errors of a socket whose peer went away, e.g. syslogd restarted */
+static bool
+syslog_disconnected(int err)
+{
+	return err == ECONNREFUSED || err == ENOTCONN || err == ECONNRESET ||
+		err == ENOENT || err == EPIPE;
+}
+
+/* `Oct 17 13:37:00`, in local time */
+static size_t
+syslog_ts_rfc3164(char *out, size_t size, const sk_log_msg_t *msg)
+{
+	const time_t sec = msg->ts_nsec / 1000000000;
+	struct tm tm;
+
+	localtime_r(&sec, &tm);
+
+	return strftime(out, size, "%b %e %T", &tm);
+}
+
+/* `2026-10-17T13:37:00.123456Z` */
+static size_t
+syslog_ts_rfc5424(char *out, size_t size, const sk_log_msg_t *msg)
+{
+	const time_t sec = msg->ts_nsec / 1000000000;
+	struct tm tm;
+
+	gmtime_r(&sec, &tm);
+
+	const size_t len = strftime(out, size, "%FT%T", &tm);
+	const int frac = snprintf(out + len, size - len, ".%06uZ",
+		(unsigned int)(msg->ts_nsec % 1000000000 / 1000));
+
+	return len + ((frac > 0 && (size_t)frac < size - len) ? (size_t)frac : 0);
+}
+
+static size_t
+syslog_format(struct syslog_ctx *ctx, const char *name,
+	const sk_log_msg_t *msg, char *out)
+{
+	const int pri = ctx->opts.facility | msg->level;
+	char ts[64], fields[SK_LOG_KV_TEXT_MAX] = "";
+	int len;
+
+	if (msg->kv_count != 0)
+		sk_log_kv_format(fields, sizeof(fields), msg);
+
+	switch (ctx->opts.format) {
+	case SK_LOGGER_DRV_SYSLOG_RFC5424:
+		syslog_ts_rfc5424(ts, sizeof(ts), msg);
+		len = snprintf(out, SYSLOG_LINE_MAX,
+			"<%d>1 %s %s %s %d - - %s {file: %s, func: %s, line: %d} %s%s",
+			pri, ts, ctx->host, ctx->ident, ctx->pid, name, msg->debug.file,
+			msg->debug.function, msg->debug.line, msg->payload, fields);
+		break;
+	case SK_LOGGER_DRV_SYSLOG_RFC3164:
+	default:
+		syslog_ts_rfc3164(ts, sizeof(ts), msg);
+		len = snprintf(out, SYSLOG_LINE_MAX,
+			"<%d>%s %s[%d]: %s {file: %s, func: %s, line: %d} %s%s", pri, ts,
+			ctx->ident, ctx->pid, name, msg->debug.file, msg->debug.function,
+			msg->debug.line, msg->payload, fields);
+		break;
+	}
+
+	if (len < 0)
+		return 0;
+
+	/* Truncated datagrams are still valid messages */
+	return ((size_t)len < SYSLOG_LINE_MAX) ? (size_t)len : SYSLOG_LINE_MAX - 1;
+}
+
+/* Send datagrams, resuming after partial sends and reconnecting once */
+static bool
+syslog_send(struct syslog_ctx *ctx, size_t n, sk_error_t *error)
+{
+	bool reconnected = false;
+	size_t sent = 0;
+
+	while (sent < n) {
+		if (ctx->fd == -1) {
+			if (!syslog_connect(ctx, error))
+				return false;
+			reconnected = true;
+		}
+
+		const int len =
+			sendmmsg(ctx->fd, ctx->hdrs + sent, n - sent, MSG_NOSIGNAL);
+		if (len > 0) {
+			sent += len;
+			continue;
+		}
+
+		const int err = (len == 0) ? EIO : errno;
+		if (err == EINTR)
+			continue;
+
+		syslog_close(ctx);
+		if (!syslog_disconnected(err) || reconnected)
+			return sk_error_msg_code(error, "failed to send to syslog", err);
+	}
+
+	return true;
+}
+
+bool
+sk_logger_drv_open_syslog_socket(sk_logger_drv_t *driver, sk_error_t *error)
+{
+	(void)error;
+	struct syslog_ctx *ctx = driver->ctx;
+
+	ctx->pid = getpid();
+	if (gethostname(ctx->host, sizeof(ctx->host)) == -1 || ctx->host[0] == '\0')
+		strcpy(ctx->host, "-");
+	ctx->host[sizeof(ctx->host) - 1] = '\0';
+
+	/* Like syslog(3), a missing syslogd is retried by the next batch */
+	sk_error_t ignored;
+	(void)syslog_connect(ctx, &ignored);
+
+	return true;
+}
+
+bool
+sk_logger_drv_log_batch_syslog_socket(sk_logger_drv_t *driver,
+	sk_log_msg_t **msgs, size_t n, sk_error_t *error)
+{
+	struct syslog_ctx *ctx = driver->ctx;
+
+	for (size_t i = 0; i < n; i++) {
+		ctx->iov[i].iov_base = ctx->lines[i];
+		ctx->iov[i].iov_len =
+			syslog_format(ctx, driver->name, msgs[i], ctx->lines[i]);
+		ctx->hdrs[i] = (struct mmsghdr){
+			.msg_hdr = {.msg_iov = &ctx->iov[i], .msg_iovlen = 1},
+		};
+	}
+
+	return syslog_send(ctx, n, error);
+}
+
+bool
+sk_logger_drv_log_syslog_socket(
+	sk_logger_drv_t *driver, sk_log_msg_t *msg, sk_error_t *error)
+{
+	return sk_logger_drv_log_batch_syslog_socket(driver, &msg, 1, error);
+}
+
+void
+sk_logger_drv_close_syslog_socket(sk_logger_drv_t *driver)
+{
+	struct syslog_ctx *ctx = driver->ctx;
+
+	syslog_close(ctx);
+	free(ctx->ident);
+	free(ctx);
+}
+
+bool
+sk_logger_drv_builder_syslog_socket(
+	sk_logger_drv_t *driver, void *ctx, sk_error_t *error)
+{
+	const sk_logger_drv_syslog_socket_ctx_t *opts = ctx;
+	const char *path = SK_LOGGER_DRV_SYSLOG_PATH;
+
+	if (opts != NULL && opts->path != NULL)
+		path = opts->path;
+
+	struct syslog_ctx *syslog_ctx = calloc(1, sizeof(*syslog_ctx));
+	if (syslog_ctx == NULL)
+		return sk_error_msg_code(
+			error, "syslog_ctx calloc failed", SK_ERROR_ENOMEM);
+
+	if (strlen(path) >= sizeof(syslog_ctx->addr.sun_path)) {
+		free(syslog_ctx);
+		return sk_error_msg_code(
+			error, "syslog path too long", SK_ERROR_EINVAL);
+	}
+
+	if (opts != NULL)
+		syslog_ctx->opts = *opts;
+	syslog_ctx->opts.path = NULL;
+	/* Like openlog(3), LOG_KERN is reserved to the kernel */
+	if (syslog_ctx->opts.facility == 0)
+		syslog_ctx->opts.facility = LOG_USER;
+	syslog_ctx->addr.sun_family = AF_UNIX;
+	strcpy(syslog_ctx->addr.sun_path, path);
+	syslog_ctx->fd = -1;
+
+	const char *ident = (opts != NULL && opts->ident != NULL)
+		? opts->ident
+		: program_invocation_short_name;
+	if ((syslog_ctx->ident = strdup(ident)) == NULL) {
+		free(syslog_ctx);
+		return sk_error_msg_code(
+			error, "syslog ident strdup failed", SK_ERROR_ENOMEM);
+	}
+	syslog_ctx->opts.ident = syslog_ctx->ident;
+
+	driver->open = sk_logger_drv_open_syslog_socket;
+	driver->log = sk_logger_drv_log_syslog_socket;
+	driver->log_batch = sk_logger_drv_log_batch_syslog_socket;
+	driver->flush = NULL;
+	driver->close = sk_logger_drv_close_syslog_socket;
+
+	driver->ctx = syslog_ctx;
+
+	return true;
+}
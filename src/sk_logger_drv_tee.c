@@ -0,0 +1,396 @@
+#include <inttypes.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <ck_pr.h>
+
+#include <sk_logger_drv.h>
+
+#include "sk_log_priv.h"
+
+/*
+ * Fan out of messages to sinks. Sinks without a queue are called by the
+ * drain; queued sinks get copies of messages in a ring drained by a thread of
+ * their own, the drain never waits on them.
+ */
+
+enum {
+	/* Bound of the sleep of an idle sink thread */
+	TEE_IDLE_MS = 100,
+};
+
+struct tee_sink {
+	sk_logger_drv_t driver;
+	enum sk_log_level level;
+	uint8_t queue_log_size;
+
+	/*
+	 * Queued sinks. The idle thread arms the sink and sleeps on the wakeup
+	 * word, the drain disarms it and wakes the thread, as drain workers.
+	 */
+	sk_ring_t ring;
+	pthread_t thread;
+	bool started;
+	int running, armed;
+	uint32_t wakeup;
+	/* Incremented by the drain, reported by the sink thread */
+	uint64_t dropped, dropped_reported;
+
+	/* Messages of the queue handed to the sink in place */
+	sk_log_msg_t *msgs[SK_LOG_BATCH_MAX];
+};
+
+struct tee_ctx {
+	size_t n_sinks;
+	struct tee_sink *sinks;
+};
+
+static bool
+tee_drv_log(
+	sk_logger_drv_t *driver, sk_log_msg_t **msgs, size_t n, sk_error_t *error)
+{
+	if (driver->log_batch != NULL)
+		return driver->log_batch(driver, msgs, n, error);
+
+	bool ok = true;
+	for (size_t i = 0; i < n; i++)
+		ok &= driver->log(driver, msgs[i], error);
+
+	return ok;
+}
+
+static inline bool
+tee_sink_queued(const struct tee_sink *sink)
+{
+	return sink->queue_log_size != 0;
+}
+
+/* Report messages the queue dropped since the previous report */
+static void
+tee_sink_report_drops(struct tee_sink *sink)
+{
+	const uint64_t dropped = ck_pr_load_64(&sink->dropped);
+	sk_error_t error;
+	struct timespec now;
+
+	if (dropped == sink->dropped_reported)
+		return;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	sk_log_msg_t msg = {
+		.ts_nsec = (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec,
+		.level = SK_LOG_WARNING,
+		.debug = sk_debug,
+		.pid = getpid(),
+		.tid = syscall(SYS_gettid),
+	};
+	snprintf(msg.payload, sizeof(msg.payload),
+		"%" PRIu64 " messages dropped by a full tee queue",
+		dropped - sink->dropped_reported);
+	sink->dropped_reported = dropped;
+
+	sk_log_msg_t *msgs = &msg;
+	(void)tee_drv_log(&sink->driver, &msgs, 1, &error);
+}
+
+/* Forward a batch of queued messages, returns the number forwarded */
+static size_t
+tee_sink_drain(struct tee_sink *sink)
+{
+	sk_log_msg_t *msg = NULL;
+	size_t n = 0, len;
+	sk_error_t error;
+
+	while (n < SK_LOG_BATCH_MAX) {
+		msg = (n == 0) ? sk_ring_peek(&sink->ring, &len)
+			: sk_ring_peek_next(&sink->ring, msg, &len);
+		if (msg == NULL)
+			break;
+		sink->msgs[n++] = msg;
+	}
+
+	if (n == 0)
+		return 0;
+
+	/* Drivers failures are not actionable here */
+	(void)tee_drv_log(&sink->driver, sink->msgs, n, &error);
+	sk_ring_release(&sink->ring, sink->msgs[n - 1]);
+
+	return n;
+}
+
+static void
+tee_sink_idle(struct tee_sink *sink)
+{
+	sk_error_t error;
+
+	tee_sink_report_drops(sink);
+	if (sink->driver.flush != NULL)
+		(void)sink->driver.flush(&sink->driver, &error);
+}
+
+static void
+tee_sink_sleep(struct tee_sink *sink, uint32_t seen)
+{
+	const struct timespec timeout = {
+		TEE_IDLE_MS / 1000, (TEE_IDLE_MS % 1000) * 1000000L};
+
+	syscall(SYS_futex, &sink->wakeup, FUTEX_WAIT_PRIVATE, seen, &timeout, NULL,
+		0);
+}
+
+static void *
+tee_sink_main(void *opaque)
+{
+	struct tee_sink *sink = opaque;
+
+	for (;;) {
+		if (tee_sink_drain(sink) != 0)
+			continue;
+
+		tee_sink_idle(sink);
+
+		/* Read before running, the close bumps it after clearing running */
+		const uint32_t seen = ck_pr_load_32(&sink->wakeup);
+		ck_pr_fence_load();
+		if (!ck_pr_load_int(&sink->running))
+			break;
+
+		/* Read the ring after arming, see `tee_sink_wakeup` */
+		ck_pr_store_int(&sink->armed, 1);
+		ck_pr_fence_memory();
+		if (sk_ring_used(&sink->ring) != 0)
+			continue;
+
+		tee_sink_sleep(sink, seen);
+	}
+
+	/* Messages enqueued before the close */
+	while (tee_sink_drain(sink) != 0)
+		;
+	tee_sink_idle(sink);
+
+	return NULL;
+}
+
+static inline void
+tee_sink_wakeup(struct tee_sink *sink)
+{
+	/* Orders the enqueue before reading armed, see the idle path */
+	ck_pr_fence_memory();
+	if (ck_pr_load_int(&sink->armed) && ck_pr_fas_int(&sink->armed, 0))
+		sk_log_drain_wakeup(&sink->wakeup);
+}
+
+static void
+tee_sink_enqueue(struct tee_sink *sink, sk_log_msg_t **msgs, size_t n)
+{
+	bool enqueued = false;
+
+	for (size_t i = 0; i < n; i++) {
+		const sk_log_msg_t *msg = msgs[i];
+		if (msg->level > sink->level)
+			continue;
+
+		const size_t len =
+			offsetof(sk_log_msg_t, payload) + sk_log_msg_payload_size(msg);
+		if (sk_ring_enqueue(&sink->ring, msg, len))
+			enqueued = true;
+		else
+			ck_pr_inc_64(&sink->dropped);
+	}
+
+	if (enqueued)
+		tee_sink_wakeup(sink);
+}
+
+static bool
+tee_sink_log(struct tee_sink *sink, sk_log_msg_t **msgs, size_t n,
+	sk_error_t *error)
+{
+	sk_log_msg_t *selected[SK_LOG_BATCH_MAX];
+	size_t n_selected = 0;
+
+	if (sink->level >= SK_LOG_DEBUG)
+		return tee_drv_log(&sink->driver, msgs, n, error);
+
+	for (size_t i = 0; i < n; i++) {
+		if (msgs[i]->level <= sink->level)
+			selected[n_selected++] = msgs[i];
+	}
+
+	return n_selected == 0 ||
+		tee_drv_log(&sink->driver, selected, n_selected, error);
+}
+
+static bool
+tee_sink_open(struct tee_sink *sink, const char *name, sk_error_t *error)
+{
+	sink->driver.name = name;
+	if (sink->driver.open != NULL && !sink->driver.open(&sink->driver, error))
+		return false;
+
+	if (!tee_sink_queued(sink))
+		return true;
+
+	if (!sk_ring_init(&sink->ring, sink->queue_log_size, error))
+		return false;
+
+	if (sk_ring_record_max(&sink->ring) < sizeof(sk_log_msg_t)) {
+		sk_ring_destroy(&sink->ring);
+		return sk_error_msg_code(
+			error, "tee queue too small for a message", SK_ERROR_EINVAL);
+	}
+
+	ck_pr_store_int(&sink->running, 1);
+	if (pthread_create(&sink->thread, NULL, tee_sink_main, sink) != 0) {
+		sk_ring_destroy(&sink->ring);
+		return sk_error_msg_code(
+			error, "failed to create tee sink thread", SK_ERROR_EAGAIN);
+	}
+	sink->started = true;
+
+	return true;
+}
+
+static void
+tee_sink_close(struct tee_sink *sink)
+{
+	if (sink->started) {
+		ck_pr_store_int(&sink->running, 0);
+		ck_pr_fence_store();
+		sk_log_drain_wakeup(&sink->wakeup);
+		pthread_join(sink->thread, NULL);
+		sk_ring_destroy(&sink->ring);
+		sink->started = false;
+	}
+
+	if (sink->driver.close != NULL)
+		sink->driver.close(&sink->driver);
+}
+
+bool
+sk_logger_drv_open_tee(sk_logger_drv_t *driver, sk_error_t *error)
+{
+	struct tee_ctx *ctx = driver->ctx;
+
+	/* Sinks opened so far are closed by `close` */
+	for (size_t i = 0; i < ctx->n_sinks; i++) {
+		if (!tee_sink_open(&ctx->sinks[i], driver->name, error))
+			return false;
+	}
+
+	return true;
+}
+
+bool
+sk_logger_drv_log_batch_tee(sk_logger_drv_t *driver, sk_log_msg_t **msgs,
+	size_t n, sk_error_t *error)
+{
+	struct tee_ctx *ctx = driver->ctx;
+	bool ok = true;
+
+	for (size_t i = 0; i < ctx->n_sinks; i++) {
+		struct tee_sink *sink = &ctx->sinks[i];
+
+		if (tee_sink_queued(sink))
+			tee_sink_enqueue(sink, msgs, n);
+		else
+			ok &= tee_sink_log(sink, msgs, n, error);
+	}
+
+	return ok;
+}
+
+bool
+sk_logger_drv_log_tee(
+	sk_logger_drv_t *driver, sk_log_msg_t *msg, sk_error_t *error)
+{
+	return sk_logger_drv_log_batch_tee(driver, &msg, 1, error);
+}
+
+bool
+sk_logger_drv_flush_tee(sk_logger_drv_t *driver, sk_error_t *error)
+{
+	struct tee_ctx *ctx = driver->ctx;
+	bool ok = true;
+
+	/* Queued sinks are flushed by their thread */
+	for (size_t i = 0; i < ctx->n_sinks; i++) {
+		struct tee_sink *sink = &ctx->sinks[i];
+
+		if (!tee_sink_queued(sink) && sink->driver.flush != NULL)
+			ok &= sink->driver.flush(&sink->driver, error);
+	}
+
+	return ok;
+}
+
+void
+sk_logger_drv_close_tee(sk_logger_drv_t *driver)
+{
+	struct tee_ctx *ctx = driver->ctx;
+
+	for (size_t i = 0; i < ctx->n_sinks; i++)
+		tee_sink_close(&ctx->sinks[i]);
+
+	free(ctx->sinks);
+	free(ctx);
+}
+
+bool
+sk_logger_drv_builder_tee(sk_logger_drv_t *driver, void *ctx, sk_error_t *error)
+{
+	const sk_logger_drv_tee_ctx_t *opts = ctx;
+
+	if (opts->sinks == NULL || opts->n_sinks == 0)
+		return sk_error_msg_code(error, "tee has no sinks", SK_ERROR_EINVAL);
+
+	for (size_t i = 0; i < opts->n_sinks; i++) {
+		if (opts->sinks[i].builder == NULL)
+			return sk_error_msg_code(
+				error, "tee sink builder is NULL", SK_ERROR_EINVAL);
+	}
+
+	struct tee_ctx *tee_ctx = calloc(1, sizeof(*tee_ctx));
+	if (tee_ctx == NULL)
+		return sk_error_msg_code(
+			error, "tee_ctx calloc failed", SK_ERROR_ENOMEM);
+
+	tee_ctx->sinks = calloc(opts->n_sinks, sizeof(*tee_ctx->sinks));
+	if (tee_ctx->sinks == NULL) {
+		free(tee_ctx);
+		return sk_error_msg_code(
+			error, "tee sinks calloc failed", SK_ERROR_ENOMEM);
+	}
+
+	for (size_t i = 0; i < opts->n_sinks; i++) {
+		const sk_logger_drv_tee_sink_t *sink_opts = &opts->sinks[i];
+		struct tee_sink *sink = &tee_ctx->sinks[i];
+
+		if (!sink_opts->builder(&sink->driver, sink_opts->ctx, error)) {
+			sk_logger_drv_close_tee(&(sk_logger_drv_t){.ctx = tee_ctx});
+			return false;
+		}
+		sink->level = sink_opts->level;
+		sink->queue_log_size = sink_opts->queue_log_size;
+		tee_ctx->n_sinks++;
+	}
+
+	driver->open = sk_logger_drv_open_tee;
+	driver->log = sk_logger_drv_log_tee;
+	driver->log_batch = sk_logger_drv_log_batch_tee;
+	driver->flush = sk_logger_drv_flush_tee;
+	driver->close = sk_logger_drv_close_tee;
+
+	driver->ctx = tee_ctx;
+
+	return true;
+}
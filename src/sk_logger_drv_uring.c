@@ -0,0 +1,538 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <ck_pr.h>
+
+#include <sk_logger_drv.h>
+
+#include "sk_log_priv.h"
+
+/*
+ * Lines are formatted in a buffer while the previous buffers are written by
+ * io_uring, a single write in flight at a time such that lines stay in order,
+ * short writes included. The drain only waits once every buffer is waiting
+ * to be written. Without io_uring, buffers are written with write(2).
+ */
+
+enum {
+	/* Room kept in a buffer for a formatted message */
+	URING_LINE_MAX = 4096,
+	URING_DEFAULT_MODE = 0644,
+	URING_DEPTH_MIN = 2,
+};
+
+struct uring_buf {
+	char *data;
+	size_t used;
+	/* Bytes of a sealed buffer written so far */
+	size_t written;
+};
+
+struct uring_ctx {
+	sk_logger_drv_uring_ctx_t opts;
+	char *path;
+	int fd;
+
+	/* io_uring instance, -1 while writing with write(2) */
+	int ring_fd;
+	/* Buffers are registered, written with IORING_OP_WRITE_FIXED */
+	bool fixed;
+	void *sq_map, *cq_map;
+	size_t sq_map_size, cq_map_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+	uint32_t *sq_head, *sq_tail, *sq_mask, *sq_array;
+	uint32_t *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_cqe *cqes;
+
+	/*
+	 * Buffers form a ring: `sealed` buffers from `head` wait to be written,
+	 * the head one is in flight, and the one after is being filled.
+	 */
+	char *mem;
+	struct uring_buf *bufs;
+	size_t head, sealed;
+	bool in_flight;
+
+	/* Error of an asynchronous write, reported by the next call */
+	int failed;
+};
+
+static inline struct uring_buf *
+uring_filling(struct uring_ctx *ctx)
+{
+	return &ctx->bufs[(ctx->head + ctx->sealed) % ctx->opts.depth];
+}
+
+static void
+uring_teardown(struct uring_ctx *ctx)
+{
+	if (ctx->sqes != NULL)
+		munmap(ctx->sqes, ctx->sqes_size);
+	if (ctx->cq_map != NULL && ctx->cq_map != ctx->sq_map)
+		munmap(ctx->cq_map, ctx->cq_map_size);
+	if (ctx->sq_map != NULL)
+		munmap(ctx->sq_map, ctx->sq_map_size);
+	if (ctx->ring_fd != -1)
+		close(ctx->ring_fd);
+
+	ctx->sqes = NULL;
+	ctx->sq_map = ctx->cq_map = NULL;
+	ctx->ring_fd = -1;
+	ctx->fixed = false;
+}
+
+/*
+ * Writes are at the file position, which needs IORING_FEAT_RW_CUR_POS, with
+ * an opcode the kernel may not support, or a probe may not allow.
+ */
+static bool
+uring_supported(struct uring_ctx *ctx, const struct io_uring_params *params)
+{
+	const uint8_t op = ctx->fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+	const size_t n_ops = IORING_OP_LAST;
+
+	if (!(params->features & IORING_FEAT_RW_CUR_POS))
+		return false;
+
+	struct io_uring_probe *probe =
+		calloc(1, sizeof(*probe) + n_ops * sizeof(probe->ops[0]));
+	if (probe == NULL)
+		return false;
+
+	const bool supported = syscall(SYS_io_uring_register, ctx->ring_fd,
+							   IORING_REGISTER_PROBE, probe, n_ops) == 0 &&
+		op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+	free(probe);
+
+	return supported;
+}
+
+/* Map an io_uring instance, returns false if the kernel doesn't provide it */
+static bool
+uring_setup(struct uring_ctx *ctx)
+{
+	struct io_uring_params params = {0};
+
+	ctx->ring_fd = syscall(SYS_io_uring_setup, ctx->opts.depth, &params);
+	if (ctx->ring_fd == -1)
+		return false;
+
+	ctx->sq_map_size =
+		params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+	ctx->cq_map_size =
+		params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ctx->cq_map_size > ctx->sq_map_size)
+			ctx->sq_map_size = ctx->cq_map_size;
+		ctx->cq_map_size = ctx->sq_map_size;
+	}
+
+	ctx->sq_map = mmap(NULL, ctx->sq_map_size, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ctx->ring_fd, IORING_OFF_SQ_RING);
+	if (ctx->sq_map == MAP_FAILED) {
+		ctx->sq_map = NULL;
+		goto failed;
+	}
+
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		ctx->cq_map = ctx->sq_map;
+	} else {
+		ctx->cq_map = mmap(NULL, ctx->cq_map_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ctx->ring_fd, IORING_OFF_CQ_RING);
+		if (ctx->cq_map == MAP_FAILED) {
+			ctx->cq_map = NULL;
+			goto failed;
+		}
+	}
+
+	ctx->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	ctx->sqes = mmap(NULL, ctx->sqes_size, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ctx->ring_fd, IORING_OFF_SQES);
+	if (ctx->sqes == MAP_FAILED) {
+		ctx->sqes = NULL;
+		goto failed;
+	}
+
+	char *sq = ctx->sq_map, *cq = ctx->cq_map;
+	ctx->sq_head = (uint32_t *)(sq + params.sq_off.head);
+	ctx->sq_tail = (uint32_t *)(sq + params.sq_off.tail);
+	ctx->sq_mask = (uint32_t *)(sq + params.sq_off.ring_mask);
+	ctx->sq_array = (uint32_t *)(sq + params.sq_off.array);
+	ctx->cq_head = (uint32_t *)(cq + params.cq_off.head);
+	ctx->cq_tail = (uint32_t *)(cq + params.cq_off.tail);
+	ctx->cq_mask = (uint32_t *)(cq + params.cq_off.ring_mask);
+	ctx->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+	/*
+	 * Registered buffers save pinning pages on every write. Best effort,
+	 * e.g. RLIMIT_MEMLOCK may not allow it.
+	 */
+	struct iovec *iov = calloc(ctx->opts.depth, sizeof(*iov));
+	if (iov != NULL) {
+		for (size_t i = 0; i < ctx->opts.depth; i++)
+			iov[i] = (struct iovec){ctx->bufs[i].data, ctx->opts.buf_size};
+		ctx->fixed = syscall(SYS_io_uring_register, ctx->ring_fd,
+						 IORING_REGISTER_BUFFERS, iov, ctx->opts.depth) == 0;
+		free(iov);
+	}
+
+	if (!uring_supported(ctx, &params))
+		goto failed;
+
+	return true;
+
+failed:
+	uring_teardown(ctx);
+	return false;
+}
+
+static int
+uring_enter(struct uring_ctx *ctx, uint32_t submit, uint32_t wait)
+{
+	const uint32_t flags = (wait != 0) ? IORING_ENTER_GETEVENTS : 0;
+
+	for (;;) {
+		if (syscall(SYS_io_uring_enter, ctx->ring_fd, submit, wait, flags,
+				NULL, 0) != -1)
+			return 0;
+		if (errno != EINTR)
+			return errno;
+		/* Submitted entries are consumed even if the wait was interrupted */
+		submit = 0;
+	}
+}
+
+/* Written or failed, the head buffer is free again */
+static void
+uring_release(struct uring_ctx *ctx)
+{
+	struct uring_buf *buf = &ctx->bufs[ctx->head];
+
+	buf->used = buf->written = 0;
+	ctx->head = (ctx->head + 1) % ctx->opts.depth;
+	ctx->sealed--;
+}
+
+/* Write the head buffer with write(2), resuming after partial writes */
+static void
+uring_write_plain(struct uring_ctx *ctx)
+{
+	struct uring_buf *buf = &ctx->bufs[ctx->head];
+
+	while (buf->written < buf->used) {
+		const ssize_t len = write(
+			ctx->fd, buf->data + buf->written, buf->used - buf->written);
+		if (len == -1) {
+			if (errno == EINTR)
+				continue;
+			ctx->failed = errno;
+			break;
+		}
+		buf->written += len;
+	}
+
+	uring_release(ctx);
+}
+
+/* Submit the write of the rest of the head buffer, or write it if it can't */
+static void
+uring_submit(struct uring_ctx *ctx)
+{
+	if (ctx->in_flight || ctx->sealed == 0)
+		return;
+
+	const struct uring_buf *buf = &ctx->bufs[ctx->head];
+	const uint32_t tail = *ctx->sq_tail;
+	const uint32_t index = tail & *ctx->sq_mask;
+	struct io_uring_sqe *sqe = &ctx->sqes[index];
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = ctx->fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+	sqe->fd = ctx->fd;
+	sqe->addr = (uint64_t)(uintptr_t)(buf->data + buf->written);
+	sqe->len = buf->used - buf->written;
+	/* The position of the file, or its end with O_APPEND */
+	sqe->off = (uint64_t)-1;
+	sqe->buf_index = ctx->fixed ? ctx->head : 0;
+	sqe->user_data = ctx->head;
+
+	ctx->sq_array[index] = index;
+	ck_pr_fence_store();
+	ck_pr_store_32(ctx->sq_tail, tail + 1);
+
+	if (uring_enter(ctx, 1, 0) != 0) {
+		/* Nothing was consumed, the entry is withdrawn */
+		ck_pr_store_32(ctx->sq_tail, tail);
+		uring_write_plain(ctx);
+		return;
+	}
+
+	ctx->in_flight = true;
+}
+
+/* Returns false if the kernel can't write, buffers are left to write(2) */
+static bool
+uring_complete(struct uring_ctx *ctx, int res)
+{
+	struct uring_buf *buf = &ctx->bufs[ctx->head];
+
+	ctx->in_flight = false;
+
+	if (res == -EINTR || res == -EAGAIN)
+		return true;
+	if (res == -EINVAL || res == -EOPNOTSUPP)
+		return false;
+
+	if (res < 0) {
+		/* The buffer is discarded, the next one may succeed */
+		ctx->failed = -res;
+		uring_release(ctx);
+		return true;
+	}
+
+	buf->written += res;
+	if (buf->written == buf->used)
+		uring_release(ctx);
+
+	return true;
+}
+
+/* Handle completed writes, waiting for one if `wait`, then submit the next */
+static void
+uring_reap(struct uring_ctx *ctx, bool wait)
+{
+	uint32_t head = *ctx->cq_head;
+	bool supported = true;
+
+	if (wait && ctx->in_flight && head == ck_pr_load_32(ctx->cq_tail)) {
+		const int err = uring_enter(ctx, 0, 1);
+		if (err != 0)
+			ctx->failed = err;
+	}
+
+	while (head != ck_pr_load_32(ctx->cq_tail)) {
+		ck_pr_fence_load();
+		supported &= uring_complete(ctx, ctx->cqes[head & *ctx->cq_mask].res);
+		ck_pr_store_32(ctx->cq_head, ++head);
+	}
+
+	/* Probed, yet e.g. the file doesn't support it, nothing is in flight */
+	if (!supported) {
+		uring_teardown(ctx);
+		while (ctx->sealed != 0)
+			uring_write_plain(ctx);
+		return;
+	}
+
+	uring_submit(ctx);
+}
+
+/* Queue the buffer being filled for writing, such that another one is free */
+static void
+uring_seal(struct uring_ctx *ctx)
+{
+	if (uring_filling(ctx)->used == 0)
+		return;
+
+	ctx->sealed++;
+	if (ctx->ring_fd == -1) {
+		uring_write_plain(ctx);
+		return;
+	}
+
+	uring_reap(ctx, false);
+	/* Every buffer waits to be written, the device is behind */
+	while (ctx->sealed == ctx->opts.depth)
+		uring_reap(ctx, true);
+}
+
+/* Report the error of a previous write */
+static bool
+uring_check(struct uring_ctx *ctx, sk_error_t *error)
+{
+	if (ctx->failed == 0)
+		return true;
+
+	const int err = ctx->failed;
+	ctx->failed = 0;
+
+	return sk_error_msg_code(error, "failed to write log", err);
+}
+
+bool
+sk_logger_drv_open_uring(sk_logger_drv_t *driver, sk_error_t *error)
+{
+	struct uring_ctx *ctx = driver->ctx;
+	const size_t depth = ctx->opts.depth;
+
+	if ((ctx->bufs = calloc(depth, sizeof(*ctx->bufs))) == NULL)
+		return sk_error_msg_code(
+			error, "uring buffers calloc failed", SK_ERROR_ENOMEM);
+
+	if (posix_memalign((void **)&ctx->mem, sysconf(_SC_PAGESIZE),
+			depth * ctx->opts.buf_size) != 0) {
+		ctx->mem = NULL;
+		sk_error_msg_code(error, "uring buffers malloc failed", SK_ERROR_ENOMEM);
+		goto failed_mem;
+	}
+	for (size_t i = 0; i < depth; i++)
+		ctx->bufs[i].data = ctx->mem + i * ctx->opts.buf_size;
+
+	if (ctx->path != NULL) {
+		ctx->fd = open(ctx->path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC,
+			ctx->opts.mode);
+		if (ctx->fd == -1) {
+			sk_error_msg_code(error, "failed to open log file", errno);
+			goto failed_open;
+		}
+	}
+
+	/*
+	 * Falls back to write(2), e.g. kernels without io_uring, its writes at
+	 * the file position, or seccomp.
+	 */
+	if (!ctx->opts.no_uring)
+		(void)uring_setup(ctx);
+
+	return true;
+
+failed_open:
+	free(ctx->mem);
+	ctx->mem = NULL;
+failed_mem:
+	free(ctx->bufs);
+	ctx->bufs = NULL;
+	return false;
+}
+
+bool
+sk_logger_drv_log_batch_uring(sk_logger_drv_t *driver, sk_log_msg_t **msgs,
+	size_t n, sk_error_t *error)
+{
+	struct uring_ctx *ctx = driver->ctx;
+	const size_t size = ctx->opts.buf_size;
+
+	for (size_t i = 0; i < n; i++) {
+		const sk_log_msg_t *msg = msgs[i];
+		struct uring_buf *buf = uring_filling(ctx);
+
+		if (size - buf->used < URING_LINE_MAX) {
+			uring_seal(ctx);
+			buf = uring_filling(ctx);
+		}
+
+		char *line = buf->data + buf->used;
+		const size_t left = size - buf->used;
+		size_t len = sk_log_header_format(line, left - 1, msg);
+		size_t payload = strnlen(msg->payload, SK_LOG_MSG_MAX);
+		if (payload > left - 1 - len)
+			payload = left - 1 - len;
+		memcpy(line + len, msg->payload, payload);
+		len += payload;
+		if (msg->kv_count != 0 && len + 1 < left - 1)
+			len += sk_log_kv_format(line + len, left - 1 - len, msg);
+		line[len++] = '\n';
+		buf->used += len;
+	}
+
+	if (ctx->ring_fd != -1)
+		uring_reap(ctx, false);
+
+	return uring_check(ctx, error);
+}
+
+bool
+sk_logger_drv_flush_uring(sk_logger_drv_t *driver, sk_error_t *error)
+{
+	struct uring_ctx *ctx = driver->ctx;
+
+	/* Submitted, only waited for if no buffer is left */
+	uring_seal(ctx);
+
+	return uring_check(ctx, error);
+}
+
+bool
+sk_logger_drv_log_uring(
+	sk_logger_drv_t *driver, sk_log_msg_t *msg, sk_error_t *error)
+{
+	return sk_logger_drv_log_batch_uring(driver, &msg, 1, error) &&
+		sk_logger_drv_flush_uring(driver, error);
+}
+
+void
+sk_logger_drv_close_uring(sk_logger_drv_t *driver)
+{
+	struct uring_ctx *ctx = driver->ctx;
+
+	if (ctx->bufs != NULL) {
+		uring_seal(ctx);
+		while (ctx->ring_fd != -1 && ctx->sealed != 0)
+			uring_reap(ctx, true);
+		uring_teardown(ctx);
+		if (ctx->path != NULL)
+			close(ctx->fd);
+	}
+
+	free(ctx->mem);
+	free(ctx->bufs);
+	free(ctx->path);
+	free(ctx);
+}
+
+bool
+sk_logger_drv_builder_uring(
+	sk_logger_drv_t *driver, void *ctx, sk_error_t *error)
+{
+	const sk_logger_drv_uring_ctx_t *opts = ctx;
+
+	if (opts->path == NULL && opts->fd < 0)
+		return sk_error_msg_code(
+			error, "uring needs a path or a fd", SK_ERROR_EINVAL);
+
+	struct uring_ctx *uring_ctx = calloc(1, sizeof(*uring_ctx));
+	if (uring_ctx == NULL)
+		return sk_error_msg_code(
+			error, "uring_ctx calloc failed", SK_ERROR_ENOMEM);
+
+	uring_ctx->opts = *opts;
+	uring_ctx->fd = opts->fd;
+	uring_ctx->ring_fd = -1;
+
+	if (opts->path != NULL && (uring_ctx->path = strdup(opts->path)) == NULL) {
+		free(uring_ctx);
+		return sk_error_msg_code(
+			error, "uring path strdup failed", SK_ERROR_ENOMEM);
+	}
+	uring_ctx->opts.path = uring_ctx->path;
+
+	if (uring_ctx->opts.mode == 0)
+		uring_ctx->opts.mode = URING_DEFAULT_MODE;
+	if (uring_ctx->opts.depth == 0)
+		uring_ctx->opts.depth = SK_LOGGER_DRV_URING_DEPTH;
+	if (uring_ctx->opts.depth < URING_DEPTH_MIN)
+		uring_ctx->opts.depth = URING_DEPTH_MIN;
+	if (uring_ctx->opts.buf_size == 0)
+		uring_ctx->opts.buf_size = SK_LOGGER_DRV_URING_BUF_SIZE;
+	if (uring_ctx->opts.buf_size < URING_LINE_MAX)
+		uring_ctx->opts.buf_size = URING_LINE_MAX;
+
+	driver->open = sk_logger_drv_open_uring;
+	driver->log = sk_logger_drv_log_uring;
+	driver->log_batch = sk_logger_drv_log_batch_uring;
+	driver->flush = sk_logger_drv_flush_uring;
+	driver->close = sk_logger_drv_close_uring;
+
+	driver->ctx = uring_ctx;
+
+	return true;
+}
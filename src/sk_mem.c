@@ -0,0 +1,123 @@
+#include <errno.h>
+#include <linux/mempolicy.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <sk_mem.h>
+
+static inline bool
+mem_mapped(const sk_mem_opts_t *opts)
+{
+	return opts != NULL && opts->flags != 0;
+}
+
+/* Length of the mapping, the same for huge pages and their fallback */
+static size_t
+mem_map_size(size_t size, const sk_mem_opts_t *opts)
+{
+	const size_t page = (opts->flags & (SK_MEM_HUGETLB | SK_MEM_THP))
+		? SK_MEM_HUGE_PAGE_SIZE
+		: (size_t)sysconf(_SC_PAGESIZE);
+
+	return (size + page - 1) & ~(page - 1);
+}
+
+static bool
+mem_bind(void *mem, size_t size, uint16_t node, sk_error_t *error)
+{
+	unsigned long mask[SK_MEM_NUMA_NODES_MAX / (8 * sizeof(unsigned long))];
+	const size_t bits = 8 * sizeof(unsigned long);
+
+	if (node >= SK_MEM_NUMA_NODES_MAX)
+		return sk_error_msg_code(
+			error, "numa_node >= SK_MEM_NUMA_NODES_MAX", SK_ERROR_EINVAL);
+
+	memset(mask, 0, sizeof(mask));
+	mask[node / bits] = 1ul << (node % bits);
+
+	if (syscall(SYS_mbind, mem, size, MPOL_BIND, mask, 8 * sizeof(mask), 0) ==
+		-1)
+		return sk_error_msg_code(error, "failed to bind to numa node", errno);
+
+	return true;
+}
+
+/* Write a byte per page, faulting pages in under the memory policy */
+static void
+mem_populate(char *mem, size_t size)
+{
+	const size_t page = sysconf(_SC_PAGESIZE);
+
+	for (size_t offset = 0; offset < size; offset += page)
+		((volatile char *)mem)[offset] = 0;
+}
+
+void *
+sk_mem_alloc(size_t size, const sk_mem_opts_t *opts, sk_error_t *error)
+{
+	if (!mem_mapped(opts)) {
+		void *mem = calloc(1, size);
+		if (mem == NULL)
+			sk_error_msg_code(error, "calloc failed", SK_ERROR_ENOMEM);
+		return mem;
+	}
+
+	const size_t map_size = mem_map_size(size, opts);
+	const uint32_t flags = opts->flags;
+	void *mem = MAP_FAILED;
+	int map_flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+	/* Faulted in once bound, see below */
+	if ((flags & SK_MEM_POPULATE) && !(flags & SK_MEM_NUMA))
+		map_flags |= MAP_POPULATE;
+
+	if (flags & SK_MEM_HUGETLB)
+		mem = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+			map_flags | MAP_HUGETLB, -1, 0);
+	if (mem == MAP_FAILED) {
+		mem = mmap(NULL, map_size, PROT_READ | PROT_WRITE, map_flags, -1, 0);
+		if (mem == MAP_FAILED) {
+			sk_error_msg_code(error, "mmap failed", SK_ERROR_ENOMEM);
+			return NULL;
+		}
+		/* Best effort, THP may be disabled */
+		if (flags & (SK_MEM_HUGETLB | SK_MEM_THP))
+			(void)madvise(mem, map_size, MADV_HUGEPAGE);
+	}
+
+	if ((flags & SK_MEM_NUMA) &&
+		!mem_bind(mem, map_size, opts->numa_node, error))
+		goto failed;
+
+	if (flags & SK_MEM_MLOCK) {
+		if (mlock(mem, map_size) == -1) {
+			sk_error_msg_code(error, "mlock failed", SK_ERROR_ENOMEM);
+			goto failed;
+		}
+	} else if ((flags & SK_MEM_POPULATE) && (flags & SK_MEM_NUMA)) {
+		mem_populate(mem, map_size);
+	}
+
+	return mem;
+
+failed:
+	munmap(mem, map_size);
+	return NULL;
+}
+
+void
+sk_mem_free(void *mem, size_t size, const sk_mem_opts_t *opts)
+{
+	if (mem == NULL)
+		return;
+
+	if (!mem_mapped(opts)) {
+		free(mem);
+		return;
+	}
+
+	munmap(mem, mem_map_size(size, opts));
+}
@@ -0,0 +1,350 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ck_pr.h>
+
+#include <sk_ring.h>
+
+/*
+ * Every record is preceded by a header. The state is written last by the
+ * producer, the consumer polls it. The consumer zeroes released records such
+ * that free space always reads as uncommitted.
+ */
+struct record_hdr {
+	/* Length of the record, or of the skipped space for padding */
+	uint32_t len;
+	uint32_t state;
+};
+
+enum {
+	RECORD_FREE = 0,
+	RECORD_COMMITTED,
+	RECORD_PADDING,
+};
+
+static_assert(sizeof(struct record_hdr) == 8, "record header must be 8 bytes");
+
+static inline size_t
+record_span(size_t len)
+{
+	return (sizeof(struct record_hdr) + len + 7) & ~(size_t)7;
+}
+
+static inline struct record_hdr *
+record_hdr_at(const sk_ring_t *ring, uint64_t pos)
+{
+	return (struct record_hdr *)(ring->buf + (pos & ring->mask));
+}
+
+/* Position of a record that was not released yet, from the consumer's */
+static inline uint64_t
+record_pos(const sk_ring_t *ring, const struct record_hdr *hdr)
+{
+	const uint64_t head = ck_pr_load_64((uint64_t *)&ring->head);
+	const size_t offset = (const char *)hdr - ring->buf;
+
+	return head + ((offset - head) & ring->mask);
+}
+
+bool
+sk_ring_init_mem(sk_ring_t *ring, uint8_t log_size, const sk_mem_opts_t *mem,
+	sk_error_t *error)
+{
+	if (log_size < SK_RING_SIZE_MIN || log_size > SK_RING_SIZE_MAX)
+		return sk_error_msg_code(
+			error, "ring log_size out of range", SK_ERROR_EINVAL);
+
+	memset(ring, 0, sizeof(*ring));
+	ring->size = (size_t)1 << log_size;
+	ring->mask = ring->size - 1;
+	if (mem != NULL)
+		ring->mem = *mem;
+
+	return (ring->buf = sk_mem_alloc(ring->size, &ring->mem, error)) != NULL;
+}
+
+bool
+sk_ring_init(sk_ring_t *ring, uint8_t log_size, sk_error_t *error)
+{
+	return sk_ring_init_mem(ring, log_size, NULL, error);
+}
+
+void
+sk_ring_destroy(sk_ring_t *ring)
+{
+	sk_mem_free(ring->buf, ring->size, &ring->mem);
+	ring->buf = NULL;
+}
+
+size_t
+sk_ring_record_max(const sk_ring_t *ring)
+{
+	/*
+	 * A record of half the ring always fits in an empty ring, even if it must
+	 * be preceded by padding.
+	 */
+	return ring->size / 2 - sizeof(struct record_hdr);
+}
+
+/* Bytes to reserve at tail for a span, padding included; 0 if full */
+static inline uint64_t
+ring_reservation(const sk_ring_t *ring, uint64_t tail, size_t span)
+{
+	ck_pr_fence_load();
+	const uint64_t head = ck_pr_load_64(&ring->head);
+
+	const size_t offset = tail & ring->mask;
+	const uint64_t padding =
+		(offset + span > ring->size) ? ring->size - offset : 0;
+
+	if (tail + padding + span - head > ring->size)
+		return 0;
+
+	return padding + span;
+}
+
+/* Write the padding and header of a record reserved at tail */
+static inline void *
+ring_reserved(sk_ring_t *ring, uint64_t tail, size_t reserved, size_t len)
+{
+	const uint64_t padding = reserved - record_span(len);
+
+	if (padding != 0) {
+		struct record_hdr *pad = record_hdr_at(ring, tail);
+		pad->len = (uint32_t)padding;
+		ck_pr_fence_store();
+		ck_pr_store_32(&pad->state, RECORD_PADDING);
+	}
+
+	struct record_hdr *hdr = record_hdr_at(ring, tail + padding);
+	hdr->len = (uint32_t)len;
+
+	return hdr + 1;
+}
+
+void *
+sk_ring_reserve(sk_ring_t *ring, size_t len)
+{
+	if (len > sk_ring_record_max(ring))
+		return NULL;
+
+	const size_t span = record_span(len);
+	uint64_t tail, reserved;
+
+	do {
+		tail = ck_pr_load_64(&ring->tail);
+		if ((reserved = ring_reservation(ring, tail, span)) == 0)
+			return NULL;
+	} while (!ck_pr_cas_64(&ring->tail, tail, tail + reserved));
+
+	return ring_reserved(ring, tail, reserved, len);
+}
+
+void *
+sk_ring_reserve_sp(sk_ring_t *ring, size_t len)
+{
+	if (len > sk_ring_record_max(ring))
+		return NULL;
+
+	const uint64_t tail = ring->tail;
+	const uint64_t reserved = ring_reservation(ring, tail, record_span(len));
+	if (reserved == 0)
+		return NULL;
+
+	ck_pr_store_64(&ring->tail, tail + reserved);
+
+	return ring_reserved(ring, tail, reserved, len);
+}
+
+void
+sk_ring_commit(sk_ring_t *ring, void *record)
+{
+	(void)ring;
+	struct record_hdr *hdr = (struct record_hdr *)record - 1;
+
+	ck_pr_fence_store();
+	ck_pr_store_32(&hdr->state, RECORD_COMMITTED);
+}
+
+/*
+ * Shrink a reservation to `used` bytes. The rest is handed back unless a later
+ * record was reserved, then it's padding skipped by the consumer.
+ */
+static void
+ring_shrink(sk_ring_t *ring, struct record_hdr *hdr, size_t used)
+{
+	const size_t span = record_span(hdr->len);
+	if (used == span)
+		return;
+
+	const uint64_t pos = record_pos(ring, hdr);
+	struct record_hdr *rest = (struct record_hdr *)((char *)hdr + used);
+
+	/* Free space reads as uncommitted, see `struct record_hdr` */
+	memset(rest, 0, span - used);
+
+	if (!ck_pr_cas_64(&ring->tail, pos + span, pos + used)) {
+		rest->len = (uint32_t)(span - used);
+		ck_pr_fence_store();
+		ck_pr_store_32(&rest->state, RECORD_PADDING);
+	}
+}
+
+void
+sk_ring_commit_len(sk_ring_t *ring, void *record, size_t len)
+{
+	struct record_hdr *hdr = (struct record_hdr *)record - 1;
+
+	assert(len <= hdr->len);
+	ring_shrink(ring, hdr, record_span(len));
+
+	hdr->len = (uint32_t)len;
+	sk_ring_commit(ring, record);
+}
+
+void
+sk_ring_abort(sk_ring_t *ring, void *record)
+{
+	ring_shrink(ring, (struct record_hdr *)record - 1, 0);
+}
+
+bool
+sk_ring_enqueue(sk_ring_t *ring, const void *record, size_t len)
+{
+	void *dst = sk_ring_reserve(ring, len);
+	if (dst == NULL)
+		return false;
+
+	memcpy(dst, record, len);
+	sk_ring_commit(ring, dst);
+
+	return true;
+}
+
+bool
+sk_ring_enqueue_sp(sk_ring_t *ring, const void *record, size_t len)
+{
+	void *dst = sk_ring_reserve_sp(ring, len);
+	if (dst == NULL)
+		return false;
+
+	memcpy(dst, record, len);
+	sk_ring_commit(ring, dst);
+
+	return true;
+}
+
+/* Zero a span and hand it back to producers */
+static inline void
+ring_advance(sk_ring_t *ring, struct record_hdr *hdr, size_t span)
+{
+	memset(hdr, 0, span);
+	ck_pr_fence_store();
+	ck_pr_store_64(&ring->head, ring->head + span);
+}
+
+/* Committed record at pos or after its padding, NULL past `end` */
+static void *
+ring_record_at(sk_ring_t *ring, uint64_t pos, uint64_t end, size_t *len)
+{
+	while (pos < end) {
+		struct record_hdr *hdr = record_hdr_at(ring, pos);
+
+		const uint32_t state = ck_pr_load_32(&hdr->state);
+		if (state == RECORD_FREE)
+			return NULL;
+		ck_pr_fence_load();
+
+		if (state == RECORD_PADDING) {
+			pos += hdr->len;
+			continue;
+		}
+
+		*len = hdr->len;
+		return hdr + 1;
+	}
+
+	return NULL;
+}
+
+void *
+sk_ring_peek(sk_ring_t *ring, size_t *len)
+{
+	for (;;) {
+		struct record_hdr *hdr = record_hdr_at(ring, ring->head);
+
+		const uint32_t state = ck_pr_load_32(&hdr->state);
+		if (state == RECORD_FREE)
+			return NULL;
+		ck_pr_fence_load();
+
+		if (state == RECORD_PADDING) {
+			ring_advance(ring, hdr, hdr->len);
+			continue;
+		}
+
+		*len = hdr->len;
+		return hdr + 1;
+	}
+}
+
+void *
+sk_ring_peek_next(sk_ring_t *ring, void *record, size_t *len)
+{
+	struct record_hdr *hdr = (struct record_hdr *)record - 1;
+	const uint64_t pos = record_pos(ring, hdr) + record_span(hdr->len);
+
+	/* A full ring wraps around to the head */
+	return ring_record_at(ring, pos, ring->head + ring->size, len);
+}
+
+void
+sk_ring_release(sk_ring_t *ring, void *record)
+{
+	struct record_hdr *last = (struct record_hdr *)record - 1;
+	uint64_t head = ring->head;
+	struct record_hdr *hdr;
+
+	do {
+		hdr = record_hdr_at(ring, head);
+		const size_t span = (hdr->state == RECORD_PADDING)
+			? hdr->len
+			: record_span(hdr->len);
+
+		memset(hdr, 0, span);
+		head += span;
+	} while (hdr != last);
+
+	ck_pr_fence_store();
+	ck_pr_store_64(&ring->head, head);
+}
+
+bool
+sk_ring_dequeue(sk_ring_t *ring, void *record, size_t *len)
+{
+	size_t record_len;
+	void *src = sk_ring_peek(ring, &record_len);
+	if (src == NULL)
+		return false;
+
+	if (record_len > *len) {
+		*len = record_len;
+		return false;
+	}
+
+	memcpy(record, src, record_len);
+	*len = record_len;
+	sk_ring_release(ring, src);
+
+	return true;
+}
+
+size_t
+sk_ring_used(const sk_ring_t *ring)
+{
+	const uint64_t head = ck_pr_load_64((uint64_t *)&ring->head);
+	ck_pr_fence_load();
+
+	return ck_pr_load_64((uint64_t *)&ring->tail) - head;
+}
@@ -0,0 +1,237 @@
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <sk_log.h>
+#include <sk_log_bin.h>
+#include <sk_logger_drv.h>
+
+#include "test.h"
+
+static char path[PATH_MAX];
+static char index_path[PATH_MAX + sizeof(SK_LOG_BIN_INDEX_SUFFIX)];
+
+static int
+setup(void **state)
+{
+	if (test_dir_setup(state) != 0)
+		return -1;
+	test_path(path, sizeof(path), "app.bin");
+	snprintf(index_path, sizeof(index_path), "%s" SK_LOG_BIN_INDEX_SUFFIX, path);
+
+	return 0;
+}
+
+enum {
+	/* Blocks that aren't full are written by drains past this age */
+	BIN_FLUSH_MS = 1,
+};
+
+static sk_logger_t *
+bin_logger(uint32_t flush_ms)
+{
+	sk_logger_drv_bin_ctx_t ctx = {.path = path, .flush_ms = flush_ms};
+
+	return test_logger(sk_logger_drv_builder_bin, &ctx);
+}
+
+/* Drain, then let the block age until the next drain writes it */
+static void
+bin_seal(sk_logger_t *logger)
+{
+	sk_error_t error;
+	size_t drained;
+
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	usleep(BIN_FLUSH_MS * 1000);
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+}
+
+/* Log `n` messages numbered from `first`, a block per `per_block` */
+static void
+bin_fill(sk_logger_t *logger, int first, int n, int per_block)
+{
+	for (int i = first; i < first + n; i++) {
+		const enum sk_log_level level = (i % 4 == 0) ? SK_LOG_ERROR : SK_LOG_INFO;
+		assert_true(sk_log(logger, level, sk_debug, "%d", i));
+		if ((i + 1) % per_block == 0)
+			bin_seal(logger);
+	}
+	bin_seal(logger);
+}
+
+static void
+bin_basic()
+{
+	sk_logger_t *logger = bin_logger(0);
+	sk_log_bin_reader_t reader;
+	sk_log_bin_entry_t entry;
+	sk_kv_t kvs[SK_LOG_KV_MAX];
+	sk_error_t error;
+	size_t drained;
+
+	assert_true(sk_log(logger, SK_LOG_WARNING, sk_debug, "hello %s", "world"));
+	const int line = __LINE__ - 1;
+	assert_true(sk_log_kv(logger, SK_LOG_ERROR, sk_debug, "login",
+		SK_KV_INT("user", -42), SK_KV_STR("from", "a b")));
+
+	/* A young block isn't written by drains, but when closed */
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_int_equal(drained, 2);
+	assert_true(sk_log_bin_open(&reader, path, &error));
+	assert_int_equal(reader.n_blocks, 0);
+	sk_log_bin_close(&reader);
+	sk_logger_destroy(logger);
+
+	assert_true(sk_log_bin_open(&reader, path, &error));
+	assert_string_equal(reader.hdr->name, "app.db");
+	assert_int_equal(reader.n_blocks, 1);
+
+	assert_true(sk_log_bin_next(&reader, &entry));
+	assert_int_equal(entry.msg.level, SK_LOG_WARNING);
+	assert_string_equal(entry.msg.payload, "hello world");
+	assert_string_equal(entry.msg.debug.file, __FILE__);
+	assert_string_equal(entry.msg.debug.function, "bin_basic");
+	assert_int_equal(entry.msg.debug.line, line);
+	assert_int_equal(entry.msg.pid, getpid());
+	assert_null(entry.msg.thread);
+	assert_int_equal(sk_log_msg_kv(&entry.msg, kvs, SK_LOG_KV_MAX), 0);
+
+	assert_true(sk_log_bin_next(&reader, &entry));
+	assert_int_equal(entry.msg.level, SK_LOG_ERROR);
+	assert_string_equal(entry.msg.payload, "login");
+	assert_int_equal(sk_log_msg_kv(&entry.msg, kvs, SK_LOG_KV_MAX), 2);
+	assert_string_equal(kvs[0].key, "user");
+	assert_int_equal(kvs[0].i, -42);
+	assert_string_equal(kvs[1].s, "a b");
+
+	assert_false(sk_log_bin_next(&reader, &entry));
+	sk_log_bin_close(&reader);
+
+	unlink(path);
+	unlink(index_path);
+}
+
+static void
+bin_query()
+{
+	enum { COUNT = 200, PER_BLOCK = 10 };
+	sk_logger_t *logger = bin_logger(BIN_FLUSH_MS);
+	uint64_t ts[COUNT];
+	sk_log_bin_reader_t reader;
+	sk_log_bin_entry_t entry;
+	sk_error_t error;
+	int n = 0;
+
+	bin_fill(logger, 0, COUNT, PER_BLOCK);
+	sk_logger_destroy(logger);
+
+	assert_true(sk_log_bin_open(&reader, path, &error));
+	assert_int_equal(reader.n_blocks, COUNT / PER_BLOCK);
+	while (sk_log_bin_next(&reader, &entry)) {
+		assert_int_equal(atoi(entry.msg.payload), n);
+		ts[n++] = entry.msg.ts_nsec;
+	}
+	assert_int_equal(n, COUNT);
+
+	/* A time range seeks to its first block */
+	sk_log_bin_query_t query = {.from_nsec = ts[123], .to_nsec = ts[156]};
+	sk_log_bin_seek(&reader, &query);
+	assert_int_equal(reader.block, 123 / PER_BLOCK);
+	for (n = 123; sk_log_bin_next(&reader, &entry); n++)
+		assert_int_equal(atoi(entry.msg.payload), n);
+	assert_int_equal(n, 157);
+
+	/* Levels filter records */
+	query = (sk_log_bin_query_t){.levels = 1u << SK_LOG_ERROR};
+	sk_log_bin_seek(&reader, &query);
+	for (n = 0; sk_log_bin_next(&reader, &entry); n += 4) {
+		assert_int_equal(entry.msg.level, SK_LOG_ERROR);
+		assert_int_equal(atoi(entry.msg.payload), n);
+	}
+	assert_int_equal(n, COUNT);
+
+	/* Past the end */
+	query = (sk_log_bin_query_t){.from_nsec = ts[COUNT - 1] + 1};
+	sk_log_bin_seek(&reader, &query);
+	assert_int_equal(reader.block, reader.n_blocks);
+	assert_false(sk_log_bin_next(&reader, &entry));
+
+	sk_log_bin_close(&reader);
+
+	unlink(path);
+	unlink(index_path);
+}
+
+static void
+bin_recovery()
+{
+	sk_log_bin_reader_t reader;
+	sk_log_bin_entry_t entry;
+	sk_error_t error;
+	int n = 0;
+
+	/* A second logger appends to the file */
+	sk_logger_t *logger = bin_logger(BIN_FLUSH_MS);
+	bin_fill(logger, 0, 30, 10);
+	sk_logger_destroy(logger);
+	logger = bin_logger(BIN_FLUSH_MS);
+	bin_fill(logger, 30, 30, 10);
+	sk_logger_destroy(logger);
+
+	/* The index lost its last entries, and the file has a torn block */
+	assert_int_equal(truncate(index_path, 2 * sizeof(sk_log_bin_index_t)), 0);
+	const int fd = open(path, O_WRONLY | O_APPEND);
+	const sk_log_bin_block_t torn = {
+		.magic = SK_LOG_BIN_BLOCK_MAGIC,
+		.size = 4096,
+		.count = 10,
+	};
+	assert_int_equal(write(fd, &torn, sizeof(torn)), sizeof(torn));
+	close(fd);
+
+	assert_true(sk_log_bin_open(&reader, path, &error));
+	assert_int_equal(reader.n_blocks, 6);
+	while (sk_log_bin_next(&reader, &entry))
+		assert_int_equal(atoi(entry.msg.payload), n++);
+	assert_int_equal(n, 60);
+	sk_log_bin_close(&reader);
+
+	/* A restarted logger appends in place of the torn block */
+	logger = bin_logger(BIN_FLUSH_MS);
+	bin_fill(logger, 60, 10, 10);
+	sk_logger_destroy(logger);
+
+	n = 0;
+	assert_true(sk_log_bin_open(&reader, path, &error));
+	assert_int_equal(reader.n_blocks, 7);
+	while (sk_log_bin_next(&reader, &entry))
+		assert_int_equal(atoi(entry.msg.payload), n++);
+	assert_int_equal(n, 70);
+	sk_log_bin_close(&reader);
+
+	/* Not a binary log file */
+	assert_false(sk_log_bin_open(&reader, index_path, &error));
+	assert_int_equal(error.code, SK_ERROR_EINVAL);
+
+	/* Without an index, as no garbage is left between blocks */
+	unlink(index_path);
+	assert_true(sk_log_bin_open(&reader, path, &error));
+	assert_int_equal(reader.n_blocks, 7);
+	sk_log_bin_close(&reader);
+
+	unlink(path);
+}
+
+int
+main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(bin_basic),
+		cmocka_unit_test(bin_query),
+		cmocka_unit_test(bin_recovery),
+	};
+
+	return cmocka_run_group_tests(tests, setup, test_dir_teardown);
+}
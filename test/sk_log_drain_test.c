@@ -0,0 +1,183 @@
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include <ck_pr.h>
+
+#include <sk_log.h>
+#include <sk_log_drain.h>
+#include <sk_logger_drv.h>
+
+#include "test.h"
+
+static uint64_t
+now_ms()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Wait until a tally counter reaches a value, false on timeout */
+static bool
+wait_tally(sk_logger_t *logger, enum sk_log_level level, uint64_t value,
+	uint64_t timeout_ms)
+{
+	sk_logger_drv_tally_ctx_t *tally_ctx = logger->driver.ctx;
+	const uint64_t deadline = now_ms() + timeout_ms;
+
+	while (ck_pr_load_64(&tally_ctx->counters[level]) != value) {
+		if (now_ms() > deadline)
+			return false;
+		sched_yield();
+	}
+
+	return true;
+}
+
+static void
+drain_basic()
+{
+	sk_log_drain_opts_t opts = {.workers = 2};
+	sk_logger_t *loggers[4];
+	sk_error_t error;
+
+	sk_logger_drv_set_default(sk_logger_drv_builder_tally, NULL);
+
+	for (size_t i = 0; i < sk_array_size(loggers); i++)
+		assert_non_null(
+			(loggers[i] = sk_logger_create("drained", 10, NULL, &error)));
+
+	assert_true(sk_log_drain_start(&opts, &error));
+	assert_false(sk_log_drain_start(&opts, &error));
+	assert_int_equal(error.code, SK_ERROR_EINVAL);
+
+	for (size_t n = 1; n <= 100; n++)
+		for (size_t i = 0; i < sk_array_size(loggers); i++)
+			while (!sk_log_error(loggers[i], "%zu", n))
+				sched_yield();
+
+	for (size_t i = 0; i < sk_array_size(loggers); i++)
+		assert_true(wait_tally(loggers[i], SK_LOG_ERROR, 100, 5000));
+
+	/* Loggers created while running are drained as well */
+	sk_logger_t *late = sk_logger_create("late", 4, NULL, &error);
+	assert_non_null(late);
+	assert_true(sk_log_error(late, "late"));
+	assert_true(wait_tally(late, SK_LOG_ERROR, 1, 5000));
+
+	sk_log_drain_stop();
+	sk_log_drain_stop();
+
+	sk_logger_destroy(late);
+	for (size_t i = 0; i < sk_array_size(loggers); i++)
+		sk_logger_destroy(loggers[i]);
+}
+
+static void
+drain_wakeup()
+{
+	/* Idle workers would otherwise sleep for a minute */
+	sk_log_drain_opts_t opts = {.idle_ms = 60000};
+	sk_logger_t *logger;
+	sk_error_t error;
+
+	sk_logger_drv_set_default(sk_logger_drv_builder_tally, NULL);
+	assert_non_null((logger = sk_logger_create("wakeup", 4, NULL, &error)));
+
+	assert_true(sk_log_drain_start(&opts, &error));
+
+	for (uint64_t i = 1; i <= 5; i++) {
+		/* Give the worker time to arm the logger and fall asleep */
+		const struct timespec pause = {0, 20 * 1000000L};
+		nanosleep(&pause, NULL);
+
+		assert_true(sk_log_error(logger, "wake up"));
+		assert_true(wait_tally(logger, SK_LOG_ERROR, i, 5000));
+	}
+
+	sk_log_drain_stop();
+	sk_logger_destroy(logger);
+}
+
+static void
+drain_stop_flushes()
+{
+	sk_logger_t *logger;
+	sk_error_t error;
+
+	sk_logger_drv_set_default(sk_logger_drv_builder_tally, NULL);
+	assert_non_null((logger = sk_logger_create("flush", 10, NULL, &error)));
+
+	/* The cpus needn't outlive the start */
+	{
+		const int cpus[] = {0};
+		sk_log_drain_opts_t opts = {.cpus = cpus, .n_cpus = 1};
+		assert_true(sk_log_drain_start(&opts, &error));
+	}
+	for (size_t i = 0; i < 500; i++)
+		assert_true(sk_log_error(logger, "%zu", i));
+	sk_log_drain_stop();
+
+	/* All messages are drained once stopped */
+	assert_true(wait_tally(logger, SK_LOG_ERROR, 500, 0));
+
+	sk_logger_destroy(logger);
+}
+
+/* Driver that changes the level of its logger while being drained */
+struct set_level_ctx {
+	sk_logger_t *logger;
+	uint64_t logged;
+};
+
+static bool
+set_level_log(sk_logger_drv_t *driver, sk_log_msg_t *msg, sk_error_t *error)
+{
+	(void)msg;
+	(void)error;
+	struct set_level_ctx *ctx = driver->ctx;
+
+	assert_true(sk_logger_set_level(ctx->logger, SK_LOG_DEBUG));
+	ck_pr_inc_64(&ctx->logged);
+
+	return true;
+}
+
+static void
+drain_set_level()
+{
+	sk_log_drain_opts_t opts = {0};
+	struct set_level_ctx ctx = {0};
+	sk_logger_drv_t driver = {.ctx = &ctx, .log = set_level_log};
+	sk_logger_opts_t logger_opts = {.log_size = 4};
+	sk_error_t error;
+
+	assert_non_null((ctx.logger = sk_logger_create_opts(
+						 "set_level", &logger_opts, &driver, &error)));
+	assert_true(sk_log_drain_start(&opts, &error));
+
+	/* Levels change while workers hold the registry */
+	assert_true(sk_log_error(ctx.logger, "set level"));
+	const uint64_t deadline = now_ms() + 5000;
+	while (ck_pr_load_64(&ctx.logged) != 1) {
+		assert_true(now_ms() < deadline);
+		sched_yield();
+	}
+	assert_int_equal(sk_logger_get_level(ctx.logger), SK_LOG_DEBUG);
+
+	sk_log_drain_stop();
+	sk_logger_destroy(ctx.logger);
+}
+
+int
+main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(drain_basic), cmocka_unit_test(drain_wakeup),
+		cmocka_unit_test(drain_stop_flushes), cmocka_unit_test(drain_set_level),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,216 @@
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <sk_log.h>
+#include <sk_log_flight.h>
+#include <sk_logger_drv.h>
+
+#include "test.h"
+
+static char path[] = "/tmp/sk_log_flight.XXXXXX";
+static char prev_path[sizeof(path) + sizeof(SK_LOG_FLIGHT_PREV_SUFFIX)];
+
+static int
+setup(void **state)
+{
+	(void)state;
+	int fd = mkstemp(path);
+	if (fd == -1)
+		return -1;
+
+	close(fd);
+	snprintf(prev_path, sizeof(prev_path), "%s" SK_LOG_FLIGHT_PREV_SUFFIX,
+		path);
+	return 0;
+}
+
+static int
+teardown(void **state)
+{
+	(void)state;
+	(void)unlink(prev_path);
+	return unlink(path);
+}
+
+static sk_logger_t *
+flight_logger(uint8_t log_size)
+{
+	sk_logger_opts_t opts = {
+		.log_size = log_size,
+		.ring = SK_LOGGER_RING_FLIGHT,
+		.path = path,
+	};
+	sk_logger_drv_t driver;
+	sk_error_t error;
+	sk_logger_t *logger;
+
+	assert_true(sk_logger_drv_builder_null(&driver, NULL, &error));
+	assert_non_null(
+		logger = sk_logger_create_opts("flight", &opts, &driver, &error));
+	assert_true(sk_logger_set_level(logger, SK_LOG_DEBUG));
+
+	return logger;
+}
+
+static void
+flight_basic()
+{
+	sk_logger_opts_t opts = {.log_size = 4, .ring = SK_LOGGER_RING_FLIGHT};
+	sk_log_flight_reader_t reader;
+	sk_log_flight_record_t record;
+	sk_logger_drv_t driver;
+	sk_error_t error;
+	size_t drained;
+
+	/* A path is required */
+	assert_true(sk_logger_drv_builder_null(&driver, NULL, &error));
+	assert_null(sk_logger_create_opts("flight", &opts, &driver, &error));
+	assert_int_equal(error.code, SK_ERROR_EINVAL);
+
+	prctl(PR_SET_NAME, "recorder");
+	sk_logger_t *logger = flight_logger(4);
+
+	/* Deferred formatting is ignored */
+	sk_logger_set_flags(logger, SK_LOGGER_DEFERRED);
+	for (int i = 0; i < 40; i++)
+		assert_true(sk_log(logger, SK_LOG_DEBUG, sk_debug, "%s %d", "msg", i));
+	const int line = __LINE__ - 1;
+
+	/* Nothing is drained */
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_int_equal(drained, 0);
+
+	/* Readable while the logger is alive, the last 16 messages remain */
+	assert_true(sk_log_flight_open(&reader, path, &error));
+	assert_string_equal(reader.hdr->name, "flight");
+	assert_int_equal(reader.hdr->pid, getpid());
+	assert_int_equal(reader.hdr->slot_count, 16);
+
+	for (int i = 24; i < 40; i++) {
+		char expected[32];
+		snprintf(expected, sizeof(expected), "msg %d", i);
+
+		assert_true(sk_log_flight_next(&reader, &record));
+		assert_int_equal(record.position, i);
+		assert_string_equal(record.payload, expected);
+		assert_int_equal(record.level, SK_LOG_DEBUG);
+		assert_int_equal(record.pid, getpid());
+		assert_int_not_equal(record.tid, 0);
+		assert_int_equal(record.line, line);
+		assert_string_equal(record.thread, "recorder");
+		assert_string_equal(record.function, "flight_basic");
+		assert_non_null(strstr(record.file, "sk_log_flight_test.c"));
+	}
+	assert_false(sk_log_flight_next(&reader, &record));
+	sk_log_flight_close(&reader);
+
+	/* Fields are rendered as text */
+	assert_true(sk_log_kv(logger, SK_LOG_INFO, sk_debug, "kv",
+		SK_KV_INT("user", 42), SK_KV_STR("from", "a b")));
+	assert_true(sk_log_flight_open(&reader, path, &error));
+	while (sk_log_flight_next(&reader, &record))
+		;
+	assert_int_equal(record.position, 40);
+	assert_string_equal(record.payload, "kv user=42 from=\"a b\"");
+
+	sk_log_flight_close(&reader);
+	sk_logger_destroy(logger);
+}
+
+static void
+flight_crash()
+{
+	sk_log_flight_reader_t reader;
+	sk_log_flight_record_t record;
+	sk_error_t error;
+	int status;
+
+	pid_t child = fork();
+	assert_int_not_equal(child, -1);
+
+	if (child == 0) {
+		sk_logger_t *logger = flight_logger(8);
+		for (int i = 0; i < 10; i++)
+			sk_log(logger, SK_LOG_INFO, sk_debug, "before crash %d", i);
+		raise(SIGKILL);
+	}
+
+	assert_int_equal(waitpid(child, &status, 0), child);
+	assert_true(WIFSIGNALED(status));
+
+	assert_true(sk_log_flight_open(&reader, path, &error));
+	assert_int_equal(reader.hdr->pid, child);
+
+	for (int i = 0; i < 10; i++) {
+		char expected[32];
+		snprintf(expected, sizeof(expected), "before crash %d", i);
+
+		assert_true(sk_log_flight_next(&reader, &record));
+		assert_string_equal(record.payload, expected);
+		assert_int_equal(record.pid, child);
+		assert_int_equal(record.level, SK_LOG_INFO);
+	}
+	assert_false(sk_log_flight_next(&reader, &record));
+
+	sk_log_flight_close(&reader);
+
+	/* A restart keeps the recorder of the crashed process aside */
+	sk_logger_t *logger = flight_logger(8);
+	assert_true(sk_log_flight_open(&reader, prev_path, &error));
+	assert_int_equal(reader.hdr->pid, child);
+	assert_true(sk_log_flight_next(&reader, &record));
+	assert_string_equal(record.payload, "before crash 0");
+	sk_log_flight_close(&reader);
+
+	assert_true(sk_log_flight_open(&reader, path, &error));
+	assert_int_equal(reader.hdr->pid, getpid());
+	assert_false(sk_log_flight_next(&reader, &record));
+	sk_log_flight_close(&reader);
+
+	sk_logger_destroy(logger);
+}
+
+static void
+flight_invalid()
+{
+	sk_log_flight_reader_t reader;
+	sk_error_t error;
+
+	assert_false(sk_log_flight_open(&reader, "/nonexistent", &error));
+	assert_int_equal(error.code, ENOENT);
+
+	/* Too small */
+	assert_int_equal(truncate(path, 16), 0);
+	assert_false(sk_log_flight_open(&reader, path, &error));
+	assert_int_equal(error.code, SK_ERROR_EINVAL);
+
+	/* Bad magic */
+	assert_int_equal(truncate(path, 1 << 16), 0);
+	assert_false(sk_log_flight_open(&reader, path, &error));
+	assert_int_equal(error.code, SK_ERROR_EINVAL);
+
+	/* Truncated slots */
+	sk_logger_destroy(flight_logger(8));
+	assert_true(sk_log_flight_open(&reader, path, &error));
+	sk_log_flight_close(&reader);
+	assert_int_equal(truncate(path, 8192), 0);
+	assert_false(sk_log_flight_open(&reader, path, &error));
+	assert_int_equal(error.code, SK_ERROR_EINVAL);
+}
+
+int
+main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(flight_basic),
+		cmocka_unit_test(flight_crash),
+		cmocka_unit_test(flight_invalid),
+	};
+
+	return cmocka_run_group_tests(tests, setup, teardown);
+}
@@ -1,7 +1,19 @@
+/* Compile out debug messages, see logger_macro_gate */
+#define SK_LOG_COMPILE_LEVEL SK_LOG_INFO
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <sys/prctl.h>
+#include <unistd.h>
+
 #include <sk_log.h>
 #include <sk_logger_drv.h>
 
 #include "test.h"
+
+/* Needed when linked with the shared library, see logger_callsites */
+SK_LOG_CALLSITES_MODULE()
 CK_RING_PROTOTYPE(msg, sk_log_msg)
 
 static void
@@ -96,12 +108,1595 @@ logger_maximum_drain()
 	sk_logger_destroy(logger);
 }
 
+static int
+side_effect(int *counter)
+{
+	return ++(*counter);
+}
+
+static void
+logger_macro_gate()
+{
+	sk_logger_t *logger;
+	sk_error_t error;
+	size_t drained = 0;
+	int evaluated = 0;
+
+	sk_logger_drv_set_default(sk_logger_drv_builder_tally, NULL);
+
+	assert_non_null(
+		(logger = sk_logger_create("gate_logger", 4, NULL, &error)));
+
+	/* Arguments of messages below the logger's level are not evaluated */
+	assert_true(sk_logger_set_level(logger, SK_LOG_WARNING));
+	assert_false(sk_logger_is_enabled(logger, SK_LOG_NOTICE));
+	assert_true(sk_logger_is_enabled(logger, SK_LOG_WARNING));
+	assert_true(sk_log_info(logger, "%d", side_effect(&evaluated)));
+	assert_true(sk_log_notice(logger, "%d", side_effect(&evaluated)));
+	assert_int_equal(evaluated, 0);
+	assert_true(sk_log_warning(logger, "%d", side_effect(&evaluated)));
+	assert_int_equal(evaluated, 1);
+
+	/* Debug is above SK_LOG_COMPILE_LEVEL and compiled out */
+	assert_true(sk_logger_set_level(logger, SK_LOG_DEBUG));
+	assert_true(sk_log_debug(logger, "%d", side_effect(&evaluated)));
+	assert_int_equal(evaluated, 1);
+	assert_true(sk_log_info(logger, "%d", side_effect(&evaluated)));
+	assert_int_equal(evaluated, 2);
+
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_int_equal(drained, 2);
+
+	const sk_logger_drv_tally_ctx_t *tally_ctx = logger->driver.ctx;
+	assert_int_equal(tally_ctx->counters[SK_LOG_WARNING], 1);
+	assert_int_equal(tally_ctx->counters[SK_LOG_INFO], 1);
+	assert_int_equal(tally_ctx->counters[SK_LOG_DEBUG], 0);
+
+	sk_logger_destroy(logger);
+}
+
+/* Driver that keeps a copy of the last message */
+static bool
+capture_log(sk_logger_drv_t *driver, sk_log_msg_t *msg, sk_error_t *error)
+{
+	(void)error;
+	memcpy(driver->ctx, msg,
+		offsetof(sk_log_msg_t, payload) + sk_log_msg_payload_size(msg));
+
+	return true;
+}
+
+static sk_logger_t *
+capture_logger(const char *name, sk_log_msg_t *last)
+{
+	sk_logger_drv_t driver = {.ctx = last, .log = capture_log};
+	sk_error_t error;
+	sk_logger_t *logger = sk_logger_create(name, 4, &driver, &error);
+
+	assert_non_null(logger);
+	assert_true(sk_logger_set_level(logger, SK_LOG_DEBUG));
+
+	return logger;
+}
+
+static sk_logger_t *
+registry_logger(const char *name)
+{
+	sk_error_t error;
+	sk_logger_t *logger = sk_logger_create(name, 2, NULL, &error);
+
+	assert_non_null(logger);
+
+	return logger;
+}
+
+static void
+logger_registry()
+{
+	sk_error_t error;
+
+	sk_logger_drv_set_default(sk_logger_drv_builder_tally, NULL);
+
+	sk_logger_t *app = registry_logger("app");
+	sk_logger_t *db = registry_logger("app.db");
+	sk_logger_t *pool = registry_logger("app.db.pool");
+	sk_logger_t *other = registry_logger("application");
+
+	assert_ptr_equal(sk_logger_find("app.db"), db);
+	assert_null(sk_logger_find("app.d"));
+	assert_int_equal(sk_logger_get_level(pool), SK_LOG_DEFAULT_LEVEL);
+
+	/* Descendants inherit, unless they have their own level */
+	assert_true(sk_logger_set_level(app, SK_LOG_DEBUG));
+	assert_int_equal(sk_logger_get_level(db), SK_LOG_DEBUG);
+	assert_int_equal(sk_logger_get_level(pool), SK_LOG_DEBUG);
+	assert_int_equal(sk_logger_get_level(other), SK_LOG_DEFAULT_LEVEL);
+
+	assert_true(sk_logger_set_level(db, SK_LOG_ERROR));
+	assert_int_equal(sk_logger_get_level(app), SK_LOG_DEBUG);
+	assert_int_equal(sk_logger_get_level(pool), SK_LOG_ERROR);
+
+	/* New loggers inherit too */
+	sk_logger_t *cache = registry_logger("app.db.cache");
+	assert_int_equal(sk_logger_get_level(cache), SK_LOG_ERROR);
+
+	/* Patterns override older levels */
+	assert_true(sk_logger_set_level_match("app.db*", SK_LOG_INFO, &error));
+	assert_int_equal(sk_logger_get_level(app), SK_LOG_DEBUG);
+	assert_int_equal(sk_logger_get_level(db), SK_LOG_INFO);
+	assert_int_equal(sk_logger_get_level(pool), SK_LOG_INFO);
+	assert_int_equal(sk_logger_get_level(cache), SK_LOG_INFO);
+	assert_int_equal(sk_logger_get_level(other), SK_LOG_DEFAULT_LEVEL);
+
+	/* ... and are overridden by newer levels */
+	assert_true(sk_logger_set_level(pool, SK_LOG_WARNING));
+	assert_int_equal(sk_logger_get_level(pool), SK_LOG_WARNING);
+	assert_int_equal(sk_logger_get_level(cache), SK_LOG_INFO);
+
+	/* Patterns apply to future loggers */
+	sk_logger_t *queue = registry_logger("app.db.queue");
+	assert_int_equal(sk_logger_get_level(queue), SK_LOG_INFO);
+
+	/* Regexes match whole names */
+	assert_true(
+		sk_logger_set_level_regex("app(lication)?", SK_LOG_ALERT, &error));
+	assert_int_equal(sk_logger_get_level(app), SK_LOG_ALERT);
+	assert_int_equal(sk_logger_get_level(other), SK_LOG_ALERT);
+	assert_int_equal(sk_logger_get_level(db), SK_LOG_INFO);
+
+	assert_false(sk_logger_set_level_regex("(", SK_LOG_ALERT, &error));
+	assert_int_equal(error.code, SK_ERROR_EINVAL);
+	assert_false(sk_logger_set_level_match("*", SK_LOG_COUNT, &error));
+	assert_int_equal(error.code, SK_ERROR_EINVAL);
+
+	/* Ancestors need not exist */
+	sk_logger_t *deep = registry_logger("svc.http.client");
+	assert_true(sk_logger_set_level_match("svc", SK_LOG_CRITICAL, &error));
+	assert_int_equal(sk_logger_get_level(deep), SK_LOG_CRITICAL);
+
+	/* Back to own and inherited levels */
+	sk_logger_reset_level_match();
+	assert_int_equal(sk_logger_get_level(app), SK_LOG_DEBUG);
+	assert_int_equal(sk_logger_get_level(db), SK_LOG_ERROR);
+	assert_int_equal(sk_logger_get_level(pool), SK_LOG_WARNING);
+	assert_int_equal(sk_logger_get_level(queue), SK_LOG_ERROR);
+	assert_int_equal(sk_logger_get_level(deep), SK_LOG_DEFAULT_LEVEL);
+
+	/* Destroying an ancestor releases its descendants */
+	sk_logger_destroy(db);
+	assert_int_equal(sk_logger_get_level(queue), SK_LOG_DEBUG);
+	sk_logger_destroy(app);
+	assert_int_equal(sk_logger_get_level(queue), SK_LOG_DEFAULT_LEVEL);
+	assert_int_equal(sk_logger_get_level(pool), SK_LOG_WARNING);
+
+	sk_logger_destroy(deep);
+	sk_logger_destroy(queue);
+	sk_logger_destroy(cache);
+	sk_logger_destroy(pool);
+	sk_logger_destroy(other);
+}
+
+static void
+logger_deferred()
+{
+	sk_log_msg_t last;
+	sk_logger_t *logger = capture_logger("deferred_logger", &last);
+	sk_error_t error;
+	size_t drained = 0;
+	char expected[SK_LOG_MSG_MAX];
+	const char not_terminated[] = {'a', 'b', 'c', 'd'};
+	char mutated[] = "before";
+
+	sk_logger_set_flags(logger, SK_LOGGER_DEFERRED);
+
+#define DEFERRED_FMT                                                           \
+	"%d %u %ld %lld %zu %c %5.2f %Lg %-*s| %.*s %s %x %% %hhd"
+#define DEFERRED_ARGS                                                          \
+	-1, 2U, -3L, 4LL, (size_t)5, 'x', 3.14159, (long double)2.5, 6, "pad", 2, \
+		not_terminated, mutated, 255, 7
+
+	snprintf(expected, sizeof(expected), DEFERRED_FMT, DEFERRED_ARGS);
+	assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, DEFERRED_FMT,
+		DEFERRED_ARGS));
+
+	/* Strings are copied when logging, not when draining */
+	strcpy(mutated, "after");
+
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_int_equal(drained, 1);
+	assert_null(last.fmt);
+	assert_string_equal(last.payload, expected);
+
+	/* Conversions which can't be deferred are formatted eagerly */
+	errno = EINVAL;
+	snprintf(expected, sizeof(expected), "%m");
+	errno = EINVAL;
+	assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "%m"));
+	errno = 0;
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_string_equal(last.payload, expected);
+
+	/* Truncation matches eager formatting */
+	char large[2 * SK_LOG_MSG_MAX];
+	memset(large, 'z', sizeof(large) - 1);
+	large[sizeof(large) - 1] = '\0';
+	memset(expected, 'z', sizeof(expected) - 1);
+	expected[sizeof(expected) - 1] = '\0';
+	assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "%s", large));
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_string_equal(last.payload, expected);
+
+	sk_logger_destroy(logger);
+}
+
+static void
+logger_kv()
+{
+	sk_log_msg_t last;
+	sk_logger_t *logger = capture_logger("kv_logger", &last);
+	sk_kv_t kvs[SK_LOG_KV_MAX];
+	sk_error_t error;
+	size_t drained = 0;
+	char mutated[] = "before";
+
+	assert_true(sk_log_kv(logger, SK_LOG_INFO, sk_debug, "login",
+		SK_KV_INT("int", -42), SK_KV_UINT("uint", UINT64_MAX),
+		SK_KV_DOUBLE("double", 0.5), SK_KV_BOOL("bool", true),
+		SK_KV_STR("str", mutated), SK_KV_STR("null", NULL)));
+
+	/* Strings are copied when logging */
+	strcpy(mutated, "after");
+
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_int_equal(drained, 1);
+	assert_string_equal(last.payload, "login");
+	assert_int_equal(last.kv_count, 6);
+	assert_int_equal(sk_log_msg_kv(&last, kvs, SK_LOG_KV_MAX), 6);
+
+	assert_string_equal(kvs[0].key, "int");
+	assert_int_equal(kvs[0].type, SK_KV_TYPE_INT);
+	assert_int_equal(kvs[0].i, -42);
+	assert_string_equal(kvs[1].key, "uint");
+	assert_int_equal(kvs[1].type, SK_KV_TYPE_UINT);
+	assert_true(kvs[1].u == UINT64_MAX);
+	assert_int_equal(kvs[2].type, SK_KV_TYPE_DOUBLE);
+	assert_true(kvs[2].d > 0.49 && kvs[2].d < 0.51);
+	assert_int_equal(kvs[3].type, SK_KV_TYPE_BOOL);
+	assert_true(kvs[3].b);
+	assert_int_equal(kvs[4].type, SK_KV_TYPE_STR);
+	assert_string_equal(kvs[4].s, "before");
+	assert_string_equal(kvs[5].s, "(null)");
+
+	/* Decoding is bounded by the array */
+	assert_int_equal(sk_log_msg_kv(&last, kvs, 2), 2);
+
+	/* Plain messages have no fields */
+	assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "plain"));
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_int_equal(last.kv_count, 0);
+	assert_int_equal(sk_log_msg_kv(&last, kvs, SK_LOG_KV_MAX), 0);
+	assert_true(sk_log_kv(logger, SK_LOG_INFO, sk_debug, "none"));
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_string_equal(last.payload, "none");
+	assert_int_equal(last.kv_count, 0);
+
+	/* The last string fitting is truncated, the following fields dropped */
+	char large[SK_LOG_MSG_MAX];
+	memset(large, 'z', sizeof(large) - 1);
+	large[sizeof(large) - 1] = '\0';
+	assert_true(sk_log_kv(logger, SK_LOG_INFO, sk_debug, "large",
+		SK_KV_INT("first", 1), SK_KV_STR("large", large),
+		SK_KV_INT("dropped", 2)));
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_int_equal(sk_log_msg_kv(&last, kvs, SK_LOG_KV_MAX), 2);
+	assert_int_equal(kvs[0].i, 1);
+	assert_in_range(strlen(kvs[1].s), 1, SK_LOG_MSG_MAX - 1);
+	assert_int_equal(strspn(kvs[1].s, "z"), strlen(kvs[1].s));
+
+	/* Fields go through variable length rings with the message */
+	sk_logger_destroy(logger);
+	sk_logger_opts_t opts = {.log_size = 12, .ring = SK_LOGGER_RING_VARIABLE};
+	sk_logger_drv_t driver = {.ctx = &last, .log = capture_log};
+	assert_non_null(
+		logger = sk_logger_create_opts("kv_variable", &opts, &driver, &error));
+	assert_true(sk_log_kv(logger, SK_LOG_ERROR, sk_debug, "variable",
+		SK_KV_STR("key", "value")));
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_int_equal(drained, 1);
+	assert_int_equal(sk_log_msg_kv(&last, kvs, SK_LOG_KV_MAX), 1);
+	assert_string_equal(kvs[0].key, "key");
+	assert_string_equal(kvs[0].s, "value");
+
+	sk_logger_destroy(logger);
+}
+
+static void
+logger_variable_ring()
+{
+	sk_log_msg_t last;
+	sk_logger_drv_t driver = {.ctx = &last, .log = capture_log};
+	sk_logger_opts_t opts = {.log_size = 8, .ring = SK_LOGGER_RING_VARIABLE};
+	sk_logger_t *logger;
+	sk_error_t error;
+	size_t drained;
+
+	/* A ring must hold at least a message of maximal size */
+	assert_null(sk_logger_create_opts("small_ring", &opts, &driver, &error));
+	assert_int_equal(error.code, SK_ERROR_EINVAL);
+
+	opts.log_size = 12;
+	assert_non_null(
+		(logger = sk_logger_create_opts("var_ring", &opts, &driver, &error)));
+
+	/* Short messages only take their length */
+	size_t enqueued = 0;
+	while (sk_log(logger, SK_LOG_ERROR, sk_debug, "msg %zu", enqueued))
+		enqueued++;
+	assert_true(enqueued > (4096 / sizeof(sk_log_msg_t)) * 4);
+
+	/* The message refused by the full ring is reported by the next drain */
+	assert_int_equal(sk_logger_dropped(logger, SK_LOG_ERROR), 1);
+	assert_true(sk_logger_drain(logger, &drained, 1, &error));
+	assert_int_equal(drained, 1);
+	assert_int_equal(last.level, SK_LOG_WARNING);
+	assert_string_equal(last.payload, "1 messages dropped (error: 1)");
+
+	for (size_t i = 1; i < enqueued; i++) {
+		char expected[32];
+		snprintf(expected, sizeof(expected), "msg %zu", i);
+		assert_true(sk_logger_drain(logger, &drained, 1, &error));
+		assert_int_equal(drained, 1);
+		assert_string_equal(last.payload, expected);
+	}
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_int_equal(drained, 0);
+
+	/* Deferred messages are unpacked from their actual size */
+	sk_logger_set_flags(logger, SK_LOGGER_DEFERRED);
+	assert_true(sk_log(logger, SK_LOG_ERROR, sk_debug, "%s=%d", "key", 42));
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_int_equal(drained, 1);
+	assert_string_equal(last.payload, "key=42");
+
+	sk_logger_destroy(logger);
+}
+
+enum {
+	N_PRODUCERS = 4,
+	N_MESSAGES = 20000,
+};
+
+struct producer_ctx {
+	sk_logger_t *logger;
+	int id;
+	atomic_bool *start;
+};
+
+static void *
+logger_producer(void *opaque)
+{
+	struct producer_ctx *ctx = opaque;
+	char name[SK_LOG_THREAD_NAME_MAX];
+
+	snprintf(name, sizeof(name), "producer-%d", ctx->id);
+	prctl(PR_SET_NAME, name);
+
+	while (!*ctx->start)
+		sched_yield();
+
+	for (int i = 0; i < N_MESSAGES; i++)
+		while (!sk_log(ctx->logger, SK_LOG_ERROR, sk_debug, "%d %d", ctx->id, i))
+			sched_yield();
+
+	return NULL;
+}
+
+/* Validates that messages of each thread are received in order */
+static bool
+ordered_log(sk_logger_drv_t *driver, sk_log_msg_t *msg, sk_error_t *error)
+{
+	(void)error;
+	int *expected = driver->ctx;
+	int id, seq;
+	char name[SK_LOG_THREAD_NAME_MAX];
+
+	/* Drops of producers retrying on a full ring are reported */
+	if (msg->level == SK_LOG_WARNING)
+		return true;
+
+	assert_int_equal(sscanf(msg->payload, "%d %d", &id, &seq), 2);
+	assert_in_range(id, 0, N_PRODUCERS - 1);
+	assert_int_equal(seq, expected[id]++);
+
+	snprintf(name, sizeof(name), "producer-%d", id);
+	assert_non_null(msg->thread);
+	assert_string_equal(msg->thread, name);
+	assert_int_not_equal(msg->tid, 0);
+
+	return true;
+}
+
+static void
+logger_per_thread()
+{
+	int expected[N_PRODUCERS] = {0};
+	sk_logger_drv_t driver = {.ctx = expected, .log = ordered_log};
+	sk_logger_opts_t opts = {.log_size = 12, .ring = SK_LOGGER_RING_PER_THREAD};
+	pthread_t producers[N_PRODUCERS];
+	struct producer_ctx contexes[N_PRODUCERS];
+	atomic_bool start = false;
+	sk_logger_t *logger;
+	sk_error_t error;
+	size_t drained, total = 0;
+
+	opts.log_size = 8;
+	assert_null(sk_logger_create_opts("per_thread", &opts, &driver, &error));
+	assert_int_equal(error.code, SK_ERROR_EINVAL);
+
+	opts.log_size = 12;
+	assert_non_null(
+		(logger = sk_logger_create_opts("per_thread", &opts, &driver, &error)));
+
+	/* Nothing to drain before any thread logged */
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_int_equal(drained, 0);
+
+	for (int i = 0; i < N_PRODUCERS; i++) {
+		contexes[i] = (struct producer_ctx){logger, i, &start};
+		pthread_create(&producers[i], NULL, logger_producer, &contexes[i]);
+	}
+
+	start = true;
+
+	while (total != N_PRODUCERS * N_MESSAGES) {
+		assert_true(sk_logger_drain(logger, &drained, 0, &error));
+		total += drained;
+		if (drained == 0)
+			sched_yield();
+	}
+
+	for (int i = 0; i < N_PRODUCERS; i++) {
+		pthread_join(producers[i], NULL);
+		assert_int_equal(expected[i], N_MESSAGES);
+	}
+
+	sk_logger_destroy(logger);
+}
+
+/* Driver that keeps the payloads of messages */
+struct collect_ctx {
+	size_t n;
+	enum sk_log_level levels[32];
+	size_t kv_counts[32];
+	char payloads[32][SK_LOG_MSG_MAX];
+};
+
+static bool
+collect_log(sk_logger_drv_t *driver, sk_log_msg_t *msg, sk_error_t *error)
+{
+	(void)error;
+	struct collect_ctx *ctx = driver->ctx;
+
+	assert_true(ctx->n < sk_array_size(ctx->payloads));
+	ctx->levels[ctx->n] = msg->level;
+	ctx->kv_counts[ctx->n] = msg->kv_count;
+	memcpy(ctx->payloads[ctx->n], msg->payload, sk_log_msg_payload_size(msg));
+	ctx->n++;
+
+	return true;
+}
+
+static sk_logger_t *
+collect_logger(const char *name, sk_logger_opts_t *opts, struct collect_ctx *ctx)
+{
+	sk_logger_drv_t driver = {.ctx = ctx, .log = collect_log};
+	sk_error_t error;
+	sk_logger_t *logger = sk_logger_create_opts(name, opts, &driver, &error);
+
+	assert_non_null(logger);
+	assert_true(sk_logger_set_level(logger, SK_LOG_DEBUG));
+	memset(ctx, 0, sizeof(*ctx));
+
+	return logger;
+}
+
+static void
+logger_full_drop_newest()
+{
+	struct collect_ctx ctx;
+	sk_logger_opts_t opts = {.log_size = 2};
+	sk_logger_t *logger = collect_logger("drop_newest", &opts, &ctx);
+	sk_error_t error;
+	size_t drained;
+
+	/* A fixed ring of 2^2 slots holds 3 messages */
+	for (int i = 0; i < 3; i++)
+		assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "%d", i));
+	assert_false(sk_log(logger, SK_LOG_INFO, sk_debug, "3"));
+	assert_false(sk_log(logger, SK_LOG_ERROR, sk_debug, "4"));
+	assert_false(sk_log(logger, SK_LOG_INFO, sk_debug, "5"));
+
+	assert_int_equal(sk_logger_dropped(logger, SK_LOG_INFO), 2);
+	assert_int_equal(sk_logger_dropped(logger, SK_LOG_ERROR), 1);
+	assert_int_equal(sk_logger_dropped(logger, SK_LOG_DEBUG), 0);
+
+	/* The report follows the messages of the ring */
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_int_equal(drained, 3);
+	assert_int_equal(ctx.n, 4);
+	assert_string_equal(ctx.payloads[2], "2");
+	assert_int_equal(ctx.levels[3], SK_LOG_WARNING);
+	assert_string_equal(
+		ctx.payloads[3], "3 messages dropped (error: 1, info: 2)");
+
+	/* Reports are rate limited */
+	assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "6"));
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_int_equal(ctx.n, 5);
+	assert_string_equal(ctx.payloads[4], "6");
+
+	sk_logger_destroy(logger);
+
+	/* A drain that doesn't empty the ring still reports */
+	logger = collect_logger("drop_newest", &opts, &ctx);
+	for (int i = 0; i < 3; i++)
+		assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "%d", i));
+	assert_false(sk_log(logger, SK_LOG_INFO, sk_debug, "3"));
+
+	assert_true(sk_logger_drain(logger, &drained, 1, &error));
+	assert_int_equal(drained, 1);
+	assert_int_equal(ctx.n, 2);
+	assert_string_equal(ctx.payloads[1], "1 messages dropped (info: 1)");
+
+	sk_logger_destroy(logger);
+}
+
+static void
+logger_full_drop_oldest()
+{
+	const enum sk_logger_ring rings[] = {
+		SK_LOGGER_RING_FIXED,
+		SK_LOGGER_RING_VARIABLE,
+		SK_LOGGER_RING_PER_THREAD,
+	};
+
+	for (size_t r = 0; r < sk_array_size(rings); r++) {
+		struct collect_ctx ctx;
+		sk_logger_opts_t opts = {
+			.ring = rings[r],
+			.full_policy = SK_LOGGER_FULL_DROP_OLDEST,
+		};
+		opts.log_size = (rings[r] == SK_LOGGER_RING_FIXED) ? 2 : 10;
+		sk_logger_t *logger = collect_logger("drop_oldest", &opts, &ctx);
+		sk_error_t error;
+		size_t drained, enqueued = 0;
+
+		/* Fill the ring, then overwrite with as many messages */
+		while (sk_logger_dropped(logger, SK_LOG_INFO) == 0)
+			assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "%zu", enqueued++));
+		const size_t capacity = enqueued - 1;
+		for (size_t i = 1; i < capacity; i++)
+			assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "%zu", enqueued++));
+
+		assert_int_equal(sk_logger_dropped(logger, SK_LOG_INFO), capacity);
+		assert_in_range(capacity, 3, sk_array_size(ctx.payloads) - 1);
+
+		/* Only the newest messages remain */
+		assert_true(sk_logger_drain(logger, &drained, 0, &error));
+		assert_int_equal(drained, capacity);
+		for (size_t i = 0; i < capacity; i++) {
+			char expected[32];
+			snprintf(expected, sizeof(expected), "%zu", capacity + i);
+			assert_string_equal(ctx.payloads[i], expected);
+		}
+
+		sk_logger_destroy(logger);
+	}
+}
+
+struct drainer_ctx {
+	sk_logger_t *logger;
+	atomic_bool *stop;
+};
+
+static void *
+logger_drainer(void *opaque)
+{
+	struct drainer_ctx *ctx = opaque;
+	sk_error_t error;
+	size_t drained;
+
+	while (!*ctx->stop) {
+		assert_true(sk_logger_drain(ctx->logger, &drained, 0, &error));
+		if (drained == 0)
+			sched_yield();
+	}
+
+	return NULL;
+}
+
+/* Validates that messages are received in order */
+static bool
+sequence_log(sk_logger_drv_t *driver, sk_log_msg_t *msg, sk_error_t *error)
+{
+	(void)error;
+	int *expected = driver->ctx;
+	int seq;
+
+	/* Drop reports */
+	if (msg->level == SK_LOG_WARNING)
+		return true;
+
+	assert_int_equal(sscanf(msg->payload, "%d", &seq), 1);
+	assert_int_equal(seq, (*expected)++);
+
+	return true;
+}
+
+static void
+logger_full_block()
+{
+	int expected = 0;
+	sk_logger_drv_t driver = {.ctx = &expected, .log = sequence_log};
+	sk_logger_opts_t opts = {
+		.log_size = 2,
+		.full_policy = SK_LOGGER_FULL_BLOCK,
+		.block_timeout_us = 1000,
+	};
+	atomic_bool stop = false;
+	struct drainer_ctx ctx = {.stop = &stop};
+	pthread_t drainer;
+	sk_logger_t *logger;
+	sk_error_t error;
+	size_t drained;
+
+	assert_non_null(
+		(logger = sk_logger_create_opts("block", &opts, &driver, &error)));
+	assert_true(sk_logger_set_level(logger, SK_LOG_DEBUG));
+
+	/* Nobody drains, gives up after the timeout */
+	for (int i = 0; i < 3; i++)
+		assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "%d", i));
+	assert_false(sk_log(logger, SK_LOG_INFO, sk_debug, "lost"));
+	assert_int_equal(sk_logger_dropped(logger, SK_LOG_INFO), 1);
+
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_int_equal(drained, 3);
+	sk_logger_destroy(logger);
+
+	/* Waits for a concurrent drain, nothing is lost */
+	expected = 0;
+	opts.block_timeout_us = 10 * 1000 * 1000;
+	assert_non_null(
+		(logger = sk_logger_create_opts("block", &opts, &driver, &error)));
+	assert_true(sk_logger_set_level(logger, SK_LOG_DEBUG));
+
+	ctx.logger = logger;
+	pthread_create(&drainer, NULL, logger_drainer, &ctx);
+	for (int i = 0; i < 1000; i++)
+		assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "%d", i));
+	stop = true;
+	pthread_join(drainer, NULL);
+
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_int_equal(expected, 1000);
+	assert_int_equal(sk_logger_dropped(logger, SK_LOG_INFO), 0);
+
+	sk_logger_destroy(logger);
+}
+
+static void
+logger_full_spill()
+{
+	int expected = 0;
+	sk_logger_drv_t driver = {.ctx = &expected, .log = sequence_log};
+	sk_logger_opts_t opts = {
+		.log_size = 2,
+		.full_policy = SK_LOGGER_FULL_SPILL,
+		.spill_log_size = 8,
+	};
+	sk_logger_t *logger;
+	sk_error_t error;
+	size_t drained;
+
+	/* The spill ring must hold any message */
+	assert_null(sk_logger_create_opts("spill", &opts, &driver, &error));
+	assert_int_equal(error.code, SK_ERROR_EINVAL);
+
+	opts.full_policy = SK_LOGGER_FULL_SPILL + 1;
+	assert_null(sk_logger_create_opts("spill", &opts, &driver, &error));
+	assert_int_equal(error.code, SK_ERROR_EINVAL);
+
+	opts.full_policy = SK_LOGGER_FULL_SPILL;
+	opts.spill_log_size = 12;
+	assert_non_null(
+		(logger = sk_logger_create_opts("spill", &opts, &driver, &error)));
+	assert_true(sk_logger_set_level(logger, SK_LOG_DEBUG));
+
+	for (int i = 0; i < 20; i++)
+		assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "%d", i));
+
+	/* Partially drain, new messages follow the spilled ones */
+	assert_true(sk_logger_drain(logger, &drained, 6, &error));
+	for (int i = 20; i < 30; i++)
+		assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "%d", i));
+
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_int_equal(drained, 24);
+	assert_int_equal(expected, 30);
+	assert_int_equal(sk_logger_dropped(logger, SK_LOG_INFO), 0);
+
+	/* Fill both rings */
+	int n = expected;
+	while (sk_log(logger, SK_LOG_INFO, sk_debug, "%d", n))
+		n++;
+	assert_int_equal(sk_logger_dropped(logger, SK_LOG_INFO), 1);
+
+	/* The ring has room again, but messages can't overtake spilled ones */
+	assert_true(sk_logger_drain(logger, &drained, 2, &error));
+	assert_false(sk_log(logger, SK_LOG_INFO, sk_debug, "lost"));
+	assert_int_equal(sk_logger_dropped(logger, SK_LOG_INFO), 2);
+
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_int_equal(expected, n);
+
+	/* Once drained, messages go to the ring again */
+	assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "%d", n));
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_int_equal(expected, n + 1);
+
+	sk_logger_destroy(logger);
+}
+
+/* Logs a sequence, then waits until released if a barrier is given */
+struct exiting_ctx {
+	sk_logger_t *logger;
+	int seq;
+	pthread_barrier_t *barrier;
+};
+
+static void *
+exiting_producer(void *opaque)
+{
+	struct exiting_ctx *ctx = opaque;
+
+	for (int i = 0; i < 5; i++)
+		assert_true(
+			sk_log(ctx->logger, SK_LOG_INFO, sk_debug, "%d", ctx->seq++));
+
+	if (ctx->barrier != NULL) {
+		pthread_barrier_wait(ctx->barrier);
+		pthread_barrier_wait(ctx->barrier);
+	}
+
+	return NULL;
+}
+
+static size_t
+producers_count(sk_logger_t *logger)
+{
+	sk_logger_producer_t *producer;
+	size_t n = 0;
+
+	CK_SLIST_FOREACH(producer, &logger->producers, next)
+	{
+		n++;
+	}
+
+	return n;
+}
+
+static void
+logger_producer_exit()
+{
+	int expected = 0;
+	sk_logger_drv_t driver = {.ctx = &expected, .log = sequence_log};
+	sk_logger_opts_t opts = {.log_size = 12, .ring = SK_LOGGER_RING_PER_THREAD};
+	struct exiting_ctx ctx = {0};
+	pthread_barrier_t barrier;
+	sk_logger_stats_t stats;
+	sk_logger_t *logger;
+	sk_error_t error;
+	size_t drained;
+	pthread_t thread;
+
+	assert_non_null(
+		(logger = sk_logger_create_opts("exit", &opts, &driver, &error)));
+	assert_true(sk_logger_set_level(logger, SK_LOG_DEBUG));
+	ctx.logger = logger;
+
+	/* The ring of an exited thread is drained before being freed */
+	pthread_create(&thread, NULL, exiting_producer, &ctx);
+	pthread_join(thread, NULL);
+	assert_int_equal(producers_count(logger), 1);
+
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_int_equal(drained, 5);
+	assert_int_equal(producers_count(logger), 0);
+
+	sk_logger_get_stats(logger, &stats);
+	assert_int_equal(stats.enqueued, 5);
+	assert_int_equal(stats.pending, 0);
+
+	/* Threads exiting after the logger is gone free their producer */
+	pthread_barrier_init(&barrier, NULL, 2);
+	ctx.barrier = &barrier;
+	pthread_create(&thread, NULL, exiting_producer, &ctx);
+	pthread_barrier_wait(&barrier);
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_int_equal(drained, 5);
+	assert_int_equal(producers_count(logger), 1);
+	sk_logger_destroy(logger);
+	pthread_barrier_wait(&barrier);
+	pthread_join(thread, NULL);
+	pthread_barrier_destroy(&barrier);
+}
+
+/* Driver that records the size of batches */
+struct batch_ctx {
+	size_t n_batches;
+	size_t sizes[8];
+	int expected;
+};
+
+static bool
+batch_log(sk_logger_drv_t *driver, sk_log_msg_t **msgs, size_t n,
+	sk_error_t *error)
+{
+	(void)error;
+	struct batch_ctx *ctx = driver->ctx;
+
+	assert_true(ctx->n_batches < sk_array_size(ctx->sizes));
+	assert_in_range(n, 1, SK_LOG_BATCH_MAX);
+	ctx->sizes[ctx->n_batches++] = n;
+
+	for (size_t i = 0; i < n; i++)
+		assert_int_equal(atoi(msgs[i]->payload), ctx->expected++);
+
+	return true;
+}
+
+/* A single callsite, as in a hot error loop */
+static void
+storm(sk_logger_t *logger, int i)
+{
+	assert_true(sk_log_error_ratelimited(logger, 10, 3, "storm %d", i));
+}
+
+static void
+logger_ratelimited()
+{
+	sk_logger_opts_t opts = {.log_size = 4};
+	struct collect_ctx ctx;
+	sk_logger_t *logger = collect_logger("ratelimited", &opts, &ctx);
+	sk_error_t error;
+	size_t drained;
+
+	/* A burst of 3, then a message every 100ms */
+	for (int i = 0; i < 20; i++)
+		storm(logger, i);
+	usleep(150 * 1000);
+	storm(logger, 20);
+
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_int_equal(drained, 4);
+	assert_string_equal(ctx.payloads[0], "storm 0");
+	assert_string_equal(ctx.payloads[2], "storm 2");
+	assert_string_equal(ctx.payloads[3], "storm 20 (17 suppressed)");
+
+	/* One in 4 */
+	ctx.n = 0;
+	for (int i = 0; i < 10; i++)
+		assert_true(sk_log_info_sampled(logger, 4, "sample %d", i));
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_int_equal(drained, 3);
+	assert_string_equal(ctx.payloads[0], "sample 0");
+	assert_string_equal(ctx.payloads[1], "sample 4 (3 suppressed)");
+	assert_string_equal(ctx.payloads[2], "sample 8 (3 suppressed)");
+
+	/* Disabled levels don't count as suppressed */
+	assert_true(sk_logger_set_level(logger, SK_LOG_WARNING));
+	for (int i = 0; i < 10; i++)
+		assert_true(sk_log_info_sampled(logger, 2, "disabled %d", i));
+	assert_true(sk_logger_set_level(logger, SK_LOG_DEBUG));
+	ctx.n = 0;
+	for (int i = 0; i < 3; i++)
+		assert_true(sk_log_info_sampled(logger, 2, "enabled %d", i));
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_int_equal(drained, 2);
+	assert_string_equal(ctx.payloads[0], "enabled 0");
+	assert_string_equal(ctx.payloads[1], "enabled 2 (1 suppressed)");
+
+	/* A rate of 0 is unlimited */
+	ctx.n = 0;
+	for (int i = 0; i < 3; i++)
+		assert_true(sk_log_alert_ratelimited(logger, 0, 1, "alert %d", i));
+	assert_true(sk_log_emergency_sampled(logger, 1, "emergency"));
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_int_equal(drained, 4);
+	assert_string_equal(ctx.payloads[2], "alert 2");
+	assert_int_equal(ctx.levels[3], SK_LOG_EMERGENCY);
+
+	sk_logger_destroy(logger);
+}
+
+static void
+logger_coalesce()
+{
+	sk_logger_opts_t opts = {.log_size = 8, .coalesce_ms = 50};
+	struct collect_ctx ctx;
+	sk_logger_t *logger = collect_logger("coalesce", &opts, &ctx);
+	sk_log_msg_t msg = {0};
+	sk_kv_t kvs[SK_LOG_KV_MAX];
+	sk_error_t error;
+	size_t drained;
+
+	/* Runs go on across batches, other messages break them */
+	for (int i = 0; i < 100; i++)
+		assert_true(sk_log(logger, SK_LOG_ERROR, sk_debug, "timeout"));
+	assert_true(sk_log(logger, SK_LOG_ERROR, sk_debug, "timeout"));
+	for (int i = 0; i < 3; i++)
+		assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "%d", i / 2));
+	for (int i = 0; i < 3; i++)
+		assert_true(sk_log_kv(logger, SK_LOG_WARNING, sk_debug, "retry",
+			SK_KV_INT("attempt", 1)));
+
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_int_equal(drained, 107);
+	assert_int_equal(ctx.n, 5);
+	assert_string_equal(ctx.payloads[0], "timeout (repeated 99 times)");
+	assert_string_equal(ctx.payloads[1], "timeout");
+	assert_string_equal(ctx.payloads[2], "0 (repeated 1 times)");
+	assert_string_equal(ctx.payloads[3], "1");
+	assert_string_equal(ctx.payloads[4], "retry (repeated 2 times)");
+
+	/* Fields follow the count */
+	memcpy(msg.payload, ctx.payloads[4], SK_LOG_MSG_MAX);
+	msg.kv_count = ctx.kv_counts[4];
+	assert_int_equal(sk_log_msg_kv(&msg, kvs, SK_LOG_KV_MAX), 1);
+	assert_string_equal(kvs[0].key, "attempt");
+	assert_int_equal(kvs[0].i, 1);
+
+	/* Duplicates past the window start a new run */
+	ctx.n = 0;
+	for (int i = 0; i < 4; i++) {
+		assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "tick"));
+		if (i == 1)
+			usleep(100 * 1000);
+	}
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_int_equal(ctx.n, 2);
+	assert_string_equal(ctx.payloads[0], "tick (repeated 1 times)");
+	assert_string_equal(ctx.payloads[1], "tick (repeated 1 times)");
+
+	sk_logger_destroy(logger);
+}
+
+static bool
+failing_log(sk_logger_drv_t *driver, sk_log_msg_t *msg, sk_error_t *error)
+{
+	(void)driver;
+	(void)msg;
+
+	return sk_error_msg_code(error, "failing driver", SK_ERROR_EINVAL);
+}
+
+static uint64_t
+latency_total(const sk_logger_stats_t *stats)
+{
+	uint64_t total = 0;
+	for (size_t i = 0; i < SK_LOGGER_LATENCY_BUCKETS; i++)
+		total += stats->latency[i];
+
+	return total;
+}
+
+static void *
+stats_producer(void *opaque)
+{
+	sk_logger_t *logger = opaque;
+
+	for (int i = 0; i < 10; i++)
+		assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "%d", i));
+
+	return NULL;
+}
+
+static void
+logger_stats()
+{
+	sk_logger_opts_t opts = {.log_size = 2};
+	struct collect_ctx ctx;
+	sk_logger_t *logger = collect_logger("stats", &opts, &ctx);
+	sk_logger_stats_t stats;
+	sk_error_t error;
+	size_t drained;
+
+	/* A fixed ring of 2^2 slots holds 3 messages */
+	for (int i = 0; i < 5; i++)
+		(void)sk_log(logger, SK_LOG_INFO, sk_debug, "%d", i);
+	sk_logger_get_stats(logger, &stats);
+	assert_int_equal(stats.enqueued, 3);
+	assert_int_equal(stats.dropped, 2);
+	assert_int_equal(stats.drained, 0);
+	assert_int_equal(stats.pending, 3);
+	assert_int_equal(stats.pending_high, 3);
+	assert_int_equal(stats.capacity, 3);
+	assert_int_equal(latency_total(&stats), 0);
+
+	/* The high water mark stays */
+	usleep(1000);
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "5"));
+	sk_logger_get_stats(logger, &stats);
+	assert_int_equal(stats.enqueued, 4);
+	assert_int_equal(stats.drained, 3);
+	assert_int_equal(stats.pending, 1);
+	assert_int_equal(stats.pending_high, 3);
+	assert_int_equal(latency_total(&stats), 3);
+	/* Waited for at least a millisecond */
+	for (size_t i = 0; i < 20; i++)
+		assert_int_equal(stats.latency[i], 0);
+	assert_int_equal(stats.driver_errors, 0);
+
+	sk_logger_destroy(logger);
+
+	/* Failed driver calls, the drop report included */
+	sk_logger_drv_t driver = {.log = failing_log};
+	opts = (sk_logger_opts_t){.log_size = 2};
+	assert_non_null(
+		logger = sk_logger_create_opts("stats", &opts, &driver, &error));
+	assert_true(sk_logger_set_level(logger, SK_LOG_DEBUG));
+	for (int i = 0; i < 4; i++)
+		(void)sk_log(logger, SK_LOG_INFO, sk_debug, "%d", i);
+	assert_false(sk_logger_drain(logger, &drained, 0, &error));
+	sk_logger_get_stats(logger, &stats);
+	assert_int_equal(stats.drained, 3);
+	assert_int_equal(stats.driver_errors, 4);
+
+	sk_logger_destroy(logger);
+
+	/* Threads count on their own, drivers without callback still drain */
+	pthread_t threads[4];
+	driver = (sk_logger_drv_t){0};
+	opts = (sk_logger_opts_t){.log_size = 8};
+	assert_non_null(
+		logger = sk_logger_create_opts("stats", &opts, &driver, &error));
+	assert_true(sk_logger_set_level(logger, SK_LOG_DEBUG));
+	for (size_t i = 0; i < sk_array_size(threads); i++)
+		pthread_create(&threads[i], NULL, stats_producer, logger);
+	for (size_t i = 0; i < sk_array_size(threads); i++)
+		pthread_join(threads[i], NULL);
+	assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "main"));
+
+	sk_logger_get_stats(logger, &stats);
+	assert_int_equal(stats.enqueued, 41);
+	assert_int_equal(stats.pending, 41);
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_int_equal(drained, 41);
+	sk_logger_get_stats(logger, &stats);
+	assert_int_equal(stats.drained, 41);
+	assert_int_equal(stats.pending, 0);
+
+	sk_logger_destroy(logger);
+
+	/* Loggers colliding in the cache of the thread keep their producer */
+	sk_logger_t *loggers[9];
+	opts = (sk_logger_opts_t){.log_size = 4};
+	for (size_t i = 0; i < sk_array_size(loggers); i++)
+		assert_non_null(loggers[i] =
+				sk_logger_create_opts("stats", &opts, &driver, &error));
+	for (int round = 0; round < 2; round++)
+		for (size_t i = 0; i < sk_array_size(loggers); i++)
+			assert_true(sk_log(loggers[i], SK_LOG_ERROR, sk_debug, "%d", round));
+	for (size_t i = 0; i < sk_array_size(loggers); i++) {
+		sk_logger_get_stats(loggers[i], &stats);
+		assert_int_equal(stats.enqueued, 2);
+		assert_int_equal(producers_count(loggers[i]), 1);
+		sk_logger_destroy(loggers[i]);
+	}
+}
+
+static void
+logger_mem()
+{
+	const enum sk_logger_ring rings[] = {
+		SK_LOGGER_RING_FIXED, SK_LOGGER_RING_VARIABLE, SK_LOGGER_RING_PER_THREAD};
+	sk_error_t error;
+	size_t drained;
+
+	for (size_t r = 0; r < sk_array_size(rings); r++) {
+		/* Past the former cap of 2^16 messages */
+		sk_logger_opts_t opts = {
+			.log_size = (rings[r] == SK_LOGGER_RING_FIXED) ? 17 : 20,
+			.ring = rings[r],
+			.mem = {.flags = SK_MEM_THP | SK_MEM_POPULATE},
+		};
+		struct collect_ctx ctx;
+		sk_logger_t *logger = collect_logger("mem", &opts, &ctx);
+
+		for (int i = 0; i < 4; i++)
+			assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "%d", i));
+		assert_true(sk_logger_drain(logger, &drained, 0, &error));
+		assert_int_equal(ctx.n, 4);
+		for (int i = 0; i < 4; i++)
+			assert_int_equal(atoi(ctx.payloads[i]), i);
+
+		sk_logger_destroy(logger);
+	}
+
+	sk_logger_drv_t driver = {.log = collect_log};
+	sk_logger_opts_t opts = {.log_size = SK_LOGGER_RING_MAX + 1};
+	assert_null(sk_logger_create_opts("mem", &opts, &driver, &error));
+	assert_int_equal(error.code, SK_ERROR_EINVAL);
+
+	opts = (sk_logger_opts_t){
+		.log_size = 4,
+		.mem = {.flags = SK_MEM_NUMA, .numa_node = SK_MEM_NUMA_NODES_MAX},
+	};
+	assert_null(sk_logger_create_opts("mem", &opts, &driver, &error));
+	assert_int_equal(error.code, SK_ERROR_EINVAL);
+}
+
+static uint64_t
+clock_now(clockid_t clock)
+{
+	struct timespec time;
+	clock_gettime(clock, &time);
+
+	return (uint64_t)time.tv_sec * 1000000000 + (uint64_t)time.tv_nsec;
+}
+
+static void
+logger_clock()
+{
+	const struct {
+		enum sk_log_clock clock;
+		clockid_t reference;
+	} clocks[] = {
+		{SK_LOG_CLOCK_REALTIME, CLOCK_REALTIME},
+		{SK_LOG_CLOCK_REALTIME_COARSE, CLOCK_REALTIME},
+		{SK_LOG_CLOCK_MONOTONIC, CLOCK_MONOTONIC},
+		{SK_LOG_CLOCK_TSC, CLOCK_REALTIME},
+	};
+	const uint64_t slack = 1000000000;
+	sk_log_msg_t last;
+	sk_error_t error;
+	size_t drained;
+
+	for (size_t i = 0; i < sk_array_size(clocks); i++) {
+		sk_logger_drv_t driver = {.ctx = &last, .log = capture_log};
+		sk_logger_opts_t opts = {.log_size = 4, .clock = clocks[i].clock};
+		sk_logger_t *logger =
+			sk_logger_create_opts("clock", &opts, &driver, &error);
+		assert_non_null(logger);
+
+		/* Drained timestamps are nanoseconds of the reference clock */
+		const uint64_t before = clock_now(clocks[i].reference);
+		assert_true(sk_log(logger, SK_LOG_ERROR, sk_debug, "tick"));
+		assert_true(sk_logger_drain(logger, &drained, 0, &error));
+		const uint64_t after = clock_now(clocks[i].reference);
+
+		assert_int_equal(drained, 1);
+		assert_true(last.ts_nsec + slack > before);
+		assert_true(last.ts_nsec < after + slack);
+
+		sk_logger_destroy(logger);
+	}
+
+	sk_logger_drv_t driver = {.ctx = &last, .log = capture_log};
+	sk_logger_opts_t opts = {.log_size = 4, .clock = 42};
+	assert_null(sk_logger_create_opts("clock", &opts, &driver, &error));
+	assert_int_equal(error.code, SK_ERROR_EINVAL);
+}
+
+static void
+logger_batch()
+{
+	struct batch_ctx ctx = {0};
+	sk_logger_drv_t driver = {.ctx = &ctx, .log_batch = batch_log};
+	sk_logger_opts_t opts = {.log_size = 16, .ring = SK_LOGGER_RING_VARIABLE};
+	sk_logger_t *logger;
+	sk_error_t error;
+	size_t drained;
+
+	assert_non_null(
+		(logger = sk_logger_create_opts("batch", &opts, &driver, &error)));
+
+	for (int i = 0; i < 100; i++)
+		assert_true(sk_log(logger, SK_LOG_ERROR, sk_debug, "%d", i));
+
+	/* Batches are capped by maximum_drain */
+	assert_true(sk_logger_drain(logger, &drained, 10, &error));
+	assert_int_equal(drained, 10);
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_int_equal(drained, 90);
+
+	assert_int_equal(ctx.n_batches, 3);
+	assert_int_equal(ctx.sizes[0], 10);
+	assert_int_equal(ctx.sizes[1], SK_LOG_BATCH_MAX);
+	assert_int_equal(ctx.sizes[2], 90 - SK_LOG_BATCH_MAX);
+	assert_int_equal(ctx.expected, 100);
+
+	sk_logger_destroy(logger);
+}
+
+/* Driver that counts the messages handed from a ring in place */
+struct in_place_ctx {
+	const sk_ring_t *ring;
+	int n;
+	size_t in_place;
+};
+
+static bool
+in_place_log(sk_logger_drv_t *driver, sk_log_msg_t *msg, sk_error_t *error)
+{
+	(void)error;
+	struct in_place_ctx *ctx = driver->ctx;
+	const char *record = (const char *)msg;
+
+	/* Drop reports aren't numbered */
+	if (msg->level == SK_LOG_WARNING)
+		return true;
+
+	assert_int_equal(atoi(msg->payload), ctx->n++);
+	if (record >= ctx->ring->buf && record < ctx->ring->buf + ctx->ring->size)
+		ctx->in_place++;
+
+	return true;
+}
+
+static void
+logger_reserve()
+{
+	struct in_place_ctx ctx = {0};
+	sk_logger_drv_t driver = {.ctx = &ctx, .log = in_place_log};
+	sk_logger_opts_t opts = {.log_size = 12, .ring = SK_LOGGER_RING_VARIABLE};
+	sk_logger_t *logger;
+	sk_log_msg_t *msg;
+	sk_error_t error;
+	size_t drained;
+
+	assert_non_null(
+		(logger = sk_logger_create_opts("reserve", &opts, &driver, &error)));
+	assert_true(sk_logger_set_level(logger, SK_LOG_INFO));
+	ctx.ring = &logger->records;
+
+	assert_null(sk_log_reserve(logger, SK_LOG_DEBUG, sk_debug));
+
+	/* Filled and drained in place */
+	for (int i = 0; i < 3; i++) {
+		assert_non_null(msg = sk_log_reserve(logger, SK_LOG_INFO, sk_debug));
+		assert_int_equal(msg->level, SK_LOG_INFO);
+		snprintf(msg->payload, SK_LOG_MSG_MAX, "%d", i);
+		assert_true(sk_log_commit(logger, msg));
+	}
+	assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "%d", 3));
+	/* Aborted messages never reach the driver */
+	assert_non_null(msg = sk_log_reserve(logger, SK_LOG_INFO, sk_debug));
+	sk_log_abort(logger, msg);
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_int_equal(drained, 4);
+	assert_int_equal(ctx.in_place, 4);
+
+	/* Packed arguments are formatted out of the ring */
+	sk_logger_set_flags(logger, SK_LOGGER_DEFERRED);
+	assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "%d", 4));
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_int_equal(ctx.n, 5);
+	assert_int_equal(ctx.in_place, 4);
+	sk_logger_unset_flags(logger, SK_LOGGER_DEFERRED);
+
+	/* Wraps around the ring */
+	for (int i = 5; i < 500; i++) {
+		assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "%d", i));
+		if (i % 7 == 0)
+			assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	}
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_int_equal(ctx.n, 500);
+	assert_int_equal(ctx.in_place, 499);
+
+	sk_logger_destroy(logger);
+
+	/* Messages too large for the room left are staged, then enqueued */
+	opts.log_size = 10;
+	ctx = (struct in_place_ctx){0};
+	assert_non_null(
+		(logger = sk_logger_create_opts("reserve", &opts, &driver, &error)));
+	ctx.ring = &logger->records;
+	int committed = 0;
+	while (sk_log(logger, SK_LOG_ERROR, sk_debug, "%d", committed))
+		committed++;
+	/* More than the records of the largest message that fit */
+	assert_true(committed > 1024 / (int)sizeof(sk_log_msg_t));
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_int_equal(ctx.n, committed);
+
+	sk_logger_destroy(logger);
+
+	/* Other rings stage the message */
+	struct collect_ctx collect;
+	opts = (sk_logger_opts_t){.log_size = 4};
+	logger = collect_logger("reserve", &opts, &collect);
+	assert_non_null(msg = sk_log_reserve(logger, SK_LOG_INFO, sk_debug));
+	strcpy(msg->payload, "staged");
+	assert_true(sk_log_commit(logger, msg));
+	assert_non_null(msg = sk_log_reserve(logger, SK_LOG_INFO, sk_debug));
+	sk_log_abort(logger, msg);
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_int_equal(collect.n, 1);
+	assert_string_equal(collect.payloads[0], "staged");
+
+	sk_logger_destroy(logger);
+
+	/* Reservations of different loggers don't interfere */
+	sk_logger_t *other;
+	opts = (sk_logger_opts_t){.log_size = 12, .ring = SK_LOGGER_RING_VARIABLE};
+	ctx = (struct in_place_ctx){0};
+	assert_non_null(
+		(logger = sk_logger_create_opts("reserve", &opts, &driver, &error)));
+	assert_true(sk_logger_set_level(logger, SK_LOG_INFO));
+	ctx.ring = &logger->records;
+	opts.ring = SK_LOGGER_RING_PER_THREAD;
+	other = collect_logger("reserve.other", &opts, &collect);
+
+	assert_non_null(msg = sk_log_reserve(logger, SK_LOG_INFO, sk_debug));
+	assert_true(sk_log(other, SK_LOG_INFO, sk_debug, "other"));
+	strcpy(msg->payload, "0");
+	assert_true(sk_log_commit(logger, msg));
+
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_int_equal(drained, 1);
+	assert_int_equal(ctx.in_place, 1);
+	assert_true(sk_logger_drain(other, &drained, 0, &error));
+	assert_int_equal(collect.n, 1);
+	assert_string_equal(collect.payloads[0], "other");
+
+	sk_logger_destroy(other);
+	sk_logger_destroy(logger);
+
+	/* Nor do the staged reservations of fixed rings */
+	struct collect_ctx collect_other;
+	opts = (sk_logger_opts_t){.log_size = 4};
+	logger = collect_logger("reserve.fixed", &opts, &collect);
+	other = collect_logger("reserve.fixed.other", &opts, &collect_other);
+
+	assert_non_null(msg = sk_log_reserve(logger, SK_LOG_INFO, sk_debug));
+	strcpy(msg->payload, "message for A");
+	assert_true(sk_log_info(other, "message for B"));
+	assert_true(sk_log_commit(logger, msg));
+
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_int_equal(collect.n, 1);
+	assert_string_equal(collect.payloads[0], "message for A");
+	assert_true(sk_logger_drain(other, &drained, 0, &error));
+	assert_int_equal(collect_other.n, 1);
+	assert_string_equal(collect_other.payloads[0], "message for B");
+
+	sk_logger_destroy(other);
+	sk_logger_destroy(logger);
+}
+
+static bool
+dynamic_site(sk_logger_t *logger, int i)
+{
+	return sk_log_info_dynamic(logger, "dynamic %d", i);
+}
+
+static bool
+dynamic_compiled_out(sk_logger_t *logger)
+{
+	return sk_log_debug_dynamic(logger, "compiled out");
+}
+
+static size_t
+callsite_find(sk_log_callsite_t *site, void *ctx)
+{
+	sk_log_callsite_t **found = ctx;
+
+	if (strcmp(site->debug.function, "dynamic_site") != 0)
+		return 0;
+	*found = site;
+
+	return 1;
+}
+
+static void
+logger_callsites()
+{
+	sk_logger_opts_t opts = {.log_size = 4};
+	struct collect_ctx ctx;
+	sk_logger_t *logger = collect_logger("callsites", &opts, &ctx);
+	sk_log_callsite_t *site = NULL;
+	sk_error_t error;
+	size_t drained;
+	char pattern[64];
+
+	assert_true(sk_logger_set_level(logger, SK_LOG_WARNING));
+
+	/* Registered, disabled */
+	assert_int_equal(sk_log_callsites_foreach(callsite_find, &site), 1);
+	assert_non_null(site);
+	assert_int_equal(site->level, SK_LOG_INFO);
+	assert_string_equal(site->fmt, "dynamic %d");
+	assert_true(dynamic_site(logger, 0));
+
+	/* Enabled by file, function or line, whatever the logger's level */
+	assert_int_equal(sk_log_callsites_enable("*:dynamic_site:*", true), 1);
+	assert_true(dynamic_site(logger, 1));
+	assert_int_equal(sk_log_callsites_enable("*:dynamic_site:*", false), 1);
+	assert_true(dynamic_site(logger, 2));
+	snprintf(pattern, sizeof(pattern), "*sk_log_test.c:*:%d", site->debug.line);
+	assert_int_equal(sk_log_callsites_enable(pattern, true), 1);
+	assert_true(dynamic_site(logger, 3));
+
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_int_equal(ctx.n, 2);
+	assert_int_equal(ctx.levels[0], SK_LOG_INFO);
+	assert_string_equal(ctx.payloads[0], "dynamic 1");
+	assert_string_equal(ctx.payloads[1], "dynamic 3");
+
+	/* Above SK_LOG_COMPILE_LEVEL, enabling is a no-op */
+	assert_true(sk_log_callsites_enable("*sk_log_test.c:*", true) >= 2);
+	assert_true(dynamic_compiled_out(logger));
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_int_equal(ctx.n, 2);
+
+	assert_int_equal(sk_log_callsites_enable("*:no_such_function:*", true), 0);
+	sk_log_callsites_enable("*", false);
+
+	/* Callsites of an unloaded module are gone */
+	static sk_log_callsite_t unloaded[] = {
+		{0, SK_LOG_INFO, {"unloaded.c", "unloaded", 1}, "unloaded"},
+	};
+	static sk_log_callsites_module_t module = {unloaded, unloaded + 1, NULL};
+	sk_log_callsites_register(&module);
+	assert_int_equal(sk_log_callsites_enable("unloaded.c:*", true), 1);
+	sk_log_callsites_unregister(&module);
+	assert_int_equal(sk_log_callsites_enable("unloaded.c:*", true), 0);
+	assert_int_equal(sk_log_callsites_foreach(callsite_find, &site), 1);
+
+	sk_logger_destroy(logger);
+}
+
+static void
+logger_console_batch()
+{
+	sk_logger_drv_console_ctx_t console = {SK_LOG_EMERGENCY};
+	sk_logger_drv_t driver;
+	sk_logger_t *logger;
+	sk_error_t error;
+	size_t drained;
+	char line[512];
+
+	assert_true(sk_logger_drv_builder_console(&driver, &console, &error));
+	assert_non_null(driver.log_batch);
+	assert_non_null(
+		(logger = sk_logger_create("console", 8, &driver, &error)));
+
+	for (int i = 0; i < 100; i++)
+		assert_true(sk_log(logger, SK_LOG_ERROR, sk_debug, "message %d", i));
+	/* Fields are rendered after the message */
+	assert_true(sk_log_kv(logger, SK_LOG_ERROR, sk_debug, "login",
+		SK_KV_INT("user", 42), SK_KV_STR("from", "a \"b\""),
+		SK_KV_BOOL("ok", false)));
+
+	/* Capture stdout */
+	FILE *out = tmpfile();
+	assert_non_null(out);
+	fflush(stdout);
+	const int saved = dup(STDOUT_FILENO);
+	assert_int_not_equal(dup2(fileno(out), STDOUT_FILENO), -1);
+
+	const bool ok = sk_logger_drain(logger, &drained, 0, &error);
+
+	assert_int_not_equal(dup2(saved, STDOUT_FILENO), -1);
+	close(saved);
+	assert_true(ok);
+	assert_int_equal(drained, 101);
+
+	rewind(out);
+	for (int i = 0; i < 100; i++) {
+		char expected[32];
+		snprintf(expected, sizeof(expected), "[error]: message %d\n", i);
+		assert_non_null(fgets(line, sizeof(line), out));
+		assert_non_null(strstr(line, expected));
+	}
+	assert_non_null(fgets(line, sizeof(line), out));
+	assert_non_null(
+		strstr(line, "[error]: login user=42 from=\"a \\\"b\\\"\" ok=false\n"));
+	assert_null(fgets(line, sizeof(line), out));
+	fclose(out);
+
+	sk_logger_destroy(logger);
+}
+
+static void
+logger_console_header()
+{
+	sk_logger_drv_console_ctx_t console = {SK_LOG_EMERGENCY};
+	const struct {
+		uint64_t ts_nsec;
+		int line;
+		const char *expected;
+	} cases[] = {
+		{1792202492633890123ULL, 42,
+			"2026-10-17T02:01:32.633890Z logger {file: a.c, func: f, "
+			"line: 42} [info]: hi\n"},
+		/* Same second, then the next one */
+		{1792202492999999999ULL, 7,
+			"2026-10-17T02:01:32.999999Z logger {file: a.c, func: f, "
+			"line: 7} [info]: hi\n"},
+		{1792202493000001999ULL, 0,
+			"2026-10-17T02:01:33.000001Z logger {file: a.c, func: f, "
+			"line: 0} [info]: hi\n"},
+		{951782400123456789ULL, -1,
+			"2000-02-29T00:00:00.123456Z logger {file: a.c, func: f, "
+			"line: -1} [info]: hi\n"},
+	};
+	sk_logger_drv_t driver;
+	sk_error_t error;
+	char line[512];
+
+	assert_true(sk_logger_drv_builder_console(&driver, &console, &error));
+
+	FILE *out = tmpfile();
+	assert_non_null(out);
+	fflush(stdout);
+	const int saved = dup(STDOUT_FILENO);
+	assert_int_not_equal(dup2(fileno(out), STDOUT_FILENO), -1);
+
+	for (size_t i = 0; i < sk_array_size(cases); i++) {
+		sk_log_msg_t msg = {
+			.ts_nsec = cases[i].ts_nsec,
+			.level = SK_LOG_INFO,
+			.debug = {"a.c", "f", cases[i].line},
+			.payload = "hi",
+		};
+		assert_true(driver.log(&driver, &msg, &error));
+	}
+
+	assert_int_not_equal(dup2(saved, STDOUT_FILENO), -1);
+	close(saved);
+
+	rewind(out);
+	for (size_t i = 0; i < sk_array_size(cases); i++) {
+		assert_non_null(fgets(line, sizeof(line), out));
+		assert_string_equal(line, cases[i].expected);
+	}
+	fclose(out);
+
+	driver.close(&driver);
+}
+
 int
 main()
 {
 	const struct CMUnitTest tests[] = {
 		cmocka_unit_test(logger_basic), cmocka_unit_test(logger_lazy_level),
 		cmocka_unit_test(logger_maximum_drain),
+		cmocka_unit_test(logger_macro_gate),
+		cmocka_unit_test(logger_registry),
+		cmocka_unit_test(logger_deferred),
+		cmocka_unit_test(logger_kv),
+		cmocka_unit_test(logger_variable_ring),
+		cmocka_unit_test(logger_per_thread),
+		cmocka_unit_test(logger_producer_exit),
+		cmocka_unit_test(logger_full_drop_newest),
+		cmocka_unit_test(logger_full_drop_oldest),
+		cmocka_unit_test(logger_full_block),
+		cmocka_unit_test(logger_full_spill),
+		cmocka_unit_test(logger_ratelimited),
+		cmocka_unit_test(logger_coalesce),
+		cmocka_unit_test(logger_stats),
+		cmocka_unit_test(logger_mem),
+		cmocka_unit_test(logger_clock),
+		cmocka_unit_test(logger_batch),
+		cmocka_unit_test(logger_reserve),
+		cmocka_unit_test(logger_callsites),
+		cmocka_unit_test(logger_console_batch),
+		cmocka_unit_test(logger_console_header),
 	};
 
 	return cmocka_run_group_tests(tests, NULL, NULL);
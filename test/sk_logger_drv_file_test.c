@@ -0,0 +1,247 @@
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <sk_log.h>
+#include <sk_logger_drv.h>
+
+#include "test.h"
+
+static size_t
+count_lines(const char *path)
+{
+	FILE *file = fopen(path, "r");
+	size_t lines = 0;
+	int c;
+
+	if (file == NULL)
+		return 0;
+
+	while ((c = fgetc(file)) != EOF)
+		lines += (c == '\n');
+	fclose(file);
+
+	return lines;
+}
+
+static off_t
+file_size(const char *path)
+{
+	struct stat st;
+	return (stat(path, &st) == 0) ? st.st_size : -1;
+}
+
+static void
+log_n(sk_logger_t *logger, enum sk_log_level level, int n)
+{
+	for (int i = 0; i < n; i++)
+		assert_true(sk_log(logger, level, sk_debug, "message %d", i));
+}
+
+static void
+drain(sk_logger_t *logger, size_t maximum_drain)
+{
+	sk_error_t error;
+	size_t drained;
+
+	assert_true(sk_logger_drain(logger, &drained, maximum_drain, &error));
+}
+
+static void
+file_basic()
+{
+	char path[PATH_MAX];
+	test_path(path, sizeof(path), "basic.log");
+	sk_logger_drv_file_ctx_t ctx = {.path = path};
+	sk_logger_drv_t driver;
+	sk_error_t error;
+
+	/* A path is required */
+	ctx.path = NULL;
+	assert_false(sk_logger_drv_builder_file(&driver, &ctx, &error));
+	assert_int_equal(error.code, SK_ERROR_EINVAL);
+
+	/* The file can't be created */
+	char missing[PATH_MAX];
+	test_path(missing, sizeof(missing), "missing/basic.log");
+	ctx.path = missing;
+	assert_true(sk_logger_drv_builder_file(&driver, &ctx, &error));
+	assert_null(sk_logger_create("file", 10, &driver, &error));
+	assert_int_equal(error.code, ENOENT);
+
+	ctx.path = path;
+	sk_logger_t *logger = test_logger(sk_logger_drv_builder_file, &ctx);
+	log_n(logger, SK_LOG_INFO, 10);
+	drain(logger, 0);
+	assert_int_equal(count_lines(path), 10);
+
+	/* Appends to an existing file */
+	sk_logger_destroy(logger);
+	logger = test_logger(sk_logger_drv_builder_file, &ctx);
+	log_n(logger, SK_LOG_INFO, 5);
+	drain(logger, 0);
+	assert_int_equal(count_lines(path), 15);
+
+	FILE *file = fopen(path, "r");
+	char line[512];
+	assert_non_null(fgets(line, sizeof(line), file));
+	assert_non_null(strstr(line, "[info]: message 0\n"));
+	fclose(file);
+
+	sk_logger_destroy(logger);
+}
+
+static void
+file_buffering()
+{
+	char path[PATH_MAX];
+	test_path(path, sizeof(path), "buffering.log");
+	sk_logger_drv_file_ctx_t ctx = {.path = path};
+	sk_logger_t *logger = test_logger(sk_logger_drv_builder_file, &ctx);
+
+	/* Full batches stay in the buffer while the ring has messages */
+	log_n(logger, SK_LOG_INFO, 3 * SK_LOG_BATCH_MAX);
+	drain(logger, 2 * SK_LOG_BATCH_MAX);
+	assert_int_equal(count_lines(path), 0);
+
+	drain(logger, 0);
+	assert_int_equal(count_lines(path), 3 * SK_LOG_BATCH_MAX);
+
+	/* Close flushes */
+	log_n(logger, SK_LOG_INFO, SK_LOG_BATCH_MAX);
+	drain(logger, SK_LOG_BATCH_MAX);
+	assert_int_equal(count_lines(path), 3 * SK_LOG_BATCH_MAX);
+	sk_logger_destroy(logger);
+	assert_int_equal(count_lines(path), 4 * SK_LOG_BATCH_MAX);
+}
+
+static void
+file_rotate_size()
+{
+	char path[PATH_MAX], rotated[PATH_MAX + 16];
+	test_path(path, sizeof(path), "size.log");
+	sk_logger_drv_file_ctx_t ctx = {
+		.path = path,
+		.rotate_size = 4096,
+		.rotate_keep = 2,
+	};
+	sk_logger_t *logger = test_logger(sk_logger_drv_builder_file, &ctx);
+
+	for (int i = 0; i < 10; i++) {
+		log_n(logger, SK_LOG_INFO, 100);
+		drain(logger, 0);
+	}
+
+	assert_in_range(file_size(path), 0, 4096);
+	for (int i = 1; i <= 2; i++) {
+		snprintf(rotated, sizeof(rotated), "%s.%d", path, i);
+		assert_in_range(file_size(rotated), 4096, 4096 + 512);
+	}
+
+	snprintf(rotated, sizeof(rotated), "%s.3", path);
+	assert_int_equal(file_size(rotated), -1);
+
+	sk_logger_destroy(logger);
+}
+
+static void
+file_rotate_time()
+{
+	char path[PATH_MAX], rotated[PATH_MAX + 16];
+	test_path(path, sizeof(path), "time.log");
+	snprintf(rotated, sizeof(rotated), "%s.1", path);
+	sk_logger_drv_file_ctx_t ctx = {.path = path, .rotate_sec = 1};
+	sk_logger_t *logger = test_logger(sk_logger_drv_builder_file, &ctx);
+
+	log_n(logger, SK_LOG_INFO, 10);
+	drain(logger, 0);
+	assert_int_equal(file_size(rotated), -1);
+
+	sleep(1);
+
+	log_n(logger, SK_LOG_INFO, 5);
+	drain(logger, 0);
+	assert_int_equal(count_lines(rotated), 10);
+	assert_int_equal(count_lines(path), 5);
+
+	sk_logger_destroy(logger);
+}
+
+static void
+file_reopen()
+{
+	char path[PATH_MAX], moved[PATH_MAX];
+	test_path(path, sizeof(path), "reopen.log");
+	test_path(moved, sizeof(moved), "reopen.log.old");
+	sk_logger_drv_file_ctx_t ctx = {.path = path, .reopen_on_sighup = true};
+	sk_logger_t *logger = test_logger(sk_logger_drv_builder_file, &ctx);
+
+	log_n(logger, SK_LOG_INFO, 10);
+	drain(logger, 0);
+
+	/* Without reopening, writes follow the moved file */
+	assert_int_equal(rename(path, moved), 0);
+	log_n(logger, SK_LOG_INFO, 1);
+	drain(logger, 0);
+	assert_int_equal(count_lines(moved), 11);
+
+	sk_logger_drv_file_reopen();
+	log_n(logger, SK_LOG_INFO, 2);
+	drain(logger, 0);
+	assert_int_equal(count_lines(moved), 11);
+	assert_int_equal(count_lines(path), 2);
+
+	/* Same through SIGHUP */
+	assert_int_equal(unlink(path), 0);
+	assert_int_equal(raise(SIGHUP), 0);
+	log_n(logger, SK_LOG_INFO, 3);
+	drain(logger, 0);
+	assert_int_equal(count_lines(path), 3);
+
+	sk_logger_destroy(logger);
+}
+
+static void
+file_sync()
+{
+	char path[PATH_MAX];
+	test_path(path, sizeof(path), "sync.log");
+	sk_logger_drv_file_ctx_t ctx = {
+		.path = path,
+		.sync = SK_LOGGER_DRV_FILE_SYNC_ERROR,
+	};
+	sk_logger_t *logger = test_logger(sk_logger_drv_builder_file, &ctx);
+
+	/* An error is written with its batch, even if full */
+	log_n(logger, SK_LOG_INFO, SK_LOG_BATCH_MAX - 1);
+	log_n(logger, SK_LOG_ERROR, 1);
+	log_n(logger, SK_LOG_INFO, SK_LOG_BATCH_MAX);
+	drain(logger, SK_LOG_BATCH_MAX);
+	assert_int_equal(count_lines(path), SK_LOG_BATCH_MAX);
+	sk_logger_destroy(logger);
+
+	ctx.sync = SK_LOGGER_DRV_FILE_SYNC_BYTES;
+	ctx.sync_bytes = 1024;
+	logger = test_logger(sk_logger_drv_builder_file, &ctx);
+	log_n(logger, SK_LOG_INFO, 100);
+	drain(logger, 0);
+	assert_int_equal(count_lines(path), SK_LOG_BATCH_MAX + 100);
+	sk_logger_destroy(logger);
+}
+
+int
+main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(file_basic),
+		cmocka_unit_test(file_buffering),
+		cmocka_unit_test(file_rotate_size),
+		cmocka_unit_test(file_rotate_time),
+		cmocka_unit_test(file_reopen),
+		cmocka_unit_test(file_sync),
+	};
+
+	return cmocka_run_group_tests(tests, test_dir_setup, test_dir_teardown);
+}
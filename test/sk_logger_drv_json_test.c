@@ -0,0 +1,219 @@
+#include <locale.h>
+#include <math.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <sk_log.h>
+#include <sk_logger_drv.h>
+
+#include "test.h"
+
+static sk_logger_t *
+line_logger(sk_logger_drv_builder_fn_t builder, FILE *stream)
+{
+	sk_logger_drv_json_ctx_t ctx = {.stream = stream};
+
+	return test_logger(builder, &ctx);
+}
+
+static void
+drain(sk_logger_t *logger)
+{
+	sk_error_t error;
+	size_t drained;
+
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+}
+
+/* Timestamps are seconds and microseconds, whatever the locale */
+static void
+assert_ts(const char *ts)
+{
+	size_t digits = strspn(ts, "0123456789");
+
+	assert_true(digits > 0);
+	assert_int_equal(ts[digits], '.');
+	assert_int_equal(strspn(ts + digits + 1, "0123456789"), 6);
+}
+
+static void
+json_basic()
+{
+	FILE *out = tmpfile();
+	sk_logger_t *logger = line_logger(sk_logger_drv_builder_json, out);
+	char line[4096], expected[256];
+
+	assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "hello world"));
+	const int line_no = __LINE__ - 1;
+	assert_true(sk_log_kv(logger, SK_LOG_ERROR, sk_debug, "login",
+		SK_KV_INT("user", -42), SK_KV_UINT("id", 7),
+		SK_KV_DOUBLE("ratio", 0.25), SK_KV_DOUBLE("nan", NAN),
+		SK_KV_BOOL("ok", true), SK_KV_STR("from", "a \"b\"")));
+	drain(logger);
+
+	rewind(out);
+	assert_non_null(fgets(line, sizeof(line), out));
+	assert_true(strncmp(line, "{\"ts\":", 6) == 0);
+	assert_ts(line + 6);
+	snprintf(expected, sizeof(expected),
+		"\"level\":\"info\",\"logger\":\"app.db\",\"file\":\"%s\","
+		"\"func\":\"json_basic\",\"line\":%d,\"pid\":%d,",
+		__FILE__, line_no, getpid());
+	assert_non_null(strstr(line, expected));
+	assert_non_null(strstr(line, ",\"msg\":\"hello world\"}\n"));
+
+	assert_non_null(fgets(line, sizeof(line), out));
+	assert_non_null(strstr(line,
+		"\"msg\":\"login\",\"user\":-42,\"id\":7,\"ratio\":0.25,"
+		"\"nan\":null,\"ok\":true,\"from\":\"a \\\"b\\\"\"}\n"));
+	assert_null(fgets(line, sizeof(line), out));
+
+	sk_logger_destroy(logger);
+	fclose(out);
+}
+
+/* Escaped form of a byte in a JSON string */
+static const char *
+json_escaped(char c)
+{
+	static char escaped[8];
+
+	switch (c) {
+	case '"':
+		return "\\\"";
+	case '\\':
+		return "\\\\";
+	case '\n':
+		return "\\n";
+	case '\t':
+		return "\\t";
+	default:
+		snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+		return escaped;
+	}
+}
+
+static void
+json_escape()
+{
+	FILE *out = tmpfile();
+	sk_logger_t *logger = line_logger(sk_logger_drv_builder_json, out);
+	const char specials[] = {'"', '\\', '\n', '\t', '\x01', '\x1f'};
+	char payload[80], filler[80], line[4096], expected[256];
+
+	memset(filler, 'a', sizeof(filler) - 1);
+	filler[sizeof(filler) - 1] = '\0';
+
+	/* A special byte at every offset of vectors */
+	for (size_t s = 0; s < sizeof(specials); s++) {
+		for (size_t pos = 0; pos < sizeof(payload) - 1; pos++) {
+			memset(payload, 'a', sizeof(payload) - 1);
+			payload[sizeof(payload) - 1] = '\0';
+			payload[pos] = specials[s];
+			assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "%s", payload));
+		}
+		drain(logger);
+	}
+
+	/* Bytes above 0x7f and DEL are not escaped, e.g. UTF-8 */
+	assert_true(sk_log(logger, SK_LOG_INFO, sk_debug,
+		"caf\xc3\xa9 \x7f 0123456789abcdef0123456789abcdef"));
+	drain(logger);
+
+	rewind(out);
+	for (size_t s = 0; s < sizeof(specials); s++) {
+		for (size_t pos = 0; pos < sizeof(payload) - 1; pos++) {
+			const size_t after = sizeof(payload) - 2 - pos;
+			snprintf(expected, sizeof(expected), "\"msg\":\"%.*s%s%.*s\"}\n",
+				(int)pos, filler, json_escaped(specials[s]), (int)after,
+				filler);
+
+			assert_non_null(fgets(line, sizeof(line), out));
+			assert_non_null(strstr(line, expected));
+		}
+	}
+	assert_non_null(fgets(line, sizeof(line), out));
+	assert_non_null(strstr(line,
+		"\"msg\":\"caf\xc3\xa9 \x7f 0123456789abcdef0123456789abcdef\"}\n"));
+	assert_null(fgets(line, sizeof(line), out));
+
+	sk_logger_destroy(logger);
+	fclose(out);
+}
+
+static void
+logfmt_basic()
+{
+	FILE *out = tmpfile();
+	sk_logger_t *logger = line_logger(sk_logger_drv_builder_logfmt, out);
+	char line[4096];
+
+	assert_true(sk_log(logger, SK_LOG_WARNING, sk_debug, "plain"));
+	assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "%s", ""));
+	assert_true(sk_log_kv(logger, SK_LOG_INFO, sk_debug, "with spaces",
+		SK_KV_INT("user", 42), SK_KV_STR("query", "a=b"),
+		SK_KV_STR("quote", "say \"hi\"\n"), SK_KV_BOOL("ok", false),
+		SK_KV_STR("empty", "")));
+	drain(logger);
+
+	rewind(out);
+	assert_non_null(fgets(line, sizeof(line), out));
+	assert_true(strncmp(line, "ts=", 3) == 0);
+	assert_ts(line + 3);
+	assert_non_null(strstr(line, " level=warning logger=app.db file="));
+	assert_non_null(strstr(line, " func=logfmt_basic line="));
+	assert_non_null(strstr(line, " msg=plain\n"));
+
+	assert_non_null(fgets(line, sizeof(line), out));
+	assert_non_null(strstr(line, " msg=\"\"\n"));
+
+	assert_non_null(fgets(line, sizeof(line), out));
+	assert_non_null(strstr(line,
+		" msg=\"with spaces\" user=42 query=\"a=b\" "
+		"quote=\"say \\\"hi\\\"\\n\" ok=false empty=\"\"\n"));
+	assert_null(fgets(line, sizeof(line), out));
+
+	sk_logger_destroy(logger);
+	fclose(out);
+}
+
+static void
+json_locale()
+{
+	FILE *out = tmpfile();
+	sk_logger_t *logger = line_logger(sk_logger_drv_builder_json, out);
+	locale_t comma = newlocale(LC_ALL_MASK, "de_DE.UTF-8", (locale_t)0);
+	char line[4096];
+
+	/* The drain thread may use a locale whose radix is a comma */
+	const locale_t locale =
+		(comma != (locale_t)0) ? uselocale(comma) : (locale_t)0;
+	assert_true(sk_log_kv(logger, SK_LOG_INFO, sk_debug, "ratio",
+		SK_KV_DOUBLE("ratio", 0.5)));
+	drain(logger);
+	if (comma != (locale_t)0) {
+		uselocale(locale);
+		freelocale(comma);
+	}
+
+	rewind(out);
+	assert_non_null(fgets(line, sizeof(line), out));
+	assert_ts(line + 6);
+	assert_non_null(strstr(line, ",\"ratio\":0.5}\n"));
+
+	sk_logger_destroy(logger);
+	fclose(out);
+}
+
+int
+main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(json_basic),
+		cmocka_unit_test(json_escape),
+		cmocka_unit_test(logfmt_basic),
+		cmocka_unit_test(json_locale),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
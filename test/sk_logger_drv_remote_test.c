@@ -0,0 +1,255 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sk_log.h>
+#include <sk_logger_drv.h>
+
+#include "test.h"
+
+/* Stand-in collector on a local port, `port` is set if 0 */
+static int
+collector_bind(int type, char *port, size_t size)
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+		.sin_port = htons(atoi(port)),
+	};
+	socklen_t len = sizeof(addr);
+	const int one = 1;
+	int fd;
+
+	assert_true((fd = socket(AF_INET, type, 0)) != -1);
+	assert_true(
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) == 0);
+	assert_true(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+	if (type == SOCK_STREAM)
+		assert_true(listen(fd, 1) == 0);
+
+	assert_true(getsockname(fd, (struct sockaddr *)&addr, &len) == 0);
+	snprintf(port, size, "%d", ntohs(addr.sin_port));
+
+	return fd;
+}
+
+/* Read from the collector until `n` lines were received */
+static void
+collector_read_lines(int fd, char *buf, size_t size, size_t n)
+{
+	size_t used = 0, lines = 0;
+
+	while (lines < n) {
+		const ssize_t len = read(fd, buf + used, size - 1 - used);
+		assert_true(len > 0);
+		for (ssize_t i = 0; i < len; i++)
+			lines += buf[used + i] == '\n';
+		used += len;
+	}
+	buf[used] = '\0';
+}
+
+static sk_logger_t *
+remote_logger(sk_logger_drv_remote_ctx_t *ctx)
+{
+	ctx->host = "127.0.0.1";
+
+	return test_logger(sk_logger_drv_builder_remote, ctx);
+}
+
+static uint64_t
+now_nsec(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+static void
+remote_tcp()
+{
+	char port[16] = "0", buf[4096];
+	const int server = collector_bind(SOCK_STREAM, port, sizeof(port));
+	sk_logger_drv_remote_ctx_t ctx = {.port = port};
+	sk_logger_t *logger = remote_logger(&ctx);
+	sk_error_t error;
+	size_t drained;
+
+	assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "hello\nworld"));
+	assert_true(sk_log_kv(
+		logger, SK_LOG_ERROR, sk_debug, "login", SK_KV_INT("user", 42)));
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+
+	const int conn = accept(server, NULL, NULL);
+	assert_true(conn != -1);
+	collector_read_lines(conn, buf, sizeof(buf), 2);
+	/* Timestamps are seconds and microseconds, whatever the locale */
+	const size_t digits = strspn(buf, "0123456789");
+	assert_true(digits > 0);
+	assert_int_equal(buf[digits], '.');
+	assert_int_equal(strspn(buf + digits + 1, "0123456789"), 6);
+	assert_int_equal(buf[digits + 7], ' ');
+	assert_non_null(strstr(buf, " app.db remote_tcp [info]: hello world\n"));
+	assert_non_null(strstr(buf, " [error]: login user=42\n"));
+
+	sk_logger_destroy(logger);
+	close(conn);
+	close(server);
+}
+
+static void
+remote_tcp_length()
+{
+	char port[16] = "0", buf[4096];
+	const int server = collector_bind(SOCK_STREAM, port, sizeof(port));
+	sk_logger_drv_remote_ctx_t ctx = {
+		.port = port,
+		.framing = SK_LOGGER_DRV_REMOTE_LENGTH,
+	};
+	sk_logger_t *logger = remote_logger(&ctx);
+	sk_error_t error;
+	size_t drained;
+	uint32_t be;
+
+	assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "a\nb"));
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+
+	const int conn = accept(server, NULL, NULL);
+	assert_true(conn != -1);
+	assert_int_equal(read(conn, &be, sizeof(be)), sizeof(be));
+	const size_t len = ntohl(be);
+	assert_true(len < sizeof(buf));
+	assert_int_equal(read(conn, buf, len), len);
+	buf[len] = '\0';
+	assert_non_null(strstr(buf, "[info]: a\nb"));
+	assert_int_equal(buf[len - 1], 'b');
+
+	sk_logger_destroy(logger);
+	close(conn);
+	close(server);
+}
+
+static void
+remote_tcp_outage()
+{
+	char port[16] = "0", buf[4096];
+	/* Reserve a port, then leave it without a collector */
+	int server = collector_bind(SOCK_STREAM, port, sizeof(port));
+	close(server);
+
+	sk_logger_drv_remote_ctx_t ctx = {
+		.port = port,
+		.reconnect_min_nsec = 1000000,
+		.reconnect_max_nsec = 1000000,
+	};
+	sk_logger_t *logger = remote_logger(&ctx);
+	sk_error_t error;
+	size_t drained;
+
+	/* Messages are kept meanwhile */
+	for (int i = 0; i < 3; i++) {
+		assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "kept %d", i));
+		assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	}
+
+	server = collector_bind(SOCK_STREAM, port, sizeof(port));
+	usleep(2000);
+	assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "kept 3"));
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+
+	const int conn = accept(server, NULL, NULL);
+	assert_true(conn != -1);
+	collector_read_lines(conn, buf, sizeof(buf), 4);
+	for (int i = 0; i < 4; i++) {
+		char expected[32];
+		snprintf(expected, sizeof(expected), "]: kept %d\n", i);
+		assert_non_null(strstr(buf, expected));
+	}
+
+	sk_logger_destroy(logger);
+	close(conn);
+	close(server);
+}
+
+static void
+remote_tcp_budget()
+{
+	char port[16] = "0", payload[200];
+	const int server = collector_bind(SOCK_STREAM, port, sizeof(port));
+	const uint64_t budget = 5 * 1000 * 1000;
+	sk_logger_drv_remote_ctx_t ctx = {
+		.port = port,
+		.spill_size = 64 * 1024,
+		.budget_nsec = budget,
+	};
+	sk_logger_t *logger = remote_logger(&ctx);
+	sk_error_t error;
+	size_t drained;
+
+	memset(payload, 'x', sizeof(payload) - 1);
+	payload[sizeof(payload) - 1] = '\0';
+
+	/* The collector never reads, socket buffers then the spill fill up */
+	for (int i = 0; i < 200; i++) {
+		for (int j = 0; j < 200; j++)
+			assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "%s", payload));
+
+		const uint64_t start = now_nsec();
+		assert_true(sk_logger_drain(logger, &drained, 0, &error));
+		assert_true(now_nsec() - start < budget + 100 * 1000 * 1000);
+	}
+
+	sk_logger_destroy(logger);
+	close(server);
+}
+
+static void
+remote_udp()
+{
+	char port[16] = "0", buf[4096];
+	const int server = collector_bind(SOCK_DGRAM, port, sizeof(port));
+	sk_logger_drv_remote_ctx_t ctx = {
+		.port = port,
+		.proto = SK_LOGGER_DRV_REMOTE_UDP,
+		.mtu = 512,
+	};
+	sk_logger_t *logger = remote_logger(&ctx);
+	sk_error_t error;
+	size_t drained, lines = 0;
+
+	for (int i = 0; i < 100; i++)
+		assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "udp %d", i));
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+
+	/* Frames are packed in datagrams bounded by the mtu */
+	while (lines < 100) {
+		const ssize_t len = recv(server, buf, sizeof(buf) - 1, MSG_DONTWAIT);
+		assert_true(len > 0);
+		assert_true(len <= 512);
+		assert_int_equal(buf[len - 1], '\n');
+		for (ssize_t i = 0; i < len; i++)
+			lines += buf[i] == '\n';
+	}
+	assert_int_equal(lines, 100);
+
+	sk_logger_destroy(logger);
+	close(server);
+}
+
+int
+main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(remote_tcp),
+		cmocka_unit_test(remote_tcp_length),
+		cmocka_unit_test(remote_tcp_outage),
+		cmocka_unit_test(remote_tcp_budget),
+		cmocka_unit_test(remote_udp),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,175 @@
+#include <limits.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include <sk_log.h>
+#include <sk_logger_drv.h>
+
+#include "test.h"
+
+static char path[PATH_MAX];
+
+static int
+setup(void **state)
+{
+	if (test_dir_setup(state) != 0)
+		return -1;
+	test_path(path, sizeof(path), "log");
+
+	return 0;
+}
+
+/* Stand-in of syslogd bound at `path` */
+static int
+syslogd_bind(void)
+{
+	struct sockaddr_un addr = {.sun_family = AF_UNIX};
+	int fd;
+
+	unlink(path);
+	strcpy(addr.sun_path, path);
+	assert_true((fd = socket(AF_UNIX, SOCK_DGRAM, 0)) != -1);
+	assert_true(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+
+	return fd;
+}
+
+/* Receive a datagram without blocking */
+static bool
+syslogd_recv(int fd, char *buf, size_t size)
+{
+	const ssize_t len = recv(fd, buf, size - 1, MSG_DONTWAIT);
+	if (len < 0)
+		return false;
+	buf[len] = '\0';
+
+	return true;
+}
+
+static sk_logger_t *
+syslog_logger(enum sk_logger_drv_syslog_format format)
+{
+	sk_logger_drv_syslog_socket_ctx_t ctx = {
+		.path = path,
+		.ident = "app",
+		.facility = LOG_LOCAL0,
+		.format = format,
+	};
+
+	return test_logger(sk_logger_drv_builder_syslog_socket, &ctx);
+}
+
+static void
+syslog_rfc3164()
+{
+	const int server = syslogd_bind();
+	sk_logger_t *logger = syslog_logger(SK_LOGGER_DRV_SYSLOG_RFC3164);
+	char buf[4096], expected[256];
+	sk_error_t error;
+	size_t drained;
+
+	/* A batch is a datagram per message */
+	for (int i = 0; i < 3; i++)
+		assert_true(sk_log(logger, SK_LOG_WARNING, sk_debug, "msg %d", i));
+	assert_true(sk_log_kv(
+		logger, SK_LOG_ERROR, sk_debug, "login", SK_KV_INT("user", 42)));
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_int_equal(drained, 4);
+
+	for (int i = 0; i < 3; i++) {
+		assert_true(syslogd_recv(server, buf, sizeof(buf)));
+		assert_true(strncmp(buf, "<132>", 5) == 0);
+		snprintf(expected, sizeof(expected), " app[%d]: app.db {file: %s",
+			getpid(), __FILE__);
+		assert_non_null(strstr(buf, expected));
+		snprintf(expected, sizeof(expected), "} msg %d", i);
+		assert_non_null(strstr(buf, expected));
+	}
+	assert_true(syslogd_recv(server, buf, sizeof(buf)));
+	assert_true(strncmp(buf, "<131>", 5) == 0);
+	assert_non_null(strstr(buf, "} login user=42"));
+	assert_false(syslogd_recv(server, buf, sizeof(buf)));
+
+	sk_logger_destroy(logger);
+	close(server);
+}
+
+static void
+syslog_rfc5424()
+{
+	const int server = syslogd_bind();
+	sk_logger_t *logger = syslog_logger(SK_LOGGER_DRV_SYSLOG_RFC5424);
+	char buf[4096], expected[256];
+	sk_error_t error;
+	size_t drained;
+
+	assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "hello"));
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+
+	assert_true(syslogd_recv(server, buf, sizeof(buf)));
+	assert_true(strncmp(buf, "<134>1 ", 7) == 0);
+	/* e.g. 2026-10-17T13:37:00.123456Z */
+	assert_int_equal(buf[11], '-');
+	assert_int_equal(buf[17], 'T');
+	assert_int_equal(buf[33], 'Z');
+	snprintf(expected, sizeof(expected), " app %d - - app.db {", getpid());
+	assert_non_null(strstr(buf, expected));
+	assert_non_null(strstr(buf, "} hello"));
+
+	sk_logger_destroy(logger);
+	close(server);
+}
+
+static void
+syslog_reconnect()
+{
+	int server = syslogd_bind();
+	sk_logger_t *logger = syslog_logger(SK_LOGGER_DRV_SYSLOG_RFC3164);
+	char buf[4096];
+	sk_error_t error;
+	size_t drained;
+
+	assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "before"));
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_true(syslogd_recv(server, buf, sizeof(buf)));
+	assert_non_null(strstr(buf, "} before"));
+
+	/* syslogd restarts, the connected socket is stale */
+	close(server);
+	server = syslogd_bind();
+
+	assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "after"));
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_true(syslogd_recv(server, buf, sizeof(buf)));
+	assert_non_null(strstr(buf, "} after"));
+
+	/* syslogd is gone, batches fail until it is back */
+	close(server);
+	unlink(path);
+	assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "lost"));
+	assert_false(sk_logger_drain(logger, &drained, 0, &error));
+
+	server = syslogd_bind();
+	assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "back"));
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	assert_true(syslogd_recv(server, buf, sizeof(buf)));
+	assert_non_null(strstr(buf, "} back"));
+
+	sk_logger_destroy(logger);
+	close(server);
+}
+
+int
+main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(syslog_rfc3164),
+		cmocka_unit_test(syslog_rfc5424),
+		cmocka_unit_test(syslog_reconnect),
+	};
+
+	return cmocka_run_group_tests(tests, setup, test_dir_teardown);
+}
@@ -0,0 +1,160 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <ck_pr.h>
+
+#include <sk_log.h>
+#include <sk_logger_drv.h>
+
+#include "test.h"
+
+/* Sink keeping the payloads of messages, blocked while `blocked` is set */
+struct sink_ctx {
+	int blocked;
+	size_t n;
+	char payloads[128][SK_LOG_MSG_MAX];
+	size_t flushed;
+};
+
+static bool
+sink_log(sk_logger_drv_t *driver, sk_log_msg_t *msg, sk_error_t *error)
+{
+	(void)error;
+	struct sink_ctx *ctx = driver->ctx;
+
+	while (ck_pr_load_int(&ctx->blocked))
+		usleep(1000);
+
+	assert_true(ctx->n < sk_array_size(ctx->payloads));
+	memcpy(ctx->payloads[ctx->n++], msg->payload, sk_log_msg_payload_size(msg));
+
+	return true;
+}
+
+static bool
+sink_flush(sk_logger_drv_t *driver, sk_error_t *error)
+{
+	(void)error;
+	struct sink_ctx *ctx = driver->ctx;
+
+	ctx->flushed++;
+
+	return true;
+}
+
+static bool
+sink_builder(sk_logger_drv_t *driver, void *ctx, sk_error_t *error)
+{
+	(void)error;
+
+	*driver = (sk_logger_drv_t){
+		.ctx = ctx, .log = sink_log, .flush = sink_flush};
+
+	return true;
+}
+
+static sk_logger_t *
+tee_logger(const sk_logger_drv_tee_sink_t *sinks, size_t n_sinks)
+{
+	sk_logger_drv_tee_ctx_t ctx = {.sinks = sinks, .n_sinks = n_sinks};
+
+	return test_logger(sk_logger_drv_builder_tee, &ctx);
+}
+
+static void
+tee_levels()
+{
+	struct sink_ctx all = {0}, errors = {0};
+	const sk_logger_drv_tee_sink_t sinks[] = {
+		{.builder = sink_builder, .ctx = &all, .level = SK_LOG_DEBUG},
+		{.builder = sink_builder, .ctx = &errors, .level = SK_LOG_ERROR},
+	};
+	sk_logger_t *logger = tee_logger(sinks, sk_array_size(sinks));
+	sk_error_t error;
+	size_t drained;
+
+	for (int level = 0; level < SK_LOG_COUNT; level++)
+		assert_true(sk_log(logger, level, sk_debug, "%d", level));
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+
+	assert_int_equal(all.n, SK_LOG_COUNT);
+	assert_int_equal(errors.n, SK_LOG_ERROR + 1);
+	for (int level = 0; level <= SK_LOG_ERROR; level++)
+		assert_int_equal(atoi(errors.payloads[level]), level);
+	assert_int_equal(all.flushed, 1);
+	assert_int_equal(errors.flushed, 1);
+
+	sk_logger_destroy(logger);
+}
+
+static void
+tee_queued()
+{
+	enum { COUNT = 100 };
+	struct sink_ctx direct = {0}, slow = {.blocked = 1};
+	const sk_logger_drv_tee_sink_t sinks[] = {
+		{.builder = sink_builder, .ctx = &direct, .level = SK_LOG_DEBUG},
+		/* Holds about ten messages */
+		{.builder = sink_builder, .ctx = &slow, .level = SK_LOG_DEBUG,
+			.queue_log_size = 12},
+	};
+	sk_logger_t *logger = tee_logger(sinks, sk_array_size(sinks));
+	sk_error_t error;
+	size_t drained;
+
+	/* A blocked sink doesn't delay the other ones */
+	for (int i = 0; i < COUNT; i++) {
+		assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "%d", i));
+		assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	}
+	assert_int_equal(direct.n, COUNT);
+
+	/* Its messages are delivered in order once unblocked, drops reported */
+	ck_pr_store_int(&slow.blocked, 0);
+	sk_logger_destroy(logger);
+
+	uint64_t dropped = 0;
+	assert_true(slow.n > 1);
+	for (size_t i = 0; i < slow.n - 1; i++)
+		assert_int_equal(atoi(slow.payloads[i]), i);
+	assert_int_equal(sscanf(slow.payloads[slow.n - 1],
+						 "%" SCNu64 " messages dropped by a full tee queue",
+						 &dropped),
+		1);
+	assert_int_equal(slow.n - 1 + dropped, COUNT);
+}
+
+static void
+tee_invalid()
+{
+	struct sink_ctx ctx = {0};
+	const sk_logger_drv_tee_sink_t sinks[] = {
+		{.builder = sink_builder, .ctx = &ctx, .level = SK_LOG_DEBUG,
+			.queue_log_size = 7},
+	};
+	sk_logger_drv_tee_ctx_t tee_ctx = {.sinks = sinks, .n_sinks = 0};
+	sk_logger_drv_t driver;
+	sk_error_t error;
+
+	assert_false(sk_logger_drv_builder_tee(&driver, &tee_ctx, &error));
+	assert_int_equal(error.code, SK_ERROR_EINVAL);
+
+	/* A queue must hold a message */
+	tee_ctx.n_sinks = 1;
+	assert_true(sk_logger_drv_builder_tee(&driver, &tee_ctx, &error));
+	assert_null(sk_logger_create("app", 10, &driver, &error));
+	assert_int_equal(error.code, SK_ERROR_EINVAL);
+}
+
+int
+main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(tee_levels),
+		cmocka_unit_test(tee_queued),
+		cmocka_unit_test(tee_invalid),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
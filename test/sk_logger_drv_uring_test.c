@@ -0,0 +1,195 @@
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <sk_log.h>
+#include <sk_logger_drv.h>
+
+#include "test.h"
+
+static char path[PATH_MAX];
+
+static int
+setup(void **state)
+{
+	if (test_dir_setup(state) != 0)
+		return -1;
+	test_path(path, sizeof(path), "app.log");
+
+	return 0;
+}
+
+/* Log `n` messages, draining every `per_drain` */
+static void
+uring_fill(sk_logger_t *logger, int n, int per_drain)
+{
+	sk_error_t error;
+	size_t drained;
+
+	for (int i = 0; i < n; i++) {
+		assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "message %d", i));
+		if ((i + 1) % per_drain == 0)
+			assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	}
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+}
+
+/* Lines of the stream hold messages numbered from 0, in order */
+static int
+uring_check_lines(FILE *stream)
+{
+	char line[4096];
+	int n = 0;
+
+	while (fgets(line, sizeof(line), stream) != NULL) {
+		const char *msg = strstr(line, "]: message ");
+		assert_non_null(msg);
+		assert_int_equal(atoi(msg + strlen("]: message ")), n);
+		assert_non_null(strchr(line, '\n'));
+		n++;
+	}
+
+	return n;
+}
+
+static void
+uring_file_check(bool no_uring)
+{
+	enum { COUNT = 2000 };
+	/* Small buffers, such that the drain waits on writes */
+	sk_logger_drv_uring_ctx_t ctx = {
+		.path = path,
+		.depth = 2,
+		.buf_size = 8192,
+		.no_uring = no_uring,
+	};
+	sk_logger_t *logger = test_logger(sk_logger_drv_builder_uring, &ctx);
+	sk_error_t error;
+	size_t drained;
+
+	uring_fill(logger, COUNT, 500);
+	sk_logger_destroy(logger);
+
+	/* Appended to by the next logger */
+	logger = test_logger(sk_logger_drv_builder_uring, &ctx);
+	assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "message %d", COUNT));
+	assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	sk_logger_destroy(logger);
+
+	FILE *file = fopen(path, "r");
+	assert_non_null(file);
+	assert_int_equal(uring_check_lines(file), COUNT + 1);
+	fclose(file);
+
+	unlink(path);
+}
+
+static void
+uring_file()
+{
+	uring_file_check(false);
+}
+
+static void
+uring_file_plain()
+{
+	uring_file_check(true);
+}
+
+static void
+uring_socket()
+{
+	enum { COUNT = 200 };
+	int fds[2];
+
+	assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+	sk_logger_drv_uring_ctx_t ctx = {.fd = fds[0]};
+	sk_logger_t *logger = test_logger(sk_logger_drv_builder_uring, &ctx);
+	uring_fill(logger, COUNT, 64);
+	sk_logger_destroy(logger);
+	close(fds[0]);
+
+	FILE *stream = fdopen(fds[1], "r");
+	assert_non_null(stream);
+	assert_int_equal(uring_check_lines(stream), COUNT);
+	fclose(stream);
+}
+
+/* Read lines of a socket slowly, such that writes stay in flight */
+static void *
+uring_slow_reader(void *opaque)
+{
+	FILE *stream = opaque;
+	int *n = malloc(sizeof(*n));
+
+	assert_non_null(n);
+	usleep(20000);
+	*n = uring_check_lines(stream);
+
+	return n;
+}
+
+static void
+uring_flush_in_flight()
+{
+	enum { ROUNDS = 50 };
+	/* A batch fills a buffer, the flush then seals the other one */
+	sk_logger_drv_uring_ctx_t ctx = {.depth = 2, .buf_size = 8192};
+	int fds[2], sndbuf = 4096, *n;
+	sk_error_t error;
+	size_t drained;
+	pthread_t reader;
+
+	assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+	assert_int_equal(
+		setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf)), 0);
+	FILE *stream = fdopen(fds[1], "r");
+	assert_non_null(stream);
+	assert_int_equal(pthread_create(&reader, NULL, uring_slow_reader, stream), 0);
+
+	ctx.fd = fds[0];
+	sk_logger_t *logger = test_logger(sk_logger_drv_builder_uring, &ctx);
+	int i = 0;
+	for (int round = 0; round < ROUNDS; round++) {
+		for (int j = 0; j < SK_LOG_BATCH_MAX; j++)
+			assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "message %d", i++));
+		assert_true(sk_logger_drain(logger, &drained, 0, &error));
+		assert_true(sk_log(logger, SK_LOG_INFO, sk_debug, "message %d", i++));
+		assert_true(sk_logger_drain(logger, &drained, 0, &error));
+	}
+	sk_logger_destroy(logger);
+	close(fds[0]);
+
+	assert_int_equal(pthread_join(reader, (void **)&n), 0);
+	assert_int_equal(*n, i);
+	free(n);
+	fclose(stream);
+}
+
+static void
+uring_invalid()
+{
+	sk_logger_drv_uring_ctx_t ctx = {.fd = -1};
+	sk_logger_drv_t driver;
+	sk_error_t error;
+
+	assert_false(sk_logger_drv_builder_uring(&driver, &ctx, &error));
+	assert_int_equal(error.code, SK_ERROR_EINVAL);
+}
+
+int
+main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(uring_file),
+		cmocka_unit_test(uring_file_plain),
+		cmocka_unit_test(uring_socket),
+		cmocka_unit_test(uring_flush_in_flight),
+		cmocka_unit_test(uring_invalid),
+	};
+
+	return cmocka_run_group_tests(tests, setup, test_dir_teardown);
+}
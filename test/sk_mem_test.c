@@ -0,0 +1,84 @@
+#include <unistd.h>
+
+#include <sk_mem.h>
+
+#include "test.h"
+
+/* Memory is zeroed, writable and freed with its options */
+static void
+mem_check(size_t size, const sk_mem_opts_t *opts)
+{
+	sk_error_t error;
+	char *mem = sk_mem_alloc(size, opts, &error);
+
+	assert_non_null(mem);
+	for (size_t i = 0; i < size; i++)
+		assert_int_equal(mem[i], 0);
+	memset(mem, 0xff, size);
+
+	sk_mem_free(mem, size, opts);
+}
+
+static void
+mem_plain()
+{
+	const sk_mem_opts_t opts = {0};
+
+	mem_check(100, NULL);
+	mem_check(100, &opts);
+	sk_mem_free(NULL, 100, &opts);
+}
+
+static void
+mem_pages()
+{
+	const size_t page = sysconf(_SC_PAGESIZE);
+	const uint32_t flags[] = {
+		SK_MEM_POPULATE,
+		SK_MEM_THP,
+		SK_MEM_THP | SK_MEM_POPULATE,
+		/* Falls back to THP without reserved huge pages */
+		SK_MEM_HUGETLB,
+		SK_MEM_HUGETLB | SK_MEM_POPULATE,
+	};
+
+	for (size_t i = 0; i < sk_array_size(flags); i++) {
+		const sk_mem_opts_t opts = {.flags = flags[i]};
+		mem_check(page + 1, &opts);
+		mem_check(SK_MEM_HUGE_PAGE_SIZE + 1, &opts);
+	}
+}
+
+static void
+mem_numa()
+{
+	sk_mem_opts_t opts = {.flags = SK_MEM_NUMA | SK_MEM_POPULATE};
+	sk_error_t error;
+
+	mem_check(64 * 1024, &opts);
+
+	opts.numa_node = SK_MEM_NUMA_NODES_MAX;
+	assert_null(sk_mem_alloc(64 * 1024, &opts, &error));
+	assert_int_equal(error.code, SK_ERROR_EINVAL);
+}
+
+static void
+mem_mlock()
+{
+	const sk_mem_opts_t opts = {.flags = SK_MEM_MLOCK};
+
+	mem_check(sysconf(_SC_PAGESIZE), &opts);
+}
+
+int
+main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(mem_plain),
+		cmocka_unit_test(mem_pages),
+		cmocka_unit_test(mem_numa),
+		cmocka_unit_test(mem_mlock),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,344 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include <sk_ring.h>
+
+#include "test.h"
+
+static void
+ring_basic()
+{
+	sk_ring_t ring;
+	sk_error_t error;
+	char record[64];
+	size_t len;
+
+	assert_false(sk_ring_init(&ring, SK_RING_SIZE_MIN - 1, &error));
+	assert_int_equal(error.code, SK_ERROR_EINVAL);
+	assert_false(sk_ring_init(&ring, SK_RING_SIZE_MAX + 1, &error));
+	assert_int_equal(error.code, SK_ERROR_EINVAL);
+
+	assert_true(sk_ring_init(&ring, 10, &error));
+	assert_int_equal(sk_ring_used(&ring), 0);
+
+	len = sizeof(record);
+	assert_false(sk_ring_dequeue(&ring, record, &len));
+
+	/* Records take their length rounded to 8 plus a header */
+	assert_true(sk_ring_enqueue(&ring, "a", 2));
+	assert_int_equal(sk_ring_used(&ring), 16);
+	assert_true(sk_ring_enqueue(&ring, "hello world", 12));
+	assert_int_equal(sk_ring_used(&ring), 16 + 24);
+
+	len = sizeof(record);
+	assert_true(sk_ring_dequeue(&ring, record, &len));
+	assert_int_equal(len, 2);
+	assert_string_equal(record, "a");
+
+	/* A record larger than the buffer is left in place */
+	len = 4;
+	assert_false(sk_ring_dequeue(&ring, record, &len));
+	assert_int_equal(len, 12);
+	len = sizeof(record);
+	assert_true(sk_ring_dequeue(&ring, record, &len));
+	assert_string_equal(record, "hello world");
+
+	assert_int_equal(sk_ring_used(&ring), 0);
+
+	/* Records larger than half the ring are refused */
+	assert_null(sk_ring_reserve(&ring, sk_ring_record_max(&ring) + 1));
+
+	sk_ring_destroy(&ring);
+}
+
+static void
+ring_wrap()
+{
+	sk_ring_t ring;
+	sk_error_t error;
+	uint8_t in[128], out[128];
+	size_t len;
+
+	assert_true(sk_ring_init(&ring, 8, &error));
+
+	/* Odd lengths force padding at various offsets of the buffer */
+	for (size_t i = 0; i < 4096; i++) {
+		const size_t n = 1 + (i * 7) % (sk_ring_record_max(&ring));
+		for (size_t j = 0; j < n; j++)
+			in[j] = (uint8_t)(i + j);
+
+		assert_true(sk_ring_enqueue(&ring, in, n));
+
+		len = sizeof(out);
+		assert_true(sk_ring_dequeue(&ring, out, &len));
+		assert_int_equal(len, n);
+		assert_memory_equal(in, out, n);
+	}
+
+	assert_int_equal(sk_ring_used(&ring), 0);
+	sk_ring_destroy(&ring);
+}
+
+static void
+ring_full()
+{
+	sk_ring_t ring;
+	sk_error_t error;
+	uint64_t value = 0, out;
+	size_t len, enqueued = 0;
+
+	assert_true(sk_ring_init(&ring, 8, &error));
+
+	while (sk_ring_enqueue(&ring, &value, sizeof(value)))
+		value = ++enqueued;
+	assert_int_equal(enqueued, 256 / 16);
+
+	/* Releasing a record frees space for a new one */
+	len = sizeof(out);
+	assert_true(sk_ring_dequeue(&ring, &out, &len));
+	assert_int_equal(out, 0);
+	assert_true(sk_ring_enqueue(&ring, &value, sizeof(value)));
+
+	for (size_t i = 1; i <= enqueued; i++) {
+		len = sizeof(out);
+		assert_true(sk_ring_dequeue(&ring, &out, &len));
+		assert_int_equal(out, i);
+	}
+
+	sk_ring_destroy(&ring);
+}
+
+static void
+ring_commit_order()
+{
+	sk_ring_t ring;
+	sk_error_t error;
+	size_t len;
+
+	assert_true(sk_ring_init(&ring, 8, &error));
+
+	char *first = sk_ring_reserve(&ring, 8);
+	char *second = sk_ring_reserve(&ring, 8);
+	assert_non_null(first);
+	assert_non_null(second);
+
+	/* The consumer can't skip over a record that is not committed */
+	strcpy(second, "second");
+	sk_ring_commit(&ring, second);
+	assert_null(sk_ring_peek(&ring, &len));
+
+	strcpy(first, "first");
+	sk_ring_commit(&ring, first);
+
+	char *record = sk_ring_peek(&ring, &len);
+	assert_ptr_equal(record, first);
+	assert_string_equal(record, "first");
+	sk_ring_release(&ring, record);
+
+	record = sk_ring_peek(&ring, &len);
+	assert_ptr_equal(record, second);
+	sk_ring_release(&ring, record);
+	assert_null(sk_ring_peek(&ring, &len));
+
+	sk_ring_destroy(&ring);
+}
+
+static void
+ring_commit_len()
+{
+	sk_ring_t ring;
+	sk_error_t error;
+	size_t len;
+
+	assert_true(sk_ring_init(&ring, 8, &error));
+
+	/* The last reservation gives its rest back */
+	char *first = sk_ring_reserve(&ring, 64);
+	assert_non_null(first);
+	strcpy(first, "first");
+	sk_ring_commit_len(&ring, first, 6);
+	assert_int_equal(sk_ring_used(&ring), 16);
+
+	/* Otherwise the rest is skipped */
+	char *second = sk_ring_reserve(&ring, 64);
+	char *third = sk_ring_reserve(&ring, 8);
+	assert_non_null(second);
+	assert_non_null(third);
+	strcpy(third, "third");
+	sk_ring_commit(&ring, third);
+	strcpy(second, "second");
+	sk_ring_commit_len(&ring, second, 7);
+	assert_int_equal(sk_ring_used(&ring), 16 + 72 + 16);
+
+	char *record = sk_ring_peek(&ring, &len);
+	assert_ptr_equal(record, first);
+	assert_int_equal(len, 6);
+	assert_non_null(record = sk_ring_peek_next(&ring, record, &len));
+	assert_int_equal(len, 7);
+	assert_string_equal(record, "second");
+	assert_non_null(record = sk_ring_peek_next(&ring, record, &len));
+	assert_string_equal(record, "third");
+	assert_null(sk_ring_peek_next(&ring, record, &len));
+
+	/* Released along with the records before it */
+	sk_ring_release(&ring, record);
+	assert_int_equal(sk_ring_used(&ring), 0);
+	assert_null(sk_ring_peek(&ring, &len));
+
+	/* Aborted records are skipped or handed back */
+	char *aborted = sk_ring_reserve(&ring, 64);
+	char *kept = sk_ring_reserve(&ring, 8);
+	assert_non_null(aborted);
+	assert_non_null(kept);
+	sk_ring_abort(&ring, aborted);
+	strcpy(kept, "kept");
+	sk_ring_commit(&ring, kept);
+	assert_non_null(aborted = sk_ring_reserve(&ring, 64));
+	sk_ring_abort(&ring, aborted);
+
+	assert_ptr_equal(record = sk_ring_peek(&ring, &len), kept);
+	sk_ring_release(&ring, record);
+	assert_null(sk_ring_peek(&ring, &len));
+	assert_int_equal(sk_ring_used(&ring), 0);
+
+	sk_ring_destroy(&ring);
+}
+
+static void
+ring_peek_next()
+{
+	sk_ring_t ring;
+	sk_error_t error;
+	uint64_t value = 0;
+	size_t len;
+
+	assert_true(sk_ring_init(&ring, 8, &error));
+
+	/* Walk batches of records of a full ring, wrapping around with padding */
+	for (uint64_t round = 0, expected = 0; round < 64; round++) {
+		for (;;) {
+			const size_t n = 8 + 8 * (value % 3);
+			uint64_t *dst = sk_ring_reserve(&ring, n);
+			if (dst == NULL)
+				break;
+			*dst = value++;
+			sk_ring_commit(&ring, dst);
+		}
+
+		uint64_t *record = sk_ring_peek(&ring, &len), *last = NULL;
+		const uint64_t batch = 1 + round % 5;
+		for (uint64_t i = 0; i < batch && record != NULL; i++) {
+			assert_int_equal(*record, expected++);
+			last = record;
+			record = sk_ring_peek_next(&ring, record, &len);
+		}
+		assert_non_null(last);
+		sk_ring_release(&ring, last);
+	}
+
+	sk_ring_destroy(&ring);
+}
+
+enum {
+	N_PRODUCERS = 4,
+	N_RECORDS = 20000,
+};
+
+struct producer_ctx {
+	sk_ring_t *ring;
+	uint32_t id;
+	atomic_bool *start;
+};
+
+struct producer_record {
+	uint32_t id;
+	uint32_t seq;
+	/* Variable length filler */
+	uint8_t filler[32];
+};
+
+static void *
+ring_producer(void *opaque)
+{
+	struct producer_ctx *ctx = opaque;
+	struct producer_record record = {.id = ctx->id};
+
+	while (!*ctx->start)
+		sched_yield();
+
+	for (uint32_t i = 0; i < N_RECORDS; i++) {
+		record.seq = i;
+		const size_t len = 8 + (i % sizeof(record.filler));
+
+		/* Odd producers reserve the largest record and shorten it */
+		if (ctx->id % 2 == 1) {
+			struct producer_record *dst;
+			while ((dst = sk_ring_reserve(ctx->ring, sizeof(record))) == NULL)
+				sched_yield();
+			memcpy(dst, &record, len);
+			sk_ring_commit_len(ctx->ring, dst, len);
+			continue;
+		}
+
+		while (!sk_ring_enqueue(ctx->ring, &record, len))
+			sched_yield();
+	}
+
+	return NULL;
+}
+
+static void
+ring_mpsc()
+{
+	sk_ring_t ring;
+	sk_error_t error;
+	pthread_t producers[N_PRODUCERS];
+	struct producer_ctx contexes[N_PRODUCERS];
+	uint32_t expected[N_PRODUCERS] = {0};
+	atomic_bool start = false;
+
+	assert_true(sk_ring_init(&ring, 12, &error));
+
+	for (uint32_t i = 0; i < N_PRODUCERS; i++) {
+		contexes[i] = (struct producer_ctx){&ring, i, &start};
+		pthread_create(&producers[i], NULL, ring_producer, &contexes[i]);
+	}
+
+	start = true;
+
+	/* Records of each producer are received in order */
+	for (size_t n = 0; n < N_PRODUCERS * N_RECORDS;) {
+		struct producer_record record;
+		size_t len = sizeof(record);
+		if (!sk_ring_dequeue(&ring, &record, &len)) {
+			sched_yield();
+			continue;
+		}
+
+		assert_in_range(record.id, 0, N_PRODUCERS - 1);
+		assert_int_equal(len, 8 + (record.seq % sizeof(record.filler)));
+		assert_int_equal(record.seq, expected[record.id]++);
+		n++;
+	}
+
+	for (size_t i = 0; i < N_PRODUCERS; i++)
+		pthread_join(producers[i], NULL);
+
+	assert_int_equal(sk_ring_used(&ring), 0);
+	sk_ring_destroy(&ring);
+}
+
+int
+main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(ring_basic), cmocka_unit_test(ring_wrap),
+		cmocka_unit_test(ring_full), cmocka_unit_test(ring_commit_order),
+		cmocka_unit_test(ring_commit_len), cmocka_unit_test(ring_peek_next),
+		cmocka_unit_test(ring_mpsc),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -8,3 +8,55 @@
 #include <string.h>
 
 #include <cmocka.h>
+
+#include <limits.h>
+#include <unistd.h>
+
+#include <sk_log.h>
+#include <sk_logger_drv.h>
+
+/*
+ * Temporary directory of a group of tests, removed with its content, e.g.
+ *
+ *   cmocka_run_group_tests(tests, test_dir_setup, test_dir_teardown);
+ */
+static char test_dir[] = "/tmp/sk_test.XXXXXX";
+
+static inline int
+test_dir_setup(void **state)
+{
+	(void)state;
+	return (mkdtemp(test_dir) != NULL) ? 0 : -1;
+}
+
+static inline int
+test_dir_teardown(void **state)
+{
+	(void)state;
+	char cmd[sizeof(test_dir) + 16];
+
+	snprintf(cmd, sizeof(cmd), "rm -rf %s", test_dir);
+	return system(cmd);
+}
+
+/* Path of `name` in the temporary directory */
+static inline void
+test_path(char *path, size_t size, const char *name)
+{
+	snprintf(path, size, "%s/%s", test_dir, name);
+}
+
+/* Logger `app.db` at SK_LOG_DEBUG, whose driver is built from `ctx` */
+static inline sk_logger_t *
+test_logger(sk_logger_drv_builder_fn_t builder, void *ctx)
+{
+	sk_logger_drv_t driver;
+	sk_error_t error;
+	sk_logger_t *logger;
+
+	assert_true(builder(&driver, ctx, &error));
+	assert_non_null(logger = sk_logger_create("app.db", 12, &driver, &error));
+	assert_true(sk_logger_set_level(logger, SK_LOG_DEBUG));
+
+	return logger;
+}
@@ -0,0 +1,46 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sk_log_flight.h>
+
+static void
+usage(const char *program)
+{
+	fprintf(stderr, "usage: %s FILE\n", program);
+	fprintf(stderr, "Print the messages of a flight recorder, oldest first.\n");
+}
+
+int
+main(int argc, char **argv)
+{
+	sk_log_flight_reader_t reader;
+	sk_log_flight_record_t record;
+	sk_error_t error;
+
+	if (argc != 2) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (!sk_log_flight_open(&reader, argv[1], &error)) {
+		fprintf(stderr, "%s: %s: %s\n", argv[0], argv[1], error.message);
+		return EXIT_FAILURE;
+	}
+
+	printf("# logger %s, pid %d, %u slots, %llu messages written\n",
+		reader.hdr->name, reader.hdr->pid, reader.hdr->slot_count,
+		(unsigned long long)reader.head);
+
+	while (sk_log_flight_next(&reader, &record)) {
+		const char *level = sk_log_level_str(record.level);
+
+		printf("%f %d/%d(%s) {file: %s, func: %s, line: %d} [%s]: %s\n",
+			record.ts_nsec / 1000000000.0, record.pid, record.tid, record.thread,
+			record.file, record.function, record.line,
+			(level != NULL) ? level : "unknown", record.payload);
+	}
+
+	sk_log_flight_close(&reader);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,178 @@
+#include <fnmatch.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include <sk_log_bin.h>
+
+static void
+usage(const char *program)
+{
+	fprintf(stderr,
+		"usage: %s [-f FROM] [-t TO] [-l LEVEL] [-n LOGGER] FILE...\n",
+		program);
+	fprintf(stderr, "Print the messages of binary log files.\n\n");
+	fprintf(stderr, "  -f FROM    skip messages older than FROM\n");
+	fprintf(stderr, "  -t TO      skip messages newer than TO\n");
+	fprintf(stderr, "  -l LEVEL   skip messages less severe than LEVEL\n");
+	fprintf(stderr, "  -n LOGGER  only read files of loggers matching LOGGER\n");
+	fprintf(stderr, "\nTimes are seconds since the epoch or "
+					"YYYY-MM-DDTHH:MM:SS in UTC.\n");
+}
+
+/* Parse a time in nanoseconds since the epoch */
+static bool
+parse_time(const char *arg, uint64_t *nsec)
+{
+	struct tm tm = {0};
+	char *end;
+
+	const char *rest = strptime(arg, "%Y-%m-%dT%H:%M:%S", &tm);
+	if (rest != NULL && *rest == '\0') {
+		*nsec = (uint64_t)timegm(&tm) * 1000000000;
+		return true;
+	}
+
+	const double sec = strtod(arg, &end);
+	if (end == arg || *end != '\0' || sec < 0)
+		return false;
+	*nsec = (uint64_t)(sec * 1000000000.0);
+
+	return true;
+}
+
+/* Bitmap of the levels at least as severe as `arg` */
+static bool
+parse_level(const char *arg, uint32_t *levels)
+{
+	for (int level = 0; level < SK_LOG_COUNT; level++) {
+		if (strcasecmp(arg, sk_log_level_str(level)) == 0) {
+			*levels = (1u << (level + 1)) - 1;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void
+print_fields(const sk_log_msg_t *msg)
+{
+	sk_kv_t kvs[SK_LOG_KV_MAX];
+	const size_t n = sk_log_msg_kv(msg, kvs, SK_LOG_KV_MAX);
+
+	for (size_t i = 0; i < n; i++) {
+		const sk_kv_t *kv = &kvs[i];
+
+		switch (kv->type) {
+		case SK_KV_TYPE_INT:
+			printf(" %s=%" PRId64, kv->key, kv->i);
+			break;
+		case SK_KV_TYPE_UINT:
+			printf(" %s=%" PRIu64, kv->key, kv->u);
+			break;
+		case SK_KV_TYPE_DOUBLE:
+			printf(" %s=%g", kv->key, kv->d);
+			break;
+		case SK_KV_TYPE_BOOL:
+			printf(" %s=%s", kv->key, kv->b ? "true" : "false");
+			break;
+		case SK_KV_TYPE_STR:
+			printf(" %s=\"%s\"", kv->key, kv->s);
+			break;
+		}
+	}
+}
+
+static bool
+print_file(const char *program, const char *path,
+	const sk_log_bin_query_t *query, const char *logger)
+{
+	sk_log_bin_reader_t reader;
+	sk_log_bin_entry_t entry;
+	sk_error_t error;
+
+	if (!sk_log_bin_open(&reader, path, &error)) {
+		fprintf(stderr, "%s: %s: %s\n", program, path, error.message);
+		return false;
+	}
+
+	if (logger != NULL && fnmatch(logger, reader.hdr->name, 0) != 0) {
+		sk_log_bin_close(&reader);
+		return true;
+	}
+
+	sk_log_bin_seek(&reader, query);
+	while (sk_log_bin_next(&reader, &entry)) {
+		const sk_log_msg_t *msg = &entry.msg;
+		const char *level = sk_log_level_str(msg->level);
+
+		printf("%f %s %d/%d", msg->ts_nsec / 1000000000.0, reader.hdr->name,
+			msg->pid, msg->tid);
+		if (msg->thread != NULL)
+			printf("(%s)", msg->thread);
+		printf(" {file: %s, func: %s, line: %d} [%s]: %s", msg->debug.file,
+			msg->debug.function, msg->debug.line,
+			(level != NULL) ? level : "unknown", msg->payload);
+		print_fields(msg);
+		putchar('\n');
+	}
+
+	sk_log_bin_close(&reader);
+
+	return true;
+}
+
+int
+main(int argc, char **argv)
+{
+	sk_log_bin_query_t query = {0};
+	const char *logger = NULL;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "f:t:l:n:h")) != -1) {
+		switch (opt) {
+		case 'f':
+			if (!parse_time(optarg, &query.from_nsec)) {
+				fprintf(stderr, "%s: invalid time %s\n", argv[0], optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 't':
+			if (!parse_time(optarg, &query.to_nsec)) {
+				fprintf(stderr, "%s: invalid time %s\n", argv[0], optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'l':
+			if (!parse_level(optarg, &query.levels)) {
+				fprintf(stderr, "%s: invalid level %s\n", argv[0], optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'n':
+			logger = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return (opt == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	if (optind == argc) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	int status = EXIT_SUCCESS;
+	for (int i = optind; i < argc; i++) {
+		if (!print_file(argv[0], argv[i], &query, logger))
+			status = EXIT_FAILURE;
+	}
+
+	return status;
+}